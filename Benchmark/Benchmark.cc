@@ -0,0 +1,68 @@
+#include "Benchmark.h"
+#include <iostream>
+#include <iomanip>
+
+BenchmarkBase::BenchmarkBase()
+{
+    BenchmarkManager::Instance().AddBenchmark(this);
+}
+
+void BenchmarkBase::Report(const std::string& label, std::size_t ops, int64_t usedUs) const
+{
+    double opsPerSec = usedUs > 0 ? ops * 1000000.0 / usedUs : 0;
+
+    std::cout << "  " << std::left << std::setw(40) << label
+              << std::right << std::setw(10) << ops << " ops "
+              << std::setw(10) << usedUs << " us "
+              << std::setw(14) << std::fixed << std::setprecision(0) << opsPerSec << " ops/s"
+              << std::endl;
+}
+
+void BenchmarkBase::Report(const std::string& label, const std::string& value) const
+{
+    std::cout << "  " << std::left << std::setw(40) << label
+              << std::right << std::setw(24) << value
+              << std::endl;
+}
+
+BenchmarkManager& BenchmarkManager::Instance()
+{
+    static BenchmarkManager  mgr;
+    return mgr;
+}
+
+void BenchmarkManager::AddBenchmark(BenchmarkBase* bench)
+{
+    benches_.push_back(bench);
+}
+
+void BenchmarkManager::Run(const std::vector<std::string>& filters)
+{
+    for (const auto& bench : benches_)
+    {
+        bool match = filters.empty();
+        for (const auto& f : filters)
+        {
+            if (bench->GetName().find(f) != std::string::npos)
+            {
+                match = true;
+                break;
+            }
+        }
+
+        if (!match)
+            continue;
+
+        std::cout << "[" << bench->GetName() << "]" << std::endl;
+        bench->Run();
+    }
+}
+
+// Usage: ./qbenchmark [name filter ...]
+int main(int ac, char* av[])
+{
+    std::vector<std::string> filters(av + 1, av + ac);
+    BenchmarkManager::Instance().Run(filters);
+    return 0;
+}
+
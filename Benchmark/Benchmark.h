@@ -0,0 +1,85 @@
+#ifndef BERT_BENCHMARK_H
+#define BERT_BENCHMARK_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+class BenchmarkBase
+{
+public:
+    BenchmarkBase();
+    virtual ~BenchmarkBase() {}
+
+    const std::string& GetName() const { return name_; }
+
+    virtual void Run() = 0;
+
+protected:
+    // print one line of result: label, ops, elapsed and ops per second
+    void Report(const std::string& label, std::size_t ops, int64_t usedUs) const;
+    // print a free-form measurement, such as bytes per key
+    void Report(const std::string& label, const std::string& value) const;
+
+    std::string name_;
+
+private:
+    BenchmarkBase(const BenchmarkBase& ) = delete;
+    BenchmarkBase& operator= (const BenchmarkBase& ) = delete;
+};
+
+
+// wall clock stop watch, in microseconds
+class BenchmarkTimer
+{
+public:
+    BenchmarkTimer() : start_(std::chrono::steady_clock::now()) { }
+
+    void    Reset() { start_ = std::chrono::steady_clock::now(); }
+    int64_t ElapsedUs() const
+    {
+        auto now = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// prevent the compiler from optimizing away the benchmarked result
+template <typename T>
+inline void DoNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+
+#define   BENCHMARK_CASE(name)                          \
+    class BenchmarkBase##name: public BenchmarkBase     \
+    {                                                   \
+    public:                                             \
+        BenchmarkBase##name() {                         \
+            name_ = #name;                              \
+        }                                               \
+        virtual void Run();                             \
+    } bench_##name##_obj;                               \
+    void    BenchmarkBase##name::Run()
+
+
+class BenchmarkManager
+{
+public:
+    static  BenchmarkManager&    Instance();
+
+    void    AddBenchmark(BenchmarkBase* bench);
+    // run benchmarks whose name contains one of filters, all if filters is empty
+    void    Run(const std::vector<std::string>& filters);
+private:
+    BenchmarkManager() {}
+
+    std::vector<BenchmarkBase* > benches_;
+};
+
+#endif
+
@@ -0,0 +1,74 @@
+#include "Benchmark.h"
+#include "QStore.h"
+#include <malloc.h>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace qedis;
+
+namespace
+{
+
+const int kKeys = 4000000;
+
+std::size_t HeapInUse()
+{
+    // big tables are mmapped
+    auto info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+// big slot tables of QDict are mmapped by itself
+std::size_t SlotsMemory(const QDB& db)
+{
+    return db.SlotsMemory();
+}
+
+template <typename DB>
+std::size_t SlotsMemory(const DB& )
+{
+    return 0;
+}
+
+// insert kKeys like a growing db, return bytes per key, speed and the slowest insert
+template <typename DB>
+std::string Grow(const std::vector<QString>& keys)
+{
+    // or the free chunks of last run are consolidated in some insert
+    malloc_trim(0);
+    const std::size_t before = HeapInUse();
+
+    DB db;
+    int64_t maxUs = 0;
+    BenchmarkTimer total;
+    for (const auto& key : keys)
+    {
+        BenchmarkTimer timer;
+        db.insert(typename DB::value_type(key, QObject(QType_string)));
+        maxUs = std::max(maxUs, timer.ElapsedUs());
+    }
+    const int64_t totalUs = total.ElapsedUs();
+
+    // keys are short, no heap for them
+    const std::size_t bytes = HeapInUse() - before + SlotsMemory(db);
+
+    char buf[128];
+    snprintf(buf, sizeof buf, "%.1f bytes/key, %.2fM inserts/s, max insert %ld us",
+             double(bytes) / keys.size(), keys.size() / double(totalUs), long(maxUs));
+    return buf;
+}
+
+}
+
+BENCHMARK_CASE(dict_growth)
+{
+    std::vector<QString> keys;
+    keys.reserve(kKeys);
+    for (int i = 0; i < kKeys; ++ i)
+        keys.push_back("key:" + std::to_string(i));
+
+    using StdDB = std::unordered_map<QString, QObject, my_hash>;
+
+    Report("unordered_map", Grow<StdDB>(keys));
+    Report("QDict", Grow<QDB>(keys));
+}
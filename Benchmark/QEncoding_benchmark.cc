@@ -0,0 +1,120 @@
+#include "Benchmark.h"
+#include "QStore.h"
+#include "QConfig.h"
+#include <malloc.h>
+#include <functional>
+
+using namespace qedis;
+
+namespace
+{
+
+const int kKeys = 100000;
+
+std::size_t HeapInUse()
+{
+    return mallinfo2().uordblks;
+}
+
+// build kKeys objects by fill, return the heap bytes used per object
+std::size_t BytesPerKey(const std::function<QObject ()>& create,
+                        const std::function<void (QObject& , int )>& fill)
+{
+    std::vector<QObject> objs;
+    objs.reserve(kKeys);
+
+    const std::size_t before = HeapInUse();
+    for (int i = 0; i < kKeys; ++ i)
+    {
+        objs.push_back(create());
+        fill(objs.back(), i);
+    }
+
+    return (HeapInUse() - before) / kKeys;
+}
+
+// compare the compact encoding against the full one
+std::string Compare(const std::function<QObject ()>& create,
+                    const std::function<void (QObject& , int )>& fill,
+                    int& threshold)
+{
+    const std::size_t compact = BytesPerKey(create, fill);
+
+    // threshold 0 forces the full encoding
+    const int saved = threshold;
+    threshold = 0;
+    const std::size_t full = BytesPerKey(create, fill);
+    threshold = saved;
+
+    char buf[128];
+    snprintf(buf, sizeof buf, "compact %zu bytes/key, full %zu bytes/key, saved %.1f%%",
+             compact, full, full ? 100.0 * (full - compact) / full : 0.0);
+    return buf;
+}
+
+}
+
+BENCHMARK_CASE(encoding_memory)
+{
+    Report("hash 3 fields", Compare(QObject::CreateHash,
+            [](QObject& obj, int i) {
+                HashSet(obj, "name", "user" + std::to_string(i));
+                HashSet(obj, "age", std::to_string(i % 100));
+                HashSet(obj, "city", "shanghai");
+            },
+            g_config.hashMaxZiplistEntries));
+
+    Report("set 5 members", Compare(QObject::CreateSet,
+            [](QObject& obj, int i) {
+                for (int j = 0; j < 5; ++ j)
+                    SetAdd(obj, "member:" + std::to_string(i + j));
+            },
+            g_config.setMaxZiplistEntries));
+
+    Report("intset 10 members", Compare(QObject::CreateSet,
+            [](QObject& obj, int i) {
+                for (int j = 0; j < 10; ++ j)
+                    SetAdd(obj, std::to_string(i + j));
+            },
+            g_config.setMaxIntsetEntries));
+
+    Report("list 10 elements", Compare(QObject::CreateList,
+            [](QObject& obj, int i) {
+                for (int j = 0; j < 10; ++ j)
+                    ListPush(obj, "elem" + std::to_string(j), ListPosition::tail);
+            },
+            g_config.listMaxZiplistEntries));
+
+    Report("zset 5 members", Compare(QObject::CreateSSet,
+            [](QObject& obj, int i) {
+                for (int j = 0; j < 5; ++ j)
+                    SSetAdd(obj, "player" + std::to_string(j), i + j * 0.5);
+            },
+            g_config.zsetMaxZiplistEntries));
+
+    Report("string 60 bytes", Compare([]() { return QObject::CreateString(QString(60, 'v')); },
+            [](QObject& , int ) { },
+            g_config.stringMaxEmbeddedValue));
+}
+
+BENCHMARK_CASE(encoding_hash_ops)
+{
+    for (int entries : {4, 32, 128})
+    {
+        QObject obj(QObject::CreateHash());
+        for (int i = 0; i < entries; ++ i)
+            HashSet(obj, "field" + std::to_string(i), std::to_string(i));
+
+        const int kOps = 1000000;
+        QString value;
+        BenchmarkTimer timer;
+        for (int i = 0; i < kOps; ++ i)
+        {
+            HashGet(obj, "field" + std::to_string(i % entries), &value);
+            DoNotOptimize(value);
+        }
+
+        Report("ziplist hget, " + std::to_string(entries) + " fields", kOps, timer.ElapsedUs());
+    }
+}
+
@@ -0,0 +1,89 @@
+#include "Benchmark.h"
+#include "QCommon.h"
+#include "QProtoParser.h"
+
+using namespace qedis;
+
+namespace
+{
+
+const int kRequests = 100000;
+
+// pipelined "mset key:i:j value...j" with 10 pairs, values longer than SSO
+QString MakePipeline(int requests)
+{
+    QString buf;
+    for (int i = 0; i < requests; ++ i)
+    {
+        buf += "*21\r\n$4\r\nmset\r\n";
+        for (int j = 0; j < 10; ++ j)
+        {
+            QString key = "key:" + std::to_string(i) + ":" + std::to_string(j);
+            QString val(32, 'a' + j);
+
+            buf += "$" + std::to_string(key.size()) + "\r\n" + key + "\r\n";
+            buf += "$" + std::to_string(val.size()) + "\r\n" + val + "\r\n";
+        }
+    }
+
+    return buf;
+}
+
+}
+
+BENCHMARK_CASE(protoparser_mset)
+{
+    const QString buf = MakePipeline(kRequests);
+    const char* const end = buf.data() + buf.size();
+
+    {
+        QProtoParser parser;
+        BenchmarkTimer timer;
+        const char* ptr = buf.data();
+        while (ptr < end)
+        {
+            if (parser.ParseRequest(ptr, end) != QParseResult::ok)
+                break;
+
+            DoNotOptimize(parser.GetParams().size());
+            parser.Reset();
+        }
+
+        Report("copy parse, mset 10 pairs", kRequests, timer.ElapsedUs());
+    }
+
+    {
+        QProtoParser parser;
+        BenchmarkTimer timer;
+        const char* ptr = buf.data();
+        while (ptr < end)
+        {
+            if (parser.ParseRequestView(ptr, end) != QParseResult::ok)
+                break;
+
+            DoNotOptimize(parser.GetParamViews().size());
+            parser.Reset();
+        }
+
+        Report("view parse, mset 10 pairs", kRequests, timer.ElapsedUs());
+    }
+
+    {
+        QProtoParser parser;
+        BenchmarkTimer timer;
+        const char* ptr = buf.data();
+        while (ptr < end)
+        {
+            if (parser.ParseRequestView(ptr, end) != QParseResult::ok)
+                break;
+
+            // what QClient does for the command handlers
+            parser.MaterializeParams();
+            DoNotOptimize(parser.GetParams().size());
+            parser.Reset();
+        }
+
+        Report("view parse + materialize, mset 10 pairs", kRequests, timer.ElapsedUs());
+    }
+}
+
@@ -0,0 +1,125 @@
+#include "Benchmark.h"
+#include "QQuickList.h"
+#include <list>
+#include <functional>
+#include <malloc.h>
+
+using namespace qedis;
+
+namespace
+{
+
+const int kElems = 100000;
+
+std::size_t HeapInUse()
+{
+    return mallinfo2().uordblks;
+}
+
+// a queue of job ids, like "job:12345"
+QString Elem(int i)
+{
+    return "job:" + std::to_string(i);
+}
+
+}
+
+BENCHMARK_CASE(quicklist_memory)
+{
+    {
+        const std::size_t before = HeapInUse();
+        std::list<QString> l;
+        for (int i = 0; i < kElems; ++ i)
+            l.push_back(Elem(i));
+
+        Report("std::list 100k elems", std::to_string((HeapInUse() - before) / 1024) + " KB");
+    }
+
+    for (int depth : {0, 1})
+    {
+        const std::size_t before = HeapInUse();
+        QQuickList ql(-2, depth);
+        for (int i = 0; i < kElems; ++ i)
+            ql.PushTail(Elem(i));
+
+        Report("quicklist 100k elems, compress depth " + std::to_string(depth),
+               std::to_string((HeapInUse() - before) / 1024) + " KB, " +
+               std::to_string(ql.NodeCount()) + " nodes");
+    }
+}
+
+BENCHMARK_CASE(quicklist_access)
+{
+    std::list<QString> l;
+    QQuickList ql(-2, 0);
+    for (int i = 0; i < kElems; ++ i)
+    {
+        l.push_back(Elem(i));
+        ql.PushTail(Elem(i));
+    }
+
+    const int kIndexOps = 2000;
+    {
+        BenchmarkTimer timer;
+        for (int i = 0; i < kIndexOps; ++ i)
+        {
+            // same as _Index2Iterator of the old list
+            long index = (i * 7919) % kElems;
+            auto it = l.begin();
+            if (2 * index < kElems)
+                std::advance(it, index);
+            else
+                it = std::prev(l.end(), kElems - index);
+
+            DoNotOptimize(*it);
+        }
+
+        Report("std::list lindex", kIndexOps, timer.ElapsedUs());
+    }
+
+    {
+        BenchmarkTimer timer;
+        for (int i = 0; i < kIndexOps; ++ i)
+        {
+            QString elem = ql.Index((i * 7919) % kElems);
+            DoNotOptimize(elem);
+        }
+
+        Report("quicklist lindex", kIndexOps, timer.ElapsedUs());
+    }
+
+    const int kRangeOps = 20;
+    {
+        BenchmarkTimer timer;
+        for (int i = 0; i < kRangeOps; ++ i)
+        {
+            // the old ListRange called back for every element as well
+            std::size_t bytes = 0;
+            std::function<void (const QString& )> func = [&bytes](const QString& e) {
+                bytes += e.size();
+            };
+            for (const auto& e : l)
+                func(e);
+
+            DoNotOptimize(bytes);
+        }
+
+        Report("std::list lrange 0 -1", kRangeOps * kElems, timer.ElapsedUs());
+    }
+
+    {
+        BenchmarkTimer timer;
+        for (int i = 0; i < kRangeOps; ++ i)
+        {
+            std::size_t bytes = 0;
+            ql.Range(0, kElems - 1, [&bytes](const QString& e) {
+                bytes += e.size();
+            });
+
+            DoNotOptimize(bytes);
+        }
+
+        Report("quicklist lrange 0 -1", kRangeOps * kElems, timer.ElapsedUs());
+    }
+}
+
@@ -0,0 +1,332 @@
+#include "Benchmark.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+// Requests to a running server, like redis-benchmark -P.
+// The server is QEDIS_BENCH_ADDR, 127.0.0.1:6379 by default; the case is
+// skipped if it's not there.
+
+namespace
+{
+
+const int kClients = 50;
+const int kRequests = 200000;
+
+// latency: enough samples for p99.9
+const int kLatencyRequests = 20000;
+
+// big values: fewer clients, the same bytes of every size
+const int kBigClients = 8;
+const std::size_t kBigBytes = 1024 * 1024 * 1024;
+
+bool GetServerAddr(sockaddr_in& addr)
+{
+    std::string ipport = "127.0.0.1:6379";
+    if (const char* env = ::getenv("QEDIS_BENCH_ADDR"))
+        ipport = env;
+
+    auto p = ipport.find(':');
+    if (p == std::string::npos)
+        return false;
+
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(std::stoi(ipport.substr(p + 1))));
+    return ::inet_pton(AF_INET, ipport.substr(0, p).c_str(), &addr.sin_addr) == 1;
+}
+
+int Connect(const sockaddr_in& addr)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    int nodelay = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof nodelay);
+    return fd;
+}
+
+std::string Request(const std::vector<std::string>& args)
+{
+    std::string req = "*" + std::to_string(args.size()) + "\r\n";
+    for (const auto& arg : args)
+        req += "$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+
+    return req;
+}
+
+// skip one reply of status, error, integer or bulk; false if not complete
+bool SkipReply(const char*& ptr, const char* end)
+{
+    const char* crlf = static_cast<const char*>(memchr(ptr, '\n', end - ptr));
+    if (!crlf)
+        return false;
+
+    if (*ptr == '$')
+    {
+        const long len = strtol(ptr + 1, nullptr, 10);
+        if (len >= 0)
+        {
+            if (end - (crlf + 1) < len + 2)
+                return false;
+
+            crlf += len + 2;
+        }
+    }
+
+    ptr = crlf + 1;
+    return true;
+}
+
+// each client sends pipeline requests, then reads the replies.
+// The nanoseconds of every round are appended to latencies if not null
+bool RunClient(const sockaddr_in& addr, const std::string& req, int pipeline, int rounds,
+               std::vector<int64_t>* latencies = nullptr)
+{
+    int fd = Connect(addr);
+    if (fd < 0)
+        return false;
+
+    std::string batch;
+    for (int i = 0; i < pipeline; ++ i)
+        batch += req;
+
+    std::vector<char> buf(1024 * 1024);
+    bool ok = true;
+    for (int r = 0; r < rounds && ok; ++ r)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if (::send(fd, batch.data(), batch.size(), 0) != static_cast<ssize_t>(batch.size()))
+        {
+            ok = false;
+            break;
+        }
+
+        int replies = 0;
+        std::size_t len = 0;
+        while (replies < pipeline)
+        {
+            if (len == buf.size())
+                buf.resize(buf.size() * 2);
+
+            ssize_t n = ::recv(fd, &buf[len], buf.size() - len, 0);
+            if (n <= 0)
+            {
+                ok = false;
+                break;
+            }
+
+            len += n;
+
+            const char* ptr = &buf[0];
+            const char* end = ptr + len;
+            while (replies < pipeline && ptr < end && SkipReply(ptr, end))
+                ++ replies;
+
+            len = end - ptr;
+            memmove(&buf[0], ptr, len);
+        }
+
+        if (latencies)
+            latencies->push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - start).count());
+    }
+
+    ::close(fd);
+    return ok;
+}
+
+// like "p50 21.3us p99 35.0us p99.9 60.2us max 1200.5us"
+std::string Percentiles(std::vector<int64_t>& ns)
+{
+    if (ns.empty())
+        return "no data";
+
+    std::sort(ns.begin(), ns.end());
+
+    std::string result;
+    char buf[64];
+    for (double p : {50.0, 99.0, 99.9, 100.0})
+    {
+        const std::size_t i = std::min(ns.size() - 1, static_cast<std::size_t>(ns.size() * p / 100));
+        if (p < 100)
+            snprintf(buf, sizeof buf, "p%g %.1fus ", p, ns[i] / 1000.0);
+        else
+            snprintf(buf, sizeof buf, "max %.1fus", ns[i] / 1000.0);
+        result += buf;
+    }
+
+    return result;
+}
+
+bool ServerReady(sockaddr_in& addr)
+{
+    int fd = GetServerAddr(addr) ? Connect(addr) : -1;
+    if (fd < 0)
+        return false;
+
+    ::close(fd);
+    return true;
+}
+
+}
+
+BENCHMARK_CASE(server_pipeline)
+{
+    sockaddr_in addr;
+    if (!ServerReady(addr))
+    {
+        Report("no server, set QEDIS_BENCH_ADDR", "skipped");
+        return;
+    }
+
+    const std::string value(16, 'v');
+    const std::vector<std::pair<std::string, std::string> > requests {
+        {"ping",  Request({"ping"})},
+        {"set",   Request({"set", "bench:key", value})},
+        {"get",   Request({"get", "bench:key"})},
+    };
+
+    for (int pipeline : {1, 16, 64})
+    {
+        for (const auto& req : requests)
+        {
+            const int rounds = kRequests / kClients / pipeline;
+            std::atomic<bool> ok(true);
+
+            BenchmarkTimer timer;
+            std::vector<std::thread> clients;
+            for (int i = 0; i < kClients; ++ i)
+            {
+                clients.emplace_back([&]() {
+                    if (!RunClient(addr, req.second, pipeline, rounds))
+                        ok = false;
+                });
+            }
+
+            for (auto& t : clients)
+                t.join();
+
+            const auto used = timer.ElapsedUs();
+            const std::string label = req.first + ", " + std::to_string(kClients) +
+                                      " clients, pipeline " + std::to_string(pipeline);
+            if (ok)
+                Report(label, static_cast<std::size_t>(rounds) * pipeline * kClients, used);
+            else
+                Report(label, "failed");
+        }
+    }
+}
+
+BENCHMARK_CASE(server_get_big)
+{
+    sockaddr_in addr;
+    if (!ServerReady(addr))
+    {
+        Report("no server, set QEDIS_BENCH_ADDR", "skipped");
+        return;
+    }
+
+    for (std::size_t size : {16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024})
+    {
+        const std::string key = "bench:big:" + std::to_string(size);
+        const std::string label = "get " + std::to_string(size / 1024) + "KB, " +
+                                  std::to_string(kBigClients) + " clients";
+        if (!RunClient(addr, Request({"set", key, std::string(size, 'v')}), 1, 1))
+        {
+            Report(label, "failed");
+            continue;
+        }
+
+        const int rounds = std::max<int>(4, kBigBytes / size / kBigClients);
+        const std::string req = Request({"get", key});
+        std::atomic<bool> ok(true);
+
+        BenchmarkTimer timer;
+        std::vector<std::thread> clients;
+        for (int i = 0; i < kBigClients; ++ i)
+        {
+            clients.emplace_back([&]() {
+                if (!RunClient(addr, req, 1, rounds))
+                    ok = false;
+            });
+        }
+
+        for (auto& t : clients)
+            t.join();
+
+        const auto used = timer.ElapsedUs();
+        if (ok)
+            Report(label, static_cast<std::size_t>(rounds) * kBigClients, used);
+        else
+            Report(label, "failed");
+
+        RunClient(addr, Request({"del", key}), 1, 1);
+    }
+}
+
+// Round trip of every request without pipeline, the tail is what busy-poll-us
+// and the cpu binding are for.
+BENCHMARK_CASE(server_latency)
+{
+    sockaddr_in addr;
+    if (!ServerReady(addr))
+    {
+        Report("no server, set QEDIS_BENCH_ADDR", "skipped");
+        return;
+    }
+
+    RunClient(addr, Request({"set", "bench:key", std::string(16, 'v')}), 1, 1);
+
+    const std::vector<std::pair<std::string, std::string> > requests {
+        {"ping",  Request({"ping"})},
+        {"get",   Request({"get", "bench:key"})},
+    };
+
+    for (int nClients : {1, 10})
+    {
+        for (const auto& req : requests)
+        {
+            const int rounds = kLatencyRequests / nClients;
+            std::atomic<bool> ok(true);
+
+            std::vector<std::vector<int64_t> > latencies(nClients);
+            std::vector<std::thread> clients;
+            for (int i = 0; i < nClients; ++ i)
+            {
+                latencies[i].reserve(rounds);
+                clients.emplace_back([&, i]() {
+                    if (!RunClient(addr, req.second, 1, rounds, &latencies[i]))
+                        ok = false;
+                });
+            }
+
+            for (auto& t : clients)
+                t.join();
+
+            std::vector<int64_t> all;
+            for (const auto& l : latencies)
+                all.insert(all.end(), l.begin(), l.end());
+
+            const std::string label = req.first + ", " + std::to_string(nClients) +
+                                      (nClients == 1 ? " client" : " clients");
+            Report(label, ok ? Percentiles(all) : "failed");
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#include "Benchmark.h"
+#include "QSortedSet.h"
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <random>
+#include <iterator>
+
+using namespace qedis;
+
+namespace
+{
+
+// The layout QSortedSet used before the skiplist: rank is found by linear walk.
+class LegacySortedSet
+{
+public:
+    void AddMember(const QString& member, double score)
+    {
+        members_[member] = score;
+        scores_[score].insert(member);
+    }
+
+    long Rank(const QString& member) const
+    {
+        auto it = members_.find(member);
+        if (it == members_.end())
+            return -1;
+
+        long rank = 0;
+        for (const auto& kv : scores_)
+        {
+            if (kv.first == it->second)
+                return rank + std::distance(kv.second.begin(), kv.second.find(member));
+
+            rank += kv.second.size();
+        }
+
+        return -1;
+    }
+
+    std::size_t RangeByRank(long start, long end) const
+    {
+        std::size_t cnt = 0;
+        long idx = 0;
+        for (const auto& kv : scores_)
+        {
+            for (const auto& m : kv.second)
+            {
+                if (idx > end)
+                    return cnt;
+                if (idx >= start)
+                {
+                    DoNotOptimize(m);
+                    ++ cnt;
+                }
+                ++ idx;
+            }
+        }
+
+        return cnt;
+    }
+
+private:
+    std::unordered_map<QString, double> members_;
+    std::map<double, std::set<QString> > scores_;
+};
+
+const int kMembers = 100000;
+const int kQueries = 2000;
+
+}
+
+BENCHMARK_CASE(sortedset_rank)
+{
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> dist(0, kMembers - 1);
+
+    LegacySortedSet legacy;
+    QSortedSet sset;
+    for (int i = 0; i < kMembers; ++ i)
+    {
+        QString member("member:" + std::to_string(i));
+        legacy.AddMember(member, i % 1000);
+        sset.AddMember(member, i % 1000);
+    }
+
+    std::vector<QString> keys;
+    for (int i = 0; i < kQueries; ++ i)
+        keys.push_back("member:" + std::to_string(dist(gen)));
+
+    BenchmarkTimer timer;
+    for (const auto& k : keys)
+        DoNotOptimize(legacy.Rank(k));
+    Report("legacy map<score, set> ZRANK", keys.size(), timer.ElapsedUs());
+
+    timer.Reset();
+    for (const auto& k : keys)
+        DoNotOptimize(sset.Rank(k));
+    Report("skiplist ZRANK", keys.size(), timer.ElapsedUs());
+}
+
+BENCHMARK_CASE(sortedset_range_by_rank)
+{
+    LegacySortedSet legacy;
+    QSortedSet sset;
+    for (int i = 0; i < kMembers; ++ i)
+    {
+        QString member("member:" + std::to_string(i));
+        legacy.AddMember(member, i);
+        sset.AddMember(member, i);
+    }
+
+    // ZRANGE key start start+10, start spread over the whole set
+    BenchmarkTimer timer;
+    for (int i = 0; i < kQueries; ++ i)
+    {
+        long start = static_cast<long>(i) * (kMembers / kQueries);
+        DoNotOptimize(legacy.RangeByRank(start, start + 10));
+    }
+    Report("legacy map<score, set> ZRANGE", kQueries, timer.ElapsedUs());
+
+    timer.Reset();
+    for (int i = 0; i < kQueries; ++ i)
+    {
+        long start = static_cast<long>(i) * (kMembers / kQueries);
+        DoNotOptimize(sset.RangeByRank(start, start + 10).size());
+    }
+    Report("skiplist ZRANGE", kQueries, timer.ElapsedUs());
+}
+
+BENCHMARK_CASE(sortedset_remrangebyrank)
+{
+    QSortedSet sset;
+    for (int i = 0; i < kMembers; ++ i)
+        sset.AddMember("member:" + std::to_string(i), i);
+
+    BenchmarkTimer timer;
+    std::size_t removed = 0;
+    while (sset.Size() > 0)
+        removed += sset.DelRangeByRank(0, 99);
+    Report("skiplist ZREMRANGEBYRANK 0 99", removed / 100, timer.ElapsedUs());
+}
+
@@ -0,0 +1,183 @@
+#include "Benchmark.h"
+#include "QStore.h"
+#include "QCommand.h"
+#include "QConfig.h"
+#include "QMemory.h"
+#include "UnboundedBuffer.h"
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+using namespace qedis;
+
+namespace
+{
+
+const int kKeys = 1000000;
+
+// run the command handler for every params, return the elapsed us
+int64_t RunCommand(QCommandHandler* handler, const std::vector<std::vector<QString> >& params)
+{
+    UnboundedBuffer reply;
+
+    BenchmarkTimer timer;
+    for (const auto& p : params)
+    {
+        handler(p, &reply);
+        reply.Clear();
+    }
+
+    return timer.ElapsedUs();
+}
+
+}
+
+BENCHMARK_CASE(store_get_set)
+{
+    QSTORE.Init(16, 1);
+    QSTORE.ClearCurrentDB();
+
+    std::vector<std::vector<QString> > sets, setexs, gets, hotGets;
+    sets.reserve(kKeys);
+    gets.reserve(kKeys);
+    hotGets.reserve(kKeys);
+    for (int i = 0; i < kKeys; ++ i)
+    {
+        QString key = "key:" + std::to_string(i);
+        sets.push_back({"set", key, "value:" + std::to_string(i)});
+        gets.push_back({"get", key});
+        // in cpu cache, the cost of lookups shows
+        hotGets.push_back({"get", "key:" + std::to_string(i % 1000 * 5)});
+
+        // one in ten keys has ttl
+        if (i % 10 == 0)
+            setexs.push_back({"setex", key, "3600", "value"});
+    }
+
+    // a hit of random key misses the cpu cache like a real server
+    std::shuffle(gets.begin(), gets.end(), std::mt19937(0));
+
+    Report("set new keys", kKeys, RunCommand(&set, sets));
+    Report("set existing keys", kKeys, RunCommand(&set, sets));
+    Report("setex 10% keys", setexs.size(), RunCommand(&setex, setexs));
+    Report("get random keys", kKeys, RunCommand(&get, gets));
+    Report("get hot keys, half with ttl", kKeys, RunCommand(&get, hotGets));
+
+    QSTORE.ClearCurrentDB();
+}
+
+// Cache simulation: GET the keys of a zipfian trace, SET them if missed,
+// with maxmemory holding a tenth of the keys.
+BENCHMARK_CASE(eviction_hit_ratio)
+{
+    const int kKeySpace = 100000;
+    const int kRequests = 2000000;
+    const double kSkew = 0.99;
+
+    QSTORE.Init(16, 1);
+    QSTORE.ClearCurrentDB();
+
+    // inverse of zipf cdf by binary search, ranks mapped to random keys
+    std::vector<double> cdf(kKeySpace);
+    double sum = 0;
+    for (int i = 0; i < kKeySpace; ++ i)
+        cdf[i] = (sum += 1.0 / std::pow(i + 1, kSkew));
+
+    std::vector<QString> keys;
+    keys.reserve(kKeySpace);
+    for (int i = 0; i < kKeySpace; ++ i)
+        keys.push_back("key:" + std::to_string(i));
+    std::mt19937 gen(0);
+    std::shuffle(keys.begin(), keys.end(), gen);
+
+    std::vector<int> trace(kRequests);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    for (auto& t : trace)
+        t = static_cast<int>(std::lower_bound(cdf.begin(), cdf.end(), uniform(gen)) - cdf.begin());
+
+    const QString value(100, 'v');
+    const uint64_t start = ::Now();
+
+    // same ttl for all, volatile-ttl is fifo
+    auto setKey = [&](int rank, int request, bool volatileKey) {
+        QSTORE.SetValue(keys[rank], QObject::CreateString(value));
+        if (volatileKey)
+            QSTORE.SetExpire(keys[rank], start + 3600 * 1000UL + request);
+    };
+
+    const auto oldMax = g_config.maxmemory;
+    const auto oldPolicy = g_config.maxmemoryPolicy;
+    const auto oldSamples = g_config.maxmemorySamples;
+    const auto oldClock = QObject::lruclock;
+    const auto oldLfuClock = QObject::lfuclock;
+
+    struct
+    {
+        int policy;
+        int samples;
+    } const cases[] =
+    {
+        {EvictAllKeysRandom, 5},
+        {EvictAllKeysLRU, 1},
+        {EvictAllKeysLRU, 5},
+        {EvictAllKeysLFU, 5},
+        {EvictVolatileLRU, 5},
+        {EvictVolatileTTL, 5},
+    };
+
+    for (const auto& c : cases)
+    {
+        g_config.maxmemoryPolicy = c.policy;
+        g_config.maxmemorySamples = c.samples;
+        // memory of a tenth keys
+        const size_t base = UsedMemory();
+        for (int i = 0; i < kKeySpace / 10; ++ i)
+            setKey(i, 0, IsVolatilePolicy(c.policy));
+        const size_t cacheBytes = UsedMemory() - base;
+        QSTORE.ClearCurrentDB();
+
+        g_config.maxmemory = UsedMemory() + cacheBytes;
+        QObject::lruclock = 0;
+        QObject::lfuclock = 0;
+
+        int hits = 0;
+        BenchmarkTimer timer;
+        for (int i = 0; i < kRequests; ++ i)
+        {
+            // a thousand requests per second
+            if (i % 1000 == 0)
+            {
+                QObject::lruclock = i / 1000;
+                QObject::lfuclock = i / 60000;
+            }
+
+            const QString& key = keys[trace[i]];
+            QObject* obj = nullptr;
+            if (QSTORE.GetValue(key, obj) == QError_ok)
+            {
+                ++ hits;
+                continue;
+            }
+
+            QSTORE.EvictIfNeeded(0);
+            setKey(trace[i], i, IsVolatilePolicy(c.policy));
+        }
+
+        const int64_t us = timer.ElapsedUs();
+
+        char label[64];
+        snprintf(label, sizeof label, "%s, %d samples", EvictionPolicyName(c.policy), c.samples);
+        char result[64];
+        snprintf(result, sizeof result, "hit ratio %.2f%%, %.0f ops/s",
+                 hits * 100.0 / kRequests, kRequests * 1e6 / std::max<int64_t>(us, 1));
+        Report(label, result);
+
+        QSTORE.ClearCurrentDB();
+    }
+
+    g_config.maxmemory = oldMax;
+    g_config.maxmemoryPolicy = oldPolicy;
+    g_config.maxmemorySamples = oldSamples;
+    QObject::lruclock = oldClock;
+    QObject::lfuclock = oldLfuClock;
+}
@@ -15,21 +15,19 @@ QError hgets(const std::vector<QString>& params, UnboundedBuffer* reply)
         return err;
     }
     
-    const PHASH& hash= value->CastHash();
-    std::vector<const QString* > res;
-    for (const auto& kv : *hash)
-    {
-        if (glob_match(params[2], kv.first))
+    std::vector<QString> res;
+    HashForEach(*value, [&](const QString& field, const QString& val) {
+        if (glob_match(params[2], field))
         {
-            res.push_back(&kv.first);
-            res.push_back(&kv.second);
+            res.push_back(field);
+            res.push_back(val);
         }
-    }
+    });
 
     PreFormatMultiBulk(res.size(), reply);
-    for (auto v : res)
+    for (const auto& v : res)
     {
-        FormatBulk(*v, reply);
+        FormatBulk(v, reply);
     }
 
     return   QError_ok;
@@ -24,32 +24,13 @@ QError ldel(const std::vector<QString>& params, UnboundedBuffer* reply)
         return QError_nan;
     }
         
-    const PLIST& list = value->CastList();
-    const int size = static_cast<int>(list->size());
-    if (idx < 0)
-        idx += size;
-    
-    if (idx < 0 || idx >= size)
+    if (!ListErase(*value, idx))
     {
         Format0(reply);
         return QError_nop;
     }
-    
-    if (2 * idx < size)
-    {
-        auto it = list->begin();
-        std::advance(it, idx);
-        list->erase(it);
-    }
-    else
-    {
-        auto it = list->rbegin();
-        idx = size - 1 - idx;
-        std::advance(it, idx);
-        list->erase((++it).base());
-    }
 
-    if (list->empty())
+    if (ListSize(*value) == 0)
         QSTORE.DeleteKey(params[1]);
     
     Format1(reply);
@@ -19,20 +19,18 @@ QError skeys(const std::vector<QString>& params, UnboundedBuffer* reply)
         return err;
     }
 
-    std::vector<const QString* > res;
-    const PSET& set = value->CastSet();
-    for (const auto& k : *set)
-    {
+    std::vector<QString> res;
+    SetForEach(*value, [&](const QString& k) {
         if (glob_match(params[2], k))
         {
-            res.push_back(&k);
+            res.push_back(k);
         }
-    }
+    });
 
     PreFormatMultiBulk(res.size(), reply);
-    for (auto v : res)
+    for (const auto& v : res)
     {
-        FormatBulk(*v, reply);
+        FormatBulk(v, reply);
     }
 
     return   QError_ok;
@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <algorithm>
+#include <new>
 
 #if defined(__APPLE__)
 #include <unistd.h>
@@ -8,104 +10,334 @@
 
 using std::size_t;
 
-AsyncBuffer::AsyncBuffer(size_t size) : buffer_(size),
-                                          backBytes_(0)
+struct AsyncBuffer::Chunk
+{
+    // published by producers: data, then next
+    std::atomic<size_t>  writePos {0};
+    std::atomic<Chunk* > next {nullptr};
+
+    // producers
+    size_t  fill = 0;
+    Chunk*  pnext = nullptr;
+
+    // consumer
+    size_t  readPos = 0;
+
+    size_t  blockSize = 0; // 0 if not from pool
+    size_t  capacity = 0;
+
+    SharedString* ref = nullptr; // the data if referenced
+
+    char*   Data() { return ref ? ref->data : reinterpret_cast<char* >(this + 1); }
+};
+
+static std::atomic<uint64_t>  s_contendedWrites {0};
+static std::atomic<uint64_t>  s_copiedBytes {0};
+static std::atomic<uint64_t>  s_referencedBytes {0};
+
+static const uintptr_t kProducing = 1;
+
+uint64_t AsyncBuffer::ContendedWrites()
+{
+    return s_contendedWrites;
+}
+
+uint64_t AsyncBuffer::CopiedBytes()
+{
+    return s_copiedBytes;
+}
+
+uint64_t AsyncBuffer::ReferencedBytes()
+{
+    return s_referencedBytes;
+}
+
+AsyncBuffer::AsyncBuffer(size_t chunkSize) : chunkSize_(BufferPool::BlockSize(chunkSize)),
+                                             pubChunk_(nullptr),
+                                             unpublished_(0),
+                                             tail_(0),
+                                             first_(nullptr),
+                                             head_(nullptr),
+                                             detached_(false),
+                                             published_(0),
+                                             sent_(0),
+                                             memory_(0)
 {
 }
 
 AsyncBuffer::~AsyncBuffer()
 {
-  //  assert (buffer_.IsEmpty());
-   // assert (backBytes_ == 0);
+    // no other thread now
+    _FreeChain(head_);
+    _FreeChain(first_);
 }
 
+AsyncBuffer::Chunk* AsyncBuffer::_NewChunk(size_t len)
+{
+    // a big write in few chunks
+    const size_t blockSize = BufferPool::BlockSize(std::min(std::max(len + sizeof(Chunk), chunkSize_),
+                                                            BufferPool::kMaxPooledBlock));
+
+    Chunk* chunk = new (BufferPool::Instance().Acquire(blockSize)) Chunk;
+    chunk->blockSize = blockSize;
+    chunk->capacity = blockSize - sizeof(Chunk);
+
+    memory_ += blockSize;
+    return chunk;
+}
 
-void   AsyncBuffer::Write(const void* data, size_t len)
+void AsyncBuffer::_FreeChunk(Chunk* chunk)
 {
-    BufferSequence  bf;
-    bf.buffers[0].iov_base = const_cast<void* >(data);
-    bf.buffers[0].iov_len  = len;
-    bf.count = 1;
-    
-    this->Write(bf);
+    memory_ -= chunk->blockSize;
+    _DestroyChunk(chunk);
 }
 
-void   AsyncBuffer::Write(const BufferSequence& data)
+void AsyncBuffer::_FreeChain(Chunk* chunk)
 {
-    auto len = data.TotalBytes();
+    while (chunk)
+    {
+        Chunk* next = chunk->pnext;
+        _DestroyChunk(chunk);
+        chunk = next;
+    }
+}
 
-    if (backBytes_ > 0 || buffer_.WritableSize() < len)
+void AsyncBuffer::_DestroyChunk(Chunk* chunk)
+{
+    if (chunk->ref)
     {
-        std::lock_guard<std::mutex>  guard(backBufLock_);
+        chunk->ref->Unref();
+        delete chunk;
+        return;
+    }
 
-        if (backBytes_ > 0 || buffer_.WritableSize() < len)
-        {
-            for (size_t i = 0; i < data.count; ++ i)
-            {
-                backBuf_.PushData(data.buffers[i].iov_base,
-                                   data.buffers[i].iov_len);
-            }
-        
-            backBytes_ += len;
-            assert (backBytes_ == backBuf_.ReadableSize());
+    const size_t blockSize = chunk->blockSize;
+    chunk->~Chunk();
+    BufferPool::Instance().Release(reinterpret_cast<char* >(chunk), blockSize);
+}
+
+AsyncBuffer::Chunk* AsyncBuffer::_AcquireTail(size_t len, Chunk* fresh)
+{
+    uintptr_t tail = tail_.load(std::memory_order_acquire);
+    if (tail & kProducing)
+        return reinterpret_cast<Chunk* >(tail & ~kProducing);
+
+    // the consumer can't return it after marked
+    if (tail != 0 && tail_.compare_exchange_strong(tail, tail | kProducing, std::memory_order_acq_rel))
+    {
+        pubChunk_ = reinterpret_cast<Chunk* >(tail);
+        return pubChunk_;
+    }
+
+    // returned, the consumer has taken the last chain
+    assert (first_.load() == nullptr);
+
+    Chunk* chunk = fresh ? fresh : _NewChunk(len);
+    pubChunk_ = chunk;
+    tail_.store(reinterpret_cast<uintptr_t>(chunk) | kProducing, std::memory_order_release);
+    first_.store(chunk, std::memory_order_release);
+
+    return chunk;
+}
+
+void AsyncBuffer::Write(const void* data, size_t len, bool publish)
+{
+    if (len == 0)
+        return;
 
-            return;
+    std::unique_lock<std::mutex>  guard(producerLock_, std::try_to_lock);
+    if (!guard.owns_lock())
+    {
+        s_contendedWrites.fetch_add(1, std::memory_order_relaxed);
+        guard.lock();
+    }
+
+    Chunk* tail = _AcquireTail(len);
+
+    const char* src = static_cast<const char* >(data);
+    size_t left = len;
+    while (left > 0)
+    {
+        if (tail->fill == tail->capacity)
+        {
+            // linked for consumer when published
+            Chunk* chunk = _NewChunk(left);
+            tail->pnext = chunk;
+            tail = chunk;
         }
+
+        const size_t n = std::min(left, tail->capacity - tail->fill);
+        ::memcpy(tail->Data() + tail->fill, src, n);
+        tail->fill += n;
+        src  += n;
+        left -= n;
     }
-    
-    assert(backBytes_ == 0 && buffer_.WritableSize() >= len);
 
-    for (size_t i = 0; i < data.count; ++ i)
+    s_copiedBytes.fetch_add(len, std::memory_order_relaxed);
+    _EndWrite(tail, len, publish);
+}
+
+void AsyncBuffer::Write(SharedString* str, bool publish)
+{
+    if (str->size == 0)
+        return;
+
+    // full, the data written later go to a new chunk
+    Chunk* chunk = new Chunk;
+    chunk->ref = str;
+    chunk->fill = chunk->capacity = str->size;
+    str->Ref();
+
+    std::unique_lock<std::mutex>  guard(producerLock_, std::try_to_lock);
+    if (!guard.owns_lock())
     {
-        buffer_.PushData(data.buffers[i].iov_base, data.buffers[i].iov_len);
+        s_contendedWrites.fetch_add(1, std::memory_order_relaxed);
+        guard.lock();
     }
+
+    Chunk* tail = _AcquireTail(0, chunk);
+    if (tail != chunk)
+    {
+        tail->pnext = chunk;
+        tail = chunk;
+    }
+
+    s_referencedBytes.fetch_add(str->size, std::memory_order_relaxed);
+    _EndWrite(tail, str->size, publish);
 }
 
-void  AsyncBuffer::ProcessBuffer(BufferSequence& data)
+void AsyncBuffer::_EndWrite(Chunk* tail, size_t len, bool publish)
 {
-    data.count = 0;
-    
-    // Here be dragons! see below...
-    if (!tmpBuf_.IsEmpty())
+    unpublished_ += len;
+
+    if (publish)
+        _Publish(tail);
+    else
+        tail_.store(reinterpret_cast<uintptr_t>(tail) | kProducing, std::memory_order_release);
+}
+
+void AsyncBuffer::Write(const BufferSequence& data)
+{
+    if (data.count == 1)
     {
-        data.count = 1;
-        data.buffers[0].iov_base = tmpBuf_.ReadAddr();
-        data.buffers[0].iov_len  = tmpBuf_.ReadableSize();
+        Write(data.buffers[0].iov_base, data.buffers[0].iov_len);
+        return;
     }
-    else if (!buffer_.IsEmpty())
+
+    for (size_t i = 0; i < data.count; ++ i)
+        Write(data.buffers[i].iov_base, data.buffers[i].iov_len, false);
+
+    Publish();
+}
+
+void AsyncBuffer::Publish()
+{
+    std::lock_guard<std::mutex>  guard(producerLock_);
+
+    const uintptr_t tail = tail_.load(std::memory_order_acquire);
+    if (tail & kProducing)
+        _Publish(reinterpret_cast<Chunk* >(tail & ~kProducing));
+}
+
+void AsyncBuffer::_Publish(Chunk* tail)
+{
+    // the data of a chunk is complete when the consumer sees its next
+    for (Chunk* chunk = pubChunk_; ; chunk = chunk->pnext)
     {
-        auto nLen = buffer_.ReadableSize();
+        chunk->writePos.store(chunk->fill, std::memory_order_release);
+        if (chunk == tail)
+            break;
 
-        buffer_.GetDatum(data, nLen);
-        assert (nLen == data.TotalBytes());
+        chunk->next.store(chunk->pnext, std::memory_order_release);
     }
-    else
+
+    published_ += unpublished_;
+    unpublished_ = 0;
+    pubChunk_ = nullptr;
+
+    tail_.store(reinterpret_cast<uintptr_t>(tail), std::memory_order_release);
+}
+
+void  AsyncBuffer::ProcessBuffer(BufferSequence& data)
+{
+    data.count = 0;
+
+    if (!head_)
+        head_ = first_.exchange(nullptr, std::memory_order_acq_rel);
+
+    for (Chunk* chunk = head_;
+         chunk && data.count < BufferSequence::kMaxIovec;
+         chunk = chunk->next.load(std::memory_order_acquire))
     {
-        if (backBytes_ > 0 && backBufLock_.try_lock())
+        const size_t writePos = chunk->writePos.load(std::memory_order_acquire);
+        if (writePos > chunk->readPos)
         {
-            // tmpBuf_ is used for process backBuf_ without held mutex!
-            backBytes_ = 0;
-            tmpBuf_.Swap(backBuf_);
-            backBufLock_.unlock();
-            
-            data.count = 1;
-            data.buffers[0].iov_base = tmpBuf_.ReadAddr();
-            data.buffers[0].iov_len  = tmpBuf_.ReadableSize();
+            data.buffers[data.count].iov_base = chunk->Data() + chunk->readPos;
+            data.buffers[data.count].iov_len  = writePos - chunk->readPos;
+            ++ data.count;
         }
     }
 }
 
 void  AsyncBuffer::Skip(size_t  size)
 {
-    if (!tmpBuf_.IsEmpty())
-    {
-        assert(size <= tmpBuf_.ReadableSize());
-        tmpBuf_.AdjustReadPtr(size);
-    }
-    else
+    sent_ += size;
+
+    while (Chunk* chunk = head_)
     {
-        assert(buffer_.ReadableSize() >= size);
-        buffer_.AdjustReadPtr(size);
+        // the data is complete if next is there
+        Chunk* next = chunk->next.load(std::memory_order_acquire);
+        const size_t writePos = chunk->writePos.load(std::memory_order_acquire);
+
+        const size_t n = std::min(size, writePos - chunk->readPos);
+        chunk->readPos += n;
+        size -= n;
+
+        if (chunk->readPos < writePos)
+            break;
+
+        if (next)
+        {
+            head_ = next;
+            _FreeChunk(chunk);
+            continue;
+        }
+
+        if (detached_)
+        {
+            head_ = nullptr;
+            detached_ = false;
+            _FreeChunk(chunk);
+            break;
+        }
+
+        // all sent, return the last one unless producers are using it
+        uintptr_t expected = reinterpret_cast<uintptr_t>(chunk);
+        if (tail_.compare_exchange_strong(expected, 0, std::memory_order_acq_rel))
+        {
+            if (chunk->writePos.load(std::memory_order_acquire) == chunk->readPos)
+            {
+                head_ = nullptr;
+                _FreeChunk(chunk);
+            }
+            else
+            {
+                detached_ = true;
+            }
+        }
+
+        break;
     }
+
+    assert (size == 0);
+}
+
+void  AsyncBuffer::GetStats(size_t& bytes, size_t& memory) const
+{
+    const size_t published = published_;
+    const size_t sent = sent_;
+
+    bytes  = published > sent ? published - sent : 0;
+    memory = memory_;
 }
 
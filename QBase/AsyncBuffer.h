@@ -3,33 +3,79 @@
 
 #include <mutex>
 #include <atomic>
+#include <cstdint>
 
 #include "Buffer.h"
 #include "UnboundedBuffer.h"
+#include "SharedString.h"
 
+// Producers write, one consumer sends.
+// The data are copied once into a chain of chunks from BufferPool, and the
+// consumer gets them as iovecs of the chunks, it never waits for a lock.
+// Producers are serialized by a lock, mostly there is only one of them.
+// A chunk is returned to pool when sent, so is the last one, unless
+// producers are using it, an idle buffer holds no memory.
+// A shared string is referenced by a chunk of its own, not copied.
 class AsyncBuffer
 {
 public:
     explicit
-    AsyncBuffer(std::size_t  size = 128 * 1024);
+    AsyncBuffer(std::size_t  chunkSize = 16 * 1024);
    ~AsyncBuffer();
 
-    void        Write(const void* data, std::size_t len);
+    AsyncBuffer(const AsyncBuffer& ) = delete;
+    void operator= (const AsyncBuffer& ) = delete;
+
+    // producers: data not published are not sent until Publish
+    void        Write(const void* data, std::size_t len, bool publish = true);
     void        Write(const BufferSequence& data);
+    void        Write(SharedString* str, bool publish = true);
+    void        Publish();
 
+    // consumer
     void        ProcessBuffer(BufferSequence& data);
     void        Skip(std::size_t  size);
 
+    // any thread: bytes published but not sent, and the memory held
+    void        GetStats(std::size_t& bytes, std::size_t& memory) const;
+
+    // of all the buffers: writes waiting for another producer, bytes copied
+    // and bytes of shared strings
+    static uint64_t  ContendedWrites();
+    static uint64_t  CopiedBytes();
+    static uint64_t  ReferencedBytes();
+
 private:
-    // for async write
-    Buffer          buffer_;
-    
-    // double buffer
-    qedis::UnboundedBuffer tmpBuf_;
-    
-    std::mutex      backBufLock_;
-    std::atomic<std::size_t>    backBytes_;
-    qedis::UnboundedBuffer backBuf_;
+    struct Chunk;
+
+    Chunk*      _NewChunk(std::size_t len);
+    void        _FreeChunk(Chunk* chunk);
+    static void _FreeChain(Chunk* chunk);
+    static void _DestroyChunk(Chunk* chunk);
+    Chunk*      _AcquireTail(std::size_t len, Chunk* fresh = nullptr);
+    void        _EndWrite(Chunk* tail, std::size_t len, bool publish);
+    void        _Publish(Chunk* tail);
+
+    const std::size_t chunkSize_;
+
+    // producers, with the lock held
+    std::mutex  producerLock_;
+    Chunk*      pubChunk_;  // the first chunk not published
+    std::size_t unpublished_;
+
+    // the last chunk, the low bit is set while it has data not published.
+    // The consumer resets it to 0 to return the chunk when all sent, then
+    // producers start a new chain in first_.
+    std::atomic<uintptr_t>  tail_;
+    std::atomic<Chunk* >    first_;
+
+    // consumer
+    Chunk*      head_;
+    bool        detached_; // head_ was the tail returned, data came just before
+
+    std::atomic<std::size_t>  published_;
+    std::atomic<std::size_t>  sent_;
+    std::atomic<std::size_t>  memory_;
 };
 
 #endif
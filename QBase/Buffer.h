@@ -9,6 +9,7 @@
 #include <sys/uio.h>
 #include <atomic>
 
+#include "BufferPool.h"
 
 struct BufferSequence
 {
@@ -86,6 +87,12 @@ public:
     std::size_t Capacity() const { return maxSize_; }
     void InitCapacity(std::size_t size);
 
+    // Move the data to a new buffer of size, false if they don't fit
+    bool Resize(std::size_t size);
+
+    // Drop the data and the memory, Capacity() is 0 until InitCapacity
+    void Release();
+
     template <typename T>
     CircularBuffer& operator<< (const T& data);
     template <typename T>
@@ -334,6 +341,35 @@ inline void CircularBuffer<BUFFER>::InitCapacity(std::size_t size)
     std::vector<char>(buffer_).swap(buffer_);
 }
 
+template <typename BUFFER>
+bool CircularBuffer<BUFFER>::Resize(std::size_t size)
+{
+    size = RoundUp2Power(size);
+
+    const std::size_t len = ReadableSize();
+    if (size <= len)
+        return false;
+
+    BUFFER  tmp(size);
+    PeekDataAt(&tmp[0], len);
+    buffer_.swap(tmp);
+
+    maxSize_  = size;
+    readPos_  = 0;
+    writePos_ = len;
+    return true;
+}
+
+template <typename BUFFER>
+void CircularBuffer<BUFFER>::Release()
+{
+    BUFFER().swap(buffer_);
+
+    maxSize_  = 0;
+    readPos_  = 0;
+    writePos_ = 0;
+}
+
 template <typename BUFFER>
 template <typename T>
 inline CircularBuffer<BUFFER>& CircularBuffer<BUFFER>::operator<< (const T& data )
@@ -426,6 +462,19 @@ inline Buffer::CircularBuffer(std::size_t maxSize) : maxSize_(RoundUp2Power(maxS
 }
 
 
+// memory from BufferPool, for the connections
+typedef CircularBuffer<PooledBlock>  PooledBuffer;
+
+template <>
+inline void PooledBuffer::InitCapacity(std::size_t size)
+{
+    assert (size > 0 && size <= 1 * 1024 * 1024 * 1024);
+
+    maxSize_ = RoundUp2Power(size);
+    buffer_.resize(maxSize_);
+}
+
+
 template <int N>
 class StackBuffer : public CircularBuffer<char [N]>
 {
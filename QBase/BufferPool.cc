@@ -0,0 +1,108 @@
+#include <cassert>
+#include <utility>
+
+#include "BufferPool.h"
+#include "Buffer.h"
+
+using std::size_t;
+
+BufferPool& BufferPool::Instance()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+size_t BufferPool::BlockSize(size_t size)
+{
+    if (size <= kMinBlock)
+        return kMinBlock;
+
+    return RoundUp2Power(size);
+}
+
+int BufferPool::_ClassOf(size_t blockSize)
+{
+    if (blockSize > kMaxPooledBlock)
+        return -1;
+
+    int index = 0;
+    for (size_t s = kMinBlock; s < blockSize; s <<= 1)
+        ++ index;
+
+    return index;
+}
+
+char* BufferPool::Acquire(size_t size)
+{
+    size = BlockSize(size);
+    ++ acquired_;
+    inUse_ += size;
+
+    const int index = _ClassOf(size);
+    if (index >= 0)
+    {
+        SizeClass& sc = classes_[index];
+        std::lock_guard<std::mutex>  guard(sc.mutex);
+        if (!sc.blocks.empty())
+        {
+            char* block = sc.blocks.back();
+            sc.blocks.pop_back();
+
+            ++ reused_;
+            cached_ -= size;
+            return block;
+        }
+    }
+
+    return new char[size];
+}
+
+void BufferPool::Release(char* block, size_t size)
+{
+    if (!block)
+        return;
+
+    assert (size == BlockSize(size));
+    inUse_ -= size;
+
+    const int index = _ClassOf(size);
+    if (index >= 0)
+    {
+        SizeClass& sc = classes_[index];
+        std::lock_guard<std::mutex>  guard(sc.mutex);
+        if ((sc.blocks.size() + 1) * size <= kMaxCachedBytes)
+        {
+            sc.blocks.push_back(block);
+            cached_ += size;
+            return;
+        }
+    }
+
+    delete [] block;
+}
+
+
+void PooledBlock::resize(size_t size)
+{
+    _Release();
+
+    if (size > 0)
+    {
+        size_ = BufferPool::BlockSize(size);
+        data_ = BufferPool::Instance().Acquire(size_);
+    }
+}
+
+void PooledBlock::swap(PooledBlock& other)
+{
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+}
+
+void PooledBlock::_Release()
+{
+    BufferPool::Instance().Release(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
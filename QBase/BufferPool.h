@@ -0,0 +1,89 @@
+#ifndef BERT_BUFFERPOOL_H
+#define BERT_BUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+// Size-classed blocks for connection buffers, shared by all threads.
+// A connection holds a block only while it has data in flight, so the idle
+// ones cost nothing, and the blocks go round between the busy ones.
+// Each class keeps at most kMaxCachedBytes of free blocks, the rest are
+// freed; blocks over the biggest class are not cached at all.
+class BufferPool
+{
+public:
+    static BufferPool& Instance();
+
+    BufferPool(const BufferPool& ) = delete;
+    void operator= (const BufferPool& ) = delete;
+
+    // the size class of size, power of 2, not less than kMinBlock
+    static std::size_t BlockSize(std::size_t size);
+
+    // a block of BlockSize(size) bytes
+    char*  Acquire(std::size_t size);
+    void   Release(char* block, std::size_t size);
+
+    // bytes held by connections, and kept free here
+    std::size_t InUse() const  { return inUse_; }
+    std::size_t Cached() const { return cached_; }
+
+    uint64_t  Acquired() const { return acquired_; }
+    uint64_t  Reused() const   { return reused_; }
+
+    static const std::size_t kMinBlock = 4 * 1024;
+    static const std::size_t kMaxPooledBlock = 1024 * 1024;
+    static const std::size_t kMaxCachedBytes = 4 * 1024 * 1024;
+
+private:
+    BufferPool() = default;
+
+    static int _ClassOf(std::size_t blockSize);
+
+    struct SizeClass
+    {
+        std::mutex          mutex;
+        std::vector<char* > blocks;
+    };
+
+    // 4K, 8K ... 1M
+    SizeClass  classes_[9];
+
+    std::atomic<std::size_t> inUse_ {0};
+    std::atomic<std::size_t> cached_ {0};
+    std::atomic<uint64_t>    acquired_ {0};
+    std::atomic<uint64_t>    reused_ {0};
+};
+
+// Memory of CircularBuffer from BufferPool
+class PooledBlock
+{
+public:
+    PooledBlock() = default;
+    explicit PooledBlock(std::size_t size) { resize(size); }
+   ~PooledBlock() { _Release(); }
+
+    PooledBlock(const PooledBlock& ) = delete;
+    void operator= (const PooledBlock& ) = delete;
+
+    // the contents are not kept
+    void  resize(std::size_t size);
+    void  swap(PooledBlock& other);
+
+    std::size_t size() const { return size_; }
+
+    char& operator[](std::size_t i) { return data_[i]; }
+    const char& operator[](std::size_t i) const { return data_[i]; }
+
+private:
+    void  _Release();
+
+    char*       data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+#endif
+
@@ -0,0 +1,76 @@
+#ifndef BERT_MPSCQUEUE_H
+#define BERT_MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// Lock-free unbounded queue, many producers and one consumer.
+// Intrusive node queue of Dmitry Vyukov: Push is one exchange, Pop touches
+// no shared cache line unless the queue is nearly empty.
+template <typename T>
+class MPSCQueue
+{
+public:
+    MPSCQueue() : head_(new Node), tail_(head_.load())
+    {
+    }
+
+   ~MPSCQueue()
+    {
+        T  tmp;
+        while (Pop(tmp))
+            ;
+
+        delete tail_;
+    }
+
+    MPSCQueue(const MPSCQueue& ) = delete;
+    void operator= (const MPSCQueue& ) = delete;
+
+    // any thread
+    void Push(T&& data)
+    {
+        Node* node = new Node(std::move(data));
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // consumer thread only.
+    // May return false while a Push is half done, the producer will wake up
+    // the consumer after that.
+    bool Pop(T& data)
+    {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+
+        data = std::move(next->data);
+        tail_ = next;
+        delete tail;
+        return true;
+    }
+
+    // consumer thread only
+    bool Empty() const
+    {
+        return tail_->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node
+    {
+        Node() : next(nullptr) { }
+        explicit
+        Node(T&& d) : data(std::move(d)), next(nullptr) { }
+
+        T   data;
+        std::atomic<Node* > next;
+    };
+
+    std::atomic<Node* > head_; // producers push here
+    Node*   tail_;             // stub node, consumer pops after it
+};
+
+#endif
+
@@ -6,6 +6,7 @@
 
 #if defined(__gnu_linux__)
 #include "EPoller.h"
+#include "UringPoller.h"
 #elif defined(__APPLE__)
 #include "Kqueue.h"
 #else
@@ -13,15 +14,37 @@
 #endif
 
 #include <cassert>
+#include <algorithm>
 #include <errno.h>
 
 
 namespace Internal
 {
 
-NetThread::NetThread() : running_(true), newCnt_(0)
+NetThread::NetThread(int index, bool ioUring) :
+    index_(index),
+    uring_(nullptr),
+    busyPoll_(false),
+    cpu_(-1),
+    socketCnt_(0),
+    eventCnt_(0),
+    running_(true),
+    newCnt_(0)
 {
 #if defined(__gnu_linux__)
+    if (ioUring)
+    {
+        std::unique_ptr<UringPoller> uring(new UringPoller);
+        if (uring->Init())
+        {
+            uring_ = uring.get();
+            poller_ = std::move(uring);
+            return;
+        }
+
+        ERR << "io_uring not supported, use epoll";
+    }
+
     poller_.reset(new Epoller);
 #else
     poller_.reset(new Kqueue);
@@ -71,7 +94,27 @@ void NetThread::_TryAddNewTasks()
 void NetThread::_AddSocket(PSOCKET task, uint32_t events)
 {
     if (poller_->AddSocket(task->GetSocket(), events, task.get()))
+    {
         tasks_.push_back(task);
+        socketCnt_ = tasks_.size();
+    }
+}
+
+void NetThread::_EraseTask(std::deque<PSOCKET>::iterator& it)
+{
+    it = tasks_.erase(it);
+    socketCnt_ = tasks_.size();
+}
+
+void NetThread::_BindCpu() const
+{
+    if (cpu_ < 0)
+        return;
+
+    if (ThreadPool::BindCpu(cpu_))
+        INF << "Bind net thread " << index_ << " to cpu " << cpu_;
+    else
+        ERR << "Failed to bind net thread " << index_ << " to cpu " << cpu_;
 }
 
 //////////////////////////////////
@@ -82,11 +125,20 @@ void RecvThread::Run()
     g_logDest  = logFILE;
     if (g_logLevel && g_logDest)
     {
-        g_log = LogManager::Instance().CreateLog(g_logLevel, g_logDest, "recvthread_log");
+        g_log = LogManager::Instance().CreateLog(g_logLevel, g_logDest,
+                                                 ("recvthread" + std::to_string(index_) + "_log").c_str());
     }
 
+    _BindCpu();
+
     std::deque<PSOCKET >::iterator it;
 
+#if defined(__gnu_linux__)
+    // stream sockets are read together if io_uring
+    std::vector<Socket* > errors;
+    std::vector<UringPoller::IoResult> results;
+#endif
+
     int loopCount = 0;
     while (IsAlive())
     {
@@ -98,13 +150,32 @@ void RecvThread::Run()
             continue;
         }
 
-        const int nReady = poller_->Poll(firedEvents_, static_cast<int>(tasks_.size()), 1);
+        const int nReady = poller_->Poll(firedEvents_, static_cast<int>(tasks_.size()), busyPoll_ ? 0 : 1);
+        if (nReady > 0)
+            eventCnt_.fetch_add(nReady, std::memory_order_relaxed);
+
         for (int i = 0; i < nReady; ++ i)
         {
             assert (!(firedEvents_[i].events & EventTypeWrite));
 
             Socket* sock = (Socket* )firedEvents_[i].userdata;
 
+#if defined(__gnu_linux__)
+            if (uring_ && sock->GetSocketType() == Socket::SocketType_Stream)
+            {
+                StreamSocket* tcpSock = static_cast<StreamSocket* >(sock);
+
+                BufferSequence  buffers;
+                if ((firedEvents_[i].events & EventTypeRead) && tcpSock->PrepareRecv(buffers))
+                    uring_->PrepareRecv(tcpSock->GetSocket(), buffers.buffers, buffers.count, tcpSock);
+
+                if (firedEvents_[i].events & EventTypeError)
+                    errors.push_back(sock);
+
+                continue;
+            }
+#endif
+
             if (firedEvents_[i].events & EventTypeRead)
             {
                 if (!sock->OnReadable())
@@ -118,6 +189,24 @@ void RecvThread::Run()
                 sock->OnError();
             }
         }
+
+#if defined(__gnu_linux__)
+        if (uring_)
+        {
+            uring_->SubmitIo(results);
+            for (const auto& res : results)
+            {
+                StreamSocket* tcpSock = static_cast<StreamSocket* >(res.userdata);
+                if (!tcpSock->OnRecvDone(res.result))
+                    tcpSock->OnError();
+            }
+
+            for (Socket* sock : errors)
+                sock->OnError();
+
+            errors.clear();
+        }
+#endif
         
         if (nReady == 0)
             loopCount *= 2;
@@ -135,7 +224,7 @@ void RecvThread::Run()
             {
                 NetThreadPool::Instance().DisableRead(*it);
                 RemoveSocket(*it, EventTypeRead);
-                it = tasks_.erase(it);
+                _EraseTask(it);
             }
             else
             {
@@ -152,10 +241,19 @@ void SendThread::Run( )
     g_logDest  = logFILE;
     if (g_logLevel && g_logDest)
     {
-        g_log = LogManager::Instance().CreateLog(g_logLevel, g_logDest, "sendthread_log");
+        g_log = LogManager::Instance().CreateLog(g_logLevel, g_logDest,
+                                                 ("sendthread" + std::to_string(index_) + "_log").c_str());
     }
-    
+
+    _BindCpu();
+
     std::deque<PSOCKET >::iterator    it;
+
+#if defined(__gnu_linux__)
+    // the sockets sent together if io_uring, held until done
+    std::vector<std::pair<PSOCKET, size_t> > sending;
+    std::vector<UringPoller::IoResult> results;
+#endif
     
     while (IsAlive())
     {
@@ -170,15 +268,30 @@ void SendThread::Run( )
             if (type == Socket::SocketType_Stream)
             {
                 StreamSocket*  tcpSock = static_cast<StreamSocket* >(sock);
-                if (!tcpSock->Send())
-                    tcpSock->OnError();
+#if defined(__gnu_linux__)
+                BufferSequence  bf;
+                if (uring_ && tcpSock->PrepareSend(bf))
+                {
+                    uring_->PrepareSend(tcpSock->GetSocket(), bf.buffers, bf.count,
+                                        reinterpret_cast<void* >(sending.size()));
+                    sending.push_back(std::make_pair(*it, bf.TotalBytes()));
+                }
+                else if (!uring_)
+#endif
+                {
+                    const int nSent = tcpSock->Send();
+                    if (nSent < 0)
+                        tcpSock->OnError();
+                    else if (nSent > 0)
+                        eventCnt_.fetch_add(1, std::memory_order_relaxed);
+                }
             }
             
             if (sock->Invalid())
             {
                 NetThreadPool::Instance().DisableWrite(*it);
                 RemoveSocket(*it, EventTypeWrite);
-                it = tasks_.erase(it);
+                _EraseTask(it);
             }
             else
             {
@@ -188,14 +301,41 @@ void SendThread::Run( )
                 ++ it;
             }
         }
+
+#if defined(__gnu_linux__)
+        if (!sending.empty())
+        {
+            uring_->SubmitIo(results);
+            for (const auto& res : results)
+            {
+                const auto& s = sending[reinterpret_cast<size_t>(res.userdata)];
+                StreamSocket*  tcpSock = static_cast<StreamSocket* >(s.first.get());
+
+                const int nSent = tcpSock->SendDone(s.second, res.result);
+                if (nSent < 0)
+                    tcpSock->OnError();
+                else if (nSent > 0)
+                    eventCnt_.fetch_add(1, std::memory_order_relaxed);
+
+                if (tcpSock->epollOut_)
+                    ++ nOut;
+            }
+
+            sending.clear();
+        }
+#endif
         
         if (nOut == 0)
         {
-            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            if (!busyPoll_)
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
             continue;
         }
 
-        const int nReady = poller_->Poll(firedEvents_, static_cast<int>(tasks_.size()), 1);
+        const int nReady = poller_->Poll(firedEvents_, static_cast<int>(tasks_.size()), busyPoll_ ? 0 : 1);
+        if (nReady > 0)
+            eventCnt_.fetch_add(nReady, std::memory_order_relaxed);
+
         for (int i = 0; i < nReady; ++ i)
         {
             Socket* sock = (Socket* )firedEvents_[i].userdata;
@@ -218,32 +358,80 @@ void SendThread::Run( )
 }
 
 
+void NetThreadPool::SetThreadNum(int recvThreads, int sendThreads)
+{
+    assert (recvThreads_.empty() && sendThreads_.empty());
+
+    recvThreadNum_ = std::max(recvThreads, 1);
+    sendThreadNum_ = std::max(sendThreads, 1);
+}
+
+void NetThreadPool::SetCpus(const std::vector<int>& recvCpus, const std::vector<int>& sendCpus)
+{
+    assert (recvThreads_.empty() && sendThreads_.empty());
+
+    recvCpus_ = recvCpus;
+    sendCpus_ = sendCpus;
+}
+
+RecvThread* NetThreadPool::_RecvThreadOf(const Socket* sock) const
+{
+    if (recvThreads_.empty())
+        return nullptr;
+
+    return recvThreads_[sock->GetID() % recvThreads_.size()].get();
+}
+
+SendThread* NetThreadPool::_SendThreadOf(const Socket* sock) const
+{
+    if (sendThreads_.empty())
+        return nullptr;
+
+    return sendThreads_[sock->GetID() % sendThreads_.size()].get();
+}
+
 void NetThreadPool::StopAllThreads()
 {
-    recvThread_->Stop();
-    recvThread_.reset();
-    sendThread_->Stop();
-    sendThread_.reset();
+    for (const auto& t : recvThreads_)
+        t->Stop();
+    recvThreads_.clear();
+
+    for (const auto& t : sendThreads_)
+        t->Stop();
+    sendThreads_.clear();
 
     INF << "Stop all recv and send threads";
 }
 
 bool NetThreadPool::AddSocket(PSOCKET sock, uint32_t  events)
 {
+    if (busyPollUs_ > 0 && sock->GetSocketType() == Socket::SocketType_Stream &&
+        !Socket::SetBusyPoll(sock->GetSocket(), busyPollUs_))
+    {
+        static bool warned = false;
+        if (!warned)
+        {
+            warned = true;
+            WRN << "Failed to set SO_BUSY_POLL, errno " << errno << ", threads still spin";
+        }
+    }
+
     if (events & EventTypeRead)
     {
-        if (!recvThread_)
+        RecvThread* t = _RecvThreadOf(sock.get());
+        if (!t)
             return false;
 
-        recvThread_->AddSocket(sock, EventTypeRead);
+        t->AddSocket(sock, EventTypeRead);
     }
 
     if (events & EventTypeWrite)
     {
-        if (!sendThread_)
+        SendThread* t = _SendThreadOf(sock.get());
+        if (!t)
             return false;
     
-        sendThread_->AddSocket(sock, EventTypeWrite);
+        t->AddSocket(sock, EventTypeWrite);
     }
 
     return true;
@@ -251,11 +439,21 @@ bool NetThreadPool::AddSocket(PSOCKET sock, uint32_t  events)
 
 bool NetThreadPool::StartAllThreads()
 {
-    recvThread_.reset(new RecvThread);
-    sendThread_.reset(new SendThread);
-    
-    ThreadPool::Instance().ExecuteTask(std::bind(&RecvThread::Run, recvThread_));
-    ThreadPool::Instance().ExecuteTask(std::bind(&SendThread::Run, sendThread_));
+    for (int i = 0; i < recvThreadNum_; ++ i)
+    {
+        recvThreads_.push_back(std::make_shared<RecvThread>(i, ioUring_));
+        recvThreads_.back()->SetBusyPoll(busyPollUs_ > 0);
+        recvThreads_.back()->SetCpu(recvCpus_.empty() ? -1 : recvCpus_[i % recvCpus_.size()]);
+        ThreadPool::Instance().ExecuteTask(std::bind(&RecvThread::Run, recvThreads_.back()));
+    }
+
+    for (int i = 0; i < sendThreadNum_; ++ i)
+    {
+        sendThreads_.push_back(std::make_shared<SendThread>(i, ioUring_));
+        sendThreads_.back()->SetBusyPoll(busyPollUs_ > 0);
+        sendThreads_.back()->SetCpu(sendCpus_.empty() ? -1 : sendCpus_[i % sendCpus_.size()]);
+        ThreadPool::Instance().ExecuteTask(std::bind(&SendThread::Run, sendThreads_.back()));
+    }
 
     return  true;
 }
@@ -263,26 +461,26 @@ bool NetThreadPool::StartAllThreads()
 
 void NetThreadPool::EnableRead(const std::shared_ptr<Socket>& sock)
 {
-    if (recvThread_)
-        recvThread_->ModSocket(sock, EventTypeRead);
+    if (RecvThread* t = _RecvThreadOf(sock.get()))
+        t->ModSocket(sock, EventTypeRead);
 }
 
 void NetThreadPool::EnableWrite(const std::shared_ptr<Socket>& sock)
 {
-    if (sendThread_)
-        sendThread_->ModSocket(sock, EventTypeWrite);
+    if (SendThread* t = _SendThreadOf(sock.get()))
+        t->ModSocket(sock, EventTypeWrite);
 }
    
 void NetThreadPool::DisableRead(const std::shared_ptr<Socket>& sock)
 {
-    if (recvThread_)
-        recvThread_->ModSocket(sock, 0);
+    if (RecvThread* t = _RecvThreadOf(sock.get()))
+        t->ModSocket(sock, 0);
 }
 
 void NetThreadPool::DisableWrite(const std::shared_ptr<Socket>& sock)
 {
-    if (sendThread_)
-        sendThread_->ModSocket(sock, 0);
+    if (SendThread* t = _SendThreadOf(sock.get()))
+        t->ModSocket(sock, 0);
 }
 
 }
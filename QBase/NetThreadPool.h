@@ -18,6 +18,8 @@ inline long GetCpuNum()
 class   Socket;
 typedef std::shared_ptr<Socket> PSOCKET;
 
+class   UringPoller;
+
 namespace Internal
 {
 
@@ -25,7 +27,8 @@ namespace Internal
 class NetThread
 {
 public:
-    NetThread();
+    explicit
+    NetThread(int index = 0, bool ioUring = false);
     virtual ~NetThread();
 
     bool IsAlive() const  {  return running_; }
@@ -35,11 +38,30 @@ public:
     void ModSocket(PSOCKET , uint32_t event);
     void RemoveSocket(PSOCKET, uint32_t event);
 
+    // for info command, read by other threads
+    std::size_t SocketCount() const { return socketCnt_; }
+    uint64_t    EventCount() const  { return eventCnt_; }
+    const char* PollerName() const  { return uring_ ? "io_uring" : "epoll"; }
+
+    // before Run: spin instead of sleeping, and the cpu to bind, -1 not bound
+    void SetBusyPoll(bool busy) { busyPoll_ = busy; }
+    void SetCpu(int cpu)        { cpu_ = cpu; }
+
 protected:
+    const int                index_;
     std::unique_ptr<Poller>        poller_;
+    UringPoller*             uring_; // poller_ if io_uring, I/O batched
     std::vector<FiredEvent > firedEvents_;    
     std::deque<PSOCKET>      tasks_;
     void  _TryAddNewTasks();
+    void  _EraseTask(std::deque<PSOCKET>::iterator& it);
+    void  _BindCpu() const;
+
+    bool  busyPoll_;
+    int   cpu_;
+
+    std::atomic<std::size_t> socketCnt_;
+    std::atomic<uint64_t>    eventCnt_;
 
 private:
     std::atomic<bool> running_;
@@ -54,12 +76,14 @@ private:
 class RecvThread : public NetThread
 {
 public:
+    using NetThread::NetThread;
     void Run();
 };
 
 class SendThread : public NetThread
 {
 public:
+    using NetThread::NetThread;
     void Run();
 };
 
@@ -67,8 +91,20 @@ public:
 ///////////////////////////////////////////////
 class NetThreadPool
 {
-    std::shared_ptr<RecvThread> recvThread_;
-    std::shared_ptr<SendThread> sendThread_;
+    int recvThreadNum_ = 1;
+    int sendThreadNum_ = 1;
+    bool ioUring_ = false;
+    int  busyPollUs_ = 0;
+    std::vector<int> recvCpus_;
+    std::vector<int> sendCpus_;
+
+    // a socket is always served by the same recv and send thread,
+    // chosen by its id, so the order of its data is kept
+    std::vector<std::shared_ptr<RecvThread> > recvThreads_;
+    std::vector<std::shared_ptr<SendThread> > sendThreads_;
+
+    RecvThread* _RecvThreadOf(const Socket* sock) const;
+    SendThread* _SendThreadOf(const Socket* sock) const;
 
 public:
     NetThreadPool() = default;
@@ -76,9 +112,21 @@ public:
     NetThreadPool(const NetThreadPool& ) = delete;
     void operator= (const NetThreadPool& ) = delete;
 
+    // call before StartAllThreads
+    void SetThreadNum(int recvThreads, int sendThreads);
+    // poll by io_uring instead of epoll, falls back to epoll if unsupported
+    void SetIoUring(bool enable) { ioUring_ = enable; }
+    // threads spin instead of sleeping and sockets set SO_BUSY_POLL, 0 is off
+    void SetBusyPoll(int usec) { busyPollUs_ = usec; }
+    // thread i is bound to cpus[i % size], not bound if empty
+    void SetCpus(const std::vector<int>& recvCpus, const std::vector<int>& sendCpus);
+
     bool AddSocket(PSOCKET , uint32_t event);
     bool StartAllThreads();
     void StopAllThreads();
+
+    const std::vector<std::shared_ptr<RecvThread> >& RecvThreads() const { return recvThreads_; }
+    const std::vector<std::shared_ptr<SendThread> >& SendThreads() const { return sendThreads_; }
     
     void EnableRead(const std::shared_ptr<Socket>& sock);
     void EnableWrite(const std::shared_ptr<Socket>& sock);
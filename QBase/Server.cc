@@ -30,7 +30,7 @@ Server* Server::sinstance_ = nullptr;
 
 std::set<int> Server::slistenSocks_;
 
-Server::Server() : bTerminate_(false), reloadCfg_(false)
+Server::Server() : bTerminate_(false), reloadCfg_(false), busyPoll_(false), logicCpu_(-1)
 {
     if (sinstance_ == NULL)
         sinstance_ = this;
@@ -128,6 +128,15 @@ void Server::MainLoop(bool daemon)
         _Init() &&
         LogManager::Instance().StartLog())
     {
+        // bound after the other threads created, they don't inherit the cpu
+        if (logicCpu_ >= 0)
+        {
+            if (ThreadPool::BindCpu(logicCpu_))
+                INF << "Bind logic thread to cpu " << logicCpu_;
+            else
+                ERR << "Failed to bind logic thread to cpu " << logicCpu_;
+        }
+
         while (!bTerminate_)
         {
             if (reloadCfg_)
@@ -136,8 +145,10 @@ void Server::MainLoop(bool daemon)
                 reloadCfg_ = false;
             }
 
-            if (!_RunLogic())
-                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            // sleep until some connection is ready, or for the timers.
+            // If busy polling, nobody needs to wake it up
+            if (!_RunLogic() && !busyPoll_)
+                tasks_.Wait(1);
         }
     }
 
@@ -32,6 +32,11 @@ public:
     void Terminate()  { bTerminate_ = true; }
 
     void MainLoop(bool daemon = false);
+
+    // before MainLoop: the logic thread spins instead of sleeping,
+    // and the cpu to bind, -1 not bound
+    void SetBusyPoll(bool busy) { busyPoll_ = busy; }
+    void SetLogicCpu(int cpu)   { logicCpu_ = cpu; }
     void NewConnection(int sock, int tag, const std::function<void ()>& cb = std::function<void ()>());
 
     void TCPConnect(const SocketAddr& peer, int tag);
@@ -46,6 +51,12 @@ public:
     static void HupHandler(int sig);
 
     std::shared_ptr<StreamSocket>  FindTCP(unsigned int id) const { return tasks_.FindTCP(id); }
+
+    // logic thread
+    void  ForEachTCP(const std::function<void (const std::shared_ptr<StreamSocket>& )>& func) const { tasks_.ForEachTCP(func); }
+
+    // the connection need parse again, any thread
+    void NotifyReady(const std::shared_ptr<StreamSocket>& conn) { tasks_.NotifyReady(conn); }
     
     static void AtForkHandler();
     static void DelListenSock(int sock);
@@ -57,6 +68,8 @@ private:
     std::atomic<bool> bTerminate_;
     Internal::TaskManager   tasks_;
     bool          reloadCfg_;
+    bool          busyPoll_;
+    int           logicCpu_;
     static Server*   sinstance_;
     
     static std::set<int>  slistenSocks_;
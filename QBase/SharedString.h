@@ -0,0 +1,35 @@
+#ifndef BERT_SHAREDSTRING_H
+#define BERT_SHAREDSTRING_H
+
+#include <atomic>
+#include <cstddef>
+
+// An immutable string shared by refcount: a big value is sent from where
+// it's stored, the socket holds a reference until it's written.
+// The creator tells how to free it.
+struct SharedString
+{
+    std::atomic<int>  refs;
+    void (*deleter)(SharedString* );
+    std::size_t size;
+    char        data[1]; // ends with '\0'
+
+    void Ref()
+    {
+        refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Unref()
+    {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            deleter(this);
+    }
+
+    bool IsShared() const
+    {
+        return refs.load(std::memory_order_acquire) > 1;
+    }
+};
+
+#endif
+
@@ -95,6 +95,16 @@ void Socket::SetRcvBuf(int sock, socklen_t winsize)
     ::setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&winsize, sizeof(winsize));
 }
 
+bool Socket::SetBusyPoll(int sock, int usec)
+{
+#if defined(SO_BUSY_POLL)
+    // greater than net.core.busy_read needs CAP_NET_ADMIN
+    return ::setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, (const char*)&usec, sizeof(usec)) == 0;
+#else
+    return false;
+#endif
+}
+
 void Socket::SetReuseAddr(int sock)
 {
     int reuse = 1;
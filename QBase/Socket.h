@@ -191,6 +191,8 @@ public:
     static void SetSndBuf(int sock, socklen_t size = 128 * 1024);
     static void SetRcvBuf(int sock, socklen_t size = 128 * 1024);
     static void SetReuseAddr(int sock);
+    // recv spins in driver for usec before sleeping, linux only
+    static bool SetBusyPoll(int sock, int usec);
     static bool GetLocalAddr(int sock, SocketAddr& );
     static bool GetPeerAddr(int sock,  SocketAddr& );
     static void GetMyAddrInfo(unsigned int* addrs, int num);
@@ -2,6 +2,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <netinet/tcp.h>
+#include <algorithm>
+#include <cassert>
 
 #include "StreamSocket.h"
 #include "Server.h"
@@ -10,7 +12,14 @@
 
 using std::size_t;
 
-StreamSocket::StreamSocket()
+// the socket parsing on this thread, and the bytes of replies not published
+static __thread StreamSocket* s_batching = nullptr;
+static __thread size_t s_batchBytes = 0;
+
+// a bigger batch is sent before parse is done
+static const size_t kMaxBatchBytes = 64 * 1024;
+
+StreamSocket::StreamSocket() : ready_(false)
 {
 }
 
@@ -44,27 +53,50 @@ bool StreamSocket::Init(int fd, const SocketAddr& peer)
 
 int StreamSocket::Recv()
 {
+    BufferSequence  buffers;
+    if (!PrepareRecv(buffers))
+        return 0;
+
+    int ret = static_cast<int>(::readv(localSock_, buffers.buffers, static_cast<int>(buffers.count)));
+    return RecvDone(ret == ERRORSOCKET ? -errno : ret);
+}
+
+bool StreamSocket::PrepareRecv(BufferSequence& buffers)
+{
+    recvLock_.lock();
+
     if (recvBuf_.Capacity() == 0)
     {
-        recvBuf_.InitCapacity(64 * 1024); // First recv data, allocate buffer
+        recvBuf_.InitCapacity(kRecvBufferSize); // First recv data, allocate buffer
     }
     
-    BufferSequence  buffers;
     recvBuf_.GetSpace(buffers);
     if (buffers.count == 0)
     {
-        WRN << "Recv buffer is full";
-        return 0;
+        recvLock_.unlock();
+
+        // logic thread will grow it
+        DBG << "Recv buffer is full";
+        return false;
     }
 
-    int ret = static_cast<int>(::readv(localSock_, buffers.buffers, static_cast<int>(buffers.count)));
-    if (ret == ERRORSOCKET && (EAGAIN == errno || EWOULDBLOCK == errno))
+    return true;
+}
+
+int StreamSocket::RecvDone(int result)
+{
+    if (result > 0)
+        recvBuf_.AdjustWritePtr(result);
+
+    recvLock_.unlock();
+
+    if (result == -EAGAIN || result == -EWOULDBLOCK)
         return 0;
 
-    if (ret > 0)
-        recvBuf_.AdjustWritePtr(ret);
+    if (result < 0)
+        return ERRORSOCKET;
 
-    return (0 == ret) ? EOFSOCKET : ret;
+    return (0 == result) ? EOFSOCKET : result;
 }
 
 
@@ -75,16 +107,25 @@ int StreamSocket::_Send(const BufferSequence& bf)
         return 0;
 
     int ret = static_cast<int>(::writev(localSock_, bf.buffers, static_cast<int>(bf.count)));
-    if (ERRORSOCKET == ret && (EAGAIN == errno || EWOULDBLOCK == errno))
+    return _SendResult(total, ret == ERRORSOCKET ? -errno : ret);
+}
+
+int StreamSocket::_SendResult(size_t total, int ret)
+{
+    if (ret == -EAGAIN || ret == -EWOULDBLOCK)
     {
         epollOut_ = true;
         ret = 0;
     }
-    else if (ret > 0 && static_cast<size_t>(ret) < total)
+    else if (ret < 0)
+    {
+        ret = ERRORSOCKET;
+    }
+    else if (static_cast<size_t>(ret) < total)
     {
         epollOut_ = true;
     }
-    else if (static_cast<size_t>(ret) == total)
+    else
     {
         epollOut_ = false;
     }
@@ -95,12 +136,35 @@ int StreamSocket::_Send(const BufferSequence& bf)
 
 bool StreamSocket::SendPacket(const void* data, size_t bytes)
 {
-    if (data && bytes > 0)
+    if (!data || bytes == 0)
+        return true;
+
+    if (s_batching == this)
+    {
+        sendBuf_.Write(data, bytes, false);
+
+        s_batchBytes += bytes;
+        if (s_batchBytes >= kMaxBatchBytes)
+            FlushReplies();
+    }
+    else
+    {
+        // the ones batched are published too
         sendBuf_.Write(data, bytes);
+    }
 
     return true;
 }
 
+void StreamSocket::FlushReplies()
+{
+    if (s_batching != this || s_batchBytes == 0)
+        return;
+
+    sendBuf_.Publish();
+    s_batchBytes = 0;
+}
+
 bool StreamSocket::SendPacket(Buffer& bf)
 {
     return SendPacket(bf.ReadAddr(), bf.ReadableSize());
@@ -114,12 +178,51 @@ bool StreamSocket::SendPacket(AttachedBuffer& af)
 
 bool StreamSocket::SendPacket(qedis::UnboundedBuffer& ubf)
 {
-    return SendPacket(ubf.ReadAddr(), ubf.ReadableSize());
+    const auto& refs = ubf.Refs();
+    if (refs.empty())
+        return SendPacket(ubf.ReadAddr(), ubf.ReadableSize());
+
+    // the shared strings between the data, published together
+    const char* data = ubf.ReadAddr();
+    size_t pos = 0;
+    size_t bytes = ubf.ReadableSize();
+    for (const auto& ref : refs)
+    {
+        sendBuf_.Write(data + pos, ref.offset - pos, false);
+        sendBuf_.Write(ref.str, false);
+
+        pos = ref.offset;
+        bytes += ref.str->size;
+    }
+
+    sendBuf_.Write(data + pos, ubf.ReadableSize() - pos, false);
+
+    if (s_batching == this)
+    {
+        s_batchBytes += bytes;
+        if (s_batchBytes >= kMaxBatchBytes)
+            FlushReplies();
+    }
+    else
+    {
+        sendBuf_.Publish();
+    }
+
+    return true;
 }
 
 bool StreamSocket::OnReadable()
 {
-    int nBytes = StreamSocket::Recv();
+    return _OnRecv(StreamSocket::Recv());
+}
+
+bool StreamSocket::OnRecvDone(int result)
+{
+    return _OnRecv(RecvDone(result));
+}
+
+bool StreamSocket::_OnRecv(int nBytes)
+{
     if (nBytes < 0)
     {
         INF << __FUNCTION__ << " failed, peer address ("
@@ -131,21 +234,40 @@ bool StreamSocket::OnReadable()
         return false;
     }
 
+    if (nBytes > 0)
+        _NotifyReady();
+
     return true;
 }
 
-bool StreamSocket::Send()
+void StreamSocket::_NotifyReady()
 {
-    if (epollOut_)
-        return true;
+    if (Server::Instance())
+        Server::Instance()->NotifyReady(std::static_pointer_cast<StreamSocket>(shared_from_this()));
+}
 
+int StreamSocket::Send()
+{
     BufferSequence  bf;
-    sendBuf_.ProcessBuffer(bf);
-    
-    size_t  total = bf.TotalBytes();
-    if (total == 0)  return true;
+    if (!PrepareSend(bf))
+        return 0;
     
-    int  nSent = _Send(bf);
+    int ret = static_cast<int>(::writev(localSock_, bf.buffers, static_cast<int>(bf.count)));
+    return SendDone(bf.TotalBytes(), ret == ERRORSOCKET ? -errno : ret);
+}
+
+bool StreamSocket::PrepareSend(BufferSequence& bf)
+{
+    if (epollOut_)
+        return false;
+
+    sendBuf_.ProcessBuffer(bf);
+    return bf.TotalBytes() > 0;
+}
+
+int StreamSocket::SendDone(size_t total, int result)
+{
+    int  nSent = _SendResult(total, result);
     
     if (nSent > 0)
     {
@@ -162,7 +284,7 @@ bool StreamSocket::Send()
             << ", register write event";
     }
     
-    return  nSent >= 0;
+    return  nSent;
 }
 
 // drive by EPOLLOUT
@@ -209,6 +331,8 @@ bool StreamSocket::OnError()
         if (onDisconnect_)
             onDisconnect_();
 
+        // let logic thread remove me
+        _NotifyReady();
         return true;
     }
         
@@ -217,14 +341,25 @@ bool StreamSocket::OnError()
 
 bool StreamSocket::DoMsgParse()
 {
+    assert (!s_batching);
+    s_batching = this;
+
     bool busy = false;
     while (!recvBuf_.IsEmpty())
     {
         BufferSequence  datum;
         recvBuf_.GetDatum(datum, recvBuf_.ReadableSize());
 
-        AttachedBuffer af(datum);
-        auto  bodyLen = _HandlePacket(af.ReadAddr(), af.ReadableSize());
+        // Parse the contiguous part in place first. Only if nothing can be
+        // handled there, the data wraps around the ring buffer, join it.
+        auto  bodyLen = _HandlePacket(static_cast<const char* >(datum.buffers[0].iov_base),
+                                      datum.buffers[0].iov_len);
+        if (bodyLen == 0 && datum.count > 1 && !Invalid())
+        {
+            AttachedBuffer af(datum);
+            bodyLen = _HandlePacket(af.ReadAddr(), af.ReadableSize());
+        }
+
         if (bodyLen > 0)
         {
             busy = true;
@@ -236,6 +371,58 @@ bool StreamSocket::DoMsgParse()
         }
     }
 
+    FlushReplies();
+    s_batching = nullptr;
+
+    _AdjustRecvBuffer();
     return  busy;
 }
 
+void StreamSocket::_AdjustRecvBuffer()
+{
+    if (recvBuf_.IsEmpty())
+    {
+        // all parsed, the buffer goes back to pool
+        std::lock_guard<std::mutex>  guard(recvLock_);
+        if (recvBuf_.IsEmpty())
+            recvBuf_.Release();
+
+        return;
+    }
+
+    // recv thread doesn't change the capacity of a buffer with data
+    const std::size_t cap = recvBuf_.Capacity();
+    const std::size_t len = recvBuf_.ReadableSize();
+
+    if (len + 1 >= cap)
+    {
+        // full of an incomplete request
+        if (cap >= kMaxRecvBufferSize)
+        {
+            WRN << "Recv buffer reaches limit " << cap
+                << ", peer address (" << peerAddr_.ToString() << ")";
+            return;
+        }
+
+        std::lock_guard<std::mutex>  guard(recvLock_);
+        recvBuf_.Resize(cap * 2);
+    }
+    else if (cap > kRecvBufferSize && len < cap / 4)
+    {
+        // shrink after a burst
+        std::lock_guard<std::mutex>  guard(recvLock_);
+        recvBuf_.Resize(std::max(RoundUp2Power(recvBuf_.ReadableSize() * 2), kRecvBufferSize));
+    }
+}
+
+void StreamSocket::GetBufferStats(BufferStats& stats)
+{
+    {
+        std::lock_guard<std::mutex>  guard(recvLock_);
+        stats.recvCapacity = recvBuf_.Capacity();
+        stats.recvBytes = stats.recvCapacity ? recvBuf_.ReadableSize() : 0;
+    }
+
+    sendBuf_.GetStats(stats.sendBytes, stats.sendMemory);
+}
+
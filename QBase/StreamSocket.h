@@ -4,6 +4,7 @@
 
 #include "AsyncBuffer.h"
 #include "Socket.h"
+#include <mutex>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -38,13 +39,44 @@ public:
 
     bool  DoMsgParse(); // false if no msg
 
+    // The replies to the requests of one DoMsgParse are written to the send
+    // buffer at once when it's done. Send them now, before another thread
+    // sends to me.
+    void  FlushReplies();
+
     void  SetOnDisconnect(const std::function<void ()>& cb = std::function<void ()>()) { onDisconnect_ = cb; }
     
-    // send thread
-    bool  Send();
+    // send thread, return bytes sent, -1 if error
+    int   Send();
+
+    // Recv and Send split for batched I/O, see UringPoller. The recv buffer
+    // is locked from PrepareRecv to RecvDone; result is bytes or -errno.
+    bool  PrepareRecv(BufferSequence& buffers);
+    int   RecvDone(int result);
+    bool  OnRecvDone(int result); // like OnReadable
+    bool  PrepareSend(BufferSequence& bf);
+    int   SendDone(std::size_t total, int result);
+
+    // ready queue of TaskManager, false if already marked
+    bool  MarkReady()  { return !ready_.exchange(true); }
+    void  ClearReady() { ready_ = false; }
     
     const SocketAddr& GetPeerAddr() const { return peerAddr_; }
 
+    // bytes buffered and the capacity of the buffers, for client list
+    struct BufferStats
+    {
+        std::size_t recvBytes = 0;
+        std::size_t recvCapacity = 0;
+        std::size_t sendBytes = 0;
+        std::size_t sendMemory = 0;
+    };
+    void  GetBufferStats(BufferStats& stats);
+
+    // the first recv buffer, it grows for a bigger request
+    static const std::size_t kRecvBufferSize = 16 * 1024;
+    static const std::size_t kMaxRecvBufferSize = 1024 * 1024 * 1024;
+
 protected:
     SocketAddr  peerAddr_;
 
@@ -52,6 +84,10 @@ private:
     std::function<void ()> onDisconnect_;
 
     int    _Send(const BufferSequence& bf);
+    int    _SendResult(std::size_t total, int result);
+    bool   _OnRecv(int nBytes);
+    void   _NotifyReady();
+    void   _AdjustRecvBuffer();
     virtual PacketLength _HandlePacket(const char* msg, std::size_t len) = 0;
 
     // For human readability
@@ -62,8 +98,15 @@ private:
         EOFSOCKET     = -2,
     };
 
-    Buffer recvBuf_;
+    // Taken from pool by the recv thread when data comes, returned by the
+    // logic thread when all parsed. Only the logic thread moves the data to
+    // another buffer, both hold the lock when they change the buffer.
+    PooledBuffer recvBuf_;
+    std::mutex   recvLock_;
+
     AsyncBuffer sendBuf_;
+
+    std::atomic<bool> ready_;
 };
 
 template <int N>
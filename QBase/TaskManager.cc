@@ -1,4 +1,14 @@
+
 #include <cassert>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#if defined(__gnu_linux__)
+#include <sys/eventfd.h>
+#endif
+
 #include "TaskManager.h"
 #include "StreamSocket.h"
 #include "Log/Logger.h"
@@ -6,18 +16,55 @@
 namespace Internal
 {
 
+TaskManager::TaskManager() : newCnt_(0), waiting_(false)
+{
+#if defined(__gnu_linux__)
+    wakeFds_[0] = wakeFds_[1] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+    if (::pipe(wakeFds_) == 0)
+    {
+        for (int fd : wakeFds_)
+        {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+    else
+    {
+        wakeFds_[0] = wakeFds_[1] = -1;
+    }
+#endif
+}
+
 TaskManager::~TaskManager()
 {
     assert(Empty() && "Why you do not clear container before exit?");
+
+    if (wakeFds_[0] != -1)
+        ::close(wakeFds_[0]);
+    if (wakeFds_[1] != wakeFds_[0])
+        ::close(wakeFds_[1]);
 }
-    
-     
+
+void TaskManager::Clear()
+{
+    tcpSockets_.clear();
+
+    // release the sockets in queue
+    PTCPSOCKET  task;
+    while (readyTasks_.Pop(task))
+        ;
+}
+
 bool TaskManager::AddTask(PTCPSOCKET task)
-{   
-    std::lock_guard<std::mutex> guard(lock_);
-    newTasks_.push_back(task);
-    ++ newCnt_;
+{
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        newTasks_.push_back(task);
+        ++ newCnt_;
+    }
 
+    _Wakeup();
     return true;
 }
 
@@ -29,23 +76,72 @@ TaskManager::PTCPSOCKET TaskManager::FindTCP(unsigned int id) const
         if (it != tcpSockets_.end())
             return it->second;
     }
-           
+
     return PTCPSOCKET();
 }
 
+void TaskManager::ForEachTCP(const std::function<void (const PTCPSOCKET& )>& func) const
+{
+    for (const auto& kv : tcpSockets_)
+        func(kv.second);
+}
+
 bool TaskManager::_AddTask(PTCPSOCKET task)
-{   
+{
     //bool succ = tcpSockets_.insert(std::map<int, PTCPSOCKET>::value_type(task->GetID(), task)).second;
     bool succ = tcpSockets_.insert({task->GetID(), task}).second;
-    return succ;    
+    return succ;
 }
 
 
-void TaskManager::_RemoveTask(std::map<int, PTCPSOCKET>::iterator& it)    
+void TaskManager::_RemoveTask(std::map<int, PTCPSOCKET>::iterator& it)
 {
     tcpSockets_.erase(it ++);
 }
 
+void TaskManager::NotifyReady(const PTCPSOCKET& task)
+{
+    // already in queue, not parsed yet
+    if (!task->MarkReady())
+        return;
+
+    readyTasks_.Push(PTCPSOCKET(task));
+    _Wakeup();
+}
+
+void TaskManager::_Wakeup()
+{
+    if (!waiting_.exchange(false))
+        return;
+
+    uint64_t one = 1;
+    if (::write(wakeFds_[1], &one, sizeof one) < 0 && errno != EAGAIN)
+        ERR << "Failed to wake up logic thread, errno " << errno;
+}
+
+void TaskManager::Wait(int timeoutMs)
+{
+    waiting_ = true;
+
+    // check again, a producer may push before waiting_ is set
+    if (newCnt_ == 0 && readyTasks_.Empty() && wakeFds_[0] != -1)
+    {
+        struct pollfd  pfd;
+        pfd.fd = wakeFds_[0];
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        if (::poll(&pfd, 1, timeoutMs) > 0)
+        {
+            uint64_t  buf[16];
+            while (::read(wakeFds_[0], buf, sizeof buf) > 0)
+                ;
+        }
+    }
+
+    waiting_ = false;
+}
+
 
 bool TaskManager::DoMsgParse()
 {
@@ -73,36 +169,45 @@ bool TaskManager::DoMsgParse()
                     << task->GetID();
 
                 task->OnConnect();
+
+                // data may arrive before the socket is added
+                task->ClearReady();
+                NotifyReady(task);
             }
         }
     }
 
     bool busy = false;
 
-    for (auto it(tcpSockets_.begin()); it != tcpSockets_.end(); )
+    // only the sockets in ready queue, not all the connections
+    PTCPSOCKET  task;
+    while (readyTasks_.Pop(task))
     {
-        if (!it->second || it->second->Invalid())
+        // cleared before parse, data comes after this will notify again
+        task->ClearReady();
+
+        auto it = tcpSockets_.find(task->GetID());
+        if (it == tcpSockets_.end() || it->second != task)
+            continue; // not added yet, or removed
+
+        if (task->Invalid())
         {
-            if (it->second)
-            {
-                INF << "Close connection from "
-                    << it->second->GetPeerAddr().ToString()
-                    << ", id = "
-                    << it->second->GetID();
+            INF << "Close connection from "
+                << task->GetPeerAddr().ToString()
+                << ", id = "
+                << task->GetID();
 
-                it->second->OnDisconnect();
-            }
+            task->OnDisconnect();
             _RemoveTask(it);
         }
         else
         {
-            if (it->second->DoMsgParse() && !busy)
+            if (task->DoMsgParse() && !busy)
                 busy = true;
-
-            ++ it;
         }
     }
 
+    task.reset();
     return busy;
 }
 
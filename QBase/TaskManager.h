@@ -3,9 +3,11 @@
 
 #include <vector>
 #include <map>
+#include <functional>
 #include <mutex>
 #include <memory>
 #include <atomic>
+#include "MPSCQueue.h"
 
 class StreamSocket;
 
@@ -18,28 +20,43 @@ class TaskManager
     typedef std::vector<PTCPSOCKET>     NEWTASKS_T;
 
 public:
-    TaskManager() : newCnt_(0) { }
+    TaskManager();
     ~TaskManager();
     
     bool AddTask(PTCPSOCKET );
 
     bool Empty() const { return tcpSockets_.empty(); }
-    void Clear()  { tcpSockets_.clear(); }
+    void Clear();
     PTCPSOCKET  FindTCP(unsigned int id) const;
     
     size_t TCPSize() const  {  return  tcpSockets_.size(); }
+    void   ForEachTCP(const std::function<void (const PTCPSOCKET& )>& func) const;
+
+    // Any thread: the socket has new data, or became invalid, or can go on
+    // parsing its buffered data. Only ready sockets are parsed by DoMsgParse.
+    void NotifyReady(const PTCPSOCKET& task);
 
     bool DoMsgParse();
 
+    // Logic thread: sleep until some socket is ready or timeout
+    void Wait(int timeoutMs);
+
 private:
     bool _AddTask(PTCPSOCKET task);
     void _RemoveTask(std::map<int, PTCPSOCKET>::iterator& );
+    void _Wakeup();
     std::map<int, PTCPSOCKET>  tcpSockets_;
 
     // Lock for new tasks
     std::mutex      lock_;
     NEWTASKS_T      newTasks_; 
     std::atomic<int> newCnt_; // vector::empty() is not thread-safe !!!
+
+    MPSCQueue<PTCPSOCKET> readyTasks_;
+
+    // eventfd(pipe on osx) to wake up the logic thread
+    int             wakeFds_[2];
+    std::atomic<bool> waiting_;
 };
 
 }
@@ -1,9 +1,23 @@
 #include "ThreadPool.h"
 
+#if defined(__gnu_linux__)
+#include <pthread.h>
+#include <sched.h>
+
+// the cpus of process, for the workers created by a bound thread
+static cpu_set_t         s_defaultCpus;
+static std::atomic<bool> s_bound {false};
+#endif
+
 __thread bool ThreadPool::working_ = true;
 
 ThreadPool::ThreadPool() : waiters_(0), shutdown_(false)
 {
+#if defined(__gnu_linux__)
+    CPU_ZERO(&s_defaultCpus);
+    ::sched_getaffinity(0, sizeof s_defaultCpus, &s_defaultCpus);
+#endif
+
     monitor_ = std::thread([this]() { this->_MonitorRoutine(); } );
     maxIdleThread_ = std::max(1U, std::thread::hardware_concurrency());
     pendingStopSignal_ = 0;
@@ -58,9 +72,38 @@ void   ThreadPool::_CreateWorker()
     workers_.push_back(std::move(t));
 }
 
+bool   ThreadPool::BindCpu(int cpu)
+{
+#if defined(__gnu_linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+
+    // default cpus saved before any thread is bound
+    Instance();
+
+    cpu_set_t  cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    if (::pthread_setaffinity_np(::pthread_self(), sizeof cpus, &cpus) != 0)
+        return false;
+
+    s_bound = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
 void   ThreadPool::_WorkerRoutine()
 {
     working_ = true;
+
+#if defined(__gnu_linux__)
+    // not inherit the cpu of creator
+    if (s_bound)
+        ::pthread_setaffinity_np(::pthread_self(), sizeof s_defaultCpus, &s_defaultCpus);
+#endif
     
     while (working_)
     {
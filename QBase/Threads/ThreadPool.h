@@ -26,6 +26,10 @@ public:
     
     void    JoinAll();
     void    SetMaxIdleThread(unsigned int m);
+
+    // Bind the calling thread to a cpu, false if failed or not supported.
+    // The workers created later by a bound thread are not bound.
+    static bool BindCpu(int cpu);
     
 private:
     ThreadPool();
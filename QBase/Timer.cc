@@ -109,12 +109,6 @@ void Time::Now()
     valid_ = false;
 }
 
-// from 2015 to 2025
-static const char* YEAR[] = { "2015", "2016", "2017", "2018",
-    "2019", "2020", "2021", "2022", "2023", "2024", "2025",
-     nullptr,
-};
-
 std::size_t Time::FormatTime(char* buf) const
 {
     static char NUMBER[60][2] = {""};
@@ -134,7 +128,11 @@ std::size_t Time::FormatTime(char* buf) const
     _UpdateTm();
     
 #if  1
-    memcpy(buf, YEAR[tm_.tm_year + 1900 - 2015], 4);
+    {
+        char tmp[16];
+        snprintf(tmp, sizeof tmp, "%04d", tm_.tm_year + 1900);
+        memcpy(buf, tmp, 4);
+    }
     buf[4] = '-';
     memcpy(buf + 5, NUMBER[tm_.tm_mon + 1], 2);
     buf[7] = '-';
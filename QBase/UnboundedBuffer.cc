@@ -123,6 +123,7 @@ void UnboundedBuffer::Shrink(bool tight)
 void UnboundedBuffer::Clear()
 {
     readPos_ = writePos_ = 0; 
+    _ClearRefs();
 }
 
 
@@ -131,6 +132,25 @@ void UnboundedBuffer::Swap(UnboundedBuffer& buf)
     buffer_.swap(buf.buffer_);
     std::swap(readPos_, buf.readPos_);
     std::swap(writePos_, buf.writePos_);
+    refs_.swap(buf.refs_);
+}
+
+bool UnboundedBuffer::PushRef(SharedString* str)
+{
+    if (!refsEnabled_)
+        return false;
+
+    str->Ref();
+    refs_.push_back(Ref {ReadableSize(), str});
+    return true;
+}
+
+void UnboundedBuffer::_ClearRefs()
+{
+    for (const auto& ref : refs_)
+        ref.str->Unref();
+
+    refs_.clear();
 }
 
 #if 0
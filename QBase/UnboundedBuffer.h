@@ -5,6 +5,8 @@
 #include <cstring>
 #include <vector>
 
+#include "SharedString.h"
+
 namespace qedis
 {
 
@@ -13,10 +15,16 @@ class UnboundedBuffer
 public:
     UnboundedBuffer() :
         readPos_(0),
-        writePos_(0)
+        writePos_(0),
+        refsEnabled_(false)
     {
     }
 
+   ~UnboundedBuffer() { _ClearRefs(); }
+
+    UnboundedBuffer(const UnboundedBuffer& ) = delete;
+    void operator= (const UnboundedBuffer& ) = delete;
+
     std::size_t PushDataAt(const void* pData, std::size_t nSize, std::size_t offset = 0);
     std::size_t PushData(const void* pData, std::size_t nSize);
     std::size_t Write(const void* pData, std::size_t nSize);
@@ -32,17 +40,36 @@ public:
     bool IsEmpty() const { return ReadableSize() == 0; }
     std::size_t ReadableSize() const {  return writePos_ - readPos_;  }
     std::size_t WritableSize() const {  return buffer_.size() - writePos_;  }
+    std::size_t Capacity() const {  return buffer_.size();  }
 
     void Shrink(bool tight = false);
     void Clear();
     void Swap(UnboundedBuffer& buf);
 
+    // Big strings are referenced instead of copied, only for the buffer
+    // sent by StreamSocket::SendPacket. A ref is sent after the readable
+    // data before its offset, so don't read it by ReadAddr.
+    struct Ref
+    {
+        std::size_t    offset;
+        SharedString*  str;
+    };
+
+    void EnableRefs(bool enable) { refsEnabled_ = enable; }
+    bool PushRef(SharedString* str); // false if not enabled, copy it then
+    const std::vector<Ref>& Refs() const { return refs_; }
+
     static const std::size_t  MAX_BUFFER_SIZE;
 private:
     void     _AssureSpace(std::size_t size);
+    void     _ClearRefs();
+
     std::size_t readPos_;
     std::size_t writePos_;
     std::vector<char>  buffer_;
+
+    bool refsEnabled_;
+    std::vector<Ref>  refs_;
 };
 
 }
@@ -0,0 +1,488 @@
+#if defined(__gnu_linux__)
+
+#include "UringPoller.h"
+#include "Log/Logger.h"
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+// user_data: the low bits tell what completes
+static const uint64_t kTagPoll   = 0;
+static const uint64_t kTagIo     = 1;
+static const uint64_t kTagIgnore = 2;
+static const uint64_t kTagMask   = 3;
+
+static inline uint64_t PollData(int fd, uint32_t gen)
+{
+    return (static_cast<uint64_t>(fd) << 32) | (static_cast<uint64_t>(gen & 0x3FFFFFFF) << 2) | kTagPoll;
+}
+
+UringPoller::UringPoller() : sqRing_(MAP_FAILED),
+                             sqRingSize_(0),
+                             cqRing_(MAP_FAILED),
+                             cqRingSize_(0),
+                             sqes_(nullptr),
+                             sqesSize_(0),
+                             sqHead_(nullptr),
+                             sqTail_(nullptr),
+                             sqArray_(nullptr),
+                             sqMask_(0),
+                             sqEntries_(0),
+                             sqLocalTail_(0),
+                             cqHead_(nullptr),
+                             cqTail_(nullptr),
+                             cqMask_(0),
+                             cqes_(nullptr),
+                             ioPending_(0),
+                             ioBatch_(0)
+{
+}
+
+UringPoller::~UringPoller()
+{
+    if (sqes_)
+        ::munmap(sqes_, sqesSize_);
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+        ::munmap(cqRing_, cqRingSize_);
+    if (sqRing_ != MAP_FAILED)
+        ::munmap(sqRing_, sqRingSize_);
+
+    if (multiplexer_ != -1)
+    {
+        INF << "close io_uring:  " << multiplexer_;
+        ::close(multiplexer_);
+    }
+}
+
+bool UringPoller::Init(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+
+    multiplexer_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (multiplexer_ < 0)
+    {
+        ERR << "io_uring_setup failed, errno " << errno;
+        return false;
+    }
+
+    // wait with timeout, no lost completion
+    const unsigned kNeeded = IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+    if ((params.features & kNeeded) != kNeeded)
+    {
+        ERR << "io_uring is too old, features " << params.features;
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     multiplexer_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+        return false;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        cqRing_ = sqRing_;
+    else
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         multiplexer_, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED)
+        return false;
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        multiplexer_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return false;
+
+    sqes_ = static_cast<io_uring_sqe* >(sqes);
+
+    char* sq = static_cast<char* >(sqRing_);
+    sqHead_  = reinterpret_cast<unsigned* >(sq + params.sq_off.head);
+    sqTail_  = reinterpret_cast<unsigned* >(sq + params.sq_off.tail);
+    sqArray_ = reinterpret_cast<unsigned* >(sq + params.sq_off.array);
+    sqMask_  = *reinterpret_cast<unsigned* >(sq + params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqLocalTail_ = *sqTail_;
+
+    char* cq = static_cast<char* >(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned* >(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned* >(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned* >(cq + params.cq_off.ring_mask);
+    cqes_   = reinterpret_cast<io_uring_cqe* >(cq + params.cq_off.cqes);
+
+    INF << "create io_uring:  " << multiplexer_ << ", entries " << sqEntries_;
+    return true;
+}
+
+bool UringPoller::AddSocket(int sock, int events, void* userPtr)
+{
+    return _Update(sock, events, userPtr);
+}
+
+bool UringPoller::ModSocket(int sock, int events, void* userPtr)
+{
+    return _Update(sock, events, userPtr);
+}
+
+bool UringPoller::DelSocket(int sock, int events)
+{
+    return _Update(sock, 0, nullptr);
+}
+
+bool UringPoller::_Update(int sock, int events, void* userPtr)
+{
+    if (sock < 0)
+        return false;
+
+    if (static_cast<std::size_t>(sock) >= entries_.size())
+        entries_.resize(sock + 1);
+
+    Entry& e = entries_[sock];
+    if (e.events != events || e.userPtr != userPtr)
+    {
+        if (e.armed)
+        {
+            // the old request completes with ECANCELED, dropped by gen.
+            // No sqe, it stays till the fd fires or closes, dropped too
+            io_uring_sqe* sqe = _GetSqe();
+            if (sqe)
+            {
+                sqe->opcode = IORING_OP_POLL_REMOVE;
+                sqe->fd = -1;
+                sqe->addr = PollData(sock, e.gen);
+                sqe->user_data = kTagIgnore;
+            }
+
+            e.armed = false;
+        }
+
+        // and the fired not returned yet
+        ++ e.gen;
+        e.fired = false;
+    }
+
+    e.events = events;
+    e.userPtr = userPtr;
+
+    if (events != 0 && !e.armed && !e.queued && !e.fired)
+    {
+        e.queued = true;
+        rearm_.push_back(sock);
+    }
+
+    return true;
+}
+
+void UringPoller::_Rearm()
+{
+    for (std::size_t i = 0; i < rearm_.size(); ++ i)
+    {
+        Entry& e = entries_[rearm_[i]];
+        if (e.events == 0 || e.armed)
+        {
+            e.queued = false;
+            continue;
+        }
+
+        unsigned mask = 0;
+        if (e.events & EventTypeRead)
+            mask |= POLLIN;
+        if (e.events & EventTypeWrite)
+            mask |= POLLOUT;
+
+        io_uring_sqe* sqe = _GetSqe();
+        if (!sqe)
+        {
+            // the rest stay queued, next Poll retries
+            rearm_.erase(rearm_.begin(), rearm_.begin() + i);
+            return;
+        }
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = rearm_[i];
+        sqe->poll32_events = mask;
+        sqe->user_data = PollData(rearm_[i], e.gen);
+
+        e.queued = false;
+        e.armed = true;
+    }
+
+    rearm_.clear();
+}
+
+io_uring_sqe* UringPoller::_GetSqe()
+{
+    // full, let kernel take them. It may be busy with a full cq, reap it;
+    // on error fail the prepared io and give up, the caller retries later
+    while (sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_)
+    {
+        const int ret = _Enter(0, 0);
+        _Reap();
+        if (ret < 0)
+        {
+            _FailIo(ret);
+            return nullptr;
+        }
+    }
+
+    const unsigned index = sqLocalTail_ & sqMask_;
+    ++ sqLocalTail_;
+
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof *sqe);
+    sqArray_[index] = index;
+
+    return sqe;
+}
+
+int UringPoller::_Enter(unsigned minComplete, int timeoutMs)
+{
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+    const unsigned toSubmit = sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    if (minComplete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec  = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+
+            memset(&arg, 0, sizeof arg);
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+    }
+    else if (toSubmit == 0)
+    {
+        return 0;
+    }
+
+    const long ret = ::syscall(__NR_io_uring_enter, multiplexer_, toSubmit, minComplete, flags,
+                               (flags & IORING_ENTER_EXT_ARG) ? &arg : nullptr,
+                               (flags & IORING_ENTER_EXT_ARG) ? sizeof arg : 0);
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+    {
+        const int err = errno;
+        ERR << "io_uring_enter failed, errno " << err;
+        return -err;
+    }
+
+    return 0;
+}
+
+void UringPoller::_Reap()
+{
+    unsigned head = *cqHead_;
+    const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++ head)
+    {
+        const io_uring_cqe& cqe = cqes_[head & cqMask_];
+        const uint64_t data = cqe.user_data;
+
+        switch (data & kTagMask)
+        {
+        case kTagPoll:
+        {
+            const int sock = static_cast<int>(data >> 32);
+            Entry& e = entries_[sock];
+            if (data != PollData(sock, e.gen) || !e.armed)
+                break;
+
+            e.armed = false;
+            if (e.events == 0)
+                break;
+
+            FiredEvent fired;
+            fired.userdata = e.userPtr;
+
+            const int res = cqe.res;
+            if (res < 0 || (res & (POLLERR | POLLHUP | POLLNVAL)))
+                fired.events |= EventTypeError;
+            if (res > 0 && (res & POLLIN))
+                fired.events |= EventTypeRead;
+            if (res > 0 && (res & POLLOUT))
+                fired.events |= EventTypeWrite;
+
+            // armed again when returned, never fired twice
+            e.fired = true;
+            fired_.push_back(Fired {fired, sock, e.gen});
+            break;
+        }
+
+        case kTagIo:
+        {
+            const std::size_t index = static_cast<uint32_t>(data) >> 2;
+            if ((data >> 32) != ioBatch_ || index >= ioSlots_.size() || ioSlots_[index].done)
+                break;
+
+            IoSlot& slot = ioSlots_[index];
+            slot.done = true;
+
+            IoResult result;
+            result.userdata = slot.userPtr;
+            result.result = cqe.res;
+            ioResults_.push_back(result);
+
+            assert (ioPending_ > 0);
+            -- ioPending_;
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+int UringPoller::Poll(std::vector<FiredEvent>& events, std::size_t maxEvent, int timeoutMs)
+{
+    if (maxEvent == 0)
+        return 0;
+
+    // the ones fired while doing I/O are returned at once
+    _Rearm();
+    if (_Enter(fired_.empty() ? 1 : 0, timeoutMs) < 0)
+        return -1;
+
+    _Reap();
+
+    std::size_t nTaken = 0, nFired = 0;
+    for (; nTaken < fired_.size() && nFired < maxEvent; ++ nTaken)
+    {
+        const Fired& f = fired_[nTaken];
+        Entry& e = entries_[f.sock];
+        if (e.gen != f.gen)
+            continue;
+
+        e.fired = false;
+        if (nFired >= events.size())
+            events.resize(nFired + 1);
+        events[nFired ++] = f.event;
+
+        if (!e.queued)
+        {
+            e.queued = true;
+            rearm_.push_back(f.sock);
+        }
+    }
+
+    fired_.erase(fired_.begin(), fired_.begin() + nTaken);
+    return static_cast<int>(nFired);
+}
+
+void UringPoller::PrepareRecv(int sock, const iovec* iov, std::size_t count, void* userPtr)
+{
+    _PrepareIo(IORING_OP_RECVMSG, sock, iov, count, userPtr);
+}
+
+void UringPoller::PrepareSend(int sock, const iovec* iov, std::size_t count, void* userPtr)
+{
+    _PrepareIo(IORING_OP_SENDMSG, sock, iov, count, userPtr);
+}
+
+void UringPoller::_PrepareIo(int op, int sock, const iovec* iov, std::size_t count, void* userPtr)
+{
+    assert (count > 0 && count <= kMaxIovec);
+
+    ioSlots_.emplace_back();
+    IoSlot& slot = ioSlots_.back();
+    std::copy(iov, iov + count, slot.iov);
+    slot.userPtr = userPtr;
+    slot.done = false;
+
+    memset(&slot.msg, 0, sizeof slot.msg);
+    slot.msg.msg_iov = slot.iov;
+    slot.msg.msg_iovlen = count;
+
+    // failed with the slots before it
+    io_uring_sqe* sqe = _GetSqe();
+    if (!sqe)
+        return;
+
+    sqe->opcode = static_cast<uint8_t>(op);
+    sqe->fd = sock;
+    sqe->addr = reinterpret_cast<uint64_t>(&slot.msg);
+    sqe->len = 1;
+    // EAGAIN instead of waiting in kernel
+    sqe->msg_flags = MSG_DONTWAIT | (op == IORING_OP_SENDMSG ? MSG_NOSIGNAL : 0);
+    sqe->user_data = (static_cast<uint64_t>(ioBatch_) << 32) |
+                     (static_cast<uint64_t>(ioSlots_.size() - 1) << 2) | kTagIo;
+
+    ++ ioPending_;
+}
+
+void UringPoller::SubmitIo(std::vector<IoResult>& results)
+{
+    while (ioPending_ > 0)
+    {
+        const int ret = _Enter(static_cast<unsigned>(ioPending_), -1);
+        if (ret < 0)
+        {
+            _FailIo(ret);
+            break;
+        }
+
+        _Reap();
+    }
+
+    results.clear();
+    results.swap(ioResults_);
+
+    ioSlots_.clear();
+    ++ ioBatch_;
+}
+
+void UringPoller::_FailIo(int err)
+{
+    // the ones not taken by kernel become nops, their slots are cleared
+    for (unsigned i = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE); i != sqLocalTail_; ++ i)
+    {
+        io_uring_sqe* sqe = &sqes_[sqArray_[i & sqMask_]];
+        if ((sqe->user_data & kTagMask) == kTagIo)
+        {
+            memset(sqe, 0, sizeof *sqe);
+            sqe->opcode = IORING_OP_NOP;
+            sqe->user_data = kTagIgnore;
+        }
+    }
+
+    _Reap();
+
+    // the sockets wait for their results, they'd never read again without.
+    // The taken ones don't block, MSG_DONTWAIT, a late completion is dropped
+    for (IoSlot& slot : ioSlots_)
+    {
+        if (slot.done)
+            continue;
+
+        slot.done = true;
+
+        IoResult result;
+        result.userdata = slot.userPtr;
+        result.result = err;
+        ioResults_.push_back(result);
+    }
+
+    ioPending_ = 0;
+}
+
+#endif
+
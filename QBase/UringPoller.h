@@ -0,0 +1,121 @@
+#ifndef BERT_URINGPOLLER_H
+#define BERT_URINGPOLLER_H
+
+#if defined(__gnu_linux__)
+
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include "Poller.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// Poller on io_uring, without liburing.
+// Readiness is one-shot poll requests armed again by the next Poll, so it's
+// level triggered like Epoller, and the requests of a loop are submitted
+// with the wait by one syscall. The recv and send of sockets can be batched
+// too, see PrepareRecv.
+// Only used by its own thread.
+class UringPoller : public Poller
+{
+public:
+    UringPoller();
+   ~UringPoller();
+
+    // false if io_uring is not supported
+    bool Init(unsigned entries = 1024);
+
+    bool AddSocket(int sock, int events, void* userPtr);
+    bool ModSocket(int sock, int events, void* userPtr);
+    bool DelSocket(int sock, int events);
+
+    int Poll(std::vector<FiredEvent>& events, std::size_t maxEvent, int timeoutMs);
+
+    // Batched I/O, the sockets are not blocked. The iovecs are copied, but
+    // the buffers must be there until SubmitIo returns.
+    struct IoResult
+    {
+        void* userdata;
+        int   result; // bytes, or -errno
+    };
+
+    void PrepareRecv(int sock, const iovec* iov, std::size_t count, void* userPtr);
+    void PrepareSend(int sock, const iovec* iov, std::size_t count, void* userPtr);
+
+    // submit the prepared and wait for all of them, by one syscall mostly.
+    // Every prepared one has its result, -errno if io_uring failed
+    void SubmitIo(std::vector<IoResult>& results);
+
+private:
+    struct Entry
+    {
+        int      events = 0;
+        void*    userPtr = nullptr;
+        uint32_t gen = 0;     // stale completions are dropped
+        bool     armed = false;
+        bool     queued = false;
+        bool     fired = false;  // not returned by Poll yet
+    };
+
+    struct Fired
+    {
+        FiredEvent event;
+        int        sock;
+        uint32_t   gen;
+    };
+
+    static const std::size_t kMaxIovec = 16;
+
+    struct IoSlot
+    {
+        msghdr  msg;
+        iovec   iov[kMaxIovec];
+        void*   userPtr;
+        bool    done;
+    };
+
+    bool  _Update(int sock, int events, void* userPtr);
+    void  _Rearm();
+    void  _PrepareIo(int op, int sock, const iovec* iov, std::size_t count, void* userPtr);
+    io_uring_sqe* _GetSqe();
+    int   _Enter(unsigned minComplete, int timeoutMs);
+    void  _Reap();
+    void  _FailIo(int err);
+
+    // the rings shared with kernel
+    void*  sqRing_;
+    std::size_t sqRingSize_;
+    void*  cqRing_;
+    std::size_t cqRingSize_;
+    io_uring_sqe* sqes_;
+    std::size_t sqesSize_;
+
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqArray_;
+    unsigned  sqMask_;
+    unsigned  sqEntries_;
+    unsigned  sqLocalTail_;
+
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned  cqMask_;
+    io_uring_cqe* cqes_;
+
+    std::vector<Entry>  entries_; // by fd
+    std::vector<int>    rearm_;
+    std::vector<Fired>  fired_;
+
+    std::deque<IoSlot>  ioSlots_;
+    std::size_t         ioPending_;
+    uint32_t            ioBatch_; // completions of old batches are dropped
+    std::vector<IoResult>  ioResults_;
+};
+
+#endif
+
+#endif
+
@@ -268,74 +268,67 @@ static void SaveStringObject(const QString& key, const QObject& obj, OutputMemor
 
 static void SaveListObject(const QString& key, const QObject& obj, OutputMemoryFile& file)
 {
-    auto list = obj.CastList();
-    if (list->empty())
+    const auto size = ListSize(obj);
+    if (size == 0)
         return;
 
-    WriteMultiBulkLong(list->size() + 2, file); // rpush listname + elems
+    WriteMultiBulkLong(size + 2, file); // rpush listname + elems
     WriteBulkString("rpush", 5, file);
     WriteBulkString(key, file);
 
-    for (const auto& elem : *list)
-    {
+    ListForEach(obj, [&file](const QString& elem) {
         WriteBulkString(elem, file);
-    }
+    });
 }
 
 static void SaveSetObject(const QString& key, const QObject& obj, OutputMemoryFile& file)
 {
-    auto set = obj.CastSet();
-    if (set->empty())
+    const auto size = SetSize(obj);
+    if (size == 0)
         return;
 
-    WriteMultiBulkLong(set->size() + 2, file); // sadd set_name + elems
+    WriteMultiBulkLong(size + 2, file); // sadd set_name + elems
     WriteBulkString("sadd", 4, file);
     WriteBulkString(key, file);
 
-    for (const auto& elem : *set)
-    {
+    SetForEach(obj, [&file](const QString& elem) {
         WriteBulkString(elem, file);
-    }
+    });
 }
 
 static void  SaveZSetObject(const QString& key, const QObject& obj, OutputMemoryFile& file)
 {
-    auto zset = obj.CastSortedSet();
-    if (zset->Size() == 0)
+    const auto size = SSetSize(obj);
+    if (size == 0)
         return;
 
-    WriteMultiBulkLong(2 * zset->Size() + 2, file); // zadd zset_name + (score + member)
+    WriteMultiBulkLong(2 * size + 2, file); // zadd zset_name + (score + member)
     WriteBulkString("zadd", 4, file);
     WriteBulkString(key, file);
 
-    for (const auto& pair : *zset)
-    {
-        const QString& member = pair.first;
-        double score          = pair.second;
-
+    SSetForEach(obj, [&file](const QString& member, double score) {
         char scoreStr[32];
         int  len = Double2Str(scoreStr, sizeof scoreStr, score);
 
         WriteBulkString(scoreStr, len, file);
         WriteBulkString(member, file);
-    }
+    });
 }
 
 static void SaveHashObject(const QString& key, const QObject& obj, OutputMemoryFile& file)
 {
-    auto hash = obj.CastHash();
-    if (hash->empty())
+    const auto size = HashSize(obj);
+    if (size == 0)
         return;
 
-    WriteMultiBulkLong(2* hash->size() + 2, file); // hmset hash_name + (key + value)
+    WriteMultiBulkLong(2 * size + 2, file); // hmset hash_name + (key + value)
     WriteBulkString("hmset", 5, file);
     WriteBulkString(key, file);
 
-    for (const auto& pair : *hash)
-    {
-        WriteBulkString(pair.first, file);
-        WriteBulkString(pair.second, file);
-    }
+    HashForEach(obj, [&file](const QString& field, const QString& value) {
+        WriteBulkString(field, file);
+        WriteBulkString(value, file);
+    });
 }
 
 
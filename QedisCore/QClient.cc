@@ -5,16 +5,21 @@
 #include "QCommand.h"
 #include "QConfig.h"
 #include "QSlowLog.h"
+#include "QShard.h"
 #include "QClient.h"
+#include "Server.h"
 
 namespace qedis
 {
 
-QClient*  QClient::s_current = 0;
+__thread QClient*  QClient::s_current = 0;
 
 std::set<std::weak_ptr<QClient>, std::owner_less<std::weak_ptr<QClient> > >
           QClient::s_monitors;
 
+// a bigger reply buffer is freed after the reply is sent
+static const std::size_t kMaxIdleReplyBuffer = 16 * 1024;
+
 PacketLength QClient::_ProcessInlineCmd(const char* buf,
                                         size_t bytes,
                                         std::vector<QString>& params)
@@ -106,15 +111,38 @@ static int ProcessMaster(const char* start, const char* end)
             //recv RDB file
             if (QREPL.GetRdbSize() == std::size_t(-1))
             {
+                if (*ptr == '+')
+                {
+                    // reply of psync: +FULLRESYNC <runid> <offset> or +CONTINUE
+                    const char* crlf = SearchCRLF(ptr, end - ptr);
+                    if (!crlf)
+                        return 0;
+
+                    QString line(ptr + 1, crlf);
+                    if (strncasecmp(line.c_str(), "FULLRESYNC ", 11) == 0)
+                    {
+                        char runid[64] = {};
+                        unsigned long offset = 0;
+                        if (sscanf(line.c_str() + 11, "%63s %lu", runid, &offset) == 2)
+                            QREPL.OnFullResync(runid, offset);
+                    }
+                    else if (strncasecmp(line.c_str(), "CONTINUE", 8) == 0)
+                    {
+                        QREPL.OnPartialResync();
+                    }
+
+                    return static_cast<int>(crlf + 2 - start);
+                }
+
                 ++ ptr; // skip $
                 int s;
-                if (QParseResult::ok == GetIntUntilCRLF(ptr, end - ptr, s))
-                {
-                    assert (s > 0); // check error for your masterauth or master config
+                if (QParseResult::ok != GetIntUntilCRLF(ptr, end - ptr, s))
+                    return 0;
 
-                    QREPL.SetRdbSize(s);
-                    USR << "recv rdb size " << s;
-                }
+                assert (s > 0); // check error for your masterauth or master config
+
+                QREPL.SetRdbSize(s);
+                USR << "recv rdb size " << s;
             }
             else
             {
@@ -142,18 +170,45 @@ PacketLength QClient::_HandlePacket(const char* start, std::size_t bytes)
 {
     s_current = this;
 
-    const char* const end   = start + bytes;
-    const char* ptr  = start;
-    
     if (GetPeerAddr() == QREPL.GetMasterAddr())
     {
         // check slave state
-        auto recved = ProcessMaster(start, end);
+        auto recved = ProcessMaster(start, start + bytes);
         if (recved != -1)
             return static_cast<PacketLength>(recved);
+
+        // replication stream, count the offset for psync
+        auto len = _HandleRequest(start, bytes);
+        QREPL.OnMasterStream(len, db_);
+        return len;
+    }
+
+    return _HandleRequest(start, bytes);
+}
+
+PacketLength QClient::_HandleRequest(const char* start, std::size_t bytes)
+{
+    const char* const end   = start + bytes;
+    const char* ptr  = start;
+
+    auto parseRet = QParseResult::wait;
+    if (parser_.IsInitialState())
+    {
+        // mostly the whole request is here, scan it without copy
+        parseRet = parser_.ParseRequestView(ptr, end);
+        if (parseRet == QParseResult::ok)
+            parser_.MaterializeParams();
     }
 
-    auto parseRet = parser_.ParseRequest(ptr, end);
+    // a partial request parsed piece by piece can't wait for the shards below,
+    // the consumed piece would be lost, so wait for the whole request.
+    if (parseRet == QParseResult::wait && pending_ > 0)
+        return 0;
+
+    // partial request, or error: parse and copy piece by piece
+    if (parseRet != QParseResult::ok)
+        parseRet = parser_.ParseRequest(ptr, end);
+
     if (parseRet == QParseResult::error)
     {
         if (!parser_.IsInitialState())
@@ -187,12 +242,25 @@ PacketLength QClient::_HandlePacket(const char* start, std::size_t bytes)
     if (params.empty())
         return static_cast<PacketLength>(ptr - start);
 
-    QString cmd(params[0]);
-    std::transform(params[0].begin(), params[0].end(), cmd.begin(), ::tolower);
+    const QCommandInfo* info = QCommandTable::GetCommandInfo(params[0]);
+    const bool readonly = info &&
+                          QREPL.GetMasterState() != QReplState_none &&
+                          !IsFlagOn(ClientFlag_master) &&
+                          (info->attr & QCommandAttr::QAttr_write);
+
+    int  shard = QShards::kMainThread;
+    bool blocking = false;
+    if (info && auth_ && !readonly && !IsFlagOn(ClientFlag_multi))
+        shard = QSHARDS.Route(info, params, &blocking);
+
+    // replies must be in order, wait for the commands executing in shard
+    // worker, except the ones go to the same shard.
+    if (pending_ > 0 && (shard < 0 || shard != pendingShard_))
+        return 0;
 
     if (!auth_)
     {
-        if (cmd == "auth")
+        if (info && info->cmd == "auth")
         {
             auto now = ::time(nullptr);
             if (now <= lastauth_ + 1)
@@ -214,13 +282,11 @@ PacketLength QClient::_HandlePacket(const char* start, std::size_t bytes)
         }
     }
     
-    DBG << "client " << GetID() << ", cmd " << cmd;
+    DBG << "client " << GetID() << ", cmd " << params[0];
     
     QSTORE.SelectDB(db_);
     FeedMonitors(params);
     
-    const QCommandInfo* info = QCommandTable::GetCommandInfo(cmd);
-
     if (!info)
     {
         ReplyError(QError_unknowCmd, &reply_);
@@ -231,6 +297,7 @@ PacketLength QClient::_HandlePacket(const char* start, std::size_t bytes)
     // check transaction
     if (IsFlagOn(ClientFlag_multi))
     {
+        const QString& cmd = info->cmd;
         if (cmd != "multi" &&
             cmd != "exec" &&
             cmd != "watch" &&
@@ -257,31 +324,99 @@ PacketLength QClient::_HandlePacket(const char* start, std::size_t bytes)
         }
     }
     
-    // check readonly slave and execute command
-    QError err = QError_ok;
-    if (QREPL.GetMasterState() != QReplState_none &&
-        !IsFlagOn(ClientFlag_master) &&
-        (info->attr & QCommandAttr::QAttr_write))
+    if (shard == QShards::kCrossShard)
     {
-        ReplyError(err = QError_readonlySlave, &reply_);
+        ReplyError(QError_crossShard, &reply_);
+        SendPacket(reply_);
+    }
+    else if (shard >= 0)
+    {
+        _Dispatch(shard, blocking, params, info);
+    }
+    else if (readonly)
+    {
+        // check readonly slave
+        ReplyError(QError_readonlySlave, &reply_);
+        SendPacket(reply_);
     }
     else
     {
-        QSlowLog::Instance().Begin();
-        err = QCommandTable::ExecuteCmd(params,
-                                        info,
-                                        IsFlagOn(ClientFlag_master) ? nullptr : &reply_);
-        QSlowLog::Instance().EndAndStat(params);
+        // cross shard commands, or sharding disabled
+        QAllShardsGuard guard;
+        _ExecuteCommand(params, info, reply_, QShards::kMainThread);
+    }
+    
+    return static_cast<PacketLength>(ptr - start);
+}
+
+void QClient::_ExecuteCommand(const std::vector<QString>& params, const QCommandInfo* info, UnboundedBuffer& reply, int shard)
+{
+    // make room before writing, the commands of master are always applied,
+    // and the ones only deleting keys are allowed even if nothing can be evicted
+    if ((info->attr & QAttr_write) &&
+        !IsFlagOn(ClientFlag_master) &&
+        !QSTORE.EvictIfNeeded(shard) &&
+        info->cmd != "del" &&
+        info->cmd != "unlink" &&
+        info->cmd != "flushdb" &&
+        info->cmd != "flushall")
+    {
+        ReplyError(QError_oom, &reply);
+        SendPacket(reply);
+        return;
     }
+
+    QSlowLog::Instance().Begin();
+    QError err = QCommandTable::ExecuteCmd(params,
+                                           info,
+                                           IsFlagOn(ClientFlag_master) ? nullptr : &reply);
+    QSlowLog::Instance().EndAndStat(params);
     
-    SendPacket(reply_);
+    SendPacket(reply);
     
     if (err == QError_ok && (info->attr & QAttr_write))
     {
         Propogate(params);
     }
-    
-    return static_cast<PacketLength>(ptr - start);
+}
+
+void QClient::_Dispatch(int shard, bool blocking, const std::vector<QString>& params, const QCommandInfo* info)
+{
+    // the worker replies by itself, after the replies batched
+    FlushReplies();
+
+    ++ pending_;
+    // nothing can be dispatched after a blocking command until it's done
+    pendingShard_ = blocking ? QShards::kCrossShard : shard;
+
+    auto self = std::static_pointer_cast<QClient>(shared_from_this());
+    QSHARDS.Dispatch(shard, std::bind(&QClient::_ExecuteInShard, self, params, info, db_, shard));
+}
+
+// called in shard worker
+void QClient::_ExecuteInShard(std::vector<QString>& params, const QCommandInfo* info, int db, int shard)
+{
+    s_current = this;
+    dispatchedCmd_ = &params;
+    QSTORE.SelectDB(db);
+
+    UnboundedBuffer reply;
+    reply.EnableRefs(true);
+    _ExecuteCommand(params, info, reply, shard);
+
+    dispatchedCmd_ = nullptr;
+    s_current = nullptr;
+
+    // if blocked, it's done when served or timeout, see ClearWaitingKeys
+    if (waitingKeys_.empty())
+        _DecPending();
+}
+
+void QClient::_DecPending()
+{
+    // the commands waiting for me can go on now
+    if (-- pending_ == 0)
+        Server::Instance()->NotifyReady(std::static_pointer_cast<StreamSocket>(shared_from_this()));
 }
 
 QClient*  QClient::Current()
@@ -289,11 +424,14 @@ QClient*  QClient::Current()
     return s_current;
 }
 
-QClient::QClient() : db_(0), flag_(0), name_("clientxxx")
+QClient::QClient() : db_(0), flag_(0), pending_(0), pendingShard_(0), dispatchedCmd_(nullptr), name_("clientxxx")
 {
     auth_ = false;
     SelectDB(0);
     _Reset();
+
+    // replies are only sent, see StreamSocket::SendPacket
+    reply_.EnableRefs(true);
 }
 
 void QClient::OnConnect()
@@ -335,6 +473,10 @@ void QClient::_Reset()
 
     parser_.Reset();
     reply_.Clear();
+
+    // don't keep the memory of a big reply
+    if (reply_.Capacity() > kMaxIdleReplyBuffer)
+        UnboundedBuffer().Swap(reply_);
 }
 
 bool QClient::Watch(int dbno, const QString& key)
@@ -415,6 +557,23 @@ void QClient::ClearWatch()
 }
 
 
+void  QClient::ClearWaitingKeys()
+{
+    // the blocking command executed in shard worker is done
+    if (!waitingKeys_.empty() && pending_ > 0)
+        _DecPending();
+
+    waitingKeys_.clear(), target_.clear();
+}
+
+void  QClient::RewriteCmd(std::vector<QString>& params)
+{
+    if (dispatchedCmd_)
+        *dispatchedCmd_ = params;
+    else
+        parser_.SetParams(params);
+}
+
 bool  QClient::WaitFor(const QString& key, const QString* target)
 {
     bool  succ = waitingKeys_.insert(key).second;
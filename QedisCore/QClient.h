@@ -7,6 +7,7 @@
 #include "QReplication.h"
 #include "QProtoParser.h"
 #include <set>
+#include <atomic>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -28,6 +29,7 @@ enum ClientFlag
 
 class DB;
 struct QSlaveInfo;
+struct QCommandInfo;
 
 class QClient: public StreamSocket
 {
@@ -40,6 +42,7 @@ public:
     void OnConnect() override;
     
     bool SelectDB(int db);
+    int  GetDB() const { return db_; }
     static QClient*  Current();
     
     //multi
@@ -83,7 +86,7 @@ public:
     bool  WaitFor(const QString& key, const QString* target = nullptr);
     
     const std::unordered_set<QString>  WaitingKeys() const { return waitingKeys_; }
-    void  ClearWaitingKeys()    {  waitingKeys_.clear(), target_.clear(); }
+    void  ClearWaitingKeys();
     const QString&  GetTarget() const { return target_; }
     
     void  SetName(const QString& name) { name_ = name; }
@@ -97,12 +100,20 @@ public:
     
     void SetAuth() { auth_ = true; }
     bool GetAuth() const { return auth_; }
-    void RewriteCmd(std::vector<QString>& params) { parser_.SetParams(params); }
+    void RewriteCmd(std::vector<QString>& params);
 
 private:
+    PacketLength _HandleRequest(const char* msg, std::size_t len);
     PacketLength _ProcessInlineCmd(const char* , size_t, std::vector<QString>& );
     void _Reset();
 
+    // shard is the one of worker, or kMainThread with all the shards locked
+    void _ExecuteCommand(const std::vector<QString>& params, const QCommandInfo* info, UnboundedBuffer& reply, int shard);
+    // sharded execution
+    void _Dispatch(int shard, bool blocking, const std::vector<QString>& params, const QCommandInfo* info);
+    void _ExecuteInShard(std::vector<QString>& params, const QCommandInfo* info, int db, int shard);
+    void _DecPending();
+
     QProtoParser parser_;
     UnboundedBuffer reply_;
 
@@ -111,13 +122,19 @@ private:
     std::unordered_set<QString>  channels_;
     std::unordered_set<QString>  patternChannels_;
     
-    unsigned flag_;
+    std::atomic<unsigned> flag_; // dirty flag is set by other threads
     std::unordered_map<int, std::unordered_set<QString> > watchKeys_;
     std::vector<std::vector<QString> > queueCmds_;
     
     // blocked list
     std::unordered_set<QString> waitingKeys_;
     QString target_;
+
+    // commands dispatched to shard worker, but not replied yet,
+    // the next command waits for them unless it goes to the same shard
+    std::atomic<int> pending_;
+    int pendingShard_;
+    std::vector<QString>* dispatchedCmd_; // for RewriteCmd in shard worker
     
     // slave info from master view
     std::unique_ptr<QSlaveInfo>  slaveInfo_;
@@ -129,7 +146,7 @@ private:
     bool  auth_;
     time_t lastauth_ = 0;
     
-    static  QClient*  s_current;
+    static  __thread QClient*  s_current;
     static  std::set<std::weak_ptr<QClient>, std::owner_less<std::weak_ptr<QClient> > > s_monitors;
 };
     
@@ -1,5 +1,6 @@
 #include "QCommand.h"
 #include "QReplication.h"
+#include "QStore.h"
 
 using std::size_t;
 
@@ -12,6 +13,7 @@ const QCommandInfo QCommandTable::s_info[] =
     {"type",        QAttr_read,                2,  &type},
     {"exists",      QAttr_read,                2,  &exists},
     {"del",         QAttr_write,              -2,  &del},
+    {"unlink",      QAttr_write,              -2,  &unlink},
     {"expire",      QAttr_read,                3,  &expire},
     {"ttl",         QAttr_read,                2,  &ttl},
     {"pexpire",     QAttr_read,                3,  &pexpire},
@@ -36,8 +38,8 @@ const QCommandInfo QCommandTable::s_info[] =
     {"bgsave",      QAttr_read,                1,  &bgsave},
     {"save",        QAttr_read,                1,  &save},
     {"lastsave",    QAttr_read,                1,  &lastsave},
-    {"flushdb",     QAttr_write,               1,  &flushdb},
-    {"flushall",    QAttr_write,               1,  &flushall},
+    {"flushdb",     QAttr_write,              -1,  &flushdb},
+    {"flushall",    QAttr_write,              -1,  &flushall},
     {"client",      QAttr_read,               -2,  &client },
     {"debug",       QAttr_read,               -2,  &debug},
     {"shutdown",    QAttr_read,               -1,  &shutdown},
@@ -160,7 +162,7 @@ const QCommandInfo QCommandTable::s_info[] =
     
     // replication
     {"sync",        QAttr_read,                1,  &sync},
-    {"psync",       QAttr_read,                1,  &sync},
+    {"psync",       QAttr_read,                3,  &psync},
     {"slaveof",     QAttr_read,                3,  &slaveof},
     {"replconf",    QAttr_read,               -3,  &replconf},
 
@@ -174,6 +176,44 @@ const QCommandInfo QCommandTable::s_info[] =
 Delegate<void (UnboundedBuffer& )> g_infoCollector;
 
 std::map<QString, const QCommandInfo*, NocaseComp>  QCommandTable::s_handlers;
+std::vector<QCommandTable::Slot>  QCommandTable::s_slots;
+
+namespace
+{
+
+inline char ToLower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// case insensitive FNV-1a
+std::size_t NocaseHash(const char* s, std::size_t len)
+{
+    std::size_t h = 2166136261u;
+    for (std::size_t i = 0; i < len; ++ i)
+    {
+        h ^= static_cast<unsigned char>(ToLower(s[i]));
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+bool NocaseEqual(const QString& name, const char* s, std::size_t len)
+{
+    if (name.size() != len)
+        return false;
+
+    for (std::size_t i = 0; i < len; ++ i)
+    {
+        if (ToLower(name[i]) != ToLower(s[i]))
+            return false;
+    }
+
+    return true;
+}
+
+}
 
 QCommandTable::QCommandTable()
 {
@@ -186,23 +226,56 @@ void QCommandTable::Init()
     {
         s_handlers[info.cmd] = &info;
     }
+
+    _RebuildSlots();
     
     g_infoCollector += OnMemoryInfoCollect;
     g_infoCollector += OnServerInfoCollect;
     g_infoCollector += OnClientInfoCollect;
+    g_infoCollector += OnThreadInfoCollect;
+    g_infoCollector += std::bind(&QStore::OnInfoCommand, &QSTORE, std::placeholders::_1);
     g_infoCollector += std::bind(&QReplication::OnInfoCommand, &QREPL, std::placeholders::_1);
 }
 
-const QCommandInfo* QCommandTable::GetCommandInfo(const QString& cmd)
+const QCommandInfo* QCommandTable::GetCommandInfo(const char* cmd, std::size_t len)
 {
-    auto it(s_handlers.find(cmd));
-    if (it != s_handlers.end())
+    if (s_slots.empty())
+        return 0;
+
+    const std::size_t hash = NocaseHash(cmd, len);
+    const std::size_t mask = s_slots.size() - 1;
+
+    // linear probing, never full
+    for (std::size_t i = hash & mask; s_slots[i].info; i = (i + 1) & mask)
     {
-        return it->second;
+        const Slot& slot = s_slots[i];
+        if (slot.hash == hash && NocaseEqual(*slot.name, cmd, len))
+            return slot.info;
     }
-    
+
     return 0;
 }
+
+void QCommandTable::_RebuildSlots()
+{
+    // load factor <= 0.5
+    std::size_t size = 16;
+    while (size < 2 * s_handlers.size())
+        size <<= 1;
+
+    std::vector<Slot> slots(size, Slot{nullptr, 0, nullptr});
+    for (const auto& kv : s_handlers)
+    {
+        const std::size_t hash = NocaseHash(kv.first.data(), kv.first.size());
+        std::size_t i = hash & (size - 1);
+        while (slots[i].info)
+            i = (i + 1) & (size - 1);
+
+        slots[i] = Slot{&kv.first, hash, kv.second};
+    }
+
+    s_slots.swap(slots);
+}
     
 bool  QCommandTable::AliasCommand(const std::map<QString, QString>& aliases)
 {
@@ -231,6 +304,7 @@ const QCommandInfo* QCommandTable::DelCommand(const QString& cmd)
     {
         auto p = it->second;
         s_handlers.erase(it);
+        _RebuildSlots();
         return p;
     }
 
@@ -242,7 +316,11 @@ bool  QCommandTable::AddCommand(const QString& cmd, const QCommandInfo* info)
     if (cmd.empty() || cmd == "\"\"")
         return true;
 
-    return s_handlers.insert(std::make_pair(cmd, info)).second;
+    if (!s_handlers.insert(std::make_pair(cmd, info)).second)
+        return false;
+
+    _RebuildSlots();
+    return true;
 }
 
 QError QCommandTable::ExecuteCmd(const std::vector<QString>& params, const QCommandInfo* info, UnboundedBuffer* reply)
@@ -24,6 +24,7 @@ using QCommandHandler = QError (const std::vector<QString>& params, UnboundedBuf
 QCommandHandler  type;
 QCommandHandler  exists;
 QCommandHandler  del;
+QCommandHandler  unlink;
 QCommandHandler  expire;
 QCommandHandler  pexpire;
 QCommandHandler  expireat;
@@ -172,6 +173,7 @@ QCommandHandler  discard;
 
 // replication
 QCommandHandler  sync;
+QCommandHandler  psync;
 QCommandHandler  slaveof;
 QCommandHandler  replconf;
 
@@ -186,6 +188,7 @@ extern Delegate<void (UnboundedBuffer& )> g_infoCollector;
 extern void OnMemoryInfoCollect(UnboundedBuffer& );
 extern void OnServerInfoCollect(UnboundedBuffer& );
 extern void OnClientInfoCollect(UnboundedBuffer& );
+extern void OnThreadInfoCollect(UnboundedBuffer& );
 
 struct QCommandInfo
 {
@@ -203,7 +206,13 @@ public:
     
     static void Init();
 
-    static const QCommandInfo* GetCommandInfo(const QString& cmd);
+    // case insensitive, no allocation
+    static const QCommandInfo* GetCommandInfo(const char* cmd, std::size_t len);
+    static const QCommandInfo* GetCommandInfo(const QString& cmd)
+    {
+        return GetCommandInfo(cmd.data(), cmd.size());
+    }
+
     static QError ExecuteCmd(const std::vector<QString>& params, const QCommandInfo* info, UnboundedBuffer* reply = nullptr);
     static QError ExecuteCmd(const std::vector<QString>& params, UnboundedBuffer* reply = nullptr);
 
@@ -218,7 +227,20 @@ private:
 
     static const QCommandInfo s_info[];
 
+    // all the commands, include aliases and module commands
     static std::map<QString, const QCommandInfo*, NocaseComp>  s_handlers;
+
+    // Flat open addressing index of s_handlers for lookup, rebuilt when
+    // commands are added or removed, that's rare.
+    struct Slot
+    {
+        const QString*  name; // key of s_handlers
+        std::size_t     hash;
+        const QCommandInfo* info;
+    };
+
+    static std::vector<Slot>  s_slots;
+    static void _RebuildSlots();
 };
 
 }
@@ -31,6 +31,8 @@ struct QErrorInfo g_errorInfo[] = {
     {sizeof "-ERR uninit module failed\r\n"-1, "-ERR uninit module failed\r\n"},
     {sizeof "-ERR module already loaded\r\n"-1, "-ERR module already loaded\r\n"},
     {sizeof "-BUSYKEY Target key name already exists.\r\n"-1, "-BUSYKEY Target key name already exists.\r\n"},
+    {sizeof "-CROSSSLOT Keys in request don't hash to the same shard\r\n"-1, "-CROSSSLOT Keys in request don't hash to the same shard\r\n"},
+    {sizeof "-OOM command not allowed when used memory > 'maxmemory'.\r\n"-1, "-OOM command not allowed when used memory > 'maxmemory'.\r\n"},
     //
 };
 
@@ -236,6 +238,25 @@ size_t  FormatBulk(const QString& str, UnboundedBuffer* reply)
     return  FormatBulk(str.c_str(), str.size(), reply);
 }
 
+size_t  FormatBulk(SharedString* str, UnboundedBuffer* reply)
+{
+    if (!reply)
+        return 0;
+
+    char val[32];
+    int tmp = snprintf(val, sizeof val - 1, "$%lu" CRLF, str->size);
+    reply->PushData(val, tmp);
+
+    size_t bytes = tmp + 2;
+    if (reply->PushRef(str))
+        bytes += str->size;
+    else
+        bytes += reply->PushData(str->data, str->size);
+
+    reply->PushData(CRLF, 2);
+    return bytes;
+}
+
 size_t  PreFormatMultiBulk(size_t nBulk, UnboundedBuffer* reply)
 {
     if (!reply)
@@ -375,6 +396,10 @@ QParseResult GetIntUntilCRLF(const char*& ptr, std::size_t nBytes, int& val)
     if (negtive)
         value *= -1;
     
+    // no crlf yet
+    if (i == nBytes)
+        return QParseResult::wait;
+
     ptr += i;
     ptr += 2;
     val = value;
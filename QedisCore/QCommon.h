@@ -36,6 +36,8 @@ enum QEncode
 
     QEncode_raw, // string
     QEncode_int, // string as int
+    QEncode_embstr, // short string in one allocation, see QEmbString
+    QEncode_sharedstr, // big immutable string, sent without copy, see SharedString
 
     QEncode_list,
     
@@ -43,6 +45,15 @@ enum QEncode
     QEncode_hash,
     
     QEncode_sset,
+
+    // compact encodings of small values, see QZipList.h
+    QEncode_ziplist,
+    QEncode_zipset,
+    QEncode_ziphash,
+    QEncode_zipsset,
+
+    QEncode_intset, // set of integers, see redisIntset.h
+    // < 16
 };
 
 inline const char* EncodingStringInfo(unsigned encode)
@@ -54,9 +65,15 @@ inline const char* EncodingStringInfo(unsigned encode)
             
         case QEncode_int:
             return "int";
+
+        case QEncode_embstr:
+            return "embstr";
+
+        case QEncode_sharedstr:
+            return "sharedstr";
             
         case QEncode_list:
-            return "list";
+            return "quicklist";
             
         case QEncode_set:
             return "set";
@@ -66,6 +83,15 @@ inline const char* EncodingStringInfo(unsigned encode)
             
         case QEncode_sset:
             return "sset";
+
+        case QEncode_ziplist:
+        case QEncode_zipset:
+        case QEncode_ziphash:
+        case QEncode_zipsset:
+            return "ziplist";
+
+        case QEncode_intset:
+            return "intset";
             
         default:
             break;
@@ -97,6 +123,8 @@ enum QError
     QError_moduleuninit = 17,
     QError_modulerepeat = 18,
     QError_busykey      = 19,
+    QError_crossShard   = 20,
+    QError_oom          = 21,
     QError_max,
 };
 
@@ -167,6 +195,8 @@ std::size_t FormatSingle(const char* str, std::size_t len, UnboundedBuffer* repl
 std::size_t FormatSingle(const QString& str, UnboundedBuffer* reply);
 std::size_t FormatBulk(const char* str, std::size_t len, UnboundedBuffer* reply);
 std::size_t FormatBulk(const QString& str, UnboundedBuffer* reply);
+// referenced if the reply allows, see UnboundedBuffer::PushRef
+std::size_t FormatBulk(SharedString* str, UnboundedBuffer* reply);
 std::size_t PreFormatMultiBulk(std::size_t nBulk, UnboundedBuffer* reply);
 std::size_t FormatMultiBulk(const std::vector<QString> vs, UnboundedBuffer* reply);
 
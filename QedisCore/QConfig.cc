@@ -1,5 +1,7 @@
 #include <vector>
 #include <iostream>
+#include <strings.h>
+#include <cstdlib>
 
 #include "QConfig.h"
 #include "ConfigParser.h"
@@ -21,8 +23,65 @@ static void EraseQuotes(QString& str)
 
 extern std::vector<QString>  SplitString(const QString& str, char seperator);
 
+// "0,2,4-7" to cpus
+static bool ParseCpuList(const QString& str, std::vector<int>& cpus)
+{
+    cpus.clear();
+
+    for (const auto& item : SplitString(str, ','))
+    {
+        if (item.empty())
+            continue;
+
+        char* end = nullptr;
+        const long first = ::strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (end != item.c_str() && *end == '-')
+            last = ::strtol(end + 1, &end, 10);
+
+        if (end == item.c_str() || *end != '\0' || first < 0 || first > last || last >= 1024)
+            return false;
+
+        for (long cpu = first; cpu <= last; ++ cpu)
+            cpus.push_back(static_cast<int>(cpu));
+    }
+
+    return true;
+}
+
 QConfig  g_config;
 
+static const char* const s_evictionPolicies[EvictMax] =
+{
+    "noeviction",
+    "allkeys-lru",
+    "volatile-lru",
+    "allkeys-lfu",
+    "volatile-lfu",
+    "allkeys-random",
+    "volatile-random",
+    "volatile-ttl",
+};
+
+int EvictionPolicyByName(const QString& name)
+{
+    for (int i = 0; i < EvictMax; ++ i)
+    {
+        if (strcasecmp(name.c_str(), s_evictionPolicies[i]) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+const char* EvictionPolicyName(int policy)
+{
+    if (policy < 0 || policy >= EvictMax)
+        return "unknown";
+
+    return s_evictionPolicies[policy];
+}
+
 QConfig::QConfig()
 {
     daemonize  = false;
@@ -36,6 +95,12 @@ QConfig::QConfig()
     logdir = "stdout";
     
     databases = 16;
+    workerThreads = 0;
+    recvThreads = 1;
+    sendThreads = 1;
+    ioBackend = "epoll";
+    busyPollUs = 0;
+    logicCpu = -1;
     
     // rdb
     saveseconds = 999999999;
@@ -59,9 +124,33 @@ QConfig::QConfig()
     
     includefile = "";
 
+    replBacklogSize = 1024 * 1024;
+
     maxmemory = 2 * 1024 * 1024 * 1024UL;
     maxmemorySamples = 5;
-    noeviction = true;
+    maxmemoryPolicy = EvictNo;
+    lfuLogFactor = 10;
+    lfuDecayTime = 1;
+    lazyfreeThreshold = 64;
+
+    activedefrag = false;
+    activeDefragIgnoreBytes = 100 * 1024 * 1024UL;
+    activeDefragThresholdLower = 10;
+    activeDefragCycleMax = 25;
+
+    hashMaxZiplistEntries = 128;
+    hashMaxZiplistValue = 64;
+    setMaxZiplistEntries = 128;
+    setMaxZiplistValue = 64;
+    setMaxIntsetEntries = 512;
+    listMaxZiplistEntries = 512;
+    listMaxZiplistValue = 64;
+    listMaxZiplistSize = -2;
+    listCompressDepth = 0;
+    zsetMaxZiplistEntries = 128;
+    zsetMaxZiplistValue = 64;
+    stringMaxEmbeddedValue = 64;
+    stringMinSharedValue = 16 * 1024;
 
     backend = BackEndNone;
     backendPath = "dump";
@@ -92,6 +181,26 @@ bool  LoadQedisConfig(const char* cfgFile, QConfig& cfg)
         cfg.logdir = "stdout";
     
     cfg.databases = parser.GetData<int>("databases", cfg.databases);
+    cfg.workerThreads = parser.GetData<int>("worker-threads", cfg.workerThreads);
+    cfg.recvThreads = parser.GetData<int>("recv-threads", cfg.recvThreads);
+    cfg.sendThreads = parser.GetData<int>("send-threads", cfg.sendThreads);
+    cfg.ioBackend = parser.GetData<QString>("io-backend", cfg.ioBackend);
+    cfg.busyPollUs = parser.GetData<int>("busy-poll-us", cfg.busyPollUs);
+    cfg.logicCpu = parser.GetData<int>("logic-cpu", cfg.logicCpu);
+
+    const char* const cpuLists[] = { "worker-cpu-list", "recv-cpu-list", "send-cpu-list" };
+    std::vector<int>* const cpus[] = { &cfg.workerCpus, &cfg.recvCpus, &cfg.sendCpus };
+    for (int i = 0; i < 3; ++ i)
+    {
+        if (!ParseCpuList(parser.GetData<QString>(cpuLists[i]), *cpus[i]))
+        {
+            std::cerr << "bad format " << cpuLists[i] << ", bad string "
+                      << parser.GetData<QString>(cpuLists[i])
+                      << std::endl;
+            return false;
+        }
+    }
+
     cfg.password  = parser.GetData<QString>("requirepass");
     EraseQuotes(cfg.password);
 
@@ -173,6 +282,7 @@ bool  LoadQedisConfig(const char* cfgFile, QConfig& cfg)
         cfg.masterPort = static_cast<unsigned short>(std::stoi(master[1]));
     }
     cfg.masterauth = parser.GetData<QString>("masterauth");
+    cfg.replBacklogSize = parser.GetData<uint64_t>("repl-backlog-size", cfg.replBacklogSize);
 
     // load modules' names
     cfg.modules = parser.GetDataVector("loadmodule");
@@ -182,7 +292,31 @@ bool  LoadQedisConfig(const char* cfgFile, QConfig& cfg)
     // lru cache
     cfg.maxmemory = parser.GetData<uint64_t>("maxmemory", 2 * 1024 * 1024 * 1024UL);
     cfg.maxmemorySamples = parser.GetData<int>("maxmemory-samples", 5);
-    cfg.noeviction = (parser.GetData<QString>("maxmemory-policy", "noeviction") == "noeviction");
+    cfg.maxmemoryPolicy = EvictionPolicyByName(parser.GetData<QString>("maxmemory-policy", "noeviction"));
+    cfg.lfuLogFactor = parser.GetData<int>("lfu-log-factor", cfg.lfuLogFactor);
+    cfg.lfuDecayTime = parser.GetData<int>("lfu-decay-time", cfg.lfuDecayTime);
+    cfg.lazyfreeThreshold = parser.GetData<int>("lazyfree-threshold", cfg.lazyfreeThreshold);
+
+    // active defrag
+    cfg.activedefrag = (parser.GetData<QString>("activedefrag", "no") == "yes");
+    cfg.activeDefragIgnoreBytes = parser.GetData<uint64_t>("active-defrag-ignore-bytes", cfg.activeDefragIgnoreBytes);
+    cfg.activeDefragThresholdLower = parser.GetData<int>("active-defrag-threshold-lower", cfg.activeDefragThresholdLower);
+    cfg.activeDefragCycleMax = parser.GetData<int>("active-defrag-cycle-max", cfg.activeDefragCycleMax);
+
+    // compact encodings
+    cfg.hashMaxZiplistEntries = parser.GetData<int>("hash-max-ziplist-entries", cfg.hashMaxZiplistEntries);
+    cfg.hashMaxZiplistValue = parser.GetData<int>("hash-max-ziplist-value", cfg.hashMaxZiplistValue);
+    cfg.setMaxZiplistEntries = parser.GetData<int>("set-max-ziplist-entries", cfg.setMaxZiplistEntries);
+    cfg.setMaxZiplistValue = parser.GetData<int>("set-max-ziplist-value", cfg.setMaxZiplistValue);
+    cfg.setMaxIntsetEntries = parser.GetData<int>("set-max-intset-entries", cfg.setMaxIntsetEntries);
+    cfg.listMaxZiplistEntries = parser.GetData<int>("list-max-ziplist-entries", cfg.listMaxZiplistEntries);
+    cfg.listMaxZiplistValue = parser.GetData<int>("list-max-ziplist-value", cfg.listMaxZiplistValue);
+    cfg.listMaxZiplistSize = parser.GetData<int>("list-max-ziplist-size", cfg.listMaxZiplistSize);
+    cfg.listCompressDepth = parser.GetData<int>("list-compress-depth", cfg.listCompressDepth);
+    cfg.zsetMaxZiplistEntries = parser.GetData<int>("zset-max-ziplist-entries", cfg.zsetMaxZiplistEntries);
+    cfg.zsetMaxZiplistValue = parser.GetData<int>("zset-max-ziplist-value", cfg.zsetMaxZiplistValue);
+    cfg.stringMaxEmbeddedValue = parser.GetData<int>("string-max-embedded-value", cfg.stringMaxEmbeddedValue);
+    cfg.stringMinSharedValue = parser.GetData<int>("string-min-shared-value", cfg.stringMinSharedValue);
 
     cfg.backend = parser.GetData<int>("backend", BackEndNone);
     cfg.backendPath = parser.GetData<QString>("backendpath", cfg.backendPath);
@@ -210,10 +344,31 @@ bool  QConfig::CheckArgs() const
     
     RETURN_IF_FAIL(port > 0);
     RETURN_IF_FAIL(databases > 0);
+    RETURN_IF_FAIL(workerThreads >= 0 && workerThreads <= 64);
+    RETURN_IF_FAIL(recvThreads > 0 && recvThreads <= 64);
+    RETURN_IF_FAIL(sendThreads > 0 && sendThreads <= 64);
+    RETURN_IF_FAIL(ioBackend == "epoll" || ioBackend == "io_uring");
+    RETURN_IF_FAIL(busyPollUs >= 0);
+    RETURN_IF_FAIL(logicCpu >= -1);
     RETURN_IF_FAIL(maxclients > 0);
     RETURN_IF_FAIL(hz > 0 && hz < 500);
+    RETURN_IF_FAIL(replBacklogSize <= 1024 * 1024 * 1024UL);
     RETURN_IF_FAIL(maxmemory >= 512 * 1024 * 1024UL);
     RETURN_IF_FAIL(maxmemorySamples > 0 && maxmemorySamples < 10);
+    RETURN_IF_FAIL(maxmemoryPolicy >= 0 && maxmemoryPolicy < EvictMax);
+    RETURN_IF_FAIL(lfuLogFactor >= 0 && lfuDecayTime >= 0);
+    RETURN_IF_FAIL(lazyfreeThreshold >= 0);
+    RETURN_IF_FAIL(activeDefragThresholdLower >= 0);
+    RETURN_IF_FAIL(activeDefragCycleMax > 0 && activeDefragCycleMax <= 100);
+    RETURN_IF_FAIL(hashMaxZiplistEntries >= 0 && hashMaxZiplistValue >= 0);
+    RETURN_IF_FAIL(setMaxZiplistEntries >= 0 && setMaxZiplistValue >= 0);
+    RETURN_IF_FAIL(setMaxIntsetEntries >= 0);
+    RETURN_IF_FAIL(listMaxZiplistEntries >= 0 && listMaxZiplistValue >= 0);
+    RETURN_IF_FAIL(listMaxZiplistSize != 0 && listMaxZiplistSize >= -5);
+    RETURN_IF_FAIL(listCompressDepth >= 0);
+    RETURN_IF_FAIL(zsetMaxZiplistEntries >= 0 && zsetMaxZiplistValue >= 0);
+    RETURN_IF_FAIL(stringMaxEmbeddedValue >= 0);
+    RETURN_IF_FAIL(stringMinSharedValue >= 0);
     RETURN_IF_FAIL(backend >= BackEndNone && backend < BackEndMax);
     RETURN_IF_FAIL(backendHz >= 1 && backendHz <= 50);
 
@@ -15,6 +15,37 @@ enum BackEndType
     BackEndMax = 2,
 };
 
+// maxmemory-policy, which keys to evict when memory is used up
+enum EvictionPolicy
+{
+    EvictNo = 0,        // noeviction, reply error to write commands
+    EvictAllKeysLRU,
+    EvictVolatileLRU,   // volatile ones evict the keys with ttl only
+    EvictAllKeysLFU,
+    EvictVolatileLFU,
+    EvictAllKeysRandom,
+    EvictVolatileRandom,
+    EvictVolatileTTL,   // the key expires soonest
+    EvictMax,
+};
+
+// -1 if unknown name, like "allkeys-lru"
+int         EvictionPolicyByName(const QString& name);
+const char* EvictionPolicyName(int policy);
+
+inline bool IsLFUPolicy(int policy)
+{
+    return policy == EvictAllKeysLFU || policy == EvictVolatileLFU;
+}
+
+inline bool IsVolatilePolicy(int policy)
+{
+    return policy == EvictVolatileLRU ||
+           policy == EvictVolatileLFU ||
+           policy == EvictVolatileRandom ||
+           policy == EvictVolatileTTL;
+}
+
 struct QConfig
 {
     bool      daemonize;
@@ -29,6 +60,17 @@ struct QConfig
     QString   logdir;  // the log directory, differ from redis
     
     int       databases;
+    int       workerThreads;    // 0, execute all commands in main thread
+    int       recvThreads;      // 1
+    int       sendThreads;      // 1
+    QString   ioBackend;        // epoll or io_uring
+
+    // low latency: threads spin instead of sleeping
+    int       busyPollUs;       // 0, SO_BUSY_POLL of sockets if > 0
+    int       logicCpu;         // -1, not bound
+    std::vector<int>  workerCpus; // thread i on cpus[i % size], empty not bound
+    std::vector<int>  recvCpus;
+    std::vector<int>  sendCpus;
     
     // auth
     QString   password;
@@ -57,6 +99,7 @@ struct QConfig
     QString   masterIp;
     unsigned short masterPort;  // replication
     QString   masterauth;
+    uint64_t  replBacklogSize;  // 1MB, 0 disables psync
     
     QString   runid;
 
@@ -67,7 +110,31 @@ struct QConfig
     // use redis as cache, level db as backup
     uint64_t maxmemory; // default 2GB
     int maxmemorySamples; // default 5
-    bool noeviction; // default true
+    int maxmemoryPolicy; // enum EvictionPolicy, default noeviction
+    int lfuLogFactor; // 10, the greater, the slower lfu counter grows
+    int lfuDecayTime; // 1, minutes passed to decrease lfu counter by one
+    int lazyfreeThreshold; // 64, free the bigger values in background
+
+    // active defrag
+    bool activedefrag; // false
+    uint64_t activeDefragIgnoreBytes; // 100MB, less fragmentation is ignored
+    int activeDefragThresholdLower; // 10, percent of fragmentation to start
+    int activeDefragCycleMax; // 25, percent of cpu of shard at most
+
+    // compact encodings, convert to the normal one beyond these limits
+    int hashMaxZiplistEntries;  // 128
+    int hashMaxZiplistValue;    // 64
+    int setMaxZiplistEntries;   // 128
+    int setMaxZiplistValue;     // 64
+    int setMaxIntsetEntries;    // 512
+    int listMaxZiplistEntries;  // 512
+    int listMaxZiplistValue;    // 64
+    int listMaxZiplistSize;     // -2, quicklist node size
+    int listCompressDepth;      // 0
+    int zsetMaxZiplistEntries;  // 128
+    int zsetMaxZiplistValue;    // 64
+    int stringMaxEmbeddedValue; // 64
+    int stringMinSharedValue;   // 16k
 
     int backend; // enum BackEndType
     QString backendPath; 
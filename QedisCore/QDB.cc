@@ -1,5 +1,7 @@
 
 #include "QDB.h"
+#include "QConfig.h"
+#include "QMemory.h"
 #include "Log/Logger.h"
 #include <sstream>
 #include <unistd.h>
@@ -133,11 +135,13 @@ void QDBSaver::SaveType(const QObject& obj)
     {
         case QEncode_raw:
         case QEncode_int:
+        case QEncode_embstr:
+        case QEncode_sharedstr:
             qdb_.Write(&kTypeString, 1);
             break;
                 
         case QEncode_list:
-            qdb_.Write(&kTypeList, 1);
+            qdb_.Write(&kTypeQuickList, 1);
             break;
                 
         case QEncode_hash:
@@ -151,6 +155,26 @@ void QDBSaver::SaveType(const QObject& obj)
         case QEncode_sset:
             qdb_.Write(&kTypeZSet, 1);
             break;
+
+        case QEncode_ziplist:
+            qdb_.Write(&kTypeZipList, 1);
+            break;
+
+        case QEncode_zipset:
+            qdb_.Write(&kTypeSet, 1);
+            break;
+
+        case QEncode_intset:
+            qdb_.Write(&kTypeIntSet, 1);
+            break;
+
+        case QEncode_ziphash:
+            qdb_.Write(&kTypeHashZipList, 1);
+            break;
+
+        case QEncode_zipsset:
+            qdb_.Write(&kTypeZSetZipList, 1);
+            break;
             
         default:
             assert(!!!"Wrong encoding");
@@ -169,24 +193,44 @@ void QDBSaver::SaveObject(const QObject& obj)
     {
         case QEncode_raw:
         case QEncode_int:
+        case QEncode_embstr:
+        case QEncode_sharedstr:
             SaveString(*GetDecodedString(&obj));
             break;
 
         case QEncode_list:
-            _SaveList(obj.CastList());
+            _SaveList(obj);
             break;
             
         case QEncode_set:
-            _SaveSet(obj.CastSet());
+        case QEncode_zipset:
+            _SaveSet(obj);
             break;
             
         case QEncode_hash:
-            _SaveHash(obj.CastHash());
+            _SaveHash(obj);
             break;
             
         case QEncode_sset:
-            _SaveSSet(obj.CastSortedSet());
+            _SaveSSet(obj);
+            break;
+
+        // compact encodings are dumped as is, same as redis rdb
+        case QEncode_ziplist:
+        case QEncode_ziphash:
+        case QEncode_zipsset:
+        {
+            auto zl = obj.CastZipList();
+            SaveString(QString(reinterpret_cast<const char* >(zl), ZipListBytes(zl)));
+            break;
+        }
+
+        case QEncode_intset:
+        {
+            auto is = obj.CastIntset();
+            SaveString(QString(reinterpret_cast<const char* >(is), intsetBlobLen(is)));
             break;
+        }
             
         default:
             break;
@@ -223,56 +267,58 @@ void  QDBSaver::_SaveDoubleValue(double val)
 }
 
 
-void QDBSaver::_SaveList(const PLIST& l)
+// quicklist is saved as its ziplist nodes, same as redis rdb
+void QDBSaver::_SaveList(const QObject& l)
 {
-    SaveLength(l->size());
+    auto list = l.CastList();
+    SaveLength(list->NodeCount());
     
-    for (const auto& e : *l)
-    {
-        SaveString(e);
-    }
+    list->ForEachZipList([this](PZIPLIST zl) {
+        SaveString(QString(reinterpret_cast<const char* >(zl), ZipListBytes(zl)));
+    });
 }
 
 
-void  QDBSaver::_SaveSet(const PSET& s)
+void  QDBSaver::_SaveSet(const QObject& s)
 {
-    SaveLength(s->size());
+    SaveLength(SetSize(s));
     
-    for (const auto& e : *s)
-    {
+    SetForEach(s, [this](const QString& e) {
         SaveString(e);
-    }
+    });
 }
 
-void  QDBSaver::_SaveHash(const PHASH& h)
+void  QDBSaver::_SaveHash(const QObject& h)
 {
-    SaveLength(h->size());
+    SaveLength(HashSize(h));
     
-    for (const auto& e : *h)
-    {
-        SaveString(e.first);
-        SaveString(e.second);
-    }
+    HashForEach(h, [this](const QString& field, const QString& value) {
+        SaveString(field);
+        SaveString(value);
+    });
 }
 
 
-void    QDBSaver::_SaveSSet(const PSSET& ss)
+void    QDBSaver::_SaveSSet(const QObject& ss)
 {
-    SaveLength(ss->Size());
+    SaveLength(SSetSize(ss));
     
-    for (const auto& e : *ss)
-    {
-        SaveString(e.first);
-        _SaveDoubleValue(e.second);
-    }
+    SSetForEach(ss, [this](const QString& member, double score) {
+        SaveString(member);
+        _SaveDoubleValue(score);
+    });
 }
 
 void QDBSaver::SaveString(const QString& str)
 {
     if (str.size() < 10)
     {
+        // only canonical decimal can be saved as integer, or "01" loads as "1"
         long lVal;
-        if (Strtol(str.data(), str.size(), &lVal))
+        char buf[32];
+        if (Strtol(str.data(), str.size(), &lVal) &&
+            Number2Str(buf, sizeof buf, lVal) == str.size() &&
+            memcmp(buf, str.data(), str.size()) == 0)
         {
             SaveString(lVal);
             return;
@@ -827,7 +873,6 @@ QObject QDBLoader::_LoadList()
     DBG << "list length = " << len;
     
     QObject obj(QObject::CreateList());
-    PLIST list(obj.CastList());
     for (size_t i = 0; i < len; ++ i)
     {
         const auto elemLen = LoadLength(special);
@@ -842,7 +887,7 @@ QObject QDBLoader::_LoadList()
             elem = LoadString(elemLen);
         }
         
-        list->push_back(elem);
+        ListPush(obj, elem, ListPosition::tail);
         DBG << "list elem : " << elem.c_str();
     }
     
@@ -859,7 +904,6 @@ QObject QDBLoader::_LoadSet()
     DBG << "set length = " << len;
     
     QObject obj(QObject::CreateSet());
-    PSET  set(obj.CastSet());
     for (size_t i = 0; i < len; ++ i)
     {
         const auto elemLen = LoadLength(special);
@@ -874,7 +918,7 @@ QObject QDBLoader::_LoadSet()
             elem = LoadString(elemLen);
         }
         
-        set->insert(elem);
+        SetAdd(obj, elem);
         DBG << "set elem : " << elem.c_str();
     }
     
@@ -891,7 +935,6 @@ QObject QDBLoader::_LoadHash()
     DBG << "hash length = " << len;
     
     QObject obj(QObject::CreateHash());
-    PHASH  hash(obj.CastHash());
     for (size_t i = 0; i < len; ++ i)
     {
         const auto keyLen = LoadLength(special);
@@ -918,7 +961,7 @@ QObject QDBLoader::_LoadHash()
             val = LoadString(valLen);
         }
         
-        hash->insert(QHash::value_type(key, val));
+        HashSet(obj, key, val);
         DBG << "hash key : " << key.c_str() << " val : " << val.c_str();
     }
     
@@ -936,7 +979,6 @@ QObject QDBLoader::_LoadSSet()
     DBG << "sset length = " << len;
     
     QObject obj(QObject::CreateSSet());
-    PSSET  sset(obj.CastSortedSet());
     for (size_t i = 0; i < len; ++ i)
     {
         const auto memberLen = LoadLength(special);
@@ -952,7 +994,7 @@ QObject QDBLoader::_LoadSSet()
         }
         
         const auto score = _LoadDoubleValue();
-        sset->AddMember(member, static_cast<long>(score));
+        SSetAdd(obj, member, score);
         DBG << "sset member : " << member.c_str() << " score : " << score;
     }
     
@@ -1063,11 +1105,10 @@ QObject QDBLoader::_LoadZipList(const QString& zl, int8_t type)
         case kTypeZipList:
         {
             QObject  obj(QObject::CreateList());
-            PLIST    list(obj.CastList());
             
             for (const auto& elem : elements)
             {
-                list->push_back(elem.ToString());
+                ListPush(obj, elem.ToString(), ListPosition::tail);
             }
             
             return obj;
@@ -1076,7 +1117,6 @@ QObject QDBLoader::_LoadZipList(const QString& zl, int8_t type)
         case kTypeHashZipList:
         {
             QObject  obj(QObject::CreateHash());
-            PHASH    hash(obj.CastHash());
             
             assert(elements.size() % 2 == 0);
             
@@ -1085,8 +1125,7 @@ QObject QDBLoader::_LoadZipList(const QString& zl, int8_t type)
                 auto key = it;
                 auto value = ++ it;
 
-                hash->insert(QHash::value_type(key->ToString(),
-                                               value->ToString()));
+                HashSet(obj, key->ToString(), value->ToString());
             }
             
             return obj;
@@ -1095,7 +1134,6 @@ QObject QDBLoader::_LoadZipList(const QString& zl, int8_t type)
         case kTypeZSetZipList:
         {
             QObject  obj(QObject::CreateSSet());
-            PSSET    sset(obj.CastSortedSet());
 
             assert(elements.size() % 2 == 0);
             
@@ -1115,7 +1153,7 @@ QObject QDBLoader::_LoadZipList(const QString& zl, int8_t type)
                 }
 
                 DBG << "sset member " << member << ", score " << score;
-                sset->AddMember(member, score);
+                SSetAdd(obj, member, score);
             }
             
             return obj;
@@ -1133,26 +1171,34 @@ QObject QDBLoader::_LoadZipList(const QString& zl, int8_t type)
 QObject QDBLoader::_LoadIntset()
 {
     QString str = _LoadGenericString();
+    if (str.size() < sizeof(intset))
+        throw std::runtime_error("LoadIntset blob too short");
     
     intset* iset = (intset* )&str[0];
-    unsigned nElem = intsetLen(iset);
-    
-    std::vector<int64_t>  elements;
-    elements.resize(nElem);
-    
-    for (unsigned i = 0; i < nElem; ++ i)
+    if (intsetBlobLen(iset) != str.size())
+        throw std::runtime_error("LoadIntset blob length mismatch");
+
+    QObject  obj(QObject::CreateSet());
+
+    if (intsetLen(iset) <= static_cast<uint32_t>(g_config.setMaxIntsetEntries))
     {
-        intsetGet(iset, i, &elements[i]);
+        // keep the native encoding, just copy the blob
+        void* blob = zmalloc(str.size());
+        memcpy(blob, str.data(), str.size());
+        obj.Reset(blob);
+        obj.encoding = QEncode_intset;
+        return obj;
     }
-    
-    QObject  obj(QObject::CreateSet());
-    PSET     set(obj.CastSet());
-    
-    for (auto v : elements)
+
+    unsigned nElem = intsetLen(iset);
+    for (unsigned i = 0; i < nElem; ++ i)
     {
+        int64_t v;
+        intsetGet(iset, i, &v);
+
         char buf[64];
         auto bytes = Number2Str<int64_t>(buf, sizeof buf, v);
-        set->insert(QString(buf, bytes));
+        SetAdd(obj, QString(buf, bytes));
     }
 
     return obj;
@@ -1163,18 +1209,46 @@ QObject QDBLoader::_LoadQuickList()
     bool special = true;
     auto nElem = LoadLength(special);
 
-    QObject obj(QObject::CreateList());
-    PLIST list(obj.CastList());
+    std::vector<QString> nodes;
+    nodes.reserve(nElem);
+
+    std::size_t total = 0;
     while (nElem -- > 0)
     {
         QString zl = _LoadGenericString();
         if (zl.empty())
             continue;
 
-        QObject l = _LoadZipList(zl, kTypeZipList);
-        PLIST tmplist(l.CastList());
-        if (!tmplist->empty())
-            list->splice(list->end(), *tmplist);
+        if (ZipListBytes((PZIPLIST)&zl[0]) != zl.size())
+            throw std::runtime_error("LoadQuickList ziplist length mismatch");
+
+        total += ZipListSize((PZIPLIST)&zl[0]);
+        nodes.push_back(std::move(zl));
+    }
+
+    QObject obj(QObject::CreateList());
+    if (total <= static_cast<std::size_t>(g_config.listMaxZiplistEntries))
+    {
+        for (const auto& zl : nodes)
+        {
+            QObject l = _LoadZipList(zl, kTypeZipList);
+            ListForEach(l, [&obj](const QString& elem) {
+                ListPush(obj, elem, ListPosition::tail);
+            });
+        }
+    }
+    else
+    {
+        // adopt the nodes directly
+        std::unique_ptr<QList> list(new QList(g_config.listMaxZiplistSize, g_config.listCompressDepth));
+        for (const auto& zl : nodes)
+        {
+            if (ZipListSize((PZIPLIST)zl.data()) > 0)
+                list->AppendZipList(ZipListCopy(zl.data(), zl.size()));
+        }
+
+        obj.Reset(list.release());
+        obj.encoding = QEncode_list;
     }
 
     return obj;
@@ -1250,7 +1324,7 @@ std::string DumpObject(const QObject& val)
     const uint64_t crc = crc64(0, (const unsigned char* )result.data(), result.size());
     result.append((const char*)&crc, 8);
 
-    unlink(file.data());
+    ::unlink(file.data());
     return result;
 }
 
@@ -26,10 +26,10 @@ public:
 private:
     void    _SaveDoubleValue(double val);
     
-    void    _SaveList(const PLIST& l);
-    void    _SaveSet(const PSET& s);
-    void    _SaveHash(const PHASH& h);
-    void    _SaveSSet(const PSSET& ss);
+    void    _SaveList(const QObject& l);
+    void    _SaveSet(const QObject& s);
+    void    _SaveHash(const QObject& h);
+    void    _SaveSSet(const QObject& ss);
    
     OutputMemoryFile  qdb_;
 };
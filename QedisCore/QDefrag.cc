@@ -0,0 +1,106 @@
+#include "QDefrag.h"
+#include "QStore.h"
+
+namespace qedis
+{
+
+void* QDefragger::Alloc(void* ptr)
+{
+    void* res = DefragAlloc(ptr);
+    if (res)
+        ++ hits;
+    else
+        ++ misses;
+
+    return res;
+}
+
+bool QDefragger::_StringHint(const QString& str)
+{
+    // a short string is inside the object
+    const char* data = str.data();
+    const char* self = reinterpret_cast<const char*>(&str);
+    if (data >= self && data < self + sizeof str)
+        return false;
+
+    return DefragHint(data);
+}
+
+bool QDefragger::NodeHint(const void* node, const QString& str)
+{
+    if (DefragHint(node) || _StringHint(str))
+    {
+        ++ hits;
+        return true;
+    }
+
+    ++ misses;
+    return false;
+}
+
+bool QDefragger::NodeHint(const void* node, const std::pair<const QString, QString>& kv)
+{
+    if (DefragHint(node) || _StringHint(kv.first) || _StringHint(kv.second))
+    {
+        ++ hits;
+        return true;
+    }
+
+    ++ misses;
+    return false;
+}
+
+void QDefragger::Value(QObject& obj)
+{
+    switch (obj.encoding)
+    {
+        case QEncode_raw:
+        {
+            PSTRING str = obj.CastString();
+            if (NodeHint(str, *str))
+            {
+                obj.value = new QString(*str);
+                delete str;
+            }
+
+            break;
+        }
+
+        case QEncode_sharedstr:
+            // a reply is still sending it
+            if (obj.CastSharedString()->IsShared())
+            {
+                ++ misses;
+                break;
+            }
+
+            // fall through
+
+        case QEncode_embstr:
+        case QEncode_ziplist:
+        case QEncode_zipset:
+        case QEncode_ziphash:
+        case QEncode_zipsset:
+        case QEncode_intset:
+            if (void* value = Alloc(obj.value))
+                obj.value = value;
+
+            break;
+
+        case QEncode_list:
+        {
+            PLIST list = obj.CastList();
+            const std::size_t moved = list->Defrag();
+            hits += moved;
+            misses += list->NodeCount() * 2 - moved;
+            break;
+        }
+
+        default:
+            // the skiplist nodes are linked at many levels, sorted sets
+            // are not moved
+            break;
+    }
+}
+
+}
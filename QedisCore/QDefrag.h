@@ -0,0 +1,62 @@
+#ifndef BERT_QDEFRAG_H
+#define BERT_QDEFRAG_H
+
+#include <cstdint>
+#include <utility>
+
+#include "QString.h"
+#include "QMemory.h"
+
+namespace qedis
+{
+
+struct QObject;
+
+// Moves the keys and values of active defrag out of the sparse pages, see
+// DefragHint. A new block goes to a denser page, and the old page may be
+// returned to the system when all its blocks are gone.
+// The blocks moved are counted as hits, the ones checked but kept as misses.
+class QDefragger
+{
+public:
+    // a block of zmalloc or new without pointer to itself
+    void*   Alloc(void* ptr);
+
+    // the value of obj, but the elements of sets and hashes, which are
+    // moved by ScanDict a few buckets at a time
+    void    Value(QObject& obj);
+
+    // move the elements of one bucket of a set or hash, return next cursor
+    template <typename Dict>
+    std::size_t ScanDict(Dict& dict, std::size_t cursor);
+
+    // the node of a dict, or the heap buffers of the strings in it
+    bool    NodeHint(const void* node, const QString& str);
+    bool    NodeHint(const void* node, const std::pair<const QString, QString>& kv);
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+private:
+    static bool _StringHint(const QString& str);
+};
+
+template <typename Dict>
+std::size_t QDefragger::ScanDict(Dict& dict, std::size_t cursor)
+{
+    using Node = typename Dict::element_type;
+
+    return dict.ScanDefrag(cursor, [this](Node* node) -> Node* {
+        if (!NodeHint(node, *node))
+            return nullptr;
+
+        // copy, the strings get new buffers too
+        Node* res = new Node(*node);
+        delete node;
+        return res;
+    });
+}
+
+}
+
+#endif
@@ -0,0 +1,744 @@
+#ifndef BERT_QDICT_H
+#define BERT_QDICT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <sys/mman.h>
+
+#include "QMemory.h"
+
+namespace qedis
+{
+
+// Open addressing hash table, rehashed incrementally like redis dict.
+//
+// Slots are a flat array of {element, hash} probed linearly, the elements
+// are allocated one by one, so pointers to them are stable just as
+// unordered_map, command handlers keep QObject* while inserting other keys.
+//
+// Growing or shrinking allocates a new table, and the elements are moved
+// from the old one a few at a time by insert, erase(key) and Rehash(), the
+// lookups probe both tables meanwhile. A huge db never stalls for rehash.
+//
+// Like unordered_map, insert invalidates the iterators; erase(key) does too
+// while rehashing, erase(iterator) only invalidates the erased one.
+template <typename Value, typename Key, typename KeyOf, typename Hash, typename Equal>
+class QHashTable
+{
+    struct Slot
+    {
+        Value*      node; // nullptr if empty, or Deleted()
+        std::size_t hash;
+    };
+
+    struct Table
+    {
+        Slot*       slots = nullptr;
+        std::size_t capacity = 0; // power of 2
+        std::size_t used = 0;
+        std::size_t deleted = 0;
+    };
+
+    static Value* Deleted() { return reinterpret_cast<Value*>(std::uintptr_t(1)); }
+    static bool   IsLive(const Slot& s) { return s.node && s.node != Deleted(); }
+
+public:
+    using key_type = Key;
+    using value_type = typename std::remove_const<Value>::type;
+    using element_type = Value; // allocated one by one, const for sets
+    using size_type = std::size_t;
+    using hasher = Hash;
+    using key_equal = Equal;
+
+    template <bool Const>
+    class Iterator
+    {
+        friend class QHashTable;
+        using Owner = typename std::conditional<Const, const QHashTable, QHashTable>::type;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename QHashTable::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = typename std::conditional<Const, const Value&, Value&>::type;
+        using pointer = typename std::conditional<Const, const Value*, Value*>::type;
+
+        Iterator() : ht_(nullptr), table_(kEnd), idx_(0) { }
+
+        // iterator to const_iterator
+        template <bool C, typename = typename std::enable_if<Const && !C>::type>
+        Iterator(const Iterator<C>& other) : ht_(other.ht_), table_(other.table_), idx_(other.idx_) { }
+
+        reference operator* () const { return *ht_->tables_[table_].slots[idx_].node; }
+        pointer   operator->() const { return ht_->tables_[table_].slots[idx_].node; }
+
+        Iterator& operator++ ()
+        {
+            ++ idx_;
+            _SkipEmpty();
+            return *this;
+        }
+
+        Iterator  operator++ (int)
+        {
+            Iterator tmp(*this);
+            ++ *this;
+            return tmp;
+        }
+
+        bool operator== (const Iterator& other) const
+        {
+            return table_ == other.table_ && idx_ == other.idx_;
+        }
+
+        bool operator!= (const Iterator& other) const { return !(*this == other); }
+
+    private:
+        template <bool> friend class Iterator;
+
+        static const int kEnd = 2;
+
+        Iterator(Owner* ht, int table, std::size_t idx) : ht_(ht), table_(table), idx_(idx)
+        {
+        }
+
+        // move to the first live slot from current position
+        void _SkipEmpty()
+        {
+            while (table_ != kEnd)
+            {
+                const Table& t = ht_->tables_[table_];
+                while (idx_ < t.capacity && !IsLive(t.slots[idx_]))
+                    ++ idx_;
+
+                if (idx_ < t.capacity)
+                    return;
+
+                // the new table is used only when rehashing
+                table_ = (table_ == 0 && ht_->IsRehashing()) ? 1 : kEnd;
+                idx_ = 0;
+            }
+        }
+
+        Owner*      ht_;
+        int         table_;
+        std::size_t idx_;
+    };
+
+    using iterator = Iterator<!std::is_same<Value, value_type>::value>; // set elements are const
+    using const_iterator = Iterator<true>;
+
+    // every slot is a bucket, for RandomHashMember and ScanHashMember
+    class const_local_iterator
+    {
+    public:
+        const_local_iterator() : node_(nullptr) { }
+        explicit const_local_iterator(const Value* node) : node_(node) { }
+
+        const Value& operator* () const { return *node_; }
+        const Value* operator->() const { return node_; }
+
+        const_local_iterator& operator++ () { node_ = nullptr; return *this; }
+        const_local_iterator  operator++ (int) { auto tmp(*this); node_ = nullptr; return tmp; }
+
+        bool operator== (const const_local_iterator& other) const { return node_ == other.node_; }
+        bool operator!= (const const_local_iterator& other) const { return node_ != other.node_; }
+
+    private:
+        const Value* node_;
+    };
+
+    QHashTable() : rehashIdx_(-1) { }
+    ~QHashTable() { clear(); }
+
+    QHashTable(const QHashTable& other) : rehashIdx_(-1)
+    {
+        reserve(other.size());
+        for (const auto& v : other)
+            insert(v);
+    }
+
+    QHashTable(QHashTable&& other) noexcept : rehashIdx_(-1)
+    {
+        swap(other);
+    }
+
+    QHashTable& operator= (const QHashTable& other)
+    {
+        if (this != &other)
+        {
+            QHashTable tmp(other);
+            swap(tmp);
+        }
+
+        return *this;
+    }
+
+    QHashTable& operator= (QHashTable&& other) noexcept
+    {
+        if (this != &other)
+        {
+            clear();
+            swap(other);
+        }
+
+        return *this;
+    }
+
+    void swap(QHashTable& other) noexcept
+    {
+        std::swap(tables_[0], other.tables_[0]);
+        std::swap(tables_[1], other.tables_[1]);
+        std::swap(rehashIdx_, other.rehashIdx_);
+    }
+
+    iterator       begin()       { return _Begin<iterator>(this); }
+    const_iterator begin() const { return _Begin<const_iterator>(this); }
+    iterator       end()         { return iterator(this, iterator::kEnd, 0); }
+    const_iterator end()   const { return const_iterator(this, const_iterator::kEnd, 0); }
+
+    std::size_t size()  const { return tables_[0].used + tables_[1].used; }
+    bool        empty() const { return size() == 0; }
+
+    void clear()
+    {
+        for (auto& t : tables_)
+        {
+            for (std::size_t i = 0; i < t.capacity; ++ i)
+            {
+                if (IsLive(t.slots[i]))
+                    delete t.slots[i].node;
+            }
+
+            _Free(t);
+            t = Table();
+        }
+
+        rehashIdx_ = -1;
+    }
+
+    // make room for n elements at once, rehashing all now
+    void reserve(std::size_t n)
+    {
+        if (_CapacityFor(n) <= tables_[0].capacity)
+            return;
+
+        _RehashAll();
+        _StartRehash(_CapacityFor(n));
+        _RehashAll();
+    }
+
+    iterator find(const Key& key)
+    {
+        int table;
+        std::size_t idx;
+        if (!_Find(key, _Hash(key), table, idx))
+            return end();
+
+        return iterator(this, table, idx);
+    }
+
+    const_iterator find(const Key& key) const
+    {
+        int table;
+        std::size_t idx;
+        if (!_Find(key, _Hash(key), table, idx))
+            return end();
+
+        return const_iterator(this, table, idx);
+    }
+
+    std::size_t count(const Key& key) const
+    {
+        int table;
+        std::size_t idx;
+        return _Find(key, _Hash(key), table, idx) ? 1 : 0;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        return _Insert(KeyOf()(value), [&value]() { return new Value(value); });
+    }
+
+    std::pair<iterator, bool> insert(value_type&& value)
+    {
+        return _Insert(KeyOf()(value), [&value]() { return new Value(std::move(value)); });
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        // the key is unknown until constructed
+        Value* node = new Value(std::forward<Args>(args)...);
+        auto res = _Insert(KeyOf()(*node), [node]() { return node; });
+        if (!res.second)
+            delete node;
+
+        return res;
+    }
+
+    std::size_t erase(const Key& key)
+    {
+        if (IsRehashing())
+            _RehashStep(1);
+
+        int table;
+        std::size_t idx;
+        if (!_Find(key, _Hash(key), table, idx))
+            return 0;
+
+        _Erase(table, idx);
+        return 1;
+    }
+
+    iterator erase(const_iterator it)
+    {
+        _Erase(it.table_, it.idx_);
+
+        iterator next(this, it.table_, it.idx_);
+        next._SkipEmpty();
+        return next;
+    }
+
+    // incremental rehash, move at most n elements; return true if not done
+    bool Rehash(std::size_t n)
+    {
+        if (!IsRehashing())
+            return false;
+
+        _RehashStep(n);
+        return IsRehashing();
+    }
+
+    bool IsRehashing() const { return rehashIdx_ != -1; }
+
+    // Scan one bucket by a reverse binary cursor like redis dictScan, call
+    // func for the elements of it, return the next cursor, 0 if done.
+    // A bucket is the elements hashed to the slot, they're in the probe run
+    // from it. Increasing the reversed cursor visits the buckets of bigger
+    // table after their low bits, so every element present from the start
+    // to the end of a full scan is returned, even though the table resized.
+    template <typename Func>
+    std::size_t Scan(std::size_t cursor, const Func& func) const
+    {
+        return _Scan(this, cursor, [&func](const Slot& s) { func(*s.node); });
+    }
+
+    // Scan for active defrag: func may return a new element moved from the
+    // one passed and free the old one, or nullptr to keep it. The pointers
+    // to the elements moved are invalid after.
+    template <typename Func>
+    std::size_t ScanDefrag(std::size_t cursor, const Func& func)
+    {
+        return _Scan(this, cursor, [&func](Slot& s) {
+            if (Value* node = func(s.node))
+                s.node = node;
+        });
+    }
+
+    // start shrinking if too sparse after many erases, redis does it in cron
+    bool TryShrink()
+    {
+        const Table& t = tables_[0];
+        if (IsRehashing() || t.capacity <= kMinCapacity || t.used * 8 >= t.capacity)
+            return false;
+
+        _StartRehash(_CapacityFor(t.used));
+        return true;
+    }
+
+    std::size_t bucket_count() const
+    {
+        return tables_[0].capacity + tables_[1].capacity;
+    }
+
+    std::size_t bucket_size(std::size_t bucket) const
+    {
+        return IsLive(_Bucket(bucket)) ? 1 : 0;
+    }
+
+    const_local_iterator begin(std::size_t bucket) const
+    {
+        const Slot& s = _Bucket(bucket);
+        return IsLive(s) ? const_local_iterator(s.node) : const_local_iterator();
+    }
+
+    const_local_iterator end(std::size_t ) const
+    {
+        return const_local_iterator();
+    }
+
+    // bytes of the slots, not including the elements
+    std::size_t SlotsMemory() const
+    {
+        return bucket_count() * sizeof(Slot);
+    }
+
+protected:
+    template <typename It, typename Owner>
+    static It _Begin(Owner* ht)
+    {
+        It it(ht, 0, 0);
+        it._SkipEmpty();
+        return it;
+    }
+
+    std::size_t _Hash(const Key& key) const { return Hash()(key); }
+
+private:
+    template <typename Owner, typename SlotFunc>
+    static std::size_t _Scan(Owner* ht, std::size_t cursor, const SlotFunc& func)
+    {
+        if (ht->empty())
+            return 0;
+
+        const Table* small = &ht->tables_[0];
+        const Table* big = &ht->tables_[1];
+        if (!ht->IsRehashing())
+        {
+            _ScanBucket(*small, cursor, func);
+            return _NextCursor(cursor, small->capacity - 1);
+        }
+
+        if (small->capacity > big->capacity)
+            std::swap(small, big);
+
+        const std::size_t m0 = small->capacity - 1;
+        const std::size_t m1 = big->capacity - 1;
+
+        _ScanBucket(*small, cursor, func);
+
+        // and the buckets of big table expanded from it
+        do
+        {
+            _ScanBucket(*big, cursor, func);
+            cursor = _NextCursor(cursor, m1);
+        } while (cursor & (m0 ^ m1));
+
+        return cursor;
+    }
+
+    template <typename SlotFunc>
+    static void _ScanBucket(const Table& t, std::size_t cursor, const SlotFunc& func)
+    {
+        const std::size_t mask = t.capacity - 1;
+        const std::size_t bucket = cursor & mask;
+        for (std::size_t idx = bucket; t.slots[idx].node; idx = (idx + 1) & mask)
+        {
+            Slot& s = t.slots[idx];
+            if (s.node != Deleted() && (s.hash & mask) == bucket)
+                func(s);
+        }
+    }
+
+    // increase the reversed bits of cursor under mask
+    static std::size_t _NextCursor(std::size_t cursor, std::size_t mask)
+    {
+        cursor |= ~mask;
+        cursor = _Reverse(cursor);
+        ++ cursor;
+        return _Reverse(cursor);
+    }
+
+    static std::size_t _Reverse(std::size_t v)
+    {
+        std::size_t s = 8 * sizeof(v);
+        std::size_t mask = ~std::size_t(0);
+        while ((s >>= 1) > 0)
+        {
+            mask ^= (mask << s);
+            v = ((v >> s) & mask) | ((v << s) & ~mask);
+        }
+
+        return v;
+    }
+
+    static const std::size_t kMinCapacity = 8;
+    static const std::size_t kRehashPerInsert = 4;
+    static const std::size_t kMmapBytes = 1024 * 1024;
+
+    // the load factor is no more than 3/4, and about 1/2 after rehash
+    static std::size_t _CapacityFor(std::size_t n)
+    {
+        std::size_t cap = kMinCapacity;
+        while (cap < n * 2)
+            cap <<= 1;
+
+        return cap;
+    }
+
+    static bool _Full(const Table& t)
+    {
+        return (t.used + t.deleted + 1) * 4 > t.capacity * 3;
+    }
+
+    const Slot& _Bucket(std::size_t bucket) const
+    {
+        if (bucket < tables_[0].capacity)
+            return tables_[0].slots[bucket];
+
+        return tables_[1].slots[bucket - tables_[0].capacity];
+    }
+
+    bool _FindIn(const Table& t, const Key& key, std::size_t hash, std::size_t& idx) const
+    {
+        if (t.used == 0)
+            return false;
+
+        const std::size_t mask = t.capacity - 1;
+        for (idx = hash & mask; t.slots[idx].node; idx = (idx + 1) & mask)
+        {
+            const Slot& s = t.slots[idx];
+            if (s.hash == hash && s.node != Deleted() && Equal()(KeyOf()(*s.node), key))
+                return true;
+        }
+
+        return false;
+    }
+
+    bool _Find(const Key& key, std::size_t hash, int& table, std::size_t& idx) const
+    {
+        for (table = 0; table < 2; ++ table)
+        {
+            if (_FindIn(tables_[table], key, hash, idx))
+                return true;
+        }
+
+        return false;
+    }
+
+    // key is known not in t, reuse a deleted slot if any
+    static std::size_t _Place(Table& t, Value* node, std::size_t hash)
+    {
+        const std::size_t mask = t.capacity - 1;
+        std::size_t idx = hash & mask;
+        while (IsLive(t.slots[idx]))
+            idx = (idx + 1) & mask;
+
+        if (t.slots[idx].node == Deleted())
+            -- t.deleted;
+
+        t.slots[idx].node = node;
+        t.slots[idx].hash = hash;
+        ++ t.used;
+
+        return idx;
+    }
+
+    template <typename Create>
+    std::pair<iterator, bool> _Insert(const Key& key, const Create& create)
+    {
+        // faster than inserting, so the old table is drained before the new one is full
+        if (IsRehashing())
+            _RehashStep(kRehashPerInsert);
+
+        const std::size_t hash = _Hash(key);
+
+        int table;
+        std::size_t idx;
+        if (_Find(key, hash, table, idx))
+            return std::make_pair(iterator(this, table, idx), false);
+
+        _ExpandIfNeeded();
+
+        table = IsRehashing() ? 1 : 0;
+        idx = _Place(tables_[table], create(), hash);
+        return std::make_pair(iterator(this, table, idx), true);
+    }
+
+    void _Erase(int table, std::size_t idx)
+    {
+        Table& t = tables_[table];
+        Slot& s = t.slots[idx];
+
+        delete s.node;
+        -- t.used;
+
+        // no probe passes this slot if the next one is empty
+        if (!t.slots[(idx + 1) & (t.capacity - 1)].node)
+        {
+            s.node = nullptr;
+        }
+        else
+        {
+            s.node = Deleted();
+            ++ t.deleted;
+        }
+    }
+
+    void _ExpandIfNeeded()
+    {
+        if (IsRehashing())
+        {
+            // the new table may be full before the old one drained, rare
+            Table left = tables_[1];
+            left.used += tables_[0].used;
+            if (!_Full(left))
+                return;
+
+            _RehashAll();
+        }
+
+        if (tables_[0].capacity == 0)
+        {
+            _Allocate(tables_[0], kMinCapacity);
+        }
+        else if (_Full(tables_[0]))
+        {
+            // grow, or just clean the deleted slots
+            _StartRehash(_CapacityFor(tables_[0].used + 1));
+        }
+    }
+
+    static void _Allocate(Table& t, std::size_t capacity)
+    {
+        // malloc may memset a big table at once, the zero pages of mmap are
+        // faulted in lazily by the following inserts
+        const std::size_t bytes = capacity * sizeof(Slot);
+        if (bytes >= kMmapBytes)
+        {
+            void* addr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            t.slots = (addr == MAP_FAILED) ? nullptr : static_cast<Slot*>(addr);
+        }
+        else
+        {
+            t.slots = static_cast<Slot*>(zcalloc(capacity, sizeof(Slot)));
+        }
+
+        if (!t.slots)
+            throw std::bad_alloc();
+
+        if (bytes >= kMmapBytes)
+            AddUsedMemory(static_cast<long>(bytes));
+        AddHashTableMemory(static_cast<long>(bytes));
+
+        t.capacity = capacity;
+        t.used = 0;
+        t.deleted = 0;
+    }
+
+    static void _Free(Table& t)
+    {
+        const std::size_t bytes = t.capacity * sizeof(Slot);
+        if (bytes >= kMmapBytes)
+        {
+            ::munmap(t.slots, bytes);
+            AddUsedMemory(-static_cast<long>(bytes));
+        }
+        else
+        {
+            zfree(t.slots);
+        }
+
+        AddHashTableMemory(-static_cast<long>(bytes));
+    }
+
+    void _StartRehash(std::size_t capacity)
+    {
+        if (tables_[0].capacity == 0)
+        {
+            _Allocate(tables_[0], capacity);
+            return;
+        }
+
+        _Allocate(tables_[1], capacity);
+        rehashIdx_ = 0;
+    }
+
+    // move n elements from the old table, visit 10n empty slots at most
+    void _RehashStep(std::size_t n)
+    {
+        Table& from = tables_[0];
+        Table& to = tables_[1];
+
+        std::size_t emptyVisits = n * 10;
+        std::size_t idx = static_cast<std::size_t>(rehashIdx_);
+        while (n > 0 && idx < from.capacity)
+        {
+            Slot& s = from.slots[idx ++];
+            if (!IsLive(s))
+            {
+                if (-- emptyVisits == 0)
+                    break;
+
+                continue;
+            }
+
+            _Place(to, s.node, s.hash);
+
+            // the old table is never inserted while rehashing
+            s.node = Deleted();
+            -- from.used;
+            ++ from.deleted;
+            -- n;
+        }
+
+        rehashIdx_ = static_cast<std::ptrdiff_t>(idx);
+
+        if (idx == from.capacity || from.used == 0)
+        {
+            _Free(from);
+            from = to;
+            to = Table();
+            rehashIdx_ = -1;
+        }
+    }
+
+    void _RehashAll()
+    {
+        while (IsRehashing())
+            _RehashStep(tables_[0].capacity);
+    }
+
+    // tables_[1] is used only when rehashing from tables_[0]
+    Table tables_[2];
+    std::ptrdiff_t rehashIdx_;
+};
+
+
+template <typename K, typename V>
+struct QDictKeyOf
+{
+    const K& operator() (const std::pair<const K, V>& v) const { return v.first; }
+};
+
+template <typename K>
+struct QSetKeyOf
+{
+    const K& operator() (const K& v) const { return v; }
+};
+
+template <typename K, typename V, typename Hash, typename Equal = std::equal_to<K> >
+class QDict : public QHashTable<std::pair<const K, V>, K, QDictKeyOf<K, V>, Hash, Equal>
+{
+public:
+    using mapped_type = V;
+
+    V& operator[] (const K& key)
+    {
+        auto it = this->find(key);
+        if (it != this->end())
+            return it->second;
+
+        return this->emplace(std::piecewise_construct,
+                             std::forward_as_tuple(key),
+                             std::forward_as_tuple()).first->second;
+    }
+};
+
+template <typename K, typename Hash, typename Equal = std::equal_to<K> >
+class QHashSet : public QHashTable<const K, K, QSetKeyOf<K>, Hash, Equal>
+{
+};
+
+}
+
+#endif
+
@@ -1,5 +1,7 @@
 #include "QHash.h"
 #include "QStore.h"
+#include "QConfig.h"
+#include "QGlobRegex.h"
 #include <cassert>
 
 namespace qedis
@@ -8,10 +10,146 @@ namespace qedis
 QObject QObject::CreateHash()
 {
     QObject obj(QType_hash);
-    obj.Reset(new QHash);
+    obj.encoding = QEncode_ziphash;
+    obj.Reset(ZipListNew());
     return obj;
 }
 
+static void _ConvertHash(QObject& obj)
+{
+    assert (obj.encoding == QEncode_ziphash);
+
+    PZIPLIST zl = obj.CastZipList();
+    std::unique_ptr<QHash> hash(new QHash);
+    hash->reserve(ZipListSize(zl) / 2);
+
+    for (unsigned char* p = ZipListFirst(zl); p; )
+    {
+        unsigned char* v = ZipListNext(zl, p);
+        assert (v);
+
+        hash->insert(QHash::value_type(ZipListGet(p), ZipListGet(v)));
+        p = ZipListNext(zl, v);
+    }
+
+    obj.Reset(hash.release());
+    obj.encoding = QEncode_hash;
+}
+
+bool HashGet(const QObject& obj, const QString& field, QString* value)
+{
+    if (obj.encoding == QEncode_ziphash)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = ZipListFind(zl, field, 1);
+        if (!p)
+            return false;
+
+        if (value)
+            *value = ZipListGet(ZipListNext(zl, p));
+
+        return true;
+    }
+
+    auto hash = obj.CastHash();
+    auto it = hash->find(field);
+    if (it == hash->end())
+        return false;
+
+    if (value)
+        *value = it->second;
+
+    return true;
+}
+
+bool HashSet(QObject& obj, const QString& field, const QString& value)
+{
+    if (obj.encoding == QEncode_ziphash)
+    {
+        const size_t maxValue = static_cast<size_t>(g_config.hashMaxZiplistValue);
+        if (field.size() > maxValue || value.size() > maxValue)
+            _ConvertHash(obj);
+    }
+
+    if (obj.encoding == QEncode_ziphash)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = ZipListFind(zl, field, 1);
+        if (p)
+        {
+            p = ZipListNext(zl, p);
+            obj.value = ZipListReplace(zl, &p, value);
+            return false;
+        }
+
+        zl = ZipListPush(zl, field);
+        zl = ZipListPush(zl, value);
+        obj.value = zl;
+
+        if (ZipListSize(zl) / 2 > static_cast<size_t>(g_config.hashMaxZiplistEntries))
+            _ConvertHash(obj);
+
+        return true;
+    }
+
+    auto hash = obj.CastHash();
+    auto it(hash->find(field));
+    if (it != hash->end())
+    {
+        it->second = value;
+        return false;
+    }
+
+    hash->insert(QHash::value_type(field, value));
+    return true;
+}
+
+bool HashDelete(QObject& obj, const QString& field)
+{
+    if (obj.encoding == QEncode_ziphash)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = ZipListFind(zl, field, 1);
+        if (!p)
+            return false;
+
+        zl = ZipListDelete(zl, &p); // field
+        zl = ZipListDelete(zl, &p); // value
+        obj.value = zl;
+        return true;
+    }
+
+    return obj.CastHash()->erase(field) != 0;
+}
+
+size_t HashSize(const QObject& obj)
+{
+    if (obj.encoding == QEncode_ziphash)
+        return ZipListSize(obj.CastZipList()) / 2;
+
+    return obj.CastHash()->size();
+}
+
+void HashForEach(const QObject& obj,
+                 const std::function<void (const QString& field, const QString& value)>& func)
+{
+    if (obj.encoding == QEncode_ziphash)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        for (unsigned char* p = ZipListFirst(zl); p; )
+        {
+            unsigned char* v = ZipListNext(zl, p);
+            func(ZipListGet(p), ZipListGet(v));
+            p = ZipListNext(zl, v);
+        }
+    }
+    else
+    {
+        for (const auto& kv : *obj.CastHash())
+            func(kv.first, kv.second);
+    }
+}
+
 #define GET_HASH(hashname)  \
     QObject* value;  \
     QError err = QSTORE.GetValueByType(hashname, value, QType_hash);  \
@@ -32,28 +170,11 @@ QObject QObject::CreateHash()
     }
 
 
-QHash::iterator _set_hash_force(QHash& hash, const QString& key, const QString& val)
-{
-    auto it(hash.find(key));
-    if (it != hash.end())
-        it->second = val;
-    else
-        it = hash.insert(QHash::value_type(key, val)).first;
-
-    return it;
-}
-
-bool _set_hash_if_notexist(QHash& hash, const QString& key, const QString& val)
-{
-    return hash.insert(QHash::value_type(key, val)).second;
-}
-
 QError hset(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_OR_SET_HASH(params[1]);
     
-    auto hash= value->CastHash();
-    _set_hash_force(*hash, params[2], params[3]);
+    HashSet(*value, params[2], params[3]);
     
     FormatInt(1, reply);
     return QError_ok;
@@ -69,9 +190,8 @@ QError hmset(const std::vector<QString>& params, UnboundedBuffer* reply)
     
     GET_OR_SET_HASH(params[1]);
 
-    auto hash= value->CastHash();
     for (size_t i = 2; i < params.size(); i += 2)
-        _set_hash_force(*hash, params[i], params[i + 1]);
+        HashSet(*value, params[i], params[i + 1]);
     
     FormatOK(reply);
     return QError_ok;
@@ -81,11 +201,9 @@ QError hget(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_HASH(params[1]);
     
-    auto hash= value->CastHash();
-    auto it = hash->find(params[2]);
-
-    if (it != hash->end())
-        FormatBulk(it->second, reply);
+    QString val;
+    if (HashGet(*value, params[2], &val))
+        FormatBulk(val, reply);
     else
         FormatNull(reply);
 
@@ -99,12 +217,11 @@ QError hmget(const std::vector<QString>& params, UnboundedBuffer* reply)
 
     PreFormatMultiBulk(params.size() - 2, reply);
 
-    auto hash= value->CastHash();
+    QString val;
     for (size_t i = 2; i < params.size(); ++ i)
     {
-        auto it = hash->find(params[i]);
-        if (it != hash->end())
-            FormatBulk(it->second, reply);
+        if (HashGet(*value, params[i], &val))
+            FormatBulk(val, reply);
         else
             FormatNull(reply);
     }
@@ -116,14 +233,12 @@ QError hgetall(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_HASH(params[1]);
 
-    auto hash = value->CastHash();
-    PreFormatMultiBulk(2 * hash->size(), reply);
+    PreFormatMultiBulk(2 * HashSize(*value), reply);
     
-    for (const auto& kv : *hash)
-    {
-        FormatBulk(kv.first, reply);
-        FormatBulk(kv.second, reply);
-    }
+    HashForEach(*value, [reply](const QString& field, const QString& val) {
+        FormatBulk(field, reply);
+        FormatBulk(val, reply);
+    });
     
     return QError_ok;
 }
@@ -132,13 +247,11 @@ QError hkeys(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_HASH(params[1]);
 
-    auto hash = value->CastHash();
-    PreFormatMultiBulk(hash->size(), reply);
+    PreFormatMultiBulk(HashSize(*value), reply);
 
-    for (const auto& kv : *hash)
-    {
-        FormatBulk(kv.first, reply);
-    }
+    HashForEach(*value, [reply](const QString& field, const QString& ) {
+        FormatBulk(field, reply);
+    });
     
     return QError_ok;
 }
@@ -147,13 +260,11 @@ QError hvals(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_HASH(params[1]);
 
-    auto hash = value->CastHash();
-    PreFormatMultiBulk(hash->size(), reply);
+    PreFormatMultiBulk(HashSize(*value), reply);
     
-    for (const auto& kv : *hash)
-    {
-        FormatBulk(kv.second, reply);
-    }
+    HashForEach(*value, [reply](const QString& , const QString& val) {
+        FormatBulk(val, reply);
+    });
     
     return QError_ok;
 }
@@ -169,16 +280,10 @@ QError  hdel(const std::vector<QString>& params, UnboundedBuffer* reply)
     }
 
     int del = 0;
-    auto hash = value->CastHash();
     for (size_t i = 2; i < params.size(); ++ i)
     {
-        auto it = hash->find(params[i]);
-
-        if (it != hash->end())
-        {
-            hash->erase(it);
+        if (HashDelete(*value, params[i]))
             ++ del;
-        }
     }
             
     FormatInt(del, reply);
@@ -189,10 +294,7 @@ QError hexists(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_HASH(params[1]);
 
-    auto hash= value->CastHash();
-    auto it = hash->find(params[2]);
-
-    if (it != hash->end())
+    if (HashGet(*value, params[2]))
         FormatInt(1, reply);
     else
         FormatInt(0, reply);
@@ -204,8 +306,7 @@ QError hlen(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_HASH(params[1]);
 
-    auto hash= value->CastHash();
-    FormatInt(hash->size(), reply);
+    FormatInt(HashSize(*value), reply);
     return QError_ok;
 }
 
@@ -213,14 +314,11 @@ QError hincrby(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_OR_SET_HASH(params[1]);
     
-    auto hash = value->CastHash();
     long val = 0;
-    QString* str = nullptr;
-    auto it(hash->find(params[2]));
-    if (it != hash->end())
+    QString str;
+    if (HashGet(*value, params[2], &str))
     {
-        str = &it->second;
-        if (Strtol(str->c_str(), static_cast<int>(str->size()), &val))
+        if (Strtol(str.c_str(), static_cast<int>(str.size()), &val))
         {
             val += atoi(params[3].c_str());
         }
@@ -233,13 +331,11 @@ QError hincrby(const std::vector<QString>& params, UnboundedBuffer* reply)
     else
     {
         val = atoi(params[3].c_str());
-        auto it = _set_hash_force(*hash, params[2], "");
-        str = &it->second;
     }
 
     char tmp[32];
     snprintf(tmp, sizeof tmp - 1, "%ld", val);
-    *str = tmp;
+    HashSet(*value, params[2], tmp);
 
     FormatInt(val, reply);
     return QError_ok;
@@ -249,14 +345,11 @@ QError hincrbyfloat(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_OR_SET_HASH(params[1]);
     
-    auto hash = value->CastHash();
     float val = 0;
-    QString* str = 0;
-    auto it(hash->find(params[2]));
-    if (it != hash->end())
+    QString str;
+    if (HashGet(*value, params[2], &str))
     {
-        str = &it->second;
-        if (Strtof(str->c_str(), static_cast<int>(str->size()), &val))
+        if (Strtof(str.c_str(), static_cast<int>(str.size()), &val))
         {
             val += atof(params[3].c_str());
         }
@@ -269,15 +362,14 @@ QError hincrbyfloat(const std::vector<QString>& params, UnboundedBuffer* reply)
     else
     {
         val = atof(params[3].c_str());
-        auto it = _set_hash_force(*hash, params[2], "");
-        str = &it->second;
     }
 
     char tmp[32];
     snprintf(tmp, sizeof tmp - 1, "%f", val);
-    *str = tmp;
+    str = tmp;
+    HashSet(*value, params[2], str);
 
-    FormatBulk(*str, reply);
+    FormatBulk(str, reply);
     return QError_ok;
 }
 
@@ -285,11 +377,15 @@ QError hsetnx(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_OR_SET_HASH(params[1]);
     
-    auto hash= value->CastHash();
-    if (_set_hash_if_notexist(*hash, params[2], params[3]))
+    if (!HashGet(*value, params[2]))
+    {
+        HashSet(*value, params[2], params[3]);
         FormatInt(1, reply);
+    }
     else
+    {
         FormatInt(0, reply);
+    }
 
     return QError_ok;
 }
@@ -304,29 +400,36 @@ QError hstrlen(const std::vector<QString>& params, UnboundedBuffer* reply)
         return err;
     }
     
-    auto hash= value->CastHash();
-    auto it = hash->find(params[2]);
-    if (it == hash->end())
+    QString val;
+    if (!HashGet(*value, params[2], &val))
         Format0(reply);
     else
-        FormatInt(static_cast<long>(it->second.size()), reply);
+        FormatInt(static_cast<long>(val.size()), reply);
 
     return QError_ok;
 }
 
-size_t HScanKey(const QHash& hash, size_t cursor, size_t count, std::vector<QString>& res)
+size_t HScanKey(const QObject& obj, size_t cursor, size_t count, const QString* pattern,
+                std::vector<QString>& res)
 {
-    if (hash.empty())
+    auto filter = [&](const QString& field, const QString& val) {
+        if (!pattern || glob_match(*pattern, field))
+        {
+            res.push_back(field);
+            res.push_back(val);
+        }
+    };
+
+    if (obj.encoding == QEncode_ziphash)
+    {
+        // small hash is returned in a single call, like redis
+        HashForEach(obj, filter);
         return 0;
-    
-    std::vector<QHash::const_local_iterator> iters;
-    size_t newCursor = ScanHashMember(hash, cursor, count, iters);
-    
-    res.reserve(iters.size());
-    for (auto it : iters)
-        res.push_back(it->first), res.push_back(it->second);
-    
-    return newCursor;
+    }
+
+    return ScanHashMember(*obj.CastHash(), cursor, count, [&filter](const QHash::value_type& kv) {
+        filter(kv.first, kv.second);
+    });
 }
 
 }
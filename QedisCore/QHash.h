@@ -3,16 +3,29 @@
 
 #include "QString.h"
 #include "QHelper.h"
+#include "QDict.h"
 
-#include <unordered_map>
+#include <functional>
 
 namespace qedis
 {
 
-using QHash = std::unordered_map<QString, QString, my_hash, std::equal_to<QString> >;
-
-
-size_t   HScanKey(const QHash& hash, size_t cursor, size_t count, std::vector<QString>& res);
+using QHash = QDict<QString, QString, my_hash>;
+
+// Encoding independent hash operations.
+// A small hash is a ziplist of field-value pairs, it's converted to QHash
+// when exceeds hash-max-ziplist-entries or hash-max-ziplist-value.
+bool        HashGet(const QObject& obj, const QString& field, QString* value = nullptr);
+// return true if field is new
+bool        HashSet(QObject& obj, const QString& field, const QString& value);
+bool        HashDelete(QObject& obj, const QString& field);
+std::size_t HashSize(const QObject& obj);
+void        HashForEach(const QObject& obj,
+                        const std::function<void (const QString& field, const QString& value)>& func);
+
+// pattern is optional
+size_t   HScanKey(const QObject& obj, size_t cursor, size_t count, const QString* pattern,
+                  std::vector<QString>& res);
 
 }
 
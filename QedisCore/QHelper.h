@@ -48,67 +48,27 @@ inline typename HASH::const_local_iterator RandomHashMember(const HASH& containe
     return typename HASH::const_local_iterator();
 }
 
-// scan
-template <typename HASH>
+// scan by the reverse binary cursor of QHashTable::Scan, stop after visiting
+// count elements, or 10 times count buckets for a sparse table, like redis.
+// func is called for every visited element, it does the filtering.
+template <typename HASH, typename Func>
 inline size_t ScanHashMember(const HASH& container,
                              size_t cursor,
                              size_t count,
-                             std::vector<typename HASH::const_local_iterator>& res)
+                             const Func& func)
 {
-    if (cursor >= container.size())
-    {
-        return 0;
-    }
+    size_t visited = 0;
+    size_t maxBuckets = count * 10;
 
-    auto idx = cursor;
-    for (decltype(container.bucket_count()) bucket = 0;
-         bucket < container.bucket_count();
-         ++ bucket)
+    do
     {
-        const auto bktSize = container.bucket_size(bucket);
-        if (idx < bktSize)
-        {
-            // find the bucket;
-            auto   it = container.begin(bucket);
-            while (idx > 0)
-            {
-                ++ it;
-                -- idx;
-            }
-
-            size_t newCursor = cursor;
-            auto   end = container.end(bucket);
-            while (res.size() < count && it != end)
-            {
-                ++ newCursor;
-                res.push_back(it ++);
-
-                if (it == end)
-                {
-                    while (++ bucket < container.bucket_count())
-                    {
-                        if (container.bucket_size(bucket) > 0)
-                        {
-                            it  = container.begin(bucket);
-                            end = container.end(bucket);
-                            break;
-                        }
-                    }
-
-                    if (bucket == container.bucket_count())
-                        return  0;
-                }
-            }
-
-            return  newCursor;
-        }
-        else
-        {
-            idx -= bktSize;
-        }
-    }
+        cursor = container.Scan(cursor, [&](const typename HASH::value_type& v) {
+            ++ visited;
+            func(v);
+        });
+    } while (cursor != 0 && visited < count && -- maxBuckets > 0);
 
-    return 0;   // never here
+    return cursor;
 }
     
 extern void getRandomHexChars(char *p, unsigned int len);
@@ -6,37 +6,32 @@
 namespace qedis
 {
 
-QError type(const std::vector<QString>& params, UnboundedBuffer* reply)
+static const char* TypeName(QType type)
 {
-    const char* info = 0;
-    QType type = QSTORE.KeyType(params[1]);
     switch (type) {
         case QType_hash:
-            info = "hash";
-            break;
+            return "hash";
             
         case QType_set:
-            info = "set";
-            break;
+            return "set";
             
         case QType_string:
-            info = "string";
-            break;
+            return "string";
             
         case QType_list:
-            info = "list";
-            break;
+            return "list";
             
         case QType_sortedSet:
-            info = "sortedSet";
-            break;
+            return "sortedSet";
             
         default:
-            info = "none";
-            break;
+            return "none";
     }
+}
 
-    FormatSingle(info, reply);
+QError type(const std::vector<QString>& params, UnboundedBuffer* reply)
+{
+    FormatSingle(TypeName(QSTORE.KeyType(params[1])), reply);
     return QError_ok;
 }
 
@@ -58,28 +53,32 @@ QError del(const std::vector<QString>& params, UnboundedBuffer* reply)
         const QString& key = params[i];
     
         if (QSTORE.DeleteKey(key))
-        {
-            QSTORE.ClearExpire(key);
             ++ nDel;
-        }
     }
     
     FormatInt(nDel, reply);
     return QError_ok;
 }
 
-static int _SetExpireByMs(const QString& key, uint64_t absTimeout)
+// like del, but the big values are freed in background
+QError unlink(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
-    INF << "try set expire, key " << key.c_str() << ", timeout is " << absTimeout;
-
-    int ret = 0;
-    if (QSTORE.ExistsKey(key))
+    int nDel = 0;
+    for (size_t i = 1; i < params.size(); ++ i)
     {
-        QSTORE.SetExpire(key, absTimeout);
-        ret = 1;
+        if (QSTORE.DeleteKey(params[i], true))
+            ++ nDel;
     }
 
-    return ret;
+    FormatInt(nDel, reply);
+    return QError_ok;
+}
+
+static int _SetExpireByMs(const QString& key, uint64_t absTimeout)
+{
+    INF << "try set expire, key " << key.c_str() << ", timeout is " << absTimeout;
+
+    return QSTORE.SetExpire(key, absTimeout) ? 1 : 0;
 }
 
 QError expire(const std::vector<QString>& params, UnboundedBuffer* reply)
@@ -194,7 +193,6 @@ QError move(const std::vector<QString>& params, UnboundedBuffer* reply)
             QSTORE.SetValue(key, std::move(*val)); // set to new db
             
             QSTORE.SelectDB(fromDb);
-            QSTORE.ClearExpire(key);
             QSTORE.DeleteKey(key); // delete from old db
             
             ret = 1;
@@ -219,9 +217,14 @@ QError keys(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     const QString& pattern = params[1];
     
+    const uint64_t now = ::Now();
     std::vector<const QString* > results;
     for (const auto& kv : QSTORE)
     {
+        // expired, but not deleted by cron yet
+        if (kv.second.expire != 0 && kv.second.expire <= now)
+            continue;
+
         if (glob_match(pattern, kv.first))
             results.push_back(&kv.first);
     }
@@ -270,7 +273,6 @@ static QError RenameKey(const QString& oldKey, const QString& newKey, bool force
     else if (ttl == QStore::persist)
         QSTORE.ClearExpire(newKey);
     
-    QSTORE.ClearExpire(oldKey);
     QSTORE.DeleteKey(oldKey);
     
     return QError_ok;
@@ -297,20 +299,37 @@ QError renamenx(const std::vector<QString>& params, UnboundedBuffer* reply)
 }
 
 // helper func scan
-static QError ParseScanOption(const std::vector<QString>& params, int start, long& count, const char*& pattern)
+// type is nullptr if TYPE option is not supported
+static QError ParseScanOption(const std::vector<QString>& params, int start, long& count,
+                              const QString*& pattern, QType* type = nullptr)
 {
-    // scan cursor  MATCH pattern  COUNT 1
+    // scan cursor  MATCH pattern  COUNT 1  TYPE string
     count = -1;
     pattern = nullptr;
     for (std::size_t i = start; i < params.size(); i += 2)
     {
-        if (params[i].size() == 5)
+        if (type && params[i].size() == 4 && strncasecmp(params[i].c_str(), "type", 4) == 0)
+        {
+            // the name of TYPE command, or zset like redis
+            for (int t = QType_string; t <= QType_hash; ++ t)
+            {
+                if (strcasecmp(params[i + 1].c_str(), TypeName(QType(t))) == 0)
+                    *type = QType(t);
+            }
+
+            if (strcasecmp(params[i + 1].c_str(), "zset") == 0)
+                *type = QType_sortedSet;
+
+            if (*type != QType_invalid)
+                continue;
+        }
+        else if (params[i].size() == 5)
         {
             if (strncasecmp(params[i].c_str(), "match", 5) == 0)
             {
                 if (!pattern)
                 {
-                    pattern = params[i + 1].c_str();
+                    pattern = &params[i + 1];
                     continue;
                 }
             }
@@ -346,11 +365,12 @@ QError scan(const std::vector<QString>& params, UnboundedBuffer* reply)
         return QError_param;
     }
     
-    // scan cursor  MATCH pattern  COUNT 1
+    // scan cursor  MATCH pattern  COUNT 1  TYPE string
     long count  = -1;
-    const char* pattern = nullptr;
+    const QString* pattern = nullptr;
+    QType type = QType_invalid;
     
-    QError err = ParseScanOption(params, 2, count, pattern);
+    QError err = ParseScanOption(params, 2, count, pattern, &type);
     if (err != QError_ok)
     {
         ReplyError(err, reply);
@@ -360,19 +380,7 @@ QError scan(const std::vector<QString>& params, UnboundedBuffer* reply)
     if (count < 0) count = 5;
     
     std::vector<QString>  res;
-    auto newCursor = QSTORE.ScanKey(cursor, count, res);
-  
-    // filter by pattern
-    if (pattern)
-    {
-        for (auto it = res.begin(); it != res.end(); )
-        {
-            if (!glob_match(pattern, (*it).c_str()))
-                it = res.erase(it);
-            else
-                ++ it;
-        }
-    }
+    auto newCursor = QSTORE.ScanKey(cursor, count, pattern, type, res);
     
     // reply
     PreFormatMultiBulk(2, reply);
@@ -418,7 +426,7 @@ QError hscan(const std::vector<QString>& params, UnboundedBuffer* reply)
     
     // parse option
     long count = -1;
-    const char* pattern = nullptr;
+    const QString* pattern = nullptr;
     
     err = ParseScanOption(params, 3, count, pattern);
     if (err != QError_ok)
@@ -431,24 +439,7 @@ QError hscan(const std::vector<QString>& params, UnboundedBuffer* reply)
     
     // scan
     std::vector<QString>  res;
-    auto newCursor = HScanKey(*value->CastHash(), cursor, count, res);
-    
-    // filter by pattern
-    if (pattern)
-    {
-        for (auto it = res.begin(); it != res.end(); )
-        {
-            if (!glob_match(pattern, (*it).c_str()))
-            {
-                it = res.erase(it); // erase key
-                it = res.erase(it); // erase value
-            }
-            else
-            {
-                ++ it, ++ it;
-            }
-        }
-    }
+    auto newCursor = HScanKey(*value, cursor, count, pattern, res);
     
     // reply
     PreFormatMultiBulk(2, reply);
@@ -494,7 +485,7 @@ QError sscan(const std::vector<QString>& params, UnboundedBuffer* reply)
     
     // parse option
     long count  = -1;
-    const char* pattern = nullptr;
+    const QString* pattern = nullptr;
     
     err = ParseScanOption(params, 3, count, pattern);
     if (err != QError_ok)
@@ -507,23 +498,7 @@ QError sscan(const std::vector<QString>& params, UnboundedBuffer* reply)
     
     // scan
     std::vector<QString> res;
-    auto newCursor = SScanKey(*value->CastSet(), cursor, count, res);
-    
-    // filter by pattern
-    if (pattern)
-    {
-        for (auto it = res.begin(); it != res.end(); )
-        {
-            if (!glob_match(pattern, (*it).c_str()))
-            {
-                it = res.erase(it);
-            }
-            else
-            {
-                ++ it;
-            }
-        }
-    }
+    auto newCursor = SScanKey(*value, cursor, count, pattern, res);
     
     // reply
     PreFormatMultiBulk(2, reply);
@@ -570,25 +545,19 @@ QError sort(const std::vector<QString>& params, UnboundedBuffer* reply)
             alpha = true;
     }
     
-    std::vector<const QString* > values;
+    std::vector<QString> values;
     switch (value->type)
     {
         case QType_list:
-        {
-            PLIST l = value->CastList();
-            std::for_each(l->begin(), l->end(), [&](const QString& v) {
-                values.push_back(&v);
+            ListForEach(*value, [&](const QString& v) {
+                values.push_back(v);
             });
-        }
             break;
             
         case QType_set:
-        {
-            PSET s = value->CastSet();
-            std::for_each(s->begin(), s->end(), [&](const QString& v) {
-                values.push_back(&v);
+            SetForEach(*value, [&](const QString& v) {
+                values.push_back(v);
             });
-        }
             break;
             
         case QType_sortedSet:
@@ -603,12 +572,12 @@ QError sort(const std::vector<QString>& params, UnboundedBuffer* reply)
             break;
     }
 
-    std::sort(values.begin(), values.end(), [=](const QString* a, const QString* b)->bool {
+    std::sort(values.begin(), values.end(), [=](const QString& a, const QString& b)->bool {
         if (!alpha)
         {
             long avalue = 0, bvalue = 0;
-            TryStr2Long(a->data(), a->size(), avalue);
-            TryStr2Long(b->data(), b->size(), bvalue);
+            TryStr2Long(a.data(), a.size(), avalue);
+            TryStr2Long(b.data(), b.size(), bvalue);
             
             if (asc)
                 return avalue < bvalue;
@@ -618,18 +587,18 @@ QError sort(const std::vector<QString>& params, UnboundedBuffer* reply)
         else
         {
             if (asc)
-                return std::lexicographical_compare(a->begin(), a->end(),
-                                                    b->begin(), b->end());
+                return std::lexicographical_compare(a.begin(), a.end(),
+                                                    b.begin(), b.end());
             else
-                return std::lexicographical_compare(b->begin(), b->end(),
-                                                    a->begin(), a->end());
+                return std::lexicographical_compare(b.begin(), b.end(),
+                                                    a.begin(), a.end());
         }
     });
     
     PreFormatMultiBulk(values.size(), reply);
-    for (const auto v : values)
+    for (const auto& v : values)
     {
-        FormatBulk(*v, reply);
+        FormatBulk(v, reply);
     }
     
     return QError_ok;
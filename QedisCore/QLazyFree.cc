@@ -0,0 +1,120 @@
+#include "QLazyFree.h"
+#include "QStore.h"
+#include "QConfig.h"
+#include "Threads/ThreadPool.h"
+
+namespace qedis
+{
+
+QLazyFree& QLazyFree::Instance()
+{
+    static QLazyFree lazyFree;
+    return lazyFree;
+}
+
+void QLazyFree::Start()
+{
+    if (alive_)
+        return;
+
+    alive_ = true;
+    future_ = ThreadPool::Instance().ExecuteTask(std::bind(&QLazyFree::_Run, this));
+}
+
+void QLazyFree::Stop()
+{
+    if (!alive_)
+        return;
+
+    {
+        std::lock_guard<std::mutex>  guard(mutex_);
+        alive_ = false;
+    }
+
+    cond_.notify_one();
+
+    if (future_.valid())
+        future_.wait();
+}
+
+std::size_t QLazyFree::FreeEffort(const QObject& obj)
+{
+    // the compact encodings and strings are one or two blocks
+    switch (obj.encoding)
+    {
+        case QEncode_list:
+            return obj.CastList()->NodeCount();
+
+        case QEncode_set:
+            return obj.CastSet()->size();
+
+        case QEncode_sset:
+            return obj.CastSortedSet()->Size();
+
+        case QEncode_hash:
+            return obj.CastHash()->size();
+
+        default:
+            return 1;
+    }
+}
+
+bool QLazyFree::FreeObject(QObject& obj)
+{
+    if (!Enabled() ||
+        FreeEffort(obj) <= static_cast<std::size_t>(g_config.lazyfreeThreshold))
+        return false;
+
+    auto holder = std::make_shared<QObject>(std::move(obj));
+    std::function<void ()> task([holder]() mutable { holder.reset(); });
+    holder.reset();
+    _Push(std::move(task), 1);
+
+    return true;
+}
+
+void QLazyFree::_Push(std::function<void ()>&& task, std::size_t n)
+{
+    pending_ += n;
+
+    {
+        std::lock_guard<std::mutex>  guard(mutex_);
+        tasks_.emplace_back(std::move(task), n);
+    }
+
+    cond_.notify_one();
+}
+
+void QLazyFree::_Run()
+{
+    decltype(tasks_) tasks;
+
+    // the tasks left are freed before exit
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex>  guard(mutex_);
+            cond_.wait(guard, [this]() {
+                return !tasks_.empty() || !alive_;
+            });
+
+            if (tasks_.empty() && !alive_)
+                break;
+
+            tasks.swap(tasks_);
+        }
+
+        for (auto& task : tasks)
+        {
+            task.first();
+            task.first = nullptr;
+
+            pending_ -= task.second;
+            freed_ += task.second;
+        }
+
+        tasks.clear();
+    }
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef BERT_QLAZYFREE_H
+#define BERT_QLAZYFREE_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace qedis
+{
+
+struct QObject;
+
+// Background thread freeing the big values, like lazyfree of redis.
+// Freeing a set of millions of members, or a whole db, takes seconds on the
+// thread executing commands; the worker takes the ownership of them instead.
+// The memory freed is counted by the worker, so used_memory drops later.
+class QLazyFree
+{
+public:
+    static QLazyFree& Instance();
+
+    QLazyFree(const QLazyFree& ) = delete;
+    void operator= (const QLazyFree& ) = delete;
+
+    void  Start();
+    void  Stop();
+
+    // if not started, everything is freed at once by the caller
+    bool  Enabled() const { return alive_; }
+
+    // about the number of allocations to free the value
+    static std::size_t FreeEffort(const QObject& obj);
+
+    // move the value to the worker if its effort is over lazyfree-threshold,
+    // or leave it to the caller. true if moved
+    bool  FreeObject(QObject& obj);
+
+    // whole db or index, n is the objects in it, always freed in background.
+    // data is left empty
+    template <typename T>
+    void  Free(T& data, std::size_t n);
+
+    std::size_t  Pending() const { return pending_; }
+    uint64_t     Freed() const { return freed_; }
+
+private:
+    QLazyFree() : alive_(false) { }
+
+    void  _Push(std::function<void ()>&& task, std::size_t n);
+    void  _Run();
+
+    std::atomic<bool>  alive_;
+    std::atomic<std::size_t>  pending_ {0};
+    std::atomic<uint64_t>  freed_ {0};
+
+    std::mutex  mutex_;
+    std::condition_variable  cond_;
+    std::deque<std::pair<std::function<void ()>, std::size_t> > tasks_;
+    std::future<void>  future_;
+};
+
+template <typename T>
+void QLazyFree::Free(T& data, std::size_t n)
+{
+    auto holder = std::make_shared<T>(std::move(data));
+    if (!Enabled() || n == 0)
+        return;
+
+    // the data is destroyed with the task, in the worker
+    std::function<void ()> task([holder]() mutable { holder.reset(); });
+    holder.reset();
+    _Push(std::move(task), n);
+}
+
+}
+
+#endif
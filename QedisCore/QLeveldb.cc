@@ -108,6 +108,8 @@ void QLeveldb::_EncodeObject(const QObject& obj, int64_t absttl, UnboundedBuffer
     {
         case QEncode_raw:
         case QEncode_int:
+        case QEncode_embstr:
+        case QEncode_sharedstr:
             {
                 auto str = GetDecodedString(&obj);
                 _EncodeString(*str, v);
@@ -115,19 +117,24 @@ void QLeveldb::_EncodeObject(const QObject& obj, int64_t absttl, UnboundedBuffer
             break;
     
         case QEncode_list:
-            _EncodeList(obj.CastList(), v);
+        case QEncode_ziplist:
+            _EncodeList(obj, v);
             break;
             
         case QEncode_set:
-            _EncodeSet(obj.CastSet(), v);
+        case QEncode_zipset:
+        case QEncode_intset:
+            _EncodeSet(obj, v);
             break;
             
         case QEncode_hash:
-            _EncodeHash(obj.CastHash(), v);
+        case QEncode_ziphash:
+            _EncodeHash(obj, v);
             break;
             
         case QEncode_sset:
-            _EncodeSSet(obj.CastSortedSet(), v);
+        case QEncode_zipsset:
+            _EncodeSSet(obj, v);
             break;
             
         default:
@@ -145,54 +152,50 @@ void QLeveldb::_EncodeString(const QString& str, UnboundedBuffer& v)
     v.Write(str.data(), len);
 }
      
-void QLeveldb::_EncodeHash(const PHASH& h, UnboundedBuffer& v)
+void QLeveldb::_EncodeHash(const QObject& h, UnboundedBuffer& v)
 {
     // write size
-    auto len = static_cast<uint32_t>(h->size());
+    auto len = static_cast<uint32_t>(HashSize(h));
     v.Write(&len, 4);
 
-    for (const auto& e : *h)
-    {
-        _EncodeString(e.first, v);
-        _EncodeString(e.second, v);
-    }
+    HashForEach(h, [this, &v](const QString& field, const QString& value) {
+        _EncodeString(field, v);
+        _EncodeString(value, v);
+    });
 }
      
-void QLeveldb::_EncodeList(const PLIST& l, UnboundedBuffer& v)
+void QLeveldb::_EncodeList(const QObject& l, UnboundedBuffer& v)
 {
     // write size
-    auto len = static_cast<uint32_t>(l->size());
+    auto len = static_cast<uint32_t>(ListSize(l));
     v.Write(&len, 4);
 
-    for (const auto& e : *l)
-    {
+    ListForEach(l, [this, &v](const QString& e) {
         _EncodeString(e, v);
-    }
+    });
 }
 
-void QLeveldb::_EncodeSet(const PSET& s, UnboundedBuffer& v)
+void QLeveldb::_EncodeSet(const QObject& s, UnboundedBuffer& v)
 {
-    auto len = static_cast<uint32_t>(s->size());
+    auto len = static_cast<uint32_t>(SetSize(s));
     v.Write(&len, 4);
 
-    for (const auto& e : *s)
-    {
+    SetForEach(s, [this, &v](const QString& e) {
         _EncodeString(e, v);
-    }
+    });
 }
 
-void QLeveldb::_EncodeSSet(const PSSET& ss, UnboundedBuffer& v)
+void QLeveldb::_EncodeSSet(const QObject& ss, UnboundedBuffer& v)
 {
-    auto len = static_cast<uint32_t>(ss->Size());
+    auto len = static_cast<uint32_t>(SSetSize(ss));
     v.Write(&len, 4);
 
-    for (const auto& e : *ss)
-    {
-        _EncodeString(e.first, v);
+    SSetForEach(ss, [this, &v](const QString& member, double score) {
+        _EncodeString(member, v);
     
-        auto s(std::to_string(e.second));
+        auto s(std::to_string(score));
         _EncodeString(s, v);
-    }
+    });
 }
 
 QObject QLeveldb::_DecodeObject(const char* data, size_t len, int64_t& remainTtl)
@@ -280,7 +283,6 @@ QObject QLeveldb::_DecodeHash(const char* data, size_t len)
     uint32_t hlen = *(uint32_t*)(data);
 
     QObject obj(QObject::CreateHash());
-    PHASH hash(obj.CastHash());
 
     size_t offset = 4;
     for (uint32_t i = 0; i < hlen; ++ i)
@@ -291,7 +293,7 @@ QObject QLeveldb::_DecodeHash(const char* data, size_t len)
         auto value = _DecodeString(data + offset, len - offset);
         offset += value.size() + 4;
 
-        hash->insert(QHash::value_type(key, value));
+        HashSet(obj, key, value);
         DBG << "Load from leveldb: hash key : " << key << " val : " << value;
     }
 
@@ -304,7 +306,6 @@ QObject QLeveldb::_DecodeList(const char* data, size_t len)
     uint32_t llen = *(uint32_t*)(data);
 
     QObject obj(QObject::CreateList());
-    PLIST list(obj.CastList());
 
     size_t offset = 4;
     for (uint32_t i = 0; i < llen; ++ i)
@@ -312,7 +313,7 @@ QObject QLeveldb::_DecodeList(const char* data, size_t len)
         auto elem = _DecodeString(data + offset, len - offset);
         offset += elem.size() + 4;
 
-        list->push_back(elem);
+        ListPush(obj, elem, ListPosition::tail);
         DBG << "Load list elem from leveldb: " << elem;
     }
 
@@ -325,7 +326,6 @@ QObject QLeveldb::_DecodeSet(const char* data, size_t len)
     uint32_t slen = *(uint32_t*)(data);
 
     QObject obj(QObject::CreateSet());
-    PSET set(obj.CastSet());
 
     size_t offset = 4;
     for (uint32_t i = 0; i < slen; ++ i)
@@ -333,7 +333,7 @@ QObject QLeveldb::_DecodeSet(const char* data, size_t len)
         auto elem = _DecodeString(data + offset, len - offset);
         offset += elem.size() + 4;
 
-        set->insert(elem);
+        SetAdd(obj, elem);
         DBG << "Load set elem from leveldb: " << elem;
     }
 
@@ -346,7 +346,6 @@ QObject QLeveldb::_DecodeSSet(const char* data, size_t len)
     uint32_t sslen = *(uint32_t*)(data);
 
     QObject obj(QObject::CreateSSet());
-    PSSET sset(obj.CastSortedSet());
 
     size_t offset = 4;
     for (uint32_t i = 0; i < sslen; ++ i)
@@ -358,7 +357,7 @@ QObject QLeveldb::_DecodeSSet(const char* data, size_t len)
         offset += scoreStr.size() + 4;
 
         double score = std::stod(scoreStr);
-        sset->AddMember(member, static_cast<long>(score));
+        SSetAdd(obj, member, score);
 
         DBG << "Load leveldb sset member : " << member << " score : " << score;
     }
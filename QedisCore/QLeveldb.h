@@ -38,10 +38,10 @@ private:
      void _EncodeObject(const QObject& obj, int64_t absttl, UnboundedBuffer& v);
 
      void _EncodeString(const QString& str, UnboundedBuffer& v);
-     void _EncodeHash(const PHASH& , UnboundedBuffer& v);
-     void _EncodeList(const PLIST& , UnboundedBuffer& v);
-     void _EncodeSet(const PSET& , UnboundedBuffer& v);
-     void _EncodeSSet(const PSSET& , UnboundedBuffer& v);
+     void _EncodeHash(const QObject& , UnboundedBuffer& v);
+     void _EncodeList(const QObject& , UnboundedBuffer& v);
+     void _EncodeSet(const QObject& , UnboundedBuffer& v);
+     void _EncodeSSet(const QObject& , UnboundedBuffer& v);
 
      // decoding stuff
      QObject _DecodeObject(const char* data, size_t len, int64_t& remainTtlSeconds);
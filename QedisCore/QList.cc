@@ -1,6 +1,7 @@
 #include "QList.h"
 #include "QStore.h"
 #include "QClient.h"
+#include "QConfig.h"
 #include "Log/Logger.h"
 #include <algorithm>
 #include <cassert>
@@ -13,11 +14,287 @@ namespace qedis
 QObject QObject::CreateList()
 {
     QObject list(QType_list);
-    list.Reset(new QList);
+    list.encoding = QEncode_ziplist;
+    list.Reset(ZipListNew());
 
     return list;
 }
 
+static void _ConvertList(QObject& obj)
+{
+    assert (obj.encoding == QEncode_ziplist);
+
+    PZIPLIST zl = obj.CastZipList();
+    std::unique_ptr<QList> list(new QList(g_config.listMaxZiplistSize, g_config.listCompressDepth));
+
+    for (unsigned char* p = ZipListFirst(zl); p; p = ZipListNext(zl, p))
+        list->PushTail(ZipListGet(p));
+
+    obj.Reset(list.release());
+    obj.encoding = QEncode_list;
+}
+
+static void _TryConvertList(QObject& obj, const QString& elem)
+{
+    if (obj.encoding == QEncode_ziplist &&
+        elem.size() > static_cast<size_t>(g_config.listMaxZiplistValue))
+        _ConvertList(obj);
+}
+
+static bool _NormalizeIndex(long& index, size_t size)
+{
+    if (index < 0)
+        index += static_cast<long>(size);
+
+    return index >= 0 && index < static_cast<long>(size);
+}
+
+size_t ListSize(const QObject& obj)
+{
+    if (obj.encoding == QEncode_ziplist)
+        return ZipListSize(obj.CastZipList());
+
+    return obj.CastList()->Size();
+}
+
+void ListPush(QObject& obj, const QString& elem, ListPosition pos)
+{
+    _TryConvertList(obj, elem);
+
+    if (obj.encoding == QEncode_ziplist)
+    {
+        PZIPLIST zl = ZipListPush(obj.CastZipList(), elem, pos == ListPosition::tail);
+        obj.value = zl;
+
+        if (ZipListSize(zl) > static_cast<size_t>(g_config.listMaxZiplistEntries))
+            _ConvertList(obj);
+    }
+    else
+    {
+        auto list = obj.CastList();
+        if (pos == ListPosition::head)
+            list->PushHead(elem);
+        else
+            list->PushTail(elem);
+    }
+}
+
+bool ListPop(QObject& obj, ListPosition pos, QString* elem)
+{
+    if (obj.encoding == QEncode_ziplist)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = (pos == ListPosition::head) ? ZipListFirst(zl) : ZipListLast(zl);
+        if (!p)
+            return false;
+
+        if (elem)
+            *elem = ZipListGet(p);
+
+        obj.value = ZipListDelete(zl, &p);
+        return true;
+    }
+
+    auto list = obj.CastList();
+    if (pos == ListPosition::head)
+        return list->PopHead(elem);
+    else
+        return list->PopTail(elem);
+}
+
+bool ListIndex(const QObject& obj, long index, QString* elem)
+{
+    if (!_NormalizeIndex(index, ListSize(obj)))
+        return false;
+
+    if (obj.encoding == QEncode_ziplist)
+        *elem = ZipListGet(ZipListIndex(obj.CastZipList(), index));
+    else
+        *elem = obj.CastList()->Index(index);
+
+    return true;
+}
+
+bool ListSet(QObject& obj, long index, const QString& elem)
+{
+    if (!_NormalizeIndex(index, ListSize(obj)))
+        return false;
+
+    _TryConvertList(obj, elem);
+
+    if (obj.encoding == QEncode_ziplist)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = ZipListIndex(zl, index);
+        obj.value = ZipListReplace(zl, &p, elem);
+    }
+    else
+    {
+        obj.CastList()->Replace(index, elem);
+    }
+
+    return true;
+}
+
+bool ListErase(QObject& obj, long index)
+{
+    if (!_NormalizeIndex(index, ListSize(obj)))
+        return false;
+
+    if (obj.encoding == QEncode_ziplist)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = ZipListIndex(zl, index);
+        obj.value = ZipListDelete(zl, &p);
+    }
+    else
+    {
+        obj.CastList()->Erase(index);
+    }
+
+    return true;
+}
+
+bool ListInsert(QObject& obj, const QString& pivot, const QString& elem, bool before)
+{
+    _TryConvertList(obj, elem);
+
+    if (obj.encoding == QEncode_ziplist)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = ZipListFind(zl, pivot);
+        if (!p)
+            return false;
+
+        if (!before)
+            p = ZipListNext(zl, p);
+
+        zl = p ? ZipListInsert(zl, p, elem) : ZipListPush(zl, elem);
+        obj.value = zl;
+
+        if (ZipListSize(zl) > static_cast<size_t>(g_config.listMaxZiplistEntries))
+            _ConvertList(obj);
+
+        return true;
+    }
+
+    return obj.CastList()->Insert(pivot, elem, before);
+}
+
+long ListRemove(QObject& obj, const QString& elem, long count)
+{
+    const bool fromHead = (count >= 0);
+    if (count < 0)
+        count = -count;
+    else if (count == 0)
+        count = static_cast<long>(ListSize(obj)); // remove all elements equal to elem
+
+    if (obj.encoding != QEncode_ziplist)
+        return obj.CastList()->Remove(elem, count, fromHead);
+
+    long resultCount = 0;
+    PZIPLIST zl = obj.CastZipList();
+    if (fromHead)
+    {
+        unsigned char* p = ZipListFirst(zl);
+        while (p && resultCount < count)
+        {
+            if (ZipListEqual(p, elem))
+            {
+                zl = ZipListDelete(zl, &p);
+                ++ resultCount;
+            }
+            else
+            {
+                p = ZipListNext(zl, p);
+            }
+        }
+    }
+    else
+    {
+        unsigned char* p = ZipListLast(zl);
+        while (p && resultCount < count)
+        {
+            unsigned char* prev = ZipListPrev(zl, p);
+            if (ZipListEqual(p, elem))
+            {
+                // entries before p are not moved, but zl may be realloced
+                const long offset = prev ? prev - zl : -1;
+                zl = ZipListDelete(zl, &p);
+                prev = (offset >= 0) ? zl + offset : nullptr;
+                ++ resultCount;
+            }
+
+            p = prev;
+        }
+    }
+
+    obj.value = zl;
+    return resultCount;
+}
+
+void ListTrim(QObject& obj, long start, long end)
+{
+    const long size = static_cast<long>(ListSize(obj));
+    if (start > end || start >= size)
+    {
+        // remove all
+        start = size;
+        end = size - 1;
+    }
+
+    const long rtrim = size - end - 1;
+    if (obj.encoding == QEncode_ziplist)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        if (rtrim > 0)
+            zl = ZipListDeleteRange(zl, end + 1, rtrim);
+        if (start > 0)
+            zl = ZipListDeleteRange(zl, 0, start);
+
+        obj.value = zl;
+    }
+    else
+    {
+        auto list = obj.CastList();
+        if (rtrim > 0)
+            list->DeleteRange(end + 1, rtrim);
+        if (start > 0)
+            list->DeleteRange(0, start);
+    }
+}
+
+void ListRange(const QObject& obj, long start, long end,
+               const std::function<void (const QString& elem)>& func)
+{
+    const long size = static_cast<long>(ListSize(obj));
+    if (end >= size)
+        end = size - 1;
+
+    if (start > end || start >= size)
+        return;
+
+    if (obj.encoding == QEncode_ziplist)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = ZipListIndex(zl, start);
+        for (long i = start; p && i <= end; ++ i)
+        {
+            func(ZipListGet(p));
+            p = ZipListNext(zl, p);
+        }
+    }
+    else
+    {
+        obj.CastList()->Range(start, end, func);
+    }
+}
+
+void ListForEach(const QObject& obj, const std::function<void (const QString& elem)>& func)
+{
+    ListRange(obj, 0, static_cast<long>(ListSize(obj)) - 1, func);
+}
+
 static QError push(const vector<QString>& params, UnboundedBuffer* reply, ListPosition pos, bool createIfNotExist = true)
 {
     QObject* value;
@@ -41,24 +318,22 @@ static QError push(const vector<QString>& params, UnboundedBuffer* reply, ListPo
         }
     }
 
-    auto list = value->CastList();
-    bool mayReady = list->empty();
+    bool mayReady = (ListSize(*value) == 0);
     for (size_t i = 2; i < params.size(); ++ i)
     {
-        if (pos == ListPosition::head)
-            list->push_front(params[i]);
-        else
-            list->push_back(params[i]);
+        ListPush(*value, params[i], pos);
     }
     
-    FormatInt(static_cast<long>(list->size()), reply);
-    if (mayReady && !list->empty())
+    FormatInt(static_cast<long>(ListSize(*value)), reply);
+    if (mayReady && ListSize(*value) > 0)
     {
         if (reply) // Do not propogate if aof reload...
         {
             // push must before pop(serve)...
-            Propogate(params);                   // the push
-            QSTORE.ServeClient(params[1], list); // the pop
+            Propogate(params);                    // the push
+            QSTORE.ServeClient(params[1], value); // the pop
+            if (ListSize(*value) == 0)
+                QSTORE.DeleteKey(params[1]);
         }
         return QError_nop;
     }
@@ -79,21 +354,11 @@ static QError GenericPop(const QString& key, ListPosition pos, QString& result)
         return  err;
     }
     
-    auto list = value->CastList();
-    assert (!list->empty());
-
-    if (pos == ListPosition::head)
-    {
-        result = std::move(list->front());
-        list->pop_front();
-    }
-    else
-    {
-        result = std::move(list->back());
-        list->pop_back();
-    }
+    bool succ = ListPop(*value, pos, &result);
+    assert (succ);
+    (void)succ;
     
-    if (list->empty())
+    if (ListSize(*value) == 0)
     {
         QSTORE.DeleteKey(key);
     }
@@ -285,34 +550,14 @@ QError  lindex(const vector<QString>& params, UnboundedBuffer* reply)
         return QError_nan;
     }
     
-    auto list = value->CastList();
-    const int size = static_cast<int>(list->size());
-    if (idx < 0)
-        idx += size;
-    
-    if (idx < 0 || idx >= size)
+    QString result;
+    if (!ListIndex(*value, idx, &result))
     {
         FormatNull(reply);
         return  QError_ok;
     }
     
-    const QString* result = nullptr;
-    
-    if (2 * idx < size)
-    {
-        auto it = list->begin();
-        std::advance(it, idx);
-        result = &*it;
-    }
-    else
-    {
-        auto it = list->rbegin();
-        idx = size - 1 - idx;
-        std::advance(it, idx);
-        result = &*it;
-    }
-    
-    FormatBulk(*result, reply);
+    FormatBulk(result, reply);
     return QError_ok;
 }
 
@@ -327,7 +572,6 @@ QError lset(const vector<QString>& params, UnboundedBuffer* reply)
         return err;
     }
     
-    auto list = value->CastList();
     long idx;
     if (!TryStr2Long(params[2].c_str(), params[2].size(), idx))
     {
@@ -335,34 +579,12 @@ QError lset(const vector<QString>& params, UnboundedBuffer* reply)
         return  QError_notExist;
     }
     
-    const int size = static_cast<int>(list->size());
-    if (idx < 0)
-        idx += size;
-    
-    if (idx < 0 || idx >= size)
+    if (!ListSet(*value, idx, params[3]))
     {
         FormatNull(reply);
         return  QError_ok;
     }
     
-    QString* result = nullptr;
-    
-    if (2 * idx < size)
-    {
-        auto it = list->begin();
-        std::advance(it, idx);
-        result = &*it;
-    }
-    else
-    {
-        auto it = list->rbegin();
-        idx = size - 1 - idx;
-        std::advance(it, idx);
-        result = &*it;
-    }
-    
-    *result = params[3];
-    
     FormatOK(reply);
     return QError_ok;
 }
@@ -382,76 +604,10 @@ QError llen(const vector<QString>& params, UnboundedBuffer* reply)
         return  err;
     }
     
-    auto list = value->CastList();
-    FormatInt(static_cast<long>(list->size()), reply);
+    FormatInt(static_cast<long>(ListSize(*value)), reply);
     return QError_ok;
 }
 
-static void Index2Iterator(long start, long end,
-                           QList&  list,
-                           QList::iterator* beginIt,
-                           QList::iterator* endIt)
-{
-    assert (start >= 0 && end >= 0 && start <= end);
-    assert (end < static_cast<long>(list.size()));
-    
-    long size = static_cast<long>(list.size());
-    if (beginIt)
-    {
-        if (start * 2 < size)
-        {
-            *beginIt = list.begin();
-            while (start -- > 0)   ++ *beginIt;
-        }
-        else
-        {
-            *beginIt = list.end();
-            while (start ++ < size)  -- *beginIt;
-        } 
-    } 
-    
-    if (endIt)
-    {
-        if (end * 2 < size)
-        {
-            *endIt = list.begin();
-            while (end -- > 0)   ++ *endIt;
-        }
-        else
-        {
-            *endIt = list.end();
-            while (end ++ < size)  -- *endIt;
-        }
-    }
-}
-
-static size_t GetRange(long start, long end,
-                       QList&  list,
-                       QList::iterator* beginIt = nullptr,
-                       QList::iterator* endIt = nullptr)
-{
-    size_t rangeLen = 0;
-    if (start > end)  // empty
-    {
-        if (beginIt)    *beginIt = list.end();
-        if (endIt)      *endIt = list.end();
-    }
-    else if (start != 0 || end + 1 != static_cast<long>(list.size()))
-    {
-        rangeLen = end - start + 1;
-        Index2Iterator(start, end, list, beginIt, endIt);
-    }
-    else
-    {
-        rangeLen = list.size();
-        if (beginIt) *beginIt = list.begin();
-        if (endIt)   *endIt   = -- list.end();  // entire list
-    }
-    
-    return rangeLen;
-}
-
-
 QError  ltrim(const vector<QString>& params, UnboundedBuffer* reply)
 {
     QObject* value;
@@ -470,18 +626,11 @@ QError  ltrim(const vector<QString>& params, UnboundedBuffer* reply)
         return err;
     }
     
-    auto list = value->CastList();
-    AdjustIndex(start, end, list->size());
-    
-    QList::iterator beginIt, endIt;
-    GetRange(start, end, *list, &beginIt, &endIt);
-    
-    if (beginIt != list->end())
-    {
-        assert (endIt != list->end());
-        list->erase(list->begin(), beginIt);
-        list->erase(++ endIt, list->end());
-    }
+    AdjustIndex(start, end, ListSize(*value));
+    ListTrim(*value, start, end);
+
+    if (ListSize(*value) == 0)
+        QSTORE.DeleteKey(params[1]);
     
     FormatOK(reply);
     return QError_ok;
@@ -505,22 +654,17 @@ QError lrange(const vector<QString>& params, UnboundedBuffer* reply)
         return err;
     }
     
-    auto list = value->CastList();
-    AdjustIndex(start, end, list->size());
+    const long size = static_cast<long>(ListSize(*value));
+    AdjustIndex(start, end, size);
     
-    QList::iterator beginIt;
-    size_t rangeLen = GetRange(start, end, *list, &beginIt);
+    size_t rangeLen = 0;
+    if (start <= end && start < size)
+        rangeLen = end - start + 1;
     
     PreFormatMultiBulk(rangeLen, reply);
-    if (beginIt != list->end())
-    {
-        while (rangeLen != 0)
-        {
-            FormatBulk(beginIt->c_str(), beginIt->size(), reply);
-            ++ beginIt;
-            -- rangeLen;
-        }
-    }
+    ListRange(*value, start, end, [reply](const QString& elem) {
+        FormatBulk(elem, reply);
+    });
     
     return QError_ok;
 }
@@ -546,20 +690,13 @@ QError linsert(const vector<QString>& params, UnboundedBuffer* reply)
         return QError_param;
     }
     
-    auto list = value->CastList();
-    QList::iterator it = std::find(list->begin(), list->end(), params[3]);
-    if (it == list->end())
+    if (!ListInsert(*value, params[3], params[4], before))
     {
         FormatInt(-1, reply);
         return QError_notExist;
     }
     
-    if (before)
-        list->insert(it, params[4]);
-    else
-        list->insert(++ it, params[4]);
-    
-    FormatInt(static_cast<long>(list->size()), reply);
+    FormatInt(static_cast<long>(ListSize(*value)), reply);
     return QError_ok;
 }
 
@@ -581,51 +718,9 @@ QError  lrem(const vector<QString>& params, UnboundedBuffer* reply)
         return err;
     }
     
-    auto list = value->CastList();
-    ListPosition  start = ListPosition::head;
-    if (count < 0)
-    {
-        count = -count;
-        start = ListPosition::tail;
-    }
-    else if (count == 0)
-    {
-        count = list->size(); // remove all elements equal to param[3]
-    }
-    
-    long resultCount = 0;
-    if (start == ListPosition::head)
-    {
-        auto it = list->begin();
-        while (it != list->end() && resultCount < count)
-        {
-            if (*it == params[3])
-            {
-                list->erase(it ++);
-                ++ resultCount;
-            }
-            else
-            {
-                ++ it;
-            }
-        }
-    }
-    else
-    {
-        auto it = list->rbegin();
-        while (it != list->rend() && resultCount < count)
-        {
-            if (*it == params[3])
-            {
-                list->erase((++it).base()); // Effective STL, item 28
-                ++ resultCount;
-            }
-            else
-            {
-                ++ it;
-            }
-        }
-    }
+    long resultCount = ListRemove(*value, params[3], count);
+    if (ListSize(*value) == 0)
+        QSTORE.DeleteKey(params[1]);
 
     FormatInt(resultCount, reply);
     return QError_ok;
@@ -641,8 +736,7 @@ QError rpoplpush(const vector<QString>& params, UnboundedBuffer* reply)
         return err;
     }
     
-    auto srclist = src->CastList();
-    assert (!srclist->empty());
+    assert (ListSize(*src) > 0);
     
     QObject* dst;
     err = QSTORE.GetValueByType(params[2], dst, QType_list);
@@ -657,10 +751,14 @@ QError rpoplpush(const vector<QString>& params, UnboundedBuffer* reply)
         dst = QSTORE.SetValue(params[2], QObject::CreateList());
     }
     
-    auto dstlist = dst->CastList();
-    dstlist->splice(dstlist->begin(), *srclist, (++ srclist->rbegin()).base());
+    QString elem;
+    ListPop(*src, ListPosition::tail, &elem);
+    ListPush(*dst, elem, ListPosition::head);
+
+    if (ListSize(*src) == 0)
+        QSTORE.DeleteKey(params[1]);
     
-    FormatBulk(*(dstlist->begin()), reply);
+    FormatBulk(elem, reply);
     return QError_ok;
 }
 
@@ -2,7 +2,8 @@
 #define BERT_QLIST_H
 
 #include "QString.h"
-#include <list>
+#include "QQuickList.h"
+#include <functional>
 
 namespace qedis
 {
@@ -13,7 +14,28 @@ enum class ListPosition
     tail,
 };
 
-using QList = std::list<QString>;
+using QList = QQuickList;
+
+// Encoding independent list operations.
+// A small list is a ziplist, it's converted to quicklist when exceeds
+// list-max-ziplist-entries or list-max-ziplist-value.
+// Index is 0-based, negative index counts from the tail.
+std::size_t ListSize(const QObject& obj);
+void        ListPush(QObject& obj, const QString& elem, ListPosition pos);
+bool        ListPop(QObject& obj, ListPosition pos, QString* elem = nullptr);
+bool        ListIndex(const QObject& obj, long index, QString* elem);
+bool        ListSet(QObject& obj, long index, const QString& elem);
+bool        ListErase(QObject& obj, long index);
+// insert elem before or after the first pivot, return false if no pivot
+bool        ListInsert(QObject& obj, const QString& pivot, const QString& elem, bool before);
+// remove elems equal to elem, from head if count > 0, from tail if count < 0, all if 0
+long        ListRemove(QObject& obj, const QString& elem, long count);
+// keep [start, end] only, they must be adjusted by AdjustIndex
+void        ListTrim(QObject& obj, long start, long end);
+void        ListRange(const QObject& obj, long start, long end,
+                      const std::function<void (const QString& elem)>& func);
+void        ListForEach(const QObject& obj, const std::function<void (const QString& elem)>& func);
+
 }
 
 #endif
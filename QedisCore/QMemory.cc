@@ -0,0 +1,372 @@
+#include "QMemory.h"
+#include "QHelper.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if USE_JEMALLOC
+#include <jemalloc/jemalloc.h>
+#define QEDIS_MALLOC_SIZE(p)  malloc_usable_size(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define QEDIS_MALLOC_SIZE(p)  malloc_size(p)
+#else
+#include <malloc.h>
+#define QEDIS_MALLOC_SIZE(p)  malloc_usable_size(p)
+#endif
+
+namespace qedis
+{
+
+namespace
+{
+
+// Every thread owns a counter in its cache line, only the owner writes it,
+// so counting needs no locked instruction. A block freed by another thread
+// makes that counter negative, the sum is still right. Threads exited keep
+// their counters; too many threads share the last one.
+const int kMaxCounters = 64;
+
+struct alignas(64) Counter
+{
+    std::atomic<long> bytes;
+};
+
+Counter s_counters[kMaxCounters + 1];
+std::atomic<int> s_nextCounter {0};
+
+std::atomic<std::size_t> s_peak {0};
+std::atomic<long> s_hashTable {0};
+std::size_t s_startup = 0;
+
+__thread Counter* t_counter = nullptr;
+
+inline void Account(long bytes)
+{
+    Counter* counter = t_counter;
+    if (!counter)
+    {
+        int idx = s_nextCounter.fetch_add(1, std::memory_order_relaxed);
+        counter = t_counter = &s_counters[idx < kMaxCounters ? idx : kMaxCounters];
+    }
+
+    if (counter != &s_counters[kMaxCounters])
+        counter->bytes.store(counter->bytes.load(std::memory_order_relaxed) + bytes,
+                             std::memory_order_relaxed);
+    else
+        counter->bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+inline void* Allocate(std::size_t size)
+{
+    void* ptr = std::malloc(size);
+    if (ptr)
+        Account(static_cast<long>(QEDIS_MALLOC_SIZE(ptr)));
+
+    return ptr;
+}
+
+inline void Free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    Account(-static_cast<long>(QEDIS_MALLOC_SIZE(ptr)));
+    std::free(ptr);
+}
+
+// Defrag moves a block to a denser slab. With jemalloc it bypasses the
+// thread cache, which could give back a free region of the same sparse
+// slab, even the block just freed.
+inline void* DefragAllocate(std::size_t size)
+{
+#if USE_JEMALLOC
+    void* ptr = mallocx(size, MALLOCX_TCACHE_NONE);
+    if (ptr)
+        Account(static_cast<long>(QEDIS_MALLOC_SIZE(ptr)));
+
+    return ptr;
+#else
+    return Allocate(size);
+#endif
+}
+
+inline void DefragFree(void* ptr)
+{
+#if USE_JEMALLOC
+    Account(-static_cast<long>(QEDIS_MALLOC_SIZE(ptr)));
+    dallocx(ptr, MALLOCX_TCACHE_NONE);
+#else
+    Free(ptr);
+#endif
+}
+
+} // end namespace
+
+
+std::size_t UsedMemory()
+{
+    long used = 0;
+    for (const auto& counter : s_counters)
+        used += counter.bytes.load(std::memory_order_relaxed);
+
+    const std::size_t res = used > 0 ? static_cast<std::size_t>(used) : 0;
+
+    std::size_t peak = s_peak.load(std::memory_order_relaxed);
+    while (res > peak && !s_peak.compare_exchange_weak(peak, res, std::memory_order_relaxed))
+        ;
+
+    return res;
+}
+
+std::size_t PeakMemory()
+{
+    UsedMemory();
+    return s_peak.load(std::memory_order_relaxed);
+}
+
+void AddUsedMemory(long bytes)
+{
+    Account(bytes);
+}
+
+std::size_t HashTableMemory()
+{
+    return static_cast<std::size_t>(s_hashTable.load(std::memory_order_relaxed));
+}
+
+void AddHashTableMemory(long bytes)
+{
+    s_hashTable.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void SetStartupMemory()
+{
+    s_startup = UsedMemory();
+}
+
+std::size_t StartupMemory()
+{
+    return s_startup;
+}
+
+
+#if USE_JEMALLOC
+
+const char* AllocatorName()
+{
+    return "jemalloc-" JEMALLOC_VERSION;
+}
+
+bool GetAllocatorStats(AllocatorStats& stats)
+{
+    // the stats are cached until epoch is updated
+    uint64_t epoch = 1;
+    std::size_t len = sizeof epoch;
+    mallctl("epoch", &epoch, &len, &epoch, len);
+
+    len = sizeof(std::size_t);
+    return mallctl("stats.allocated", &stats.allocated, &len, nullptr, 0) == 0 &&
+           mallctl("stats.active", &stats.active, &len, nullptr, 0) == 0 &&
+           mallctl("stats.resident", &stats.resident, &len, nullptr, 0) == 0;
+}
+
+void PurgeAllocator()
+{
+    char cmd[64];
+    snprintf(cmd, sizeof cmd, "arena.%d.purge", MALLCTL_ARENAS_ALL);
+    mallctl(cmd, nullptr, nullptr, nullptr, 0);
+}
+
+bool DefragSupported()
+{
+    return true;
+}
+
+static bool JemallocDefragHint(const void* ptr)
+{
+    // see experimental.utilization.query of jemalloc:
+    // the slab a new block would go to, free regions and regions of the slab
+    // of ptr, its size, free regions and regions of the bin
+    struct
+    {
+        void*       slabcur;
+        std::size_t nfree;
+        std::size_t nregs;
+        std::size_t size;
+        std::size_t binNfree;
+        std::size_t binNregs;
+    } util;
+
+    std::size_t len = sizeof util;
+    if (mallctl("experimental.utilization.query", &util, &len, &ptr, sizeof ptr) != 0)
+        return false;
+
+    // large block, or the bin is full
+    if (!util.slabcur || util.binNregs == 0 || util.nfree == 0)
+        return false;
+
+    // new blocks go to the current slab, moving it is wasted every cycle
+    const char* slabcur = static_cast<const char* >(util.slabcur);
+    if (ptr >= slabcur && ptr < slabcur + util.nregs * util.size)
+        return false;
+
+    // less used than the bin, a new block would go to a denser slab
+    const std::size_t used = util.nregs - util.nfree;
+    const std::size_t binUsed = util.binNregs - util.binNfree;
+    return used * util.binNregs < binUsed * util.nregs;
+}
+
+static DefragHintFunc s_defragHint = &JemallocDefragHint;
+
+#else
+
+const char* AllocatorName()
+{
+    return "libc";
+}
+
+bool GetAllocatorStats(AllocatorStats& stats)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    // heap and mmapped bytes, both from system and in use
+    struct mallinfo2 info = mallinfo2();
+    stats.allocated = info.uordblks + info.hblkhd;
+    stats.active = info.arena + info.hblkhd;
+    stats.resident = getMemoryInfo(VmRSS);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PurgeAllocator()
+{
+#if defined(__GLIBC__)
+    // also gives back the free pages in the middle of heap
+    malloc_trim(0);
+#endif
+}
+
+bool DefragSupported()
+{
+    return false;
+}
+
+static DefragHintFunc s_defragHint = nullptr;
+
+#endif
+
+bool DefragHint(const void* ptr)
+{
+    return s_defragHint && ptr && s_defragHint(ptr);
+}
+
+DefragHintFunc SetDefragHint(DefragHintFunc hint)
+{
+    DefragHintFunc old = s_defragHint;
+    s_defragHint = hint;
+    return old;
+}
+
+void* DefragAlloc(void* ptr)
+{
+    if (!DefragHint(ptr))
+        return nullptr;
+
+    const std::size_t size = QEDIS_MALLOC_SIZE(ptr);
+    void* res = DefragAllocate(size);
+    if (!res)
+        return nullptr;
+
+    std::memcpy(res, ptr, size);
+    DefragFree(ptr);
+    return res;
+}
+
+}
+
+
+using qedis::Allocate;
+using qedis::Free;
+using qedis::Account;
+
+extern "C" void* zmalloc(size_t size)
+{
+    return Allocate(size);
+}
+
+extern "C" void* zcalloc(size_t count, size_t size)
+{
+    void* ptr = std::calloc(count, size);
+    if (ptr)
+        Account(static_cast<long>(QEDIS_MALLOC_SIZE(ptr)));
+
+    return ptr;
+}
+
+extern "C" void* zrealloc(void* ptr, size_t size)
+{
+    if (!ptr)
+        return Allocate(size);
+
+    const long old = static_cast<long>(QEDIS_MALLOC_SIZE(ptr));
+    void* res = std::realloc(ptr, size);
+    if (res)
+        Account(static_cast<long>(QEDIS_MALLOC_SIZE(res)) - old);
+
+    return res;
+}
+
+extern "C" void zfree(void* ptr)
+{
+    Free(ptr);
+}
+
+
+// replaced global allocation functions, see [replacement.functions]
+void* operator new(std::size_t size)
+{
+    void* ptr = Allocate(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t& ) noexcept
+{
+    return Allocate(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& ) noexcept
+{
+    return Allocate(size ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    Free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    Free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t& ) noexcept
+{
+    Free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t& ) noexcept
+{
+    Free(ptr);
+}
@@ -0,0 +1,76 @@
+#ifndef BERT_QMEMORY_H
+#define BERT_QMEMORY_H
+
+#include <stddef.h>
+
+// Used memory accounting, like zmalloc of redis.
+//
+// Global operator new and delete are replaced to count the usable size of
+// every block; the values living outside of new, like ziplist and intset,
+// are allocated by the z* functions below. maxmemory and INFO memory read
+// the counter instead of VmRSS, which lags and includes fragmentation.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void*   zmalloc(size_t size);
+void*   zcalloc(size_t count, size_t size);
+void*   zrealloc(void* ptr, size_t size);
+void    zfree(void* ptr);
+
+#ifdef __cplusplus
+}
+
+#include <cstddef>
+
+namespace qedis
+{
+
+// bytes allocated by all threads, the peak is updated by every call
+std::size_t UsedMemory();
+std::size_t PeakMemory();
+
+// for the memory not from malloc, like the mmapped tables of QDict
+void        AddUsedMemory(long bytes);
+
+// hash table slots of the dbs and containers, part of overhead in INFO
+std::size_t HashTableMemory();
+void        AddHashTableMemory(long bytes);
+
+// used memory before loading data, also part of overhead in INFO
+void        SetStartupMemory();
+std::size_t StartupMemory();
+
+// Allocator, jemalloc if built with USE_JEMALLOC, or the libc malloc
+const char* AllocatorName();
+
+struct AllocatorStats
+{
+    std::size_t allocated = 0; // by the application
+    std::size_t active = 0;    // pages holding them, free blocks included
+    std::size_t resident = 0;
+};
+bool        GetAllocatorStats(AllocatorStats& stats);
+
+// return the free pages to the system
+void        PurgeAllocator();
+
+// For active defrag: true if the block lies in a page used less than the
+// average of its size class, so moving it makes the pages denser. Only
+// jemalloc tells it, by the utilization of the slab.
+bool        DefragSupported();
+bool        DefragHint(const void* ptr);
+// tests can move every block with an allocator without hint, return the old
+using DefragHintFunc = bool (*)(const void* ptr);
+DefragHintFunc SetDefragHint(DefragHintFunc hint);
+
+// a block of zmalloc or new holding no pointer to itself: copy it to a new
+// block if DefragHint, and free the old one. nullptr if not moved
+void*       DefragAlloc(void* ptr);
+
+}
+
+#endif
+
+#endif
@@ -22,9 +22,15 @@ void QProtoParser::Reset()
     paramLen_ = -1;
     numOfParam_ = 0;
 
-    // Optimize: Most redis command has 3 args
+    // Optimize: Most redis command has 3 args, keep the others in spare
+    // for reuse, like the args of pipelined mset, but not the big ones.
     while (params_.size() > 3)
+    {
+        if (spare_.size() < kMaxSpareParams && params_.back().capacity() <= kMaxSpareParamSize)
+            spare_.push_back(std::move(params_.back()));
+
         params_.pop_back();
+    }
 }
 
 QParseResult QProtoParser::ParseRequest(const char*& ptr, const char* end)
@@ -43,6 +49,74 @@ QParseResult QProtoParser::ParseRequest(const char*& ptr, const char* end)
     return _ParseStrlist(ptr, end, params_);
 }
 
+QParseResult QProtoParser::ParseRequestView(const char*& ptr, const char* end)
+{
+    assert (IsInitialState());
+
+    const char* cur = ptr;
+    int multi = -1;
+    auto parseRet = _ParseMulti(cur, end, multi);
+    if (parseRet != QParseResult::ok)
+        return parseRet;
+
+    if (multi < -1)
+        return QParseResult::error;
+
+    views_.clear();
+    for (int i = 0; i < multi; ++ i)
+    {
+        int len = -1;
+        parseRet = _ParseStrlen(cur, end, len);
+        if (parseRet != QParseResult::ok)
+            return parseRet;
+
+        if (len < -1)
+            return QParseResult::error;
+
+        if (len == -1)
+        {
+            views_.push_back(QStringView());
+            continue;
+        }
+
+        if (end - cur < len + 2)
+            return QParseResult::wait;
+
+        if (cur[len] != '\r' || cur[len + 1] != '\n')
+            return QParseResult::error;
+
+        views_.push_back(QStringView(cur, len));
+        cur += len + 2;
+    }
+
+    ptr = cur;
+    return QParseResult::ok;
+}
+
+void QProtoParser::MaterializeParams()
+{
+    const size_t n = views_.size();
+    while (params_.size() > n)
+    {
+        if (spare_.size() < kMaxSpareParams && params_.back().capacity() <= kMaxSpareParamSize)
+            spare_.push_back(std::move(params_.back()));
+
+        params_.pop_back();
+    }
+
+    while (params_.size() < n && !spare_.empty())
+    {
+        params_.push_back(std::move(spare_.back()));
+        spare_.pop_back();
+    }
+
+    params_.resize(n);
+
+    // assign() keeps the capacity of the reused strings
+    for (size_t i = 0; i < n; ++ i)
+        params_[i].assign(views_[i].data, views_[i].size);
+}
+
 QParseResult QProtoParser::_ParseMulti(const char*& ptr, const char* end, int& result)
 {
     if (end - ptr < 3)
@@ -53,7 +127,11 @@ QParseResult QProtoParser::_ParseMulti(const char*& ptr, const char* end, int& r
 
     ++ ptr;
 
-    return GetIntUntilCRLF(ptr,  end - ptr, result);
+    const auto ret = GetIntUntilCRLF(ptr,  end - ptr, result);
+    if (ret != QParseResult::ok)
+        -- ptr;
+
+    return ret;
 }
 
 QParseResult QProtoParser::_ParseStrlist(const char*& ptr, const char* end, std::vector<QString>& results)
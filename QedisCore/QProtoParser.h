@@ -13,6 +13,15 @@ public:
     void Reset();
     QParseResult ParseRequest(const char*& ptr, const char* end);
 
+    // Zero copy parse, only when a whole request is in [ptr, end).
+    // Nothing is consumed if wait, call ParseRequest to parse it piece by
+    // piece. The views point into [ptr, end), valid until it's consumed.
+    QParseResult ParseRequestView(const char*& ptr, const char* end);
+    const std::vector<QStringView>& GetParamViews() const { return views_; }
+
+    // copy views to params, reuse the memory of former params
+    void MaterializeParams();
+
     const std::vector<QString>& GetParams() const { return params_; }
     void SetParams(std::vector<QString> p) { params_ = std::move(p); }
     
@@ -30,6 +39,16 @@ private:
 
     size_t numOfParam_ = 0; // for optimize
     std::vector<QString> params_;
+
+    std::vector<QStringView> views_;
+
+    // strings of former params, for reuse
+    enum
+    {
+        kMaxSpareParams    = 64,
+        kMaxSpareParamSize = 4 * 1024,
+    };
+    std::vector<QString> spare_;
 };
 
 }
@@ -0,0 +1,581 @@
+#include "QQuickList.h"
+#include "QMemory.h"
+#include <cstdlib>
+#include <cassert>
+#include <algorithm>
+
+extern "C"
+{
+#include "lzf/lzf.h"
+}
+
+namespace qedis
+{
+
+// node smaller than this is not compressed
+static const unsigned int kMinCompressBytes = 48;
+// compressed data must be smaller at least this
+static const unsigned int kMinCompressImprove = 8;
+
+static const std::size_t kSizeLimits[] = { 4096, 8192, 16384, 32768, 65536 };
+
+// worst case of ziplist entry header, prevlen 5 bytes and encoding 5 bytes
+static const std::size_t kZipEntryOverhead = 11;
+
+QQuickList::QQuickList(int fill, int compressDepth) :
+    head_(nullptr),
+    tail_(nullptr),
+    count_(0),
+    len_(0),
+    fill_(fill == 0 ? -2 : fill),
+    compressDepth_(compressDepth)
+{
+}
+
+QQuickList::~QQuickList()
+{
+    Node* node = head_;
+    while (node)
+    {
+        Node* next = node->next;
+        _FreeNode(node);
+        node = next;
+    }
+}
+
+QQuickList::Node* QQuickList::_CreateNode(PZIPLIST zl)
+{
+    Node* node = new Node;
+    node->prev = nullptr;
+    node->next = nullptr;
+    node->data = zl;
+    node->count = static_cast<unsigned int>(ZipListSize(zl));
+    node->bytes = static_cast<unsigned int>(ZipListBytes(zl));
+    node->lzfBytes = 0;
+
+    return node;
+}
+
+void QQuickList::_FreeNode(Node* node)
+{
+    zfree(node->data);
+    delete node;
+}
+
+std::size_t QQuickList::Defrag()
+{
+    std::size_t moved = 0;
+    for (Node* node = head_; node; node = node->next)
+    {
+        if (void* data = DefragAlloc(node->data))
+        {
+            node->data = static_cast<unsigned char*>(data);
+            ++ moved;
+        }
+
+        if (Node* newNode = static_cast<Node*>(DefragAlloc(node)))
+        {
+            node = newNode;
+            if (node->prev)
+                node->prev->next = node;
+            else
+                head_ = node;
+
+            if (node->next)
+                node->next->prev = node;
+            else
+                tail_ = node;
+
+            ++ moved;
+        }
+    }
+
+    return moved;
+}
+
+void QQuickList::_LinkAfter(Node* pos, Node* node)
+{
+    if (!pos)
+    {
+        node->prev = nullptr;
+        node->next = head_;
+        if (head_)
+            head_->prev = node;
+        else
+            tail_ = node;
+
+        head_ = node;
+    }
+    else
+    {
+        node->prev = pos;
+        node->next = pos->next;
+        if (pos->next)
+            pos->next->prev = node;
+        else
+            tail_ = node;
+
+        pos->next = node;
+    }
+
+    ++ len_;
+}
+
+void QQuickList::_Unlink(Node* node)
+{
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        head_ = node->next;
+
+    if (node->next)
+        node->next->prev = node->prev;
+    else
+        tail_ = node->prev;
+
+    -- len_;
+}
+
+bool QQuickList::_AllowInsert(const Node* node, const QString& elem) const
+{
+    if (!node)
+        return false;
+
+    if (fill_ > 0)
+        return node->count < static_cast<unsigned int>(fill_);
+
+    const std::size_t idx = std::min(-fill_, 5) - 1;
+    return node->bytes + elem.size() + kZipEntryOverhead <= kSizeLimits[idx];
+}
+
+void QQuickList::_Compress(Node* node)
+{
+    if (node->lzfBytes || node->bytes < kMinCompressBytes)
+        return;
+
+    const unsigned int outLen = node->bytes - kMinCompressImprove;
+    unsigned char* out = static_cast<unsigned char* >(zmalloc(outLen));
+    const unsigned int lzfBytes = lzf_compress(node->data, node->bytes, out, outLen);
+    if (lzfBytes == 0)
+    {
+        // not compressible
+        zfree(out);
+        return;
+    }
+
+    zfree(node->data);
+    node->data = static_cast<unsigned char* >(zrealloc(out, lzfBytes));
+    node->lzfBytes = lzfBytes;
+}
+
+void QQuickList::_Decompress(Node* node)
+{
+    if (!node->lzfBytes)
+        return;
+
+    unsigned char* raw = static_cast<unsigned char* >(zmalloc(node->bytes));
+    const unsigned int bytes = lzf_decompress(node->data, node->lzfBytes, raw, node->bytes);
+    assert (bytes == node->bytes);
+    (void)bytes;
+
+    zfree(node->data);
+    node->data = raw;
+    node->lzfBytes = 0;
+}
+
+// Same as redis' __quicklistCompress: nodes within compressDepth of both
+// ends are raw, node is compressed if it's in the middle.
+void QQuickList::_CompressAround(Node* node)
+{
+    if (compressDepth_ <= 0 || len_ < static_cast<std::size_t>(compressDepth_) * 2)
+        return;
+
+    Node* forward = head_;
+    Node* reverse = tail_;
+    bool inDepth = false;
+    for (int depth = 0; depth < compressDepth_; ++ depth)
+    {
+        _Decompress(forward);
+        _Decompress(reverse);
+
+        if (forward == node || reverse == node)
+            inDepth = true;
+
+        if (forward == reverse || forward->next == reverse)
+            return;
+
+        forward = forward->next;
+        reverse = reverse->prev;
+    }
+
+    if (!inDepth)
+        _Compress(node);
+
+    // the nodes just pushed out of depth
+    _Compress(forward);
+    _Compress(reverse);
+}
+
+PZIPLIST QQuickList::_ZipList(const Node* node, std::string& buf) const
+{
+    if (!node->lzfBytes)
+        return node->data;
+
+    buf.resize(node->bytes);
+    const unsigned int bytes = lzf_decompress(node->data, node->lzfBytes, &buf[0], node->bytes);
+    assert (bytes == node->bytes);
+    (void)bytes;
+
+    return reinterpret_cast<PZIPLIST>(&buf[0]);
+}
+
+QQuickList::Node* QQuickList::_Locate(long index, long* offset) const
+{
+    assert (index >= 0 && index < static_cast<long>(count_));
+
+    Node* node = nullptr;
+    if (index < static_cast<long>(count_ / 2))
+    {
+        node = head_;
+        while (index >= static_cast<long>(node->count))
+        {
+            index -= node->count;
+            node = node->next;
+        }
+
+        *offset = index;
+    }
+    else
+    {
+        long rindex = static_cast<long>(count_) - 1 - index;
+        node = tail_;
+        while (rindex >= static_cast<long>(node->count))
+        {
+            rindex -= node->count;
+            node = node->prev;
+        }
+
+        *offset = node->count - 1 - rindex;
+    }
+
+    return node;
+}
+
+// node keeps [0, offset), the others are moved to a new node after it
+void QQuickList::_Split(Node* node, long offset)
+{
+    assert (offset > 0 && offset < static_cast<long>(node->count));
+
+    _Decompress(node);
+
+    PZIPLIST right = ZipListCopy(reinterpret_cast<const char* >(node->data), node->bytes);
+    right = ZipListDeleteRange(right, 0, offset);
+
+    node->data = ZipListDeleteRange(node->data, offset, node->count - offset);
+    node->count = static_cast<unsigned int>(offset);
+    node->bytes = static_cast<unsigned int>(ZipListBytes(node->data));
+
+    Node* newNode = _CreateNode(right);
+    _LinkAfter(node, newNode);
+    _CompressAround(newNode);
+}
+
+void QQuickList::_InsertAt(Node* node, long offset, const QString& elem)
+{
+    Node* target = nullptr;
+    if (_AllowInsert(node, elem))
+    {
+        _Decompress(node);
+        if (offset == static_cast<long>(node->count))
+            node->data = ZipListPush(node->data, elem, true);
+        else
+            node->data = ZipListInsert(node->data, ZipListIndex(node->data, offset), elem);
+
+        target = node;
+    }
+    else if (offset == 0)
+    {
+        target = node->prev;
+        if (_AllowInsert(target, elem))
+        {
+            _Decompress(target);
+            target->data = ZipListPush(target->data, elem, true);
+        }
+        else
+        {
+            target = _CreateNode(ZipListPush(ZipListNew(), elem));
+            _LinkAfter(node->prev, target);
+        }
+    }
+    else if (offset == static_cast<long>(node->count))
+    {
+        target = node->next;
+        if (_AllowInsert(target, elem))
+        {
+            _Decompress(target);
+            target->data = ZipListPush(target->data, elem, false);
+        }
+        else
+        {
+            target = _CreateNode(ZipListPush(ZipListNew(), elem));
+            _LinkAfter(node, target);
+        }
+    }
+    else
+    {
+        // insert into the middle of full node, split then append to the left half
+        _Split(node, offset);
+        _InsertAt(node, offset, elem);
+        return;
+    }
+
+    target->count = static_cast<unsigned int>(ZipListSize(target->data));
+    target->bytes = static_cast<unsigned int>(ZipListBytes(target->data));
+    _CompressAround(target);
+}
+
+void QQuickList::PushHead(const QString& elem)
+{
+    if (head_)
+    {
+        _InsertAt(head_, 0, elem);
+    }
+    else
+    {
+        _LinkAfter(nullptr, _CreateNode(ZipListPush(ZipListNew(), elem)));
+    }
+
+    ++ count_;
+}
+
+void QQuickList::PushTail(const QString& elem)
+{
+    if (tail_)
+    {
+        _InsertAt(tail_, tail_->count, elem);
+    }
+    else
+    {
+        _LinkAfter(nullptr, _CreateNode(ZipListPush(ZipListNew(), elem)));
+    }
+
+    ++ count_;
+}
+
+bool QQuickList::PopHead(QString* elem)
+{
+    if (!head_)
+        return false;
+
+    if (elem)
+        *elem = Index(0);
+
+    DeleteRange(0, 1);
+    return true;
+}
+
+bool QQuickList::PopTail(QString* elem)
+{
+    if (!tail_)
+        return false;
+
+    if (elem)
+        *elem = Index(static_cast<long>(count_) - 1);
+
+    DeleteRange(static_cast<long>(count_) - 1, 1);
+    return true;
+}
+
+QString QQuickList::Index(long index) const
+{
+    long offset;
+    const Node* node = _Locate(index, &offset);
+
+    std::string buf;
+    PZIPLIST zl = _ZipList(node, buf);
+    return ZipListGet(ZipListIndex(zl, offset));
+}
+
+void QQuickList::Replace(long index, const QString& elem)
+{
+    long offset;
+    Node* node = _Locate(index, &offset);
+
+    _Decompress(node);
+    unsigned char* p = ZipListIndex(node->data, offset);
+    node->data = ZipListReplace(node->data, &p, elem);
+    node->bytes = static_cast<unsigned int>(ZipListBytes(node->data));
+
+    _CompressAround(node);
+}
+
+void QQuickList::Erase(long index)
+{
+    DeleteRange(index, 1);
+}
+
+void QQuickList::DeleteRange(long index, long count)
+{
+    if (count <= 0)
+        return;
+
+    long offset;
+    Node* node = _Locate(index, &offset);
+    while (node && count > 0)
+    {
+        Node* next = node->next;
+        const long del = std::min(count, static_cast<long>(node->count) - offset);
+
+        if (offset == 0 && del == static_cast<long>(node->count))
+        {
+            _Unlink(node);
+            _FreeNode(node);
+        }
+        else
+        {
+            _Decompress(node);
+            node->data = ZipListDeleteRange(node->data, offset, del);
+            node->count -= static_cast<unsigned int>(del);
+            node->bytes = static_cast<unsigned int>(ZipListBytes(node->data));
+            _CompressAround(node);
+        }
+
+        count_ -= del;
+        count -= del;
+        offset = 0;
+        node = next;
+    }
+}
+
+bool QQuickList::Insert(const QString& pivot, const QString& elem, bool before)
+{
+    for (Node* node = head_; node; node = node->next)
+    {
+        std::string buf;
+        PZIPLIST zl = _ZipList(node, buf);
+
+        long offset = 0;
+        for (unsigned char* p = ZipListFirst(zl); p; p = ZipListNext(zl, p), ++ offset)
+        {
+            if (ZipListEqual(p, pivot))
+            {
+                _InsertAt(node, before ? offset : offset + 1, elem);
+                ++ count_;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+long QQuickList::Remove(const QString& elem, long count, bool fromHead)
+{
+    long removed = 0;
+
+    Node* node = fromHead ? head_ : tail_;
+    while (node && removed < count)
+    {
+        Node* next = fromHead ? node->next : node->prev;
+
+        std::string buf;
+        if (!ZipListFind(_ZipList(node, buf), elem))
+        {
+            node = next;
+            continue;
+        }
+
+        _Decompress(node);
+        PZIPLIST zl = node->data;
+        if (fromHead)
+        {
+            unsigned char* p = ZipListFirst(zl);
+            while (p && removed < count)
+            {
+                if (ZipListEqual(p, elem))
+                {
+                    zl = ZipListDelete(zl, &p);
+                    ++ removed;
+                }
+                else
+                {
+                    p = ZipListNext(zl, p);
+                }
+            }
+        }
+        else
+        {
+            unsigned char* p = ZipListLast(zl);
+            while (p && removed < count)
+            {
+                unsigned char* prev = ZipListPrev(zl, p);
+                if (ZipListEqual(p, elem))
+                {
+                    // entries before p are not moved, but zl may be realloced
+                    const long offset = prev ? prev - zl : -1;
+                    zl = ZipListDelete(zl, &p);
+                    prev = (offset >= 0) ? zl + offset : nullptr;
+                    ++ removed;
+                }
+
+                p = prev;
+            }
+        }
+
+        const unsigned int newCount = static_cast<unsigned int>(ZipListSize(zl));
+        count_ -= node->count - newCount;
+
+        node->data = zl;
+        node->count = newCount;
+        node->bytes = static_cast<unsigned int>(ZipListBytes(zl));
+        if (node->count == 0)
+        {
+            _Unlink(node);
+            _FreeNode(node);
+        }
+        else
+        {
+            _CompressAround(node);
+        }
+
+        node = next;
+    }
+
+    return removed;
+}
+
+void QQuickList::Range(long start, long end, const std::function<void (const QString& )>& func) const
+{
+    assert (start <= end && end < static_cast<long>(count_));
+
+    long offset;
+    const Node* node = _Locate(start, &offset);
+
+    std::string buf;
+    for (long i = start; node && i <= end; node = node->next, offset = 0)
+    {
+        PZIPLIST zl = _ZipList(node, buf);
+        for (unsigned char* p = ZipListIndex(zl, offset); p && i <= end; p = ZipListNext(zl, p), ++ i)
+            func(ZipListGet(p));
+    }
+}
+
+void QQuickList::AppendZipList(PZIPLIST zl)
+{
+    Node* node = _CreateNode(zl);
+    assert (node->count > 0);
+
+    _LinkAfter(tail_, node);
+    count_ += node->count;
+    _CompressAround(node);
+}
+
+void QQuickList::ForEachZipList(const std::function<void (PZIPLIST )>& func) const
+{
+    std::string buf;
+    for (const Node* node = head_; node; node = node->next)
+        func(_ZipList(node, buf));
+}
+
+}
+
@@ -0,0 +1,99 @@
+#ifndef BERT_QQUICKLIST_H
+#define BERT_QQUICKLIST_H
+
+#include "QZipList.h"
+#include <functional>
+
+namespace qedis
+{
+
+// Doubly linked list of ziplists, like redis' quicklist.
+// Every node holds a bounded ziplist, so LINDEX walks nodes instead of
+// elements and LRANGE reads contiguous memory.
+// Nodes more than compressDepth away from both ends are kept LZF compressed.
+class QQuickList
+{
+public:
+    // fill > 0: max entries per node;
+    // fill < 0: max bytes per node, -1 for 4KB, -2 for 8KB ... -5 for 64KB
+    QQuickList(int fill, int compressDepth);
+   ~QQuickList();
+
+    QQuickList(const QQuickList& ) = delete;
+    void operator= (const QQuickList& ) = delete;
+
+    std::size_t Size() const { return count_; }
+    std::size_t NodeCount() const { return len_; }
+
+    void PushHead(const QString& elem);
+    void PushTail(const QString& elem);
+    bool PopHead(QString* elem);
+    bool PopTail(QString* elem);
+
+    // index must be in [0, Size())
+    QString Index(long index) const;
+    void    Replace(long index, const QString& elem);
+    void    Erase(long index);
+    // remove count elements from index
+    void    DeleteRange(long index, long count);
+
+    // insert elem before or after the first pivot, return false if no pivot
+    bool    Insert(const QString& pivot, const QString& elem, bool before);
+    // remove at most count elements equal to elem
+    long    Remove(const QString& elem, long count, bool fromHead);
+
+    // iterate [start, end], both must be valid
+    void    Range(long start, long end, const std::function<void (const QString& )>& func) const;
+
+    // take over a ziplist as the new tail node, it must not be empty
+    void    AppendZipList(PZIPLIST zl);
+    // iterate uncompressed ziplist of every node, for persistence
+    void    ForEachZipList(const std::function<void (PZIPLIST )>& func) const;
+
+    // active defrag, move the nodes and their data, return the blocks moved
+    std::size_t Defrag();
+
+private:
+    struct Node
+    {
+        Node* prev;
+        Node* next;
+        // raw ziplist, or lzf data if compressed
+        unsigned char* data;
+        unsigned int   count;
+        unsigned int   bytes;      // raw ziplist bytes
+        unsigned int   lzfBytes;   // 0 if not compressed
+    };
+
+    Node* _CreateNode(PZIPLIST zl);
+    void  _FreeNode(Node* node);
+    void  _LinkAfter(Node* pos, Node* node);  // pos nullptr means the head
+    void  _Unlink(Node* node);
+
+    bool  _AllowInsert(const Node* node, const QString& elem) const;
+
+    // compress/decompress in place
+    void  _Compress(Node* node);
+    void  _Decompress(Node* node);
+    // keep the ends raw, compress node if it's in the middle
+    void  _CompressAround(Node* node);
+    // raw ziplist of node, decompressed into buf if needed
+    PZIPLIST _ZipList(const Node* node, std::string& buf) const;
+
+    // locate node and offset in node of index
+    Node* _Locate(long index, long* offset) const;
+    void  _Split(Node* node, long offset);
+    void  _InsertAt(Node* node, long offset, const QString& elem);
+
+    Node* head_;
+    Node* tail_;
+    std::size_t count_; // total elements
+    std::size_t len_;   // nodes
+    const int fill_;
+    const int compressDepth_;
+};
+
+}
+
+#endif
+
@@ -2,6 +2,7 @@
 #include <unistd.h>
 #include <iostream> // the child process use stdout for log
 #include <sstream>
+#include <cstring>
 
 #include "Log/Logger.h"
 #include "QClient.h"
@@ -23,7 +24,63 @@ QReplication& QReplication::Instance()
     return rep;
 }
 
-QReplication::QReplication()
+void QReplBacklog::Create(std::size_t size)
+{
+    buf_.resize(size);
+    idx_ = 0;
+    histlen_ = 0;
+}
+
+void QReplBacklog::Feed(const char* data, std::size_t len)
+{
+    offset_ += len;
+
+    if (buf_.empty())
+        return;
+
+    // only the tail matters if too long
+    if (len > buf_.size())
+    {
+        data += len - buf_.size();
+        len = buf_.size();
+    }
+
+    histlen_ = std::min(histlen_ + len, buf_.size());
+
+    while (len > 0)
+    {
+        const std::size_t n = std::min(len, buf_.size() - idx_);
+        memcpy(&buf_[idx_], data, n);
+
+        idx_ = (idx_ + n) % buf_.size();
+        data += n;
+        len -= n;
+    }
+}
+
+bool QReplBacklog::Read(std::size_t offset, UnboundedBuffer& out) const
+{
+    if (buf_.empty() || offset < StartOffset() || offset > offset_)
+        return false;
+
+    std::size_t len = offset_ - offset;
+    // position of offset in ring
+    std::size_t pos = (idx_ + buf_.size() - len) % buf_.size();
+
+    while (len > 0)
+    {
+        const std::size_t n = std::min(len, buf_.size() - pos);
+        out.PushData(&buf_[pos], n);
+
+        pos = (pos + n) % buf_.size();
+        len -= n;
+    }
+
+    return true;
+}
+
+
+QReplication::QReplication() : bgsaving_(false), slaveDb_(-1)
 {
 }
 
@@ -34,7 +91,16 @@ bool QReplication::IsBgsaving() const
 
 void QReplication::AddSlave(qedis::QClient* cli)
 {
+    std::lock_guard<std::mutex>  guard(streamMutex_);
     slaves_.push_back(std::static_pointer_cast<QClient>(cli->shared_from_this()));
+
+    // from now on, keep the stream for partial resync
+    if (!backlog_.IsCreated() && g_config.replBacklogSize > 0)
+    {
+        backlog_.Create(g_config.replBacklogSize);
+        INF << "Create replication backlog " << g_config.replBacklogSize
+            << " bytes, offset " << backlog_.Offset();
+    }
 }
 
 bool QReplication::HasAnyWaitingBgsave() const
@@ -53,6 +119,7 @@ bool QReplication::HasAnyWaitingBgsave() const
 
 void QReplication::OnRdbSaveDone()
 {
+    std::lock_guard<std::mutex>  guard(streamMutex_);
     bgsaving_ = false;
     
     InputMemoryFile  rdb;
@@ -127,8 +194,13 @@ void QReplication::TryBgsave()
 
 void QReplication::_OnStartBgsave(bool succ)
 {
+    std::lock_guard<std::mutex>  guard(streamMutex_);
     buffer_.Clear();
     bgsaving_ = succ;
+
+    // the stream after rdb must select db first
+    if (succ)
+        slaveDb_ = -1;
     
     for (auto& c : slaves_)
     {
@@ -143,6 +215,16 @@ void QReplication::_OnStartBgsave(bool succ)
             {
                 INF << "_OnStartBgsave set cli wait bgsave end " << cli->GetName();
                 cli->GetSlaveInfo()->state = QSlaveState_wait_bgsave_end;
+
+                // rdb is the snapshot of this offset, stream after it is in buffer_
+                if (cli->GetSlaveInfo()->psync)
+                {
+                    char tmp[128];
+                    int n = snprintf(tmp, sizeof tmp, "+FULLRESYNC %s %lu\r\n",
+                                     g_config.runid.c_str(),
+                                     static_cast<unsigned long>(backlog_.Offset()));
+                    cli->SendPacket(tmp, n);
+                }
             }
             else
             {
@@ -154,26 +236,84 @@ void QReplication::_OnStartBgsave(bool succ)
 
 void QReplication::SendToSlaves(const std::vector<QString>& params)
 {
-    if (IsBgsaving())
-    {
-        // 在执行rdb期间，缓存变化
-        SaveCommand(params, buffer_);
+    // never had slave
+    if (slaves_.empty() && !backlog_.IsCreated())
         return;
-    }
-    
+
     UnboundedBuffer   ub;
-    
+
+    std::lock_guard<std::mutex>  guard(streamMutex_);
+    const int db = QSTORE.GetDB();
+    if (slaveDb_ != db)
+    {
+        std::vector<QString> select{"select", std::to_string(db)};
+        SaveCommand(select, ub);
+        slaveDb_ = db;
+    }
+
+    SaveCommand(params, ub);
+    _FeedSlaves(ub);
+}
+
+void QReplication::_FeedSlaves(UnboundedBuffer& data)
+{
+    backlog_.Feed(data.ReadAddr(), data.ReadableSize());
+
+    // 在执行rdb期间，缓存变化
+    if (IsBgsaving())
+        buffer_.PushData(data.ReadAddr(), data.ReadableSize());
+
     for (const auto& wptr : slaves_)
     {
         auto cli = wptr.lock();
         if (!cli || cli->GetSlaveInfo()->state != QSlaveState_online)
             continue;
-        
-        if (ub.IsEmpty())
-            SaveCommand(params, ub);
-        
-        cli->SendPacket(ub);
+
+        cli->SendPacket(data);
+    }
+}
+
+bool QReplication::TryPartialResync(QClient* cli, const QString& runid, std::size_t offset)
+{
+    if (runid != g_config.runid)
+    {
+        INF << "Psync runid " << runid << " mismatch, my runid " << g_config.runid;
+        return false;
+    }
+
+    // replconf may have added it
+    auto slave = cli->GetSlaveInfo();
+    if (!slave)
+    {
+        cli->SetSlaveInfo();
+        slave = cli->GetSlaveInfo();
+        AddSlave(cli);
     }
+
+    // already syncing with this connection
+    if (slave->state != QSlaveState_none)
+        return false;
+
+    std::lock_guard<std::mutex>  guard(streamMutex_);
+    UnboundedBuffer  missed;
+    if (!backlog_.Read(offset, missed))
+    {
+        INF << "Psync offset " << offset << " out of backlog ["
+            << backlog_.StartOffset() << ", " << backlog_.Offset() << "]";
+        return false;
+    }
+
+    // online from now on, no write is lost between the backlog and stream
+    slave->psync = true;
+    slave->ackOffset = offset;
+    slave->state = QSlaveState_online;
+
+    cli->SendPacket("+CONTINUE\r\n", 11);
+    cli->SendPacket(missed);
+
+    USR << "Partial resync with " << cli->GetName()
+        << ", offset " << offset << ", send " << missed.ReadableSize() << " bytes";
+    return true;
 }
 
 void QReplication::Cron()
@@ -182,20 +322,21 @@ void QReplication::Cron()
     
     if (pingCron ++ % 50 == 0)
     {
+        std::lock_guard<std::mutex>  guard(streamMutex_);
         for (auto it = slaves_.begin(); it != slaves_.end(); )
         {
-            auto cli = it->lock();
-            if (!cli)
-            {
+            if (it->expired())
                 it = slaves_.erase(it);
-            }
             else
-            {
                 ++ it;
+        }
 
-                if (cli->GetSlaveInfo()->state == QSlaveState_online)
-                    cli->SendPacket("PING\r\n", 6);
-            }
+        // ping is a part of the stream, for the offset
+        if (!slaves_.empty())
+        {
+            UnboundedBuffer  ping;
+            ping.PushData("PING\r\n", 6);
+            _FeedSlaves(ping);
         }
     }
     
@@ -291,9 +432,18 @@ void QReplication::Cron()
                 }
                 else
                 {
-                    // request sync rdb file
-                    master->SendPacket("SYNC\r\n", 6);
-                    INF << "Request SYNC";
+                    // continue from the offset if the master is still the same
+                    char req[128];
+                    int len = 0;
+                    if (masterInfo_.runid.empty())
+                        len = snprintf(req, sizeof req, "PSYNC ? -1\r\n");
+                    else
+                        len = snprintf(req, sizeof req, "PSYNC %s %lu\r\n",
+                                       masterInfo_.runid.c_str(),
+                                       static_cast<unsigned long>(masterInfo_.offset));
+
+                    master->SendPacket(req, len);
+                    INF << "Request " << QString(req, len - 2);
                     
                     rdb_.Open(slaveRdbFile, false);
                     masterInfo_.rdbRecved = 0;
@@ -309,6 +459,11 @@ void QReplication::Cron()
             case QReplState_online:
                 if (auto master = master_.lock())
                 {
+                    // no reply for ack
+                    char req[64];
+                    int len = snprintf(req, sizeof req, "REPLCONF ACK %lu\r\n",
+                                       static_cast<unsigned long>(masterInfo_.offset));
+                    master->SendPacket(req, len);
                 }
                 else
                 {
@@ -366,6 +521,35 @@ void QReplication::SaveTmpRdb(const char* data, std::size_t& len)
     }
 }
     
+void QReplication::OnFullResync(const QString& runid, std::size_t offset)
+{
+    USR << "Full resync from master " << runid << ", offset " << offset;
+
+    masterInfo_.runid = runid;
+    masterInfo_.offset = offset;
+    masterInfo_.db = 0;
+}
+
+void QReplication::OnPartialResync()
+{
+    USR << "Partial resync from master " << masterInfo_.runid
+        << ", offset " << masterInfo_.offset;
+
+    // no rdb, go on with the db of the stream
+    rdb_.Close();
+    if (auto master = master_.lock())
+        master->SelectDB(masterInfo_.db);
+
+    masterInfo_.state = QReplState_online;
+    masterInfo_.downSince = 0;
+}
+
+void QReplication::OnMasterStream(std::size_t bytes, int db)
+{
+    masterInfo_.offset += bytes;
+    masterInfo_.db = db;
+}
+
 void QReplication::SetMaster(const std::shared_ptr<QClient>&  cli)
 {
     master_ = cli;
@@ -388,6 +572,11 @@ SocketAddr QReplication::GetMasterAddr() const
 
 void QReplication::SetMasterAddr(const char* ip, unsigned short port)
 {
+    // another master, can not continue
+    masterInfo_.runid.clear();
+    masterInfo_.offset = 0;
+    masterInfo_.db = 0;
+
     if (ip)
         masterInfo_.addr.Init(ip, port);
     else
@@ -407,6 +596,17 @@ std::size_t QReplication::GetRdbSize() const
     
 QError replconf(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
+    // replconf ack <offset>, sent by online slave, never reply
+    if (params.size() == 3 && strcasecmp(params[1].c_str(), "ack") == 0)
+    {
+        long offset;
+        auto info = QClient::Current()->GetSlaveInfo();
+        if (info && TryStr2Long(params[2].c_str(), params[2].size(), offset) && offset >= 0)
+            info->ackOffset = static_cast<std::size_t>(offset);
+
+        return QError_ok;
+    }
+
     if (params.size() % 2 == 0)
     {
         ReplyError(QError_syntax, reply);
@@ -482,6 +682,8 @@ void QReplication::OnInfoCommand(UnboundedBuffer& res)
                 << (slaveInfo ? slaveInfo->listenPort : 0)
                 << ","
                 << slaveState[state]
+                << ","
+                << (slaveInfo ? slaveInfo->ackOffset : 0)
                 << "\r\n";
         }
     }
@@ -494,9 +696,17 @@ void QReplication::OnInfoCommand(UnboundedBuffer& res)
                  "# Replication\r\n"
                  "role:%s\r\n"
                  "connected_slaves:%d\r\n%s"
+                 "master_repl_offset:%lu\r\n"
+                 "repl_backlog_active:%d\r\n"
+                 "repl_backlog_size:%lu\r\n"
+                 "repl_backlog_first_byte_offset:%lu\r\n"
                  , isMaster ? "master" : "slave"
                  , index
-                 , slaveInfo.c_str());
+                 , slaveInfo.c_str()
+                 , static_cast<unsigned long>(backlog_.Offset())
+                 , backlog_.IsCreated() ? 1 : 0
+                 , static_cast<unsigned long>(backlog_.Size())
+                 , static_cast<unsigned long>(backlog_.StartOffset()));
 
     std::ostringstream masterInfo;
     if (!isMaster)
@@ -520,6 +730,8 @@ void QReplication::OnInfoCommand(UnboundedBuffer& res)
             masterInfo << "master_link_down_since_seconds:"
                        << (::time(nullptr) - masterInfo_.downSince) << "\r\n";
         }
+
+        masterInfo << "slave_repl_offset:" << masterInfo_.offset << "\r\n";
     }
     
     if (!res.IsEmpty())
@@ -556,7 +768,7 @@ QError  slaveof(const std::vector<QString>& params, UnboundedBuffer* reply)
     return QError_ok;
 }
     
-QError  sync(const std::vector<QString>& params, UnboundedBuffer* reply)
+static QError FullSync(bool psync)
 {
     QClient* cli = QClient::Current();
     auto slave = cli->GetSlaveInfo();
@@ -576,11 +788,32 @@ QError  sync(const std::vector<QString>& params, UnboundedBuffer* reply)
         return QError_ok;
     }
         
+    slave->psync = psync;
     slave->state = QSlaveState_wait_bgsave_start;
     QREPL.TryBgsave();
         
     return QError_ok;
 }
+
+QError  sync(const std::vector<QString>& params, UnboundedBuffer* reply)
+{
+    return FullSync(false);
+}
+
+// psync <runid> <offset>, runid is ? if slave never synced
+QError  psync(const std::vector<QString>& params, UnboundedBuffer* reply)
+{
+    long offset;
+    if (params[1] != "?" &&
+        TryStr2Long(params[2].c_str(), params[2].size(), offset) &&
+        offset >= 0)
+    {
+        if (QREPL.TryPartialResync(QClient::Current(), params[1], static_cast<std::size_t>(offset)))
+            return QError_ok;
+    }
+
+    return FullSync(true);
+}
     
 
 }
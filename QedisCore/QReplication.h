@@ -2,7 +2,9 @@
 #define BERT_QREPLICATION_H
 
 #include <list>
+#include <vector>
 #include <memory>
+#include <mutex>
 #include "UnboundedBuffer.h"
 #include "Socket.h"
 #include "Log/MemoryFile.h"
@@ -24,8 +26,10 @@ struct QSlaveInfo
 {
     QSlaveState  state;
     unsigned short listenPort; // slave listening port
+    bool         psync;        // sent psync, not sync
+    std::size_t  ackOffset;    // by replconf ack
     
-    QSlaveInfo() : state(QSlaveState_none), listenPort(0)
+    QSlaveInfo() : state(QSlaveState_none), listenPort(0), psync(false), ackOffset(0)
     {
     }
 };
@@ -51,6 +55,11 @@ struct QMasterInfo
     // For recv rdb
     std::size_t rdbSize;
     std::size_t rdbRecved;
+
+    // For psync, kept when master is down
+    QString     runid;  // empty if never synced
+    std::size_t offset; // bytes of replication stream processed
+    int         db;     // db selected by the stream
     
     QMasterInfo()
     {
@@ -58,9 +67,35 @@ struct QMasterInfo
         downSince = 0;
         rdbSize = std::size_t(-1);
         rdbRecved = 0;
+        offset = 0;
+        db = 0;
     }
 };
 
+// master side, the latest bytes of replication stream for partial resync.
+// Offset is the bytes ever fed, the backlog holds [StartOffset, Offset).
+class QReplBacklog
+{
+public:
+    void  Create(std::size_t size);
+    bool  IsCreated() const { return !buf_.empty(); }
+
+    void  Feed(const char* data, std::size_t len);
+
+    std::size_t Offset() const { return offset_; }
+    std::size_t StartOffset() const { return offset_ - histlen_; }
+    std::size_t Size() const { return buf_.size(); }
+
+    // append the data from offset to out, false if not in backlog
+    bool  Read(std::size_t offset, UnboundedBuffer& out) const;
+
+private:
+    std::vector<char> buf_;
+    std::size_t idx_ = 0;     // next write position
+    std::size_t histlen_ = 0; // valid bytes
+    std::size_t offset_ = 0;
+};
+
 //tmp filename
 const char*  const slaveRdbFile = "slave.rdb";
 
@@ -85,6 +120,8 @@ public:
     void OnStartBgsave();
     void OnRdbSaveDone();
     void SendToSlaves(const std::vector<QString>& params);
+    // +CONTINUE and the missed stream if runid and offset match
+    bool TryPartialResync(QClient* cli, const QString& runid, std::size_t offset);
     
     // slave side
     void SaveTmpRdb(const char* data, std::size_t& len);
@@ -95,6 +132,11 @@ public:
     QReplState GetMasterState() const;
     SocketAddr GetMasterAddr() const;
     std::size_t GetRdbSize() const;
+    // psync reply of master
+    void OnFullResync(const QString& runid, std::size_t offset);
+    void OnPartialResync();
+    // stream processed by master client
+    void OnMasterStream(std::size_t bytes, int db);
     
     // info command
     void OnInfoCommand(UnboundedBuffer& res);
@@ -102,11 +144,17 @@ public:
 private:
     QReplication();
     void _OnStartBgsave(bool succ);
+    void _FeedSlaves(UnboundedBuffer& data);
     
     // master side
     bool bgsaving_;
     UnboundedBuffer buffer_;
     std::list<std::weak_ptr<QClient> > slaves_;
+    QReplBacklog backlog_;
+    int slaveDb_; // db selected in the stream, -1 to select again
+    // shard workers propagate writes too, guard the stream and slaves_ list,
+    // slaves_ is only changed by main thread.
+    std::mutex streamMutex_;
 
     //slave side
     QMasterInfo masterInfo_;
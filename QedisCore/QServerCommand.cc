@@ -6,10 +6,16 @@
 #include "QClient.h"
 #include "Log/Logger.h"
 #include "Server.h"
+#include "NetThreadPool.h"
+#include "BufferPool.h"
+#include "AsyncBuffer.h"
 #include "QDB.h"
 #include "QAOF.h"
 #include "QConfig.h"
+#include "QMemory.h"
+#include "QLazyFree.h"
 #include "QSlowLog.h"
+#include "QShard.h"
 #include "QGlobRegex.h"
 #include "Delegate.h"
 
@@ -45,10 +51,32 @@ QError dbsize(const std::vector<QString>& params, UnboundedBuffer* reply)
     return QError_ok;
 }
 
+// [ASYNC|SYNC] of flushdb and flushall
+static bool _IsFlushAsync(const std::vector<QString>& params, bool& async)
+{
+    async = false;
+    if (params.size() == 1)
+        return true;
+
+    if (strcasecmp(params[1].c_str(), "async") == 0)
+        async = true;
+    else if (strcasecmp(params[1].c_str(), "sync") != 0)
+        return false;
+
+    return true;
+}
+
 QError flushdb(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
+    bool async = false;
+    if (!_IsFlushAsync(params, async))
+    {
+        ReplyError(QError_syntax, reply);
+        return QError_syntax;
+    }
+
     QSTORE.dirty_ += QSTORE.DBSize();
-    QSTORE.ClearCurrentDB();
+    QSTORE.ClearCurrentDB(async);
     Propogate(QSTORE.GetDB(), params);
     
     FormatOK(reply);
@@ -57,12 +85,19 @@ QError flushdb(const std::vector<QString>& params, UnboundedBuffer* reply)
 
 QError flushall(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
+    bool async = false;
+    if (!_IsFlushAsync(params, async))
+    {
+        ReplyError(QError_syntax, reply);
+        return QError_syntax;
+    }
+
     int currentDb = QSTORE.GetDB();
     
     QEDIS_DEFER {
         QSTORE.SelectDB(currentDb);
         Propogate(-1, params);
-        QSTORE.ResetDb();
+        QSTORE.ResetDb(async);
     };
     
     for (int dbno = 0; true; ++ dbno)
@@ -168,7 +203,30 @@ QError client(const std::vector<QString>& params, UnboundedBuffer* reply)
     }
     else if (params[1].size() == 4 && strncasecmp(params[1].c_str(), "list", 4) == 0)
     {
-        FormatOK(reply);
+        QString res;
+        Server::Instance()->ForEachTCP([&res](const std::shared_ptr<StreamSocket>& sock) {
+            auto cli = std::dynamic_pointer_cast<QClient>(sock);
+            if (!cli)
+                return;
+
+            StreamSocket::BufferStats stats;
+            cli->GetBufferStats(stats);
+
+            char buf[512];
+            int n = snprintf(buf, sizeof buf,
+                             "id=%lu addr=%s name=%s db=%d qbuf=%lu qbuf-free=%lu obl=%lu omem=%lu\n",
+                             cli->GetID(),
+                             cli->GetPeerAddr().ToString().c_str(),
+                             cli->GetName().c_str(),
+                             cli->GetDB(),
+                             stats.recvBytes,
+                             stats.recvCapacity ? stats.recvCapacity - stats.recvBytes - 1 : 0,
+                             stats.sendBytes,
+                             stats.sendMemory);
+            res.append(buf, std::min<std::size_t>(n, sizeof buf - 1));
+        });
+
+        FormatBulk(res, reply);
     }
     else
     {
@@ -206,11 +264,16 @@ QError debug(const std::vector<QString>& params, UnboundedBuffer* reply)
         }
         else
         {
-            // ref count,  encoding, idle time
+            // ref count,  encoding, idle time, or access frequency of lfu
             char buf[512];
-            int  len = snprintf(buf, sizeof buf, "ref count:%ld, encoding:%s, idletime:%u",
+            int  len = snprintf(buf, sizeof buf, "ref count:%ld, encoding:%s, ",
                                 1L, // TODO ?
-                                EncodingStringInfo(obj->encoding),
+                                EncodingStringInfo(obj->encoding));
+            if (IsLFUPolicy(g_config.maxmemoryPolicy))
+                len += snprintf(buf + len, sizeof buf - len, "freq:%u",
+                                static_cast<unsigned>(LFUDecrAndReturn(obj->lru)));
+            else
+                len += snprintf(buf + len, sizeof buf - len, "idletime:%u",
                                 EstimateIdleTime(obj->lru));
             FormatBulk(buf, len, reply);
         }
@@ -254,25 +317,73 @@ void OnMemoryInfoCollect(UnboundedBuffer& res)
     // memory info
     auto minfo = getMemoryInfo();
 
-    char buf[1024];
+    // the counted memory, rss includes the fragmentation of allocator
+    const size_t used = UsedMemory();
+    const size_t peak = PeakMemory();
+    const size_t overhead = StartupMemory() + HashTableMemory();
+
+    // the pages of allocator are more than the blocks allocated
+    AllocatorStats stats;
+    GetAllocatorStats(stats);
+    const size_t fragBytes = stats.active > stats.allocated ? stats.active - stats.allocated : 0;
+
+    char buf[2048];
     int n = snprintf(buf, sizeof buf - 1,
                  "# Memory\r\n"
-                 "used_memory_peak:%lu\r\n"
                  "used_memory:%lu\r\n"
                  "used_memory_human:%sMB\r\n"
+                 "used_memory_peak:%lu\r\n"
+                 "used_memory_peak_human:%sMB\r\n"
+                 "used_memory_overhead:%lu\r\n"
+                 "used_memory_startup:%lu\r\n"
+                 "used_memory_dataset:%lu\r\n"
                  "used_memory_rss_peak:%lu\r\n"
                  "used_memory_rss:%lu\r\n"
                  "used_memory_rss_human:%sMB\r\n"
                  "used_memory_lock:%lu\r\n"
                  "used_memory_swap:%lu\r\n"
-                 , minfo[VmPeak]
-                 , minfo[VmSize]
-                 , std::to_string(minfo[VmSize] / 1024.0f / 1024.0f).data()
+                 "mem_fragmentation_ratio:%.2f\r\n"
+                 "maxmemory:%lu\r\n"
+                 "maxmemory_policy:%s\r\n"
+                 "lazyfree_pending_objects:%lu\r\n"
+                 "mem_allocator:%s\r\n"
+                 "allocator_allocated:%lu\r\n"
+                 "allocator_active:%lu\r\n"
+                 "allocator_resident:%lu\r\n"
+                 "allocator_frag_ratio:%.2f\r\n"
+                 "allocator_frag_bytes:%lu\r\n"
+                 "active_defrag_running:%d\r\n"
+                 "conn_buffer_pool_used:%lu\r\n"
+                 "conn_buffer_pool_cached:%lu\r\n"
+                 "conn_buffer_pool_acquired:%lu\r\n"
+                 "conn_buffer_pool_reused:%lu\r\n"
+                 , used
+                 , std::to_string(used / 1024.0f / 1024.0f).data()
+                 , peak
+                 , std::to_string(peak / 1024.0f / 1024.0f).data()
+                 , overhead
+                 , StartupMemory()
+                 , used > overhead ? used - overhead : 0
                  , minfo[VmHWM]
                  , minfo[VmRSS]
                  , std::to_string(minfo[VmRSS] / 1024.0f / 1024.0f).data()
                  , minfo[VmLck]
                  , minfo[VmSwap]
+                 , used ? static_cast<double>(minfo[VmRSS]) / used : 0.0
+                 , g_config.maxmemory
+                 , EvictionPolicyName(g_config.maxmemoryPolicy)
+                 , QLazyFree::Instance().Pending()
+                 , AllocatorName()
+                 , stats.allocated
+                 , stats.active
+                 , stats.resident
+                 , stats.allocated ? static_cast<double>(stats.active) / stats.allocated : 0.0
+                 , fragBytes
+                 , QSTORE.IsDefragRunning() ? 1 : 0
+                 , BufferPool::Instance().InUse()
+                 , BufferPool::Instance().Cached()
+                 , BufferPool::Instance().Acquired()
+                 , BufferPool::Instance().Reused()
             );
     
     if (!res.IsEmpty())
@@ -325,6 +436,47 @@ void OnClientInfoCollect(UnboundedBuffer& res)
     res.PushData(buf, n);
 }
 
+void OnThreadInfoCollect(UnboundedBuffer& res)
+{
+    const auto& pool = Internal::NetThreadPool::Instance();
+
+    QString info("# Threads\r\n");
+    info += "recv_threads:" + std::to_string(pool.RecvThreads().size()) + "\r\n";
+    info += "send_threads:" + std::to_string(pool.SendThreads().size()) + "\r\n";
+    if (!pool.RecvThreads().empty())
+        info += "io_backend:" + std::string(pool.RecvThreads()[0]->PollerName()) + "\r\n";
+    info += "busy_poll_us:" + std::to_string(g_config.busyPollUs) + "\r\n";
+    info += "worker_threads:" + std::to_string(QSHARDS.Count()) + "\r\n";
+
+    // events: fired read events of recv thread, writes of send thread
+    for (std::size_t i = 0; i < pool.RecvThreads().size(); ++ i)
+    {
+        const auto& t = pool.RecvThreads()[i];
+        info += "recv_thread" + std::to_string(i) +
+                ":sockets=" + std::to_string(t->SocketCount()) +
+                ",events=" + std::to_string(t->EventCount()) + "\r\n";
+    }
+
+    for (std::size_t i = 0; i < pool.SendThreads().size(); ++ i)
+    {
+        const auto& t = pool.SendThreads()[i];
+        info += "send_thread" + std::to_string(i) +
+                ":sockets=" + std::to_string(t->SocketCount()) +
+                ",events=" + std::to_string(t->EventCount()) + "\r\n";
+    }
+
+    // replies waiting for another writer of the same socket, copied and
+    // sent from the stored values
+    info += "send_contended_writes:" + std::to_string(AsyncBuffer::ContendedWrites()) + "\r\n";
+    info += "send_copied_bytes:" + std::to_string(AsyncBuffer::CopiedBytes()) + "\r\n";
+    info += "send_referenced_bytes:" + std::to_string(AsyncBuffer::ReferencedBytes()) + "\r\n";
+
+    if (!res.IsEmpty())
+        res.PushData("\r\n", 2);
+
+    res.PushData(info.data(), info.size());
+}
+
 QError info(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     UnboundedBuffer res;
@@ -420,6 +572,7 @@ enum ConfigType {
     Config_bool,
     Config_int,
     Config_int64,
+    Config_policy, // maxmemory-policy, int in g_config
 };
 
 struct ConfigInfo
@@ -436,6 +589,12 @@ std::map<QString, ConfigInfo> configOptions = {
     {"bind", {Config_string, false, &g_config.ip}},
     {"dbfilename", {Config_string, true, &g_config.rdbfullname}},
     {"databases", {Config_int, false, &g_config.databases}},
+    {"worker-threads", {Config_int, false, &g_config.workerThreads}},
+    {"recv-threads", {Config_int, false, &g_config.recvThreads}},
+    {"send-threads", {Config_int, false, &g_config.sendThreads}},
+    {"io-backend", {Config_string, false, &g_config.ioBackend}},
+    {"busy-poll-us", {Config_int, false, &g_config.busyPollUs}},
+    {"logic-cpu", {Config_int, false, &g_config.logicCpu}},
     {"daemonize", {Config_bool, false, &g_config.daemonize}},
     {"hz", {Config_int, false, &g_config.hz}},
     {"logfile", {Config_string, false, &g_config.logdir}},
@@ -449,9 +608,30 @@ std::map<QString, ConfigInfo> configOptions = {
     {"slowlog-log-slower-than", {Config_int, true, &g_config.slowlogtime}},
     {"slowlog-max-len", {Config_int, true, &g_config.slowlogmaxlen}},
     {"slaveof", {Config_string, false, &g_config.masterIp}},
+    {"repl-backlog-size", {Config_int64, false, &g_config.replBacklogSize}},
     {"maxmemory", {Config_int64, true, &g_config.maxmemory}},
     {"maxmemorySamples", {Config_int, true, &g_config.maxmemorySamples}},
-    {"maxmemory-noevict", {Config_bool, true, &g_config.noeviction}},
+    {"maxmemory-policy", {Config_policy, true, &g_config.maxmemoryPolicy}},
+    {"lfu-log-factor", {Config_int, true, &g_config.lfuLogFactor}},
+    {"lfu-decay-time", {Config_int, true, &g_config.lfuDecayTime}},
+    {"lazyfree-threshold", {Config_int, true, &g_config.lazyfreeThreshold}},
+    {"activedefrag", {Config_bool, true, &g_config.activedefrag}},
+    {"active-defrag-ignore-bytes", {Config_int64, true, &g_config.activeDefragIgnoreBytes}},
+    {"active-defrag-threshold-lower", {Config_int, true, &g_config.activeDefragThresholdLower}},
+    {"active-defrag-cycle-max", {Config_int, true, &g_config.activeDefragCycleMax}},
+    {"hash-max-ziplist-entries", {Config_int, true, &g_config.hashMaxZiplistEntries}},
+    {"hash-max-ziplist-value", {Config_int, true, &g_config.hashMaxZiplistValue}},
+    {"set-max-ziplist-entries", {Config_int, true, &g_config.setMaxZiplistEntries}},
+    {"set-max-ziplist-value", {Config_int, true, &g_config.setMaxZiplistValue}},
+    {"set-max-intset-entries", {Config_int, true, &g_config.setMaxIntsetEntries}},
+    {"list-max-ziplist-entries", {Config_int, true, &g_config.listMaxZiplistEntries}},
+    {"list-max-ziplist-value", {Config_int, true, &g_config.listMaxZiplistValue}},
+    {"list-max-ziplist-size", {Config_int, true, &g_config.listMaxZiplistSize}},
+    {"list-compress-depth", {Config_int, true, &g_config.listCompressDepth}},
+    {"zset-max-ziplist-entries", {Config_int, true, &g_config.zsetMaxZiplistEntries}},
+    {"zset-max-ziplist-value", {Config_int, true, &g_config.zsetMaxZiplistValue}},
+    {"string-max-embedded-value", {Config_int, true, &g_config.stringMaxEmbeddedValue}},
+    {"string-min-shared-value", {Config_int, true, &g_config.stringMinSharedValue}},
     {"backend", {Config_int, false, &g_config.backend}},
     {"backendhz", {Config_int, false, &g_config.backendHz}},
 };
@@ -497,6 +677,10 @@ static std::vector<QString> GetConfig(const QString& option)
                 res.push_back(*(const QString*)it->second.value);
                 break;
 
+            case Config_policy:
+                res.push_back(EvictionPolicyName(*(const int*)it->second.value));
+                break;
+
             case Config_int:
             case Config_int64:
                 {
@@ -541,6 +725,16 @@ static QError SetConfig(const QString& option, const QString& value)
             *(QString*)it->second.value = value;
             break;
 
+        case Config_policy:
+            {
+                int policy = EvictionPolicyByName(value);
+                if (policy < 0)
+                    return QError_syntax;
+
+                *(int*)it->second.value = policy;
+            }
+            break;
+
         case Config_int:
         case Config_int64:
             {
@@ -1,7 +1,15 @@
 #include "QSet.h"
 #include "QStore.h"
 #include "QClient.h"
+#include "QConfig.h"
+#include "QGlobRegex.h"
 #include <cassert>
+#include <algorithm>
+
+extern "C"
+{
+#include "redisIntset.h"
+}
 
 namespace qedis
 {
@@ -9,11 +17,223 @@ namespace qedis
 QObject QObject::CreateSet()
 {
     QObject set(QType_set);
-    set.Reset(new QSet);
+    set.encoding = QEncode_intset;
+    set.Reset(intsetNew());
 
     return set;
 }
 
+// only canonical decimal can be stored in intset, "01" or "+1" must stay as is
+static bool _IntsetValue(const QString& member, int64_t* value)
+{
+    long long v;
+    if (!Strtoll(member.data(), member.size(), &v))
+        return false;
+
+    char buf[32];
+    auto len = Number2Str(buf, sizeof buf, v);
+    if (len != member.size() || memcmp(buf, member.data(), len) != 0)
+        return false;
+
+    *value = v;
+    return true;
+}
+
+static QString _IntsetMember(int64_t value)
+{
+    char buf[32];
+    auto len = Number2Str(buf, sizeof buf, value);
+    return QString(buf, len);
+}
+
+static void _ConvertSet(QObject& obj, QEncode encoding)
+{
+    assert (obj.encoding != encoding);
+
+    if (encoding == QEncode_zipset)
+    {
+        PZIPLIST zl = ZipListNew();
+        SetForEach(obj, [&zl](const QString& member) {
+            zl = ZipListPush(zl, member);
+        });
+
+        obj.Reset(zl);
+    }
+    else
+    {
+        assert (encoding == QEncode_set);
+
+        std::unique_ptr<QSet> set(new QSet);
+        set->reserve(SetSize(obj));
+        SetForEach(obj, [&set](const QString& member) {
+            set->insert(member);
+        });
+
+        obj.Reset(set.release());
+    }
+
+    obj.encoding = encoding;
+}
+
+bool SetAdd(QObject& obj, const QString& member)
+{
+    if (obj.encoding == QEncode_intset)
+    {
+        int64_t v;
+        if (_IntsetValue(member, &v))
+        {
+            uint8_t success = 0;
+            obj.value = intsetAdd(obj.CastIntset(), v, &success);
+            if (success && intsetLen(obj.CastIntset()) > static_cast<uint32_t>(g_config.setMaxIntsetEntries))
+                _ConvertSet(obj, QEncode_set);
+
+            return success != 0;
+        }
+
+        // upgrade, ziplist is still preferred if small enough
+        if (SetSize(obj) < static_cast<size_t>(g_config.setMaxZiplistEntries))
+            _ConvertSet(obj, QEncode_zipset);
+        else
+            _ConvertSet(obj, QEncode_set);
+    }
+
+    if (obj.encoding == QEncode_zipset)
+    {
+        if (member.size() > static_cast<size_t>(g_config.setMaxZiplistValue))
+            _ConvertSet(obj, QEncode_set);
+    }
+
+    if (obj.encoding == QEncode_zipset)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        if (ZipListFind(zl, member))
+            return false;
+
+        zl = ZipListPush(zl, member);
+        obj.value = zl;
+
+        if (ZipListSize(zl) > static_cast<size_t>(g_config.setMaxZiplistEntries))
+            _ConvertSet(obj, QEncode_set);
+
+        return true;
+    }
+
+    return obj.CastSet()->insert(member).second;
+}
+
+bool SetRemove(QObject& obj, const QString& member)
+{
+    if (obj.encoding == QEncode_intset)
+    {
+        int64_t v;
+        if (!_IntsetValue(member, &v))
+            return false;
+
+        int success = 0;
+        obj.value = intsetRemove(obj.CastIntset(), v, &success);
+        return success != 0;
+    }
+
+    if (obj.encoding == QEncode_zipset)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = ZipListFind(zl, member);
+        if (!p)
+            return false;
+
+        obj.value = ZipListDelete(zl, &p);
+        return true;
+    }
+
+    return obj.CastSet()->erase(member) != 0;
+}
+
+bool SetIsMember(const QObject& obj, const QString& member)
+{
+    if (obj.encoding == QEncode_intset)
+    {
+        // binary search
+        int64_t v;
+        return _IntsetValue(member, &v) && intsetFind(obj.CastIntset(), v);
+    }
+
+    if (obj.encoding == QEncode_zipset)
+        return ZipListFind(obj.CastZipList(), member) != nullptr;
+
+    return obj.CastSet()->count(member) != 0;
+}
+
+size_t SetSize(const QObject& obj)
+{
+    if (obj.encoding == QEncode_intset)
+        return intsetLen(obj.CastIntset());
+
+    if (obj.encoding == QEncode_zipset)
+        return ZipListSize(obj.CastZipList());
+
+    return obj.CastSet()->size();
+}
+
+bool SetRandomMember(const QObject& obj, QString& res)
+{
+    if (obj.encoding == QEncode_intset)
+    {
+        if (intsetLen(obj.CastIntset()) == 0)
+            return false;
+
+        res = _IntsetMember(intsetRandom(obj.CastIntset()));
+        return true;
+    }
+
+    if (obj.encoding == QEncode_zipset)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        const size_t size = ZipListSize(zl);
+        if (size == 0)
+            return false;
+
+        res = ZipListGet(ZipListIndex(zl, random() % size));
+        return true;
+    }
+
+    const QSet& set = *obj.CastSet();
+    QSet::const_local_iterator it = RandomHashMember(set);
+
+    if (it != QSet::const_local_iterator())
+    {
+        res = *it;
+        return true;
+    }
+
+    return false;
+}
+
+void SetForEach(const QObject& obj, const std::function<void (const QString& member)>& func)
+{
+    if (obj.encoding == QEncode_intset)
+    {
+        PINTSET is = obj.CastIntset();
+        const uint32_t size = intsetLen(is);
+        for (uint32_t i = 0; i < size; ++ i)
+        {
+            int64_t v;
+            intsetGet(is, i, &v);
+            func(_IntsetMember(v));
+        }
+    }
+    else if (obj.encoding == QEncode_zipset)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        for (unsigned char* p = ZipListFirst(zl); p; p = ZipListNext(zl, p))
+            func(ZipListGet(p));
+    }
+    else
+    {
+        for (const auto& member : *obj.CastSet())
+            func(member);
+    }
+}
+
 #define GET_SET(setname)  \
     QObject* value;  \
     QError err = QSTORE.GetValueByType(setname, value, QType_set);  \
@@ -36,30 +256,16 @@ QObject QObject::CreateSet()
         value = QSTORE.SetValue(setname, QObject::CreateSet());  \
     }
 
-static bool RandomMember(const QSet& set, QString& res)
-{
-    QSet::const_local_iterator it = RandomHashMember(set);
-
-    if (it != QSet::const_local_iterator())
-    {
-        res = *it;
-        return true;
-    }
-
-    return false;
-}
-
 QError spop(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SET(params[1]);
 
-    auto set = value->CastSet();
     QString res;
-    if (RandomMember(*set, res))
+    if (SetRandomMember(*value, res))
     {
         FormatBulk(res, reply);
-        set->erase(res);
-        if (set->empty())
+        SetRemove(*value, res);
+        if (SetSize(*value) == 0)
             QSTORE.DeleteKey(params[1]);
 
         std::vector<QString> translated;
@@ -83,9 +289,8 @@ QError srandmember(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SET(params[1]);
 
-    auto set = value->CastSet();
     QString res;
-    if (RandomMember(*set, res))
+    if (SetRandomMember(*value, res))
     {
         FormatBulk(res, reply);
     }
@@ -102,10 +307,9 @@ QError sadd(const std::vector<QString>& params, UnboundedBuffer* reply)
     GET_OR_SET_SET(params[1]);
     
     int res = 0;
-    auto set = value->CastSet();
     for (size_t i = 2; i < params.size(); ++ i)
     {
-        if (set->insert(params[i]).second)
+        if (SetAdd(*value, params[i]))
             ++ res;
     }
     
@@ -117,8 +321,7 @@ QError  scard(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SET(params[1]);
 
-    auto set = value->CastSet();
-    long size = static_cast<long>(set->size());
+    long size = static_cast<long>(SetSize(*value));
     
     FormatInt(size, reply);
     return QError_ok;
@@ -128,15 +331,14 @@ QError srem(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SET(params[1]);
 
-    auto set = value->CastSet();
     int res = 0;
     for (size_t i = 2; i < params.size(); ++ i)
     {
-        if (set->erase(params[i]) != 0)
+        if (SetRemove(*value, params[i]))
             ++ res;
     }
     
-    if (set->empty())
+    if (SetSize(*value) == 0)
         QSTORE.DeleteKey(params[1]);
     
     FormatInt(res, reply);
@@ -147,8 +349,7 @@ QError sismember(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SET(params[1]);
     
-    auto set = value->CastSet();
-    long res = static_cast<long>(set->count(params[2]));
+    long res = SetIsMember(*value, params[2]) ? 1 : 0;
     
     FormatInt(res, reply);
     return QError_ok;
@@ -158,10 +359,10 @@ QError smembers(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SET(params[1]);
 
-    auto set = value->CastSet();
-    PreFormatMultiBulk(set->size(), reply);
-    for (const auto& member : *set)
+    PreFormatMultiBulk(SetSize(*value), reply);
+    SetForEach(*value, [reply](const QString& member) {
         FormatBulk(member, reply);
+    });
 
     return QError_ok;
 }
@@ -170,8 +371,7 @@ QError smove(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SET(params[1]);
     
-    auto set = value->CastSet();
-    int ret = static_cast<int>(set->erase(params[3]));
+    int ret = SetRemove(*value, params[3]) ? 1 : 0;
     if (ret != 0)
     {
         QObject* dst;
@@ -185,8 +385,7 @@ QError smove(const std::vector<QString>& params, UnboundedBuffer* reply)
         
         if (err == QError_ok)
         {
-            auto dset = dst->CastSet();
-            dset->insert(params[3]);
+            SetAdd(*dst, params[3]);
         }
     }
     
@@ -195,11 +394,11 @@ QError smove(const std::vector<QString>& params, UnboundedBuffer* reply)
 }
 
 
-QSet& QSet_diff(const QSet& l, const QSet& r, QSet& result)
+QSet& QSet_diff(const QSet& l, const QObject& r, QSet& result)
 {
     for (const auto& le : l)
     {
-        if (r.count(le) == 0)
+        if (!SetIsMember(r, le))
         {
             result.insert(le);
         }
@@ -208,11 +407,11 @@ QSet& QSet_diff(const QSet& l, const QSet& r, QSet& result)
     return result;
 }
 
-QSet& QSet_inter(const QSet& l, const QSet& r, QSet& result)
+QSet& QSet_inter(const QSet& l, const QObject& r, QSet& result)
 {
     for (const auto& le : l)
     {
-        if (r.count(le) != 0)
+        if (SetIsMember(r, le))
         {
             result.insert(le);
         }
@@ -222,12 +421,11 @@ QSet& QSet_inter(const QSet& l, const QSet& r, QSet& result)
 }
 
 
-QSet& QSet_union(const QSet& l, const QSet& r, QSet& result)
+QSet& QSet_union(const QSet& l, const QObject& r, QSet& result)
 {
-    for (const auto& re : r)
-    {
+    SetForEach(r, [&result](const QString& re) {
         result.insert(re);
-    }
+    });
 
     for (const auto& le : l)
     {
@@ -254,9 +452,12 @@ static void  _set_operation(const std::vector<QString>& params,
     if (err != QError_ok && oper != SetOperation_union)
         return;
 
-    auto set = value->CastSet();
-    if (set)
-        res = *set;
+    if (err == QError_ok)
+    {
+        SetForEach(*value, [&res](const QString& member) {
+            res.insert(member);
+        });
+    }
     
     for (size_t i = offset + 1; i < params.size(); ++ i)
     {
@@ -273,13 +474,12 @@ static void  _set_operation(const std::vector<QString>& params,
         }
         
         QSet tmp;
-        auto r = val->CastSet();
         if (oper == SetOperation_diff)
-            QSet_diff(res, *r, tmp);
+            QSet_diff(res, *val, tmp);
         else if (oper == SetOperation_inter)
-            QSet_inter(res, *r, tmp);
+            QSet_inter(res, *val, tmp);
         else if (oper == SetOperation_union)
-            QSet_union(res, *r, tmp);
+            QSet_union(res, *val, tmp);
         
         res.swap(tmp);
         
@@ -288,93 +488,219 @@ static void  _set_operation(const std::vector<QString>& params,
     }
 }
 
-QError  sdiffstore(const std::vector<QString>& params, UnboundedBuffer* reply)
+// When every operand is an intset, the members are sorted arrays already,
+// the result is computed by linear merge without hashing any string.
+static bool _intset_operation(const std::vector<QString>& params,
+                              size_t offset,
+                              std::vector<int64_t>& res,
+                              SetOperation oper)
+{
+    std::vector<PINTSET> sets;
+    sets.reserve(params.size() - offset);
+    for (size_t i = offset; i < params.size(); ++ i)
+    {
+        QObject*  val;
+        QError err = QSTORE.GetValueByType(params[i], val, QType_set);
+        if (err == QError_ok && val->encoding != QEncode_intset)
+            return false;
+
+        // absent set is treated as empty, same as _set_operation
+        sets.push_back(err == QError_ok ? val->CastIntset() : nullptr);
+    }
+
+    auto load = [](PINTSET is, std::vector<int64_t>& out) {
+        out.clear();
+        if (!is)
+            return;
+
+        const uint32_t size = intsetLen(is);
+        out.resize(size);
+        for (uint32_t i = 0; i < size; ++ i)
+            intsetGet(is, i, &out[i]);
+    };
+
+    load(sets[0], res);
+    if (!sets[0] && oper != SetOperation_union)
+        return true;
+
+    std::vector<int64_t> operand, tmp;
+    for (size_t i = 1; i < sets.size(); ++ i)
+    {
+        if (!sets[i])
+        {
+            if (oper == SetOperation_inter)
+            {
+                res.clear();
+                return true;
+            }
+            continue;
+        }
+
+        load(sets[i], operand);
+
+        tmp.clear();
+        tmp.reserve(oper == SetOperation_union ? res.size() + operand.size() : res.size());
+        if (oper == SetOperation_diff)
+            std::set_difference(res.begin(), res.end(), operand.begin(), operand.end(), std::back_inserter(tmp));
+        else if (oper == SetOperation_inter)
+            std::set_intersection(res.begin(), res.end(), operand.begin(), operand.end(), std::back_inserter(tmp));
+        else if (oper == SetOperation_union)
+            std::set_union(res.begin(), res.end(), operand.begin(), operand.end(), std::back_inserter(tmp));
+
+        res.swap(tmp);
+
+        if (oper != SetOperation_union && res.empty())
+            return true;
+    }
+
+    return true;
+}
+
+static void _set_store(const QString& dst, const QSet& res)
 {
+    if (res.empty())
+    {
+        QSTORE.DeleteKey(dst);
+        return;
+    }
+
     QObject obj(QObject::CreateSet());
-    auto res = obj.CastSet();
-    QSTORE.SetValue(params[1], std::move(obj));
+    for (const auto& member : res)
+        SetAdd(obj, member);
 
-    _set_operation(params, 2, *res, SetOperation_diff);
+    QSTORE.SetValue(dst, std::move(obj));
+}
 
-    FormatInt(static_cast<long>(res->size()), reply);
-    return QError_ok;
+static void _set_store(const QString& dst, const std::vector<int64_t>& res)
+{
+    if (res.empty())
+    {
+        QSTORE.DeleteKey(dst);
+        return;
+    }
+
+    QObject obj(QObject::CreateSet());
+    if (res.size() <= static_cast<size_t>(g_config.setMaxIntsetEntries))
+    {
+        // sorted already, every add is an append
+        PINTSET is = obj.CastIntset();
+        for (auto v : res)
+            is = intsetAdd(is, v, nullptr);
+
+        obj.value = is;
+    }
+    else
+    {
+        for (auto v : res)
+            SetAdd(obj, _IntsetMember(v));
+    }
+
+    QSTORE.SetValue(dst, std::move(obj));
 }
 
-QError sdiff(const std::vector<QString>& params, UnboundedBuffer* reply)
+static void _set_reply(const QSet& res, UnboundedBuffer* reply)
 {
-    QSet res;
-    _set_operation(params, 1, res, SetOperation_diff);
-    
     PreFormatMultiBulk(res.size(), reply);
     for (const auto& elem : res)
         FormatBulk(elem, reply);
-    
-    return QError_ok;
 }
 
+static void _set_reply(const std::vector<int64_t>& res, UnboundedBuffer* reply)
+{
+    PreFormatMultiBulk(res.size(), reply);
+    for (auto v : res)
+    {
+        char buf[32];
+        auto len = Number2Str(buf, sizeof buf, v);
+        FormatBulk(buf, len, reply);
+    }
+}
 
-QError sinter(const std::vector<QString>& params, UnboundedBuffer* reply)
+// sdiff, sinter, sunion and the store versions, dst is params[1] if offset is 2
+static QError _set_command(const std::vector<QString>& params,
+                           size_t offset,
+                           SetOperation oper,
+                           UnboundedBuffer* reply)
 {
+    const bool store = (offset == 2);
+
+    std::vector<int64_t> ints;
+    if (_intset_operation(params, offset, ints, oper))
+    {
+        if (store)
+        {
+            _set_store(params[1], ints);
+            FormatInt(static_cast<long>(ints.size()), reply);
+        }
+        else
+        {
+            _set_reply(ints, reply);
+        }
+
+        return QError_ok;
+    }
+
     QSet res;
-    _set_operation(params, 1, res, SetOperation_inter);
-    
-    PreFormatMultiBulk(res.size(), reply);
-    for (const auto& elem : res)
-        FormatBulk(elem, reply);
-    
+    _set_operation(params, offset, res, oper);
+    if (store)
+    {
+        _set_store(params[1], res);
+        FormatInt(static_cast<long>(res.size()), reply);
+    }
+    else
+    {
+        _set_reply(res, reply);
+    }
+
     return QError_ok;
 }
 
-QError  sinterstore(const std::vector<QString>& params, UnboundedBuffer* reply)
+QError  sdiffstore(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
-    QObject obj(QObject::CreateSet());
-    auto res = obj.CastSet();
-    QSTORE.SetValue(params[1], std::move(obj));
+    return _set_command(params, 2, SetOperation_diff, reply);
+}
 
-    _set_operation(params, 2, *res, SetOperation_inter);
+QError sdiff(const std::vector<QString>& params, UnboundedBuffer* reply)
+{
+    return _set_command(params, 1, SetOperation_diff, reply);
+}
 
-    FormatInt(static_cast<long>(res->size()), reply);
-    return QError_ok;
+QError sinter(const std::vector<QString>& params, UnboundedBuffer* reply)
+{
+    return _set_command(params, 1, SetOperation_inter, reply);
 }
 
+QError  sinterstore(const std::vector<QString>& params, UnboundedBuffer* reply)
+{
+    return _set_command(params, 2, SetOperation_inter, reply);
+}
 
 QError  sunion(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
-    QSet res;
-    _set_operation(params, 1, res, SetOperation_union);
-    
-    PreFormatMultiBulk(res.size(), reply);
-    for (const auto& elem : res)
-        FormatBulk(elem, reply);
-    
-    return QError_ok;
+    return _set_command(params, 1, SetOperation_union, reply);
 }
 
 QError  sunionstore(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
-    QObject obj(QObject::CreateSet());
-    auto res = obj.CastSet();
-    QSTORE.SetValue(params[1], std::move(obj));
-
-    _set_operation(params, 2, *res, SetOperation_union);
-
-    FormatInt(static_cast<long>(res->size()), reply);
-    return QError_ok;
+    return _set_command(params, 2, SetOperation_union, reply);
 }
 
-size_t SScanKey(const QSet& qset, size_t cursor, size_t count, std::vector<QString>& res)
+size_t SScanKey(const QObject& obj, size_t cursor, size_t count, const QString* pattern,
+                std::vector<QString>& res)
 {
-    if (qset.empty())
+    auto filter = [&](const QString& member) {
+        if (!pattern || glob_match(*pattern, member))
+            res.push_back(member);
+    };
+
+    if (obj.encoding != QEncode_set)
+    {
+        // small set is returned in a single call, like redis
+        SetForEach(obj, filter);
         return 0;
-    
-    std::vector<QSet::const_local_iterator>  iters;
-    size_t newCursor = ScanHashMember(qset, cursor, count, iters);
-    
-    res.reserve(iters.size());
-    for (auto it : iters)
-        res.push_back(*it);
-    
-    return newCursor;
+    }
+
+    return ScanHashMember(*obj.CastSet(), cursor, count, filter);
 }
 
 }
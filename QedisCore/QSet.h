@@ -2,16 +2,33 @@
 #define BERT_QSET_H
 
 #include "QHelper.h"
-#include <unordered_set>
+#include "QDict.h"
+#include <functional>
+
+struct intset;
 
 namespace qedis
 {
 
-using QSet = std::unordered_set<QString,
-        my_hash,
-        std::equal_to<QString> >;
+using QSet = QHashSet<QString, my_hash>;
+
+using PINTSET = ::intset*;
+
+// Encoding independent set operations.
+// A new set is an intset, a sorted array of integers. Adding a member that
+// is not an integer upgrades it to an unordered ziplist of members, which is
+// converted to QSet when exceeds set-max-ziplist-entries or set-max-ziplist-value.
+// An intset exceeds set-max-intset-entries is converted to QSet directly.
+bool        SetAdd(QObject& obj, const QString& member); // return true if member is new
+bool        SetRemove(QObject& obj, const QString& member);
+bool        SetIsMember(const QObject& obj, const QString& member);
+std::size_t SetSize(const QObject& obj);
+bool        SetRandomMember(const QObject& obj, QString& res);
+void        SetForEach(const QObject& obj, const std::function<void (const QString& member)>& func);
 
-size_t   SScanKey(const QSet& qset, size_t cursor, size_t count, std::vector<QString>& res);
+// pattern is optional
+size_t   SScanKey(const QObject& obj, size_t cursor, size_t count, const QString* pattern,
+                  std::vector<QString>& res);
     
 }
 
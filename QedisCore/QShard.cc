@@ -0,0 +1,323 @@
+#include "QShard.h"
+#include "QStore.h"
+#include "QCommand.h"
+#include "Log/Logger.h"
+#include "Threads/ThreadPool.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cassert>
+
+namespace qedis
+{
+
+namespace
+{
+
+// Where the keys are in params, like the first key, last key and step of redis.
+// A negative last counts from the end.
+struct KeySpec
+{
+    int  first;
+    int  last;
+    int  step;
+    bool blocking;
+};
+
+const std::unordered_map<QString, KeySpec> s_keySpecs =
+{
+    // key
+    {"type",        {1,  1, 1, false}},
+    {"exists",      {1,  1, 1, false}},
+    {"del",         {1, -1, 1, false}},
+    {"unlink",      {1, -1, 1, false}},
+    {"expire",      {1,  1, 1, false}},
+    {"ttl",         {1,  1, 1, false}},
+    {"pexpire",     {1,  1, 1, false}},
+    {"pttl",        {1,  1, 1, false}},
+    {"expireat",    {1,  1, 1, false}},
+    {"pexpireat",   {1,  1, 1, false}},
+    {"persist",     {1,  1, 1, false}},
+    {"move",        {1,  1, 1, false}},
+    {"rename",      {1,  2, 1, false}},
+    {"renamenx",    {1,  2, 1, false}},
+    {"dump",        {1,  1, 1, false}},
+    {"restore",     {1,  1, 1, false}},
+
+    // string
+    {"strlen",      {1,  1, 1, false}},
+    {"set",         {1,  1, 1, false}},
+    {"mset",        {1, -2, 2, false}},
+    {"msetnx",      {1, -2, 2, false}},
+    {"setnx",       {1,  1, 1, false}},
+    {"setex",       {1,  1, 1, false}},
+    {"psetex",      {1,  1, 1, false}},
+    {"get",         {1,  1, 1, false}},
+    {"getset",      {1,  1, 1, false}},
+    {"mget",        {1, -1, 1, false}},
+    {"append",      {1,  1, 1, false}},
+    {"bitcount",    {1,  1, 1, false}},
+    {"bitop",       {2, -1, 1, false}},
+    {"getbit",      {1,  1, 1, false}},
+    {"setbit",      {1,  1, 1, false}},
+    {"incr",        {1,  1, 1, false}},
+    {"decr",        {1,  1, 1, false}},
+    {"incrby",      {1,  1, 1, false}},
+    {"incrbyfloat", {1,  1, 1, false}},
+    {"decrby",      {1,  1, 1, false}},
+    {"getrange",    {1,  1, 1, false}},
+    {"setrange",    {1,  1, 1, false}},
+
+    // list
+    {"lpush",       {1,  1, 1, false}},
+    {"rpush",       {1,  1, 1, false}},
+    {"lpushx",      {1,  1, 1, false}},
+    {"rpushx",      {1,  1, 1, false}},
+    {"lpop",        {1,  1, 1, false}},
+    {"rpop",        {1,  1, 1, false}},
+    {"lindex",      {1,  1, 1, false}},
+    {"llen",        {1,  1, 1, false}},
+    {"lset",        {1,  1, 1, false}},
+    {"ltrim",       {1,  1, 1, false}},
+    {"lrange",      {1,  1, 1, false}},
+    {"linsert",     {1,  1, 1, false}},
+    {"lrem",        {1,  1, 1, false}},
+    {"rpoplpush",   {1,  2, 1, false}},
+    {"blpop",       {1, -2, 1, true}},
+    {"brpop",       {1, -2, 1, true}},
+    {"brpoplpush",  {1,  2, 1, true}},
+
+    // hash
+    {"hget",        {1,  1, 1, false}},
+    {"hgetall",     {1,  1, 1, false}},
+    {"hmget",       {1,  1, 1, false}},
+    {"hset",        {1,  1, 1, false}},
+    {"hsetnx",      {1,  1, 1, false}},
+    {"hmset",       {1,  1, 1, false}},
+    {"hlen",        {1,  1, 1, false}},
+    {"hexists",     {1,  1, 1, false}},
+    {"hkeys",       {1,  1, 1, false}},
+    {"hvals",       {1,  1, 1, false}},
+    {"hdel",        {1,  1, 1, false}},
+    {"hincrby",     {1,  1, 1, false}},
+    {"hincrbyfloat",{1,  1, 1, false}},
+    {"hscan",       {1,  1, 1, false}},
+    {"hstrlen",     {1,  1, 1, false}},
+
+    // set
+    {"sadd",        {1,  1, 1, false}},
+    {"scard",       {1,  1, 1, false}},
+    {"sismember",   {1,  1, 1, false}},
+    {"srem",        {1,  1, 1, false}},
+    {"smembers",    {1,  1, 1, false}},
+    {"sdiff",       {1, -1, 1, false}},
+    {"sdiffstore",  {1, -1, 1, false}},
+    {"sinter",      {1, -1, 1, false}},
+    {"sinterstore", {1, -1, 1, false}},
+    {"sunion",      {1, -1, 1, false}},
+    {"sunionstore", {1, -1, 1, false}},
+    {"smove",       {1,  2, 1, false}},
+    {"spop",        {1,  1, 1, false}},
+    {"srandmember", {1,  1, 1, false}},
+    {"sscan",       {1,  1, 1, false}},
+
+    // sorted set
+    {"zadd",        {1,  1, 1, false}},
+    {"zcard",       {1,  1, 1, false}},
+    {"zrank",       {1,  1, 1, false}},
+    {"zrevrank",    {1,  1, 1, false}},
+    {"zrem",        {1,  1, 1, false}},
+    {"zincrby",     {1,  1, 1, false}},
+    {"zscore",      {1,  1, 1, false}},
+    {"zrange",      {1,  1, 1, false}},
+    {"zrevrange",   {1,  1, 1, false}},
+    {"zrangebyscore",   {1,  1, 1, false}},
+    {"zrevrangebyscore",{1,  1, 1, false}},
+    {"zremrangebyrank", {1,  1, 1, false}},
+    {"zremrangebyscore",{1,  1, 1, false}},
+};
+
+}
+
+QShards& QShards::Instance()
+{
+    static QShards shards;
+    return shards;
+}
+
+void QShards::Start(int workers, bool busyPoll, const std::vector<int>& cpus)
+{
+    assert (workers_.empty());
+    assert (workers == 0 || workers == QSTORE.ShardCount());
+
+    for (int i = 0; i < workers; ++ i)
+    {
+        const int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        auto worker = std::make_shared<Worker>(i, busyPoll, cpu);
+        workers_.push_back(worker);
+        futures_.push_back(ThreadPool::Instance().ExecuteTask(std::bind(&Worker::Run, worker)));
+    }
+
+    if (workers > 0)
+        USR << "Start " << workers << " shard workers";
+}
+
+void QShards::Stop()
+{
+    for (const auto& worker : workers_)
+        worker->Stop();
+
+    for (auto& f : futures_)
+        f.wait();
+
+    futures_.clear();
+    workers_.clear();
+}
+
+int QShards::Route(const QCommandInfo* info, const std::vector<QString>& params, bool* blocking) const
+{
+    if (!Enabled() || !info->CheckParamsCount(static_cast<int>(params.size())))
+        return kMainThread;
+
+    auto it = s_keySpecs.find(info->cmd);
+    if (it == s_keySpecs.end())
+        return kMainThread;
+
+    const KeySpec& spec = it->second;
+    *blocking = spec.blocking;
+
+    const int last = spec.last < 0 ? static_cast<int>(params.size()) + spec.last : spec.last;
+
+    int shard = kMainThread;
+    for (int i = spec.first; i <= last && i < static_cast<int>(params.size()); i += spec.step)
+    {
+        int s = QSTORE.ShardOf(params[i]);
+        if (shard == kMainThread)
+        {
+            shard = s;
+        }
+        else if (shard != s)
+        {
+            // served clients must be in the same shard as the keys and target
+            return spec.blocking ? kCrossShard : kMainThread;
+        }
+    }
+
+    return shard;
+}
+
+void QShards::Dispatch(int shard, std::function<void ()>&& task)
+{
+    workers_[shard]->Push(std::move(task));
+}
+
+void QShards::LockAll()
+{
+    // workers only lock their own shard, so no dead lock
+    for (const auto& worker : workers_)
+        worker->shardMutex_.lock();
+}
+
+void QShards::UnlockAll()
+{
+    for (auto it = workers_.rbegin(); it != workers_.rend(); ++ it)
+        (*it)->shardMutex_.unlock();
+}
+
+
+void QShards::Worker::Push(std::function<void ()>&& task)
+{
+    {
+        std::lock_guard<std::mutex>  guard(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+
+    cond_.notify_one();
+}
+
+void QShards::Worker::Stop()
+{
+    alive_ = false;
+    cond_.notify_one();
+}
+
+void QShards::Worker::Run()
+{
+    // init log, like the net threads
+    g_logLevel = logALL;
+    g_logDest  = logFILE;
+    g_log = LogManager::Instance().CreateLog(g_logLevel, g_logDest,
+                                             ("shard" + std::to_string(shard_) + "_log").c_str());
+
+    if (cpu_ >= 0)
+    {
+        if (ThreadPool::BindCpu(cpu_))
+            INF << "Bind shard worker " << shard_ << " to cpu " << cpu_;
+        else
+            ERR << "Failed to bind shard worker " << shard_ << " to cpu " << cpu_;
+    }
+
+    std::deque<std::function<void ()> > tasks;
+
+    while (alive_)
+    {
+        {
+            std::unique_lock<std::mutex>  guard(mutex_);
+            // wake up every ms for the timers
+            if (!busyPoll_)
+                cond_.wait_for(guard, std::chrono::milliseconds(1), [this]() {
+                    return !tasks_.empty() || !alive_;
+                });
+
+            tasks.swap(tasks_);
+        }
+
+        // spinning, don't keep the main thread from locking all shards
+        if (busyPoll_ && tasks.empty() &&
+            ::Now() < std::min(nextExpireCheck_, nextBlockedCheck_))
+            continue;
+
+        std::lock_guard<std::mutex>  guard(shardMutex_);
+
+        for (auto& task : tasks)
+            task();
+
+        tasks.clear();
+
+        _CheckTimers(::Now());
+    }
+}
+
+void QShards::Worker::_CheckTimers(uint64_t now)
+{
+    // same intervals as the expire and blocked timers of main thread
+    const bool expire = (now >= nextExpireCheck_);
+    const bool blocked = (now >= nextBlockedCheck_);
+
+    if (!expire && !blocked)
+        return;
+
+    if (expire)
+    {
+        QSTORE.ActiveExpireCycle(now, shard_);
+        QSTORE.ActiveDefragCycle(shard_);
+    }
+
+    for (int dbno = 0; QSTORE.SelectDB(dbno) != -1; ++ dbno)
+    {
+        if (expire)
+            QSTORE.LoopRehash(shard_);
+
+        if (blocked)
+            QSTORE.LoopCheckBlocked(now, shard_);
+    }
+
+    if (expire)
+        nextExpireCheck_ = now + 1;
+
+    if (blocked)
+        nextBlockedCheck_ = now + 3;
+}
+
+}
+
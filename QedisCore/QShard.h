@@ -0,0 +1,108 @@
+#ifndef BERT_QSHARD_H
+#define BERT_QSHARD_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "QString.h"
+
+namespace qedis
+{
+
+struct QCommandInfo;
+
+// Optional multi-threaded execution.
+// Every db of QStore is split into N shards by key slot, each shard is owned
+// by a worker thread which executes the commands of its keys and checks its
+// own expire keys and blocked clients.
+// Commands touching several shards, or no key at all, run on the main thread
+// with all the shards locked.
+class QShards
+{
+public:
+    static QShards& Instance();
+
+    QShards(const QShards& ) = delete;
+    void operator= (const QShards& ) = delete;
+
+    // 0 worker means all commands run on the main thread, like before.
+    // Workers spin instead of sleeping if busyPoll, worker i is bound to
+    // cpus[i % size]
+    void  Start(int workers, bool busyPoll = false, const std::vector<int>& cpus = std::vector<int>());
+    void  Stop();
+
+    bool  Enabled() const { return !workers_.empty(); }
+    int   Count() const { return static_cast<int>(workers_.size()); }
+
+    enum
+    {
+        kMainThread = -1, // execute on main thread
+        kCrossShard = -2, // can not execute, blocking command on several shards
+    };
+
+    // the shard which can execute this command alone,
+    // blocking is set for the commands may block client, like blpop
+    int   Route(const QCommandInfo* info, const std::vector<QString>& params, bool* blocking) const;
+    void  Dispatch(int shard, std::function<void ()>&& task);
+
+    // main thread locks all the shards before touching the whole keyspace
+    void  LockAll();
+    void  UnlockAll();
+
+private:
+    QShards() {}
+
+    class Worker
+    {
+    public:
+        Worker(int shard, bool busyPoll, int cpu) : shard_(shard), busyPoll_(busyPoll), cpu_(cpu), alive_(true) { }
+
+        void  Push(std::function<void ()>&& task);
+        void  Run();
+        void  Stop();
+
+        std::mutex  shardMutex_; // held when touching the shard
+
+    private:
+        void  _CheckTimers(uint64_t now);
+
+        const int   shard_;
+        const bool  busyPoll_;
+        const int   cpu_;
+        std::atomic<bool>  alive_;
+
+        std::mutex  mutex_;
+        std::condition_variable  cond_;
+        std::deque<std::function<void ()> > tasks_;
+
+        uint64_t    nextExpireCheck_ = 0;
+        uint64_t    nextBlockedCheck_ = 0;
+    };
+
+    std::vector<std::shared_ptr<Worker> > workers_;
+    std::vector<std::future<void> > futures_;
+};
+
+#define QSHARDS  QShards::Instance()
+
+// RAII for LockAll, no-op if sharding is disabled
+class QAllShardsGuard
+{
+public:
+    QAllShardsGuard()  { if (QSHARDS.Enabled()) QSHARDS.LockAll(); }
+   ~QAllShardsGuard()  { if (QSHARDS.Enabled()) QSHARDS.UnlockAll(); }
+
+    QAllShardsGuard(const QAllShardsGuard& ) = delete;
+    void operator= (const QAllShardsGuard& ) = delete;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,336 @@
+#include "QSkipList.h"
+#include <new>
+#include <cstdlib>
+#include <cassert>
+
+namespace qedis
+{
+
+QSkipList::Node* QSkipList::_CreateNode(int level, double score, const QString& member)
+{
+    assert (level >= 1 && level <= kMaxLevel);
+
+    void* mem = ::operator new(sizeof(Node) + (level - 1) * sizeof(Node::Level));
+    Node* node = static_cast<Node* >(mem);
+
+    new (&node->member) QString(member);
+    node->score = score;
+    node->backward = nullptr;
+    for (int i = 0; i < level; ++ i)
+    {
+        node->level[i].forward = nullptr;
+        node->level[i].span = 0;
+    }
+
+    return node;
+}
+
+void QSkipList::_FreeNode(Node* node)
+{
+    node->member.~QString();
+    ::operator delete(node);
+}
+
+// Returns a random level in [1, kMaxLevel], powerlaw-alike distribution with p = 0.25
+int QSkipList::_RandomLevel()
+{
+    int level = 1;
+    while ((random() & 0xFFFF) < (0xFFFF >> 2))
+        ++ level;
+
+    return level < kMaxLevel ? level : kMaxLevel;
+}
+
+bool QSkipList::_NodeLess(const Node* node, double score, const QString& member)
+{
+    return node->score < score ||
+          (node->score == score && node->member < member);
+}
+
+QSkipList::QSkipList() : tail_(nullptr), length_(0), level_(1)
+{
+    header_ = _CreateNode(kMaxLevel, 0, QString());
+}
+
+QSkipList::~QSkipList()
+{
+    Node* node = header_->level[0].forward;
+    while (node)
+    {
+        Node* next = node->level[0].forward;
+        _FreeNode(node);
+        node = next;
+    }
+
+    _FreeNode(header_);
+}
+
+QSkipList::Node* QSkipList::Insert(double score, const QString& member)
+{
+    Node* update[kMaxLevel];
+    unsigned long rank[kMaxLevel];
+
+    Node* x = header_;
+    for (int i = level_ - 1; i >= 0; -- i)
+    {
+        // store rank that is crossed to reach the insert position
+        rank[i] = (i == level_ - 1) ? 0 : rank[i + 1];
+        while (x->level[i].forward && _NodeLess(x->level[i].forward, score, member))
+        {
+            rank[i] += x->level[i].span;
+            x = x->level[i].forward;
+        }
+
+        update[i] = x;
+    }
+
+    // caller guarantees that the member is not inside
+    const int level = _RandomLevel();
+    if (level > level_)
+    {
+        for (int i = level_; i < level; ++ i)
+        {
+            rank[i] = 0;
+            update[i] = header_;
+            update[i]->level[i].span = length_;
+        }
+
+        level_ = level;
+    }
+
+    x = _CreateNode(level, score, member);
+    for (int i = 0; i < level; ++ i)
+    {
+        x->level[i].forward = update[i]->level[i].forward;
+        update[i]->level[i].forward = x;
+
+        // update span covered by update[i] as x is inserted here
+        x->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+        update[i]->level[i].span = (rank[0] - rank[i]) + 1;
+    }
+
+    // increment span for untouched levels
+    for (int i = level; i < level_; ++ i)
+        ++ update[i]->level[i].span;
+
+    x->backward = (update[0] == header_) ? nullptr : update[0];
+    if (x->level[0].forward)
+        x->level[0].forward->backward = x;
+    else
+        tail_ = x;
+
+    ++ length_;
+    return x;
+}
+
+void QSkipList::_DeleteNode(Node* x, Node** update)
+{
+    for (int i = 0; i < level_; ++ i)
+    {
+        if (update[i]->level[i].forward == x)
+        {
+            update[i]->level[i].span += x->level[i].span - 1;
+            update[i]->level[i].forward = x->level[i].forward;
+        }
+        else
+        {
+            -- update[i]->level[i].span;
+        }
+    }
+
+    if (x->level[0].forward)
+        x->level[0].forward->backward = x->backward;
+    else
+        tail_ = x->backward;
+
+    while (level_ > 1 && header_->level[level_ - 1].forward == nullptr)
+        -- level_;
+
+    -- length_;
+}
+
+bool QSkipList::Delete(double score, const QString& member)
+{
+    Node* update[kMaxLevel];
+
+    Node* x = header_;
+    for (int i = level_ - 1; i >= 0; -- i)
+    {
+        while (x->level[i].forward && _NodeLess(x->level[i].forward, score, member))
+            x = x->level[i].forward;
+
+        update[i] = x;
+    }
+
+    x = x->level[0].forward;
+    if (x && x->score == score && x->member == member)
+    {
+        _DeleteNode(x, update);
+        _FreeNode(x);
+        return true;
+    }
+
+    return false;
+}
+
+QSkipList::Node* QSkipList::UpdateScore(double curScore, const QString& member, double newScore)
+{
+    Node* update[kMaxLevel];
+
+    Node* x = header_;
+    for (int i = level_ - 1; i >= 0; -- i)
+    {
+        while (x->level[i].forward && _NodeLess(x->level[i].forward, curScore, member))
+            x = x->level[i].forward;
+
+        update[i] = x;
+    }
+
+    x = x->level[0].forward;
+    assert (x && x->score == curScore && x->member == member);
+
+    // fast path: the node stays at the same position, update score in place
+    if ((x->backward == nullptr || x->backward->score < newScore) &&
+        (x->level[0].forward == nullptr || x->level[0].forward->score > newScore))
+    {
+        x->score = newScore;
+        return x;
+    }
+
+    QString tmp(std::move(x->member));
+    _DeleteNode(x, update);
+    _FreeNode(x);
+
+    return Insert(newScore, tmp);
+}
+
+unsigned long QSkipList::GetRank(double score, const QString& member) const
+{
+    unsigned long rank = 0;
+
+    Node* x = header_;
+    for (int i = level_ - 1; i >= 0; -- i)
+    {
+        while (x->level[i].forward &&
+               (_NodeLess(x->level[i].forward, score, member) ||
+                (x->level[i].forward->score == score && x->level[i].forward->member == member)))
+        {
+            rank += x->level[i].span;
+            x = x->level[i].forward;
+        }
+
+        // x might be equal to header_, so test if is header
+        if (x != header_ && x->score == score && x->member == member)
+            return rank;
+    }
+
+    return 0;
+}
+
+QSkipList::Node* QSkipList::GetByRank(unsigned long rank) const
+{
+    if (rank == 0 || rank > length_)
+        return nullptr;
+
+    unsigned long traversed = 0;
+
+    Node* x = header_;
+    for (int i = level_ - 1; i >= 0; -- i)
+    {
+        while (x->level[i].forward && traversed + x->level[i].span <= rank)
+        {
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+
+        if (traversed == rank)
+            return x;
+    }
+
+    return nullptr;
+}
+
+QSkipList::Node* QSkipList::FirstGreaterEqual(double minScore) const
+{
+    Node* x = header_;
+    for (int i = level_ - 1; i >= 0; -- i)
+    {
+        while (x->level[i].forward && x->level[i].forward->score < minScore)
+            x = x->level[i].forward;
+    }
+
+    return x->level[0].forward;
+}
+
+unsigned long QSkipList::DeleteRangeByRank(unsigned long start, unsigned long end,
+                                           const std::function<void (const Node* )>& onDelete)
+{
+    Node* update[kMaxLevel];
+    unsigned long traversed = 0;
+
+    Node* x = header_;
+    for (int i = level_ - 1; i >= 0; -- i)
+    {
+        while (x->level[i].forward && traversed + x->level[i].span < start)
+        {
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+
+        update[i] = x;
+    }
+
+    unsigned long removed = 0;
+
+    ++ traversed;
+    x = x->level[0].forward;
+    while (x && traversed <= end)
+    {
+        Node* next = x->level[0].forward;
+        _DeleteNode(x, update);
+        if (onDelete)
+            onDelete(x);
+        _FreeNode(x);
+
+        ++ removed;
+        ++ traversed;
+        x = next;
+    }
+
+    return removed;
+}
+
+unsigned long QSkipList::DeleteRangeByScore(double minScore, double maxScore,
+                                            const std::function<void (const Node* )>& onDelete)
+{
+    Node* update[kMaxLevel];
+
+    Node* x = header_;
+    for (int i = level_ - 1; i >= 0; -- i)
+    {
+        while (x->level[i].forward && x->level[i].forward->score < minScore)
+            x = x->level[i].forward;
+
+        update[i] = x;
+    }
+
+    unsigned long removed = 0;
+
+    x = x->level[0].forward;
+    while (x && x->score <= maxScore)
+    {
+        Node* next = x->level[0].forward;
+        _DeleteNode(x, update);
+        if (onDelete)
+            onDelete(x);
+        _FreeNode(x);
+
+        ++ removed;
+        x = next;
+    }
+
+    return removed;
+}
+
+}
+
@@ -0,0 +1,76 @@
+#ifndef BERT_QSKIPLIST_H
+#define BERT_QSKIPLIST_H
+
+#include "QString.h"
+#include <vector>
+#include <functional>
+
+namespace qedis
+{
+
+// Skip list ordered by (score, member), like redis' zskiplist.
+// Every forward link records its span, so rank queries are O(log N).
+// Ranks are 1-based in this class.
+class QSkipList
+{
+public:
+    static const int kMaxLevel = 32;
+
+    struct Node
+    {
+        QString member;
+        double  score;
+        Node*   backward;
+
+        struct Level
+        {
+            Node*  forward;
+            unsigned long span;
+        } level[1];
+    };
+
+    QSkipList();
+   ~QSkipList();
+
+    QSkipList(const QSkipList& ) = delete;
+    void operator= (const QSkipList& ) = delete;
+
+    Node* Insert(double score, const QString& member);
+    bool  Delete(double score, const QString& member);
+    Node* UpdateScore(double curScore, const QString& member, double newScore);
+
+    // 0 if not found
+    unsigned long GetRank(double score, const QString& member) const;
+    Node* GetByRank(unsigned long rank) const;
+
+    // the first node with score >= minScore
+    Node* FirstGreaterEqual(double minScore) const;
+
+    // delete nodes in rank range [start, end], call onDelete before free each node
+    unsigned long DeleteRangeByRank(unsigned long start, unsigned long end,
+                                    const std::function<void (const Node* )>& onDelete);
+    unsigned long DeleteRangeByScore(double minScore, double maxScore,
+                                     const std::function<void (const Node* )>& onDelete);
+
+    Node* First() const { return header_->level[0].forward; }
+    Node* Last()  const { return tail_; }
+    unsigned long Size() const { return length_; }
+
+private:
+    static Node* _CreateNode(int level, double score, const QString& member);
+    static void  _FreeNode(Node* node);
+    static int   _RandomLevel();
+    static bool  _NodeLess(const Node* node, double score, const QString& member);
+
+    void _DeleteNode(Node* node, Node** update);
+
+    Node* header_;
+    Node* tail_;
+    unsigned long length_;
+    int   level_;
+};
+
+}
+
+#endif
+
@@ -8,6 +8,8 @@
 namespace qedis
 {
 
+__thread long long QSlowLog::beginUs_ = 0;
+
 QSlowLog& QSlowLog::Instance()
 {
     static QSlowLog slog;
@@ -56,6 +58,8 @@ void QSlowLog::EndAndStat(const std::vector<QString>& cmds)
     
     if (used >= threshold_)
     {
+        std::lock_guard<std::mutex>  guard(logsMutex_);
+
         if (logger_ == nullptr)
             logger_ = LogManager::Instance().CreateLog(logALL, logFILE, "slowlog.qedis");
         
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <deque>
+#include <mutex>
 
 #include "QString.h"
 
@@ -48,10 +49,11 @@ private:
     ~QSlowLog();
     
     unsigned int threshold_;
-    long long    beginUs_;
+    static __thread long long beginUs_; // commands may run in shard workers
     Logger*      logger_;
     
     std::size_t  logMaxCount_;
+    std::mutex   logsMutex_;
     std::deque<SlowLogItem> logs_;
     
 };
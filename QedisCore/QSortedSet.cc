@@ -1,5 +1,6 @@
 #include "QSortedSet.h"
 #include "QStore.h"
+#include "QConfig.h"
 #include "Log/Logger.h"
 #include <cassert>
 
@@ -16,7 +17,7 @@ void  QSortedSet::AddMember(const QString& member, double score)
     assert (FindMember(member) == members_.end());
         
     members_.insert(Member2Score::value_type(member, score));
-    scores_[score].insert(member);
+    scores_.Insert(score, member);
 }
 
 double    QSortedSet::UpdateMember(const Member2Score::iterator& itMem, double delta)
@@ -25,47 +26,21 @@ double    QSortedSet::UpdateMember(const Member2Score::iterator& itMem, double d
     auto newScore = oldScore + delta;
     itMem->second = newScore;
 
-    auto itScore(scores_.find(oldScore));
-    assert (itScore != scores_.end());
-
-    size_t ret = itScore->second.erase(itMem->first);
-    assert (ret == 1);
-
-    bool succ = scores_[newScore].insert(itMem->first).second;
-    assert (succ);
+    scores_.UpdateScore(oldScore, itMem->first, newScore);
 
     return newScore;
 }
 
 int QSortedSet::Rank(const QString& member) const
 {
-    double    score;
     auto itMem(members_.find(member));
-    if (itMem != members_.end())
-        score = itMem->second;
-    else
+    if (itMem == members_.end())
         return -1;
 
-    int  rank = 0;
-    for (auto it(scores_.begin());
-              it != scores_.end();
-              rank += it->second.size(), ++ it)
-    {
-        if (it->first == score)
-        {
-            auto iter(it->second.begin());
-            for (; iter != it->second.end(); ++ iter, ++ rank)
-            {
-                if (*iter == member)
-                    return rank;
-            }
-            
-            assert (!!!"Why can not find member");
-        }
-    }
-            
-    assert (!!!"Why can not find score");
-    return  -1;
+    unsigned long rank = scores_.GetRank(itMem->second, member);
+    assert (rank != 0);
+
+    return static_cast<int>(rank - 1);
 }
 
 
@@ -80,24 +55,15 @@ int QSortedSet::RevRank(const QString& member) const
 
 bool QSortedSet::DelMember(const QString& member)
 {
-    double score = 0;
     Member2Score::const_iterator  itMem(members_.find(member));
-    if (itMem != members_.end())
-    {
-        score  = itMem->second;
-        members_.erase(itMem);
-    }
-    else
-    {
+    if (itMem == members_.end())
         return false;
-    }
 
-    auto it(scores_.find(score));
-    assert (it != scores_.end());
-            
-    auto num = it->second.erase(member);
-    assert (num == 1);
+    bool succ = scores_.Delete(itMem->second, member);
+    assert (succ);
+    (void)succ;
 
+    members_.erase(itMem);
     return true;
 }
 
@@ -107,29 +73,12 @@ QSortedSet::GetMemberByRank(size_t rank) const
     if (rank >= members_.size())
         rank = members_.size() - 1;
 
-    double score = 0;
-    size_t iterRank = 0;
-
-    for ( auto it(scores_.begin());
-          it != scores_.end();
-          iterRank += it->second.size(), ++ it)
-    {
-        if (iterRank + it->second.size() > rank)
-        {
-            assert(iterRank <= rank);
-            
-            score = it->first;
-            auto itMem(it->second.begin());
-            for (; iterRank != rank; ++ iterRank, ++ itMem)
-            {
-            }
-            
-            DBG << "Get rank " << rank << ", name " << itMem->c_str();
-            return std::make_pair(*itMem, score);
-        }
-    }
+    const QSkipList::Node* node = scores_.GetByRank(rank + 1);
+    if (!node)
+        return std::make_pair(QString(), 0.0);
 
-    return std::make_pair(QString(), score);
+    DBG << "Get rank " << rank << ", name " << node->member.c_str();
+    return std::make_pair(node->member, node->score);
 }
 
 
@@ -147,9 +96,14 @@ QSortedSet::RangeByRank(long start, long end) const
         return std::vector<Member2Score::value_type >();
     
     std::vector<Member2Score::value_type >  res;
-    for (long rank = start; rank <= end; ++ rank)
+    res.reserve(end - start + 1);
+
+    // locate the start node in O(log N), then walk the bottom level
+    const QSkipList::Node* node = scores_.GetByRank(start + 1);
+    for (long rank = start; node && rank <= end; ++ rank)
     {
-        res.push_back(GetMemberByRank(rank));
+        res.push_back(std::make_pair(node->member, node->score));
+        node = node->level[0].forward;
     }
     
     return res;
@@ -161,29 +115,348 @@ QSortedSet::RangeByScore(double minScore, double maxScore)
     if (minScore > maxScore)
         return std::vector<Member2Score::value_type >();
     
-    auto itMin = scores_.lower_bound(minScore);
-    if (itMin == scores_.end())
-        return std::vector<Member2Score::value_type >();
-    
     std::vector<Member2Score::value_type>  res;
-    auto itMax = scores_.upper_bound(maxScore);
-    for (; itMin != itMax; ++ itMin)
+    const QSkipList::Node* node = scores_.FirstGreaterEqual(minScore);
+    for (; node && node->score <= maxScore; node = node->level[0].forward)
     {
-        for (const auto& e : itMin->second)
-        {
-            res.push_back(std::make_pair(e, itMin->first));
-        }
+        res.push_back(std::make_pair(node->member, node->score));
     }
+
     return  res;
 }
 
+size_t QSortedSet::DelRangeByRank(long start, long end)
+{
+    AdjustIndex(start, end, Size());
+    if (start > end)
+        return 0;
+
+    return scores_.DeleteRangeByRank(start + 1, end + 1, [this](const QSkipList::Node* node) {
+        members_.erase(node->member);
+    });
+}
+
+size_t QSortedSet::DelRangeByScore(double minScore, double maxScore)
+{
+    if (minScore > maxScore)
+        return 0;
+
+    return scores_.DeleteRangeByScore(minScore, maxScore, [this](const QSkipList::Node* node) {
+        members_.erase(node->member);
+    });
+}
+
 QObject QObject::CreateSSet()
 {
     QObject obj(QType_sortedSet);
-    obj.Reset(new QSortedSet);
+    obj.encoding = QEncode_zipsset;
+    obj.Reset(ZipListNew());
     return obj;
 }
 
+// the ziplist layout: member1, score1, member2, score2 ... ordered by (score, member)
+static QString _Score2Str(double score)
+{
+    char buf[64];
+    int len = snprintf(buf, sizeof buf, "%.17g", score);
+    return QString(buf, len);
+}
+
+static double _ZipScore(unsigned char* p)
+{
+    double score = 0;
+    QString str(ZipListGet(p));
+    Strtod(str.c_str(), str.size(), &score);
+    return score;
+}
+
+static void _ConvertSSet(QObject& obj)
+{
+    assert (obj.encoding == QEncode_zipsset);
+
+    PZIPLIST zl = obj.CastZipList();
+    std::unique_ptr<QSortedSet> sset(new QSortedSet);
+
+    for (unsigned char* p = ZipListFirst(zl); p; )
+    {
+        unsigned char* s = ZipListNext(zl, p);
+        sset->AddMember(ZipListGet(p), _ZipScore(s));
+        p = ZipListNext(zl, s);
+    }
+
+    obj.Reset(sset.release());
+    obj.encoding = QEncode_sset;
+}
+
+static PZIPLIST _ZipInsert(PZIPLIST zl, const QString& member, double score)
+{
+    for (unsigned char* p = ZipListFirst(zl); p; )
+    {
+        unsigned char* s = ZipListNext(zl, p);
+        const double curScore = _ZipScore(s);
+        if (curScore > score || (curScore == score && ZipListGet(p) > member))
+        {
+            const size_t offset = p - zl;
+            zl = ZipListInsert(zl, p, member);
+            p = ZipListNext(zl, zl + offset);
+            return ZipListInsert(zl, p, _Score2Str(score));
+        }
+
+        p = ZipListNext(zl, s);
+    }
+
+    zl = ZipListPush(zl, member);
+    return ZipListPush(zl, _Score2Str(score));
+}
+
+// index is the position of pair, from start
+static void _ZipRange(PZIPLIST zl, long start, long end, SSetMembers& res)
+{
+    unsigned char* p = ZipListIndex(zl, 2 * start);
+    for (long rank = start; p && rank <= end; ++ rank)
+    {
+        unsigned char* s = ZipListNext(zl, p);
+        res.push_back(std::make_pair(ZipListGet(p), _ZipScore(s)));
+        p = ZipListNext(zl, s);
+    }
+}
+
+size_t SSetSize(const QObject& obj)
+{
+    if (obj.encoding == QEncode_zipsset)
+        return ZipListSize(obj.CastZipList()) / 2;
+
+    return obj.CastSortedSet()->Size();
+}
+
+bool SSetScore(const QObject& obj, const QString& member, double* score)
+{
+    if (obj.encoding == QEncode_zipsset)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = ZipListFind(zl, member, 1);
+        if (!p)
+            return false;
+
+        if (score)
+            *score = _ZipScore(ZipListNext(zl, p));
+
+        return true;
+    }
+
+    auto sset = obj.CastSortedSet();
+    auto it = sset->FindMember(member);
+    if (it == sset->end())
+        return false;
+
+    if (score)
+        *score = it->second;
+
+    return true;
+}
+
+bool SSetAdd(QObject& obj, const QString& member, double score)
+{
+    if (SSetScore(obj, member))
+        return false;
+
+    if (obj.encoding == QEncode_zipsset &&
+        member.size() > static_cast<size_t>(g_config.zsetMaxZiplistValue))
+        _ConvertSSet(obj);
+
+    if (obj.encoding == QEncode_zipsset)
+    {
+        PZIPLIST zl = _ZipInsert(obj.CastZipList(), member, score);
+        obj.value = zl;
+
+        if (ZipListSize(zl) / 2 > static_cast<size_t>(g_config.zsetMaxZiplistEntries))
+            _ConvertSSet(obj);
+    }
+    else
+    {
+        obj.CastSortedSet()->AddMember(member, score);
+    }
+
+    return true;
+}
+
+double SSetIncrBy(QObject& obj, const QString& member, double delta)
+{
+    double score = 0;
+    if (!SSetScore(obj, member, &score))
+    {
+        SSetAdd(obj, member, delta);
+        return delta;
+    }
+
+    if (obj.encoding == QEncode_zipsset)
+    {
+        // reinsert to keep the order
+        SSetDelete(obj, member);
+        SSetAdd(obj, member, score + delta);
+        return score + delta;
+    }
+
+    auto sset = obj.CastSortedSet();
+    return sset->UpdateMember(sset->FindMember(member), delta);
+}
+
+bool SSetDelete(QObject& obj, const QString& member)
+{
+    if (obj.encoding == QEncode_zipsset)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        unsigned char* p = ZipListFind(zl, member, 1);
+        if (!p)
+            return false;
+
+        zl = ZipListDelete(zl, &p); // member
+        zl = ZipListDelete(zl, &p); // score
+        obj.value = zl;
+        return true;
+    }
+
+    return obj.CastSortedSet()->DelMember(member);
+}
+
+long SSetRank(const QObject& obj, const QString& member, bool reverse)
+{
+    if (obj.encoding == QEncode_zipsset)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        long rank = 0;
+        for (unsigned char* p = ZipListFirst(zl); p; ++ rank)
+        {
+            if (ZipListEqual(p, member))
+                return reverse ? static_cast<long>(SSetSize(obj)) - rank - 1 : rank;
+
+            p = ZipListNext(zl, ZipListNext(zl, p));
+        }
+
+        return -1;
+    }
+
+    auto sset = obj.CastSortedSet();
+    return reverse ? sset->RevRank(member) : sset->Rank(member);
+}
+
+SSetMembers SSetRangeByRank(const QObject& obj, long start, long end)
+{
+    if (obj.encoding == QEncode_zipsset)
+    {
+        AdjustIndex(start, end, SSetSize(obj));
+
+        SSetMembers res;
+        if (start <= end)
+            _ZipRange(obj.CastZipList(), start, end, res);
+
+        return res;
+    }
+
+    return obj.CastSortedSet()->RangeByRank(start, end);
+}
+
+SSetMembers SSetRangeByScore(const QObject& obj, double minScore, double maxScore)
+{
+    if (obj.encoding == QEncode_zipsset)
+    {
+        SSetMembers res;
+        if (minScore > maxScore)
+            return res;
+
+        PZIPLIST zl = obj.CastZipList();
+        for (unsigned char* p = ZipListFirst(zl); p; )
+        {
+            unsigned char* s = ZipListNext(zl, p);
+            const double score = _ZipScore(s);
+            if (score > maxScore)
+                break;
+
+            if (score >= minScore)
+                res.push_back(std::make_pair(ZipListGet(p), score));
+
+            p = ZipListNext(zl, s);
+        }
+
+        return res;
+    }
+
+    return obj.CastSortedSet()->RangeByScore(minScore, maxScore);
+}
+
+size_t SSetDelRangeByRank(QObject& obj, long start, long end)
+{
+    if (obj.encoding == QEncode_zipsset)
+    {
+        AdjustIndex(start, end, SSetSize(obj));
+        if (start > end)
+            return 0;
+
+        const size_t removed = end - start + 1;
+        obj.value = ZipListDeleteRange(obj.CastZipList(), 2 * start, 2 * removed);
+        return removed;
+    }
+
+    return obj.CastSortedSet()->DelRangeByRank(start, end);
+}
+
+size_t SSetDelRangeByScore(QObject& obj, double minScore, double maxScore)
+{
+    if (obj.encoding == QEncode_zipsset)
+    {
+        if (minScore > maxScore)
+            return 0;
+
+        PZIPLIST zl = obj.CastZipList();
+        long first = -1;
+        size_t removed = 0;
+        long rank = 0;
+        for (unsigned char* p = ZipListFirst(zl); p; ++ rank)
+        {
+            unsigned char* s = ZipListNext(zl, p);
+            const double score = _ZipScore(s);
+            if (score > maxScore)
+                break;
+
+            if (score >= minScore)
+            {
+                if (first == -1)
+                    first = rank;
+                ++ removed;
+            }
+
+            p = ZipListNext(zl, s);
+        }
+
+        if (removed > 0)
+            obj.value = ZipListDeleteRange(zl, 2 * first, 2 * removed);
+
+        return removed;
+    }
+
+    return obj.CastSortedSet()->DelRangeByScore(minScore, maxScore);
+}
+
+void SSetForEach(const QObject& obj,
+                 const std::function<void (const QString& member, double score)>& func)
+{
+    if (obj.encoding == QEncode_zipsset)
+    {
+        PZIPLIST zl = obj.CastZipList();
+        for (unsigned char* p = ZipListFirst(zl); p; )
+        {
+            unsigned char* s = ZipListNext(zl, p);
+            func(ZipListGet(p), _ZipScore(s));
+            p = ZipListNext(zl, s);
+        }
+    }
+    else
+    {
+        for (const auto& kv : *obj.CastSortedSet())
+            func(kv.first, kv.second);
+    }
+}
+
 // commands
 #define GET_SORTEDSET(name)  \
     QObject* value;  \
@@ -215,7 +488,6 @@ QError zadd(const std::vector<QString>& params, UnboundedBuffer* reply)
     GET_OR_SET_SORTEDSET(params[1]);
     
     size_t newMembers = 0;
-    auto sset = value->CastSortedSet();
     for (size_t i = 2; i < params.size(); i += 2)
     {
         double score = 0;
@@ -225,12 +497,8 @@ QError zadd(const std::vector<QString>& params, UnboundedBuffer* reply)
             return QError_nan;
         }
 
-        auto it = sset->FindMember(params[i+1]);
-        if (it == sset->end())
-        {
-            sset->AddMember(params[i+1], score);
+        if (SSetAdd(*value, params[i+1], score))
             ++ newMembers;
-        }
     }
 
     FormatInt(newMembers, reply);
@@ -241,9 +509,7 @@ QError  zcard(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SORTEDSET(params[1]);
     
-    auto sset = value->CastSortedSet();
-
-    FormatInt(static_cast<long>(sset->Size()), reply);
+    FormatInt(static_cast<long>(SSetSize(*value)), reply);
     return QError_ok;
 }
 
@@ -251,9 +517,7 @@ QError  zrank(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SORTEDSET(params[1]);
     
-    auto sset = value->CastSortedSet();
-
-    int rank = sset->Rank(params[2]);
+    long rank = SSetRank(*value, params[2]);
     if (rank != -1)
         FormatInt(rank, reply);
     else
@@ -266,9 +530,7 @@ QError zrevrank(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SORTEDSET(params[1]);
     
-    auto sset = value->CastSortedSet();
-
-    int rrank = sset->RevRank(params[2]);
+    long rrank = SSetRank(*value, params[2], true);
     if (rrank != -1)
         FormatInt(rrank, reply);
     else
@@ -281,11 +543,10 @@ QError zrem(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SORTEDSET(params[1]);
     
-    auto sset = value->CastSortedSet();
     long cnt = 0;
     for (size_t i = 2; i < params.size(); ++ i)
     {
-        if (sset->DelMember(params[i]))
+        if (SSetDelete(*value, params[i]))
             ++ cnt;
     }
 
@@ -304,13 +565,7 @@ QError  zincrby(const std::vector<QString>& params, UnboundedBuffer* reply)
         return QError_nan;
     }
     
-    double newScore = delta;
-    auto sset = value->CastSortedSet();
-    auto itMem = sset->FindMember(params[3]);
-    if (itMem == sset->end())
-        sset->AddMember(params[3], delta);
-    else
-        newScore = sset->UpdateMember(itMem, delta);
+    double newScore = SSetIncrBy(*value, params[3], delta);
 
     FormatInt(newScore, reply);
     return QError_ok;
@@ -320,12 +575,11 @@ QError zscore(const std::vector<QString>& params, UnboundedBuffer* reply)
 {
     GET_SORTEDSET(params[1]);
 
-    auto sset = value->CastSortedSet();
-    auto itMem = sset->FindMember(params[2]);
-    if (itMem == sset->end())
+    double score = 0;
+    if (!SSetScore(*value, params[2], &score))
         FormatNull(reply);
     else
-        FormatInt(itMem->second, reply);
+        FormatInt(score, reply);
 
     return QError_ok;
 }
@@ -354,9 +608,7 @@ static QError GenericRange(const std::vector<QString>& params, UnboundedBuffer*
         return QError_param;
     }
     
-    auto sset = value->CastSortedSet();
-    
-    auto res(sset->RangeByRank(start, end));
+    auto res(SSetRangeByRank(*value, start, end));
     if (res.empty())
     {
         FormatNullArray(reply);
@@ -435,9 +687,7 @@ static QError GenericScoreRange(const std::vector<QString>& params, UnboundedBuf
         return  QError_nan;
     }
     
-    auto sset = value->CastSortedSet();
-    
-    auto res(sset->RangeByScore(minScore, maxScore));
+    auto res(SSetRangeByScore(*value, minScore, maxScore));
     if (res.empty())
     {
         FormatNull(reply);
@@ -502,36 +752,28 @@ static QError GenericRemRange(const std::vector<QString>& params, UnboundedBuffe
         return  QError_nan;
     }
     
-    std::vector<QSortedSet::Member2Score::value_type> res;
-    auto sset = value->CastSortedSet();
+    size_t removed = 0;
     if (useRank)
     {
         long lstart = static_cast<long>(start);
         long lend   = static_cast<long>(end);
-        AdjustIndex(lstart, lend, sset->Size());
-        res = sset->RangeByRank(lstart, lend);
+        removed = SSetDelRangeByRank(*value, lstart, lend);
     }
     else
     {
-        res = sset->RangeByScore(start, end);
+        removed = SSetDelRangeByScore(*value, start, end);
     }
     
-    if (res.empty())
+    if (removed == 0)
     {
         Format0(reply);
         return QError_ok;
     }
     
-    for (const auto& s : res)
-    {
-        bool succ = sset->DelMember(s.first);
-        assert(succ);
-    }
-    
-    if (sset->Size() == 0)
+    if (SSetSize(*value) == 0)
         QSTORE.DeleteKey(params[1]);
     
-    FormatInt(static_cast<long>(res.size()), reply);
+    FormatInt(static_cast<long>(removed), reply);
     return QError_ok;
 }
 
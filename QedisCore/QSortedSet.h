@@ -3,10 +3,10 @@
 
 #include "QString.h"
 #include "QHelper.h"
-#include <map>
-#include <set>
+#include "QSkipList.h"
 #include <vector>
 #include <unordered_map>
+#include <functional>
 
 namespace qedis
 {
@@ -14,9 +14,6 @@ namespace qedis
 class QSortedSet
 {
 public:
-    using Members = std::set<QString>;
-    using Score2Members = std::map<double, Members>;
-
     using Member2Score = std::unordered_map<QString, double,
                                             my_hash,
                                             std::equal_to<QString> >;
@@ -41,13 +38,36 @@ public:
     std::vector<Member2Score::value_type >
         RangeByScore(double minScore, double maxScore);
 
+    std::size_t DelRangeByRank(long start, long end);
+    std::size_t DelRangeByScore(double minScore, double maxScore);
+
     std::size_t Size() const;
 
 private:
-    Score2Members   scores_;
+    QSkipList       scores_;
     Member2Score    members_;
 };
 
+// Encoding independent sorted set operations.
+// A small sorted set is a ziplist of member-score pairs ordered by score,
+// it's converted to QSortedSet when exceeds zset-max-ziplist-entries
+// or zset-max-ziplist-value. Rank is 0-based.
+using SSetMembers = std::vector<QSortedSet::Member2Score::value_type>;
+
+std::size_t SSetSize(const QObject& obj);
+bool        SSetScore(const QObject& obj, const QString& member, double* score = nullptr);
+// return false if member exists
+bool        SSetAdd(QObject& obj, const QString& member, double score);
+double      SSetIncrBy(QObject& obj, const QString& member, double delta);
+bool        SSetDelete(QObject& obj, const QString& member);
+long        SSetRank(const QObject& obj, const QString& member, bool reverse = false); // -1 if not exist
+SSetMembers SSetRangeByRank(const QObject& obj, long start, long end);
+SSetMembers SSetRangeByScore(const QObject& obj, double minScore, double maxScore);
+std::size_t SSetDelRangeByRank(QObject& obj, long start, long end);
+std::size_t SSetDelRangeByScore(QObject& obj, double minScore, double maxScore);
+void        SSetForEach(const QObject& obj,
+                        const std::function<void (const QString& member, double score)>& func);
+
 }
 
 #endif
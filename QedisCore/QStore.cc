@@ -5,14 +5,22 @@
 #include "QMulti.h"
 #include "Log/Logger.h"
 #include "QLeveldb.h"
+#include "QGlobRegex.h"
+#include "QMemory.h"
+#include "QLazyFree.h"
+#include "QShard.h"
+#include "QHelper.h"
 #include <limits>
+#include <algorithm>
+#include <mutex>
 #include <cassert>
 
 
 namespace qedis
 {
 
-uint32_t QObject::lruclock = static_cast<uint32_t>(::time(nullptr));
+uint32_t QObject::lruclock = static_cast<uint32_t>(::time(nullptr)) & kMaxLRUValue;
+uint32_t QObject::lfuclock = static_cast<uint32_t>(::time(nullptr) / 60) & 0xffff;
     
 
 QObject::QObject(QType t) : type(t)
@@ -41,7 +49,9 @@ QObject::QObject(QType t) : type(t)
     }
 
     lru = 0;
+    dirty = 0;
     value = nullptr;
+    expire = 0;
 }
         
 QObject::~QObject()
@@ -69,7 +79,9 @@ QObject::QObject(QObject&& obj) :
     type(QType_invalid),
     encoding(QEncode_invalid),
     lru(0),
-    value(nullptr)
+    dirty(0),
+    value(nullptr),
+    expire(0)
 {
     _MoveFrom(std::move(obj));
 }
@@ -95,6 +107,38 @@ void QObject::_MoveFrom(QObject&& obj)
     obj.lru = 0;
 }
         
+// Morris counter of redis: the greater it is, the less likely it grows,
+// 255 means about a million hits with the default lfu-log-factor 10
+static uint8_t LFULogIncr(uint8_t counter)
+{
+    if (counter == 255)
+        return 255;
+
+    static __thread unsigned int seed = 0;
+    if (seed == 0)
+        seed = static_cast<unsigned int>(::time(nullptr)) ^ static_cast<unsigned int>(reinterpret_cast<uintptr_t>(&seed));
+
+    const double r = static_cast<double>(::rand_r(&seed)) / RAND_MAX;
+    const double base = counter > kLFUInitVal ? counter - kLFUInitVal : 0;
+    const double p = 1.0 / (base * g_config.lfuLogFactor + 1);
+    if (r < p)
+        ++ counter;
+
+    return counter;
+}
+
+void QObject::Touch(bool created)
+{
+    if (!IsLFUPolicy(g_config.maxmemoryPolicy))
+    {
+        lru = lruclock;
+        return;
+    }
+
+    const uint8_t counter = created ? kLFUInitVal : LFULogIncr(LFUDecrAndReturn(lru));
+    lru = (lfuclock << 8) | counter;
+}
+
 void QObject::_FreeValue()
 {
     switch (encoding)
@@ -102,6 +146,14 @@ void QObject::_FreeValue()
         case QEncode_raw:
             delete CastString();
             break;
+
+        case QEncode_embstr:
+            QEmbString::Free(CastEmbString());
+            break;
+
+        case QEncode_sharedstr:
+            CastSharedString()->Unref();
+            break;
                     
         case QEncode_list:
             delete CastList();
@@ -118,6 +170,17 @@ void QObject::_FreeValue()
         case QEncode_hash:
             delete CastHash();
             break;
+
+        case QEncode_ziplist:
+        case QEncode_zipset:
+        case QEncode_ziphash:
+        case QEncode_zipsset:
+            ZipListFree(CastZipList());
+            break;
+
+        case QEncode_intset:
+            zfree(CastIntset());
+            break;
                     
         default:
             break;
@@ -125,88 +188,196 @@ void QObject::_FreeValue()
 }
 
 int QStore::dirty_ = 0;
+__thread int QStore::dbno_ = 0;
 
-void QStore::ExpiresDB::SetExpire(const QString& key, uint64_t when)
+int KeySlot(const QString& key)
 {
-    expireKeys_[key] = when;
+    // like redis cluster, only hash the part between the first '{' and the following '}'
+    // if it's not empty, so related keys can be put in the same shard
+    QString::size_type start = key.find('{');
+    if (start != QString::npos)
+    {
+        QString::size_type end = key.find('}', start + 1);
+        if (end != QString::npos && end != start + 1)
+            return static_cast<int>(dictGenHashFunction(key.data() + start + 1,
+                                                        static_cast<int>(end - start - 1)) % kSlots);
+    }
+
+    return static_cast<int>(my_hash()(key) % kSlots);
 }
 
-int64_t QStore::ExpiresDB::TTL(const QString& key, uint64_t now)
+namespace
 {
-    if (!QSTORE.ExistsKey(key))
-        return ExpireResult::notExist;
 
-    ExpireResult ret = ExpireIfNeed(key, now);
-    switch (ret)
-    {
-        case ExpireResult::expired:
-        case ExpireResult::persist:
-            return ret;
-            
-        default:
-            break;
-    }
-    
-    auto it(expireKeys_.find(key));
-    return static_cast<int64_t>(it->second - now);
-}
+// the cron runs every ms, use a quarter of it like redis does
+const int kExpireBudgetUs = 250;
+const int kMaxExpireBudgetUs = 800;
+// above this, give more time to the cron
+const int kAcceptableStalePermille = 100;
+const std::size_t kMinCompactGarbage = 1024;
 
-bool QStore::ExpiresDB::ClearExpire(const QString& key)
+uint64_t NowUs()
 {
-    return ExpireResult::expired == ExpireIfNeed(key, std::numeric_limits<uint64_t>::max());
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000UL + ts.tv_nsec / 1000;
+}
+
 }
 
-QStore::ExpireResult  QStore::ExpiresDB::ExpireIfNeed(const QString& key, uint64_t now)
+void QStore::ExpiresDB::Add(const QDB& db, const QString& key, uint64_t old, uint64_t when)
 {
-    auto    it(expireKeys_.find(key));
-    
-    if (it != expireKeys_.end())
+    if (old == 0)
     {
-        if (it->second > now)
-            return ExpireResult::notExpire;
-        
-        WRN << "Delete timeout key " << it->first;
-        QSTORE.DeleteKey(it->first);
-        expireKeys_.erase(it);
-        return ExpireResult::expired;
+        ++ size_;
     }
-    
-    return  ExpireResult::persist;
+    else if (old / 1000 == when / 1000)
+    {
+        return; // same bucket
+    }
+
+    index_[when / 1000].push_back(key);
+
+    if (old != 0)
+        _Unindex(db);
 }
 
-int QStore::ExpiresDB::LoopCheck(uint64_t now)
+void QStore::ExpiresDB::Remove(const QDB& db)
 {
-    const int kMaxDel = 100;
-    const int kMaxCheck = 2000;
+    -- size_;
+    _Unindex(db);
+}
+
+int QStore::ExpiresDB::ActiveExpire(QDB& db, uint64_t now, uint64_t budgetEndUs, bool& timeout)
+{
+    // the current second is not finished, all keys of the passed seconds are expired
+    const uint64_t nowSec = now / 1000;
 
     int  nDel = 0;
     int  nLoop = 0;
 
-    for (auto  it = expireKeys_.begin();
-               it!= expireKeys_.end() && nDel < kMaxDel && nLoop < kMaxCheck;
-               ++ nLoop)
+    while (!index_.empty() && index_.begin()->first < nowSec)
     {
-        if (it->second <= now)
+        const uint64_t second = index_.begin()->first;
+        auto& keys = index_.begin()->second;
+
+        while (!keys.empty())
         {
-            // time to delete
-            INF << "LoopCheck try delete key:" << it->first;
-            
-            std::vector<QString> params{"del", it->first};
-            Propogate(params);
-            
-            QSTORE.DeleteKey(it->first);
-            expireKeys_.erase(it ++);
+            // clock is not free, check it every 16 keys
+            if ((++ nLoop & 0xf) == 0 && NowUs() > budgetEndUs)
+            {
+                timeout = true;
+                return nDel;
+            }
+
+            const QString& key = keys.back();
+            auto it(db.find(key));
+            if (it != db.end() && it->second.expire != 0 && it->second.expire / 1000 == second)
+            {
+                DBG << "ActiveExpire delete key:" << key;
+
+                std::vector<QString> params{"del", key};
+                Propogate(params);
 
-            ++ nDel;
+                // this entry of index is used, not garbage
+                it->second.expire = 0;
+                -- size_;
+                QSTORE.DeleteKey(key, true);
+                ++ nDel;
+            }
+            else
+            {
+                -- garbage_;
+            }
+
+            keys.pop_back();
         }
-        else
+
+        index_.erase(index_.begin());
+    }
+
+    return nDel;
+}
+
+std::size_t QStore::ExpiresDB::DueKeys(uint64_t now) const
+{
+    std::size_t n = 0;
+    for (auto it = index_.begin(); it != index_.end() && it->first < now / 1000; ++ it)
+        n += it->second.size();
+
+    return n;
+}
+
+void QStore::ExpiresDB::Soonest(const QDB& db, int count, std::vector<const QDB::value_type*>& res)
+{
+    // the garbage entries met are dropped, like ActiveExpire
+    auto it = index_.begin();
+    while (it != index_.end() && static_cast<int>(res.size()) < count)
+    {
+        auto& keys = it->second;
+        for (std::size_t i = 0; i < keys.size() && static_cast<int>(res.size()) < count; )
         {
-            ++ it;
+            auto kv = db.find(keys[i]);
+            if (kv != db.end() && kv->second.expire != 0 && kv->second.expire / 1000 == it->first)
+            {
+                res.push_back(&*kv);
+                ++ i;
+            }
+            else
+            {
+                keys[i] = std::move(keys.back());
+                keys.pop_back();
+                -- garbage_;
+            }
         }
+
+        if (keys.empty())
+            it = index_.erase(it);
+        else
+            ++ it;
     }
+}
 
-    return nDel;
+void QStore::ExpiresDB::Clear(bool async)
+{
+    if (async)
+        QLazyFree::Instance().Free(index_, size_ + garbage_);
+
+    index_.clear();
+    size_ = 0;
+    garbage_ = 0;
+}
+
+void QStore::ExpiresDB::_Unindex(const QDB& db)
+{
+    // the old entry in index_ is garbage now
+    ++ garbage_;
+    if (garbage_ < kMinCompactGarbage || garbage_ < size_)
+        return;
+
+    // keep the entries still matching the deadline of key
+    std::size_t n = 0;
+    for (auto it = index_.begin(); it != index_.end(); )
+    {
+        const uint64_t second = it->first;
+        auto& keys = it->second;
+        keys.erase(std::remove_if(keys.begin(), keys.end(), [&](const QString& key) {
+                        auto obj(db.find(key));
+                        return obj == db.end() ||
+                               obj->second.expire == 0 ||
+                               obj->second.expire / 1000 != second;
+                   }),
+                   keys.end());
+
+        n += keys.size();
+        if (keys.empty())
+            it = index_.erase(it);
+        else
+            ++ it;
+    }
 
+    // duplicated ones are left
+    garbage_ = n - size_;
 }
 
 
@@ -258,9 +429,9 @@ size_t QStore::BlockedClients::UnblockClient(QClient* client)
 }
 
 
-size_t  QStore::BlockedClients::ServeClient(const QString& key, const PLIST& list)
+size_t  QStore::BlockedClients::ServeClient(const QString& key, QObject* list)
 {
-    assert(!list->empty());
+    assert(ListSize(*list) > 0);
     
     auto it = blockedClients_.find(key);
     if (it == blockedClients_.end())
@@ -272,7 +443,7 @@ size_t  QStore::BlockedClients::ServeClient(const QString& key, const PLIST& lis
     
     size_t nServed = 0;
         
-    while (!list->empty() && !clients.empty())
+    while (ListSize(*list) > 0 && !clients.empty())
     {
         auto  cli(std::get<0>(clients.front()).lock());
         auto  pos(std::get<2>(clients.front()));
@@ -286,7 +457,7 @@ size_t  QStore::BlockedClients::ServeClient(const QString& key, const PLIST& lis
 
             if (!target.empty())
             {
-                INF << list->front() << " is try lpush to target list " << target;
+                INF << key << " is try lpush to target list " << target;
                 
                 // check target list
                 QError err = QSTORE.GetValueByType(target, dst, QType_list);
@@ -308,13 +479,15 @@ size_t  QStore::BlockedClients::ServeClient(const QString& key, const PLIST& lis
             
             if (!errorTarget)
             {
+                QString elem;
+                ListPop(*list, pos, &elem);
+
                 if (dst)
                 {
-                    auto dstlist = dst->CastList();
-                    dstlist->push_front(list->back());
-                    INF << list->front() << " success lpush to target list " << target;
+                    ListPush(*dst, elem, ListPosition::head);
+                    INF << elem << " success lpush to target list " << target;
 
-                    std::vector<QString> params{"lpush", target, list->back()};
+                    std::vector<QString> params{"lpush", target, elem};
                     Propogate(params);
                 }
                 
@@ -326,19 +499,14 @@ size_t  QStore::BlockedClients::ServeClient(const QString& key, const PLIST& lis
                     FormatBulk(key, &reply);
                 }
 
+                FormatBulk(elem, &reply);
                 if (pos == ListPosition::head)
                 {
-                    FormatBulk(list->front(), &reply);
-                    list->pop_front();
-
                     std::vector<QString> params{"lpop", key};
                     Propogate(params);
                 }
                 else
                 {
-                    FormatBulk(list->back(), &reply);
-                    list->pop_back();
-
                     std::vector<QString> params{"rpop", key};
                     Propogate(params);
                 }
@@ -412,26 +580,109 @@ QStore& QStore::Instance()
     return store;
 }
 
-void  QStore::Init(int dbNum)
+void  QStore::Init(int dbNum, int shards)
 {
     if (dbNum < 1)
         dbNum = 1;
     else if (dbNum > kMaxDbNum)
         dbNum = kMaxDbNum;
     
+    if (!expireStats_ || shards_ != std::max(shards, 1))
+    {
+        shards_ = std::max(shards, 1);
+        expireStats_.reset(new ExpireStat[shards_]);
+        for (int i = 0; i < shards_; ++ i)
+            expireStats_[i].budgetUs = kExpireBudgetUs;
+
+        evictionPools_.reset(new EvictionPool[shards_]);
+        defragStates_.reset(new DefragState[shards_]);
+    }
+    
     store_.resize(dbNum);
     expiresDb_.resize(dbNum);
     blockedClients_.resize(dbNum);
+    for (int i = 0; i < dbNum; ++ i)
+    {
+        store_[i].resize(shards_);
+        expiresDb_[i].resize(shards_);
+        blockedClients_[i].resize(shards_);
+    }
+}
+
+int  QStore::ActiveExpireCycle(uint64_t now, int shard)
+{
+    ExpireStat& stat = expireStats_[shard];
+
+    const uint64_t start = NowUs();
+    const int dbNum = static_cast<int>(expiresDb_.size());
+    const int oldDb = dbno_;
+
+    int  nDel = 0;
+    bool timeout = false;
+
+    // go on with the db where last cycle stopped, so a busy db can't starve others
+    for (int i = 0; i < dbNum && !timeout; ++ i)
+    {
+        const int db = (stat.nextDb + i) % dbNum;
+        SelectDB(db);
+        nDel += expiresDb_[db][shard].ActiveExpire(store_[db][shard], now, start + stat.budgetUs, timeout);
+        if (timeout)
+            stat.nextDb = db;
+    }
+
+    SelectDB(oldDb);
+
+    // nothing is due if not timeout; otherwise estimate the expired keys still in
+    // memory, and spend more time if there are too many, less when back to normal
+    int stale = 0;
+    if (timeout)
+    {
+        std::size_t due = 0, total = 0;
+        for (const auto& shards : expiresDb_)
+        {
+            due += shards[shard].DueKeys(now);
+            total += shards[shard].Size();
+        }
+
+        if (total > 0)
+            stale = static_cast<int>(std::min<std::size_t>(due, total) * 1000 / total);
+    }
+
+    if (stale > kAcceptableStalePermille)
+        stat.budgetUs = std::min(stat.budgetUs * 2, kMaxExpireBudgetUs);
+    else
+        stat.budgetUs = kExpireBudgetUs;
+
+    stat.stalePermille = stale;
+    stat.expired += nDel;
+    stat.cycleUs += NowUs() - start;
+
+    if (now >= stat.lastSample + 1000)
+    {
+        const uint64_t expired = stat.expired;
+        if (stat.lastSample != 0)
+            stat.expiredPerSec = (expired - stat.lastExpired) * 1000 / (now - stat.lastSample);
+
+        stat.lastExpired = expired;
+        stat.lastSample = now;
+    }
+
+    return nDel;
 }
 
-int  QStore::LoopCheckExpire(uint64_t now)
+void QStore::LoopRehash(int shard)
 {
-    return expiresDb_[dbno_].LoopCheck(now);
+    // about 1M keys per second when growing, besides the steps of writes
+    const std::size_t kRehashPerLoop = 1000;
+
+    QDB& db = store_[dbno_][shard];
+    if (!db.Rehash(kRehashPerLoop))
+        db.TryShrink();
 }
 
-int  QStore::LoopCheckBlocked(uint64_t now)
+int  QStore::LoopCheckBlocked(uint64_t now, int shard)
 {
-    return blockedClients_[dbno_].LoopCheck(now);
+    return blockedClients_[dbno_][shard].LoopCheck(now);
 }
 
 
@@ -458,15 +709,20 @@ int  QStore::GetDB() const
 
 const QObject* QStore::GetObject(const QString& key) const
 {
-    auto db = &store_[dbno_];
-    QDB::const_iterator it(db->find(key));
+    return _FindObject(key, ShardOf(key));
+}
+
+QObject* QStore::_FindObject(const QString& key, int shard) const
+{
+    auto db = &store_[dbno_][shard];
+    QDB::iterator it(db->find(key));
     if (it != db->end())
         return &it->second;
 
     if (!backends_.empty())
     {
         // if it's in dirty list, it must be deleted, wait sync to backend
-        if (waitSyncKeys_[dbno_].count(key))
+        if (waitSyncKeys_[dbno_][shard].deleted.count(key))
             return nullptr;
 
         // load from leveldb, if has, insert to qedis cache
@@ -475,13 +731,14 @@ const QObject* QStore::GetObject(const QString& key) const
         {
             DBG << "GetKey from leveldb:" << key;
 
-            QObject& realobj = ((*db)[key] = std::move(obj));
-            realobj.lru = QObject::lruclock;
-
             // trick: use lru field to store the remain seconds to be expired.
             unsigned int remainTtlSeconds = obj.lru;
+
+            QObject& realobj = ((*db)[key] = std::move(obj));
+            realobj.Touch(true);
+
             if (remainTtlSeconds > 0)
-                SetExpire(key, ::Now() + remainTtlSeconds * 1000);
+                _SetExpire(key, realobj, shard, ::Now() + remainTtlSeconds * 1000);
 
             return &realobj;
         }
@@ -490,16 +747,26 @@ const QObject* QStore::GetObject(const QString& key) const
     return nullptr;
 }
 
-bool QStore::DeleteKey(const QString& key)
+bool QStore::DeleteKey(const QString& key, bool lazy)
 {
-    auto db = &store_[dbno_];
+    const int shard = ShardOf(key);
+    auto db = &store_[dbno_][shard];
     // add to dirty queue
     if (!waitSyncKeys_.empty())
     {
-        waitSyncKeys_[dbno_][key] = nullptr; // null implies delete data
+        waitSyncKeys_[dbno_][shard].deleted.insert(key);
     }
 
-    return db->erase(key) != 0;
+    auto it(db->find(key));
+    if (it == db->end())
+        return false;
+
+    _ClearExpire(it->second, shard);
+    if (lazy)
+        QLazyFree::Instance().FreeObject(it->second);
+
+    db->erase(it);
+    return true;
 }
 
 bool QStore::ExistsKey(const QString& key) const
@@ -534,25 +801,123 @@ static bool RandomMember(const QDB& hash, QString& res, QObject** val)
 QString QStore::RandomKey(QObject** val) const
 {
     QString res;
-    if (!store_.empty() && !store_[dbno_].empty())
-        RandomMember(store_[dbno_], res, val);
+    const auto& shards = store_[dbno_];
+
+    // start from a random shard, the first non empty one is used
+    const size_t start = static_cast<size_t>(::rand()) % shards.size();
+    for (size_t i = 0; i < shards.size(); ++ i)
+    {
+        const QDB& db = shards[(start + i) % shards.size()];
+        if (!db.empty())
+        {
+            RandomMember(db, res, val);
+            break;
+        }
+    }
 
     return res;
 }
 
-size_t QStore::ScanKey(size_t cursor, size_t count, std::vector<QString>& res) const
+size_t QStore::ScanKey(size_t cursor, size_t count, const QString* pattern, QType type,
+                       std::vector<QString>& res) const
 {
-    if (store_.empty() || store_[dbno_].empty())
-        return 0;
+    const auto& shards = store_[dbno_];
+    const size_t nShards = shards.size();
+
+    // low part of cursor is the shard, the high part is the cursor in that shard
+    size_t shard = cursor % nShards;
+    cursor /= nShards;
+
+    // filter when visiting, only the matched keys are copied
+    const uint64_t now = ::Now();
+    auto filter = [&](const QDB::value_type& kv) {
+        if (type != QType_invalid && kv.second.type != type)
+            return;
+
+        if (kv.second.expire != 0 && kv.second.expire <= now)
+            return;
+
+        if (pattern && !glob_match(*pattern, kv.first))
+            return;
+
+        res.push_back(kv.first);
+    };
+
+    for (; shard < nShards; ++ shard, cursor = 0)
+    {
+        if (shards[shard].empty())
+            continue;
+
+        size_t newCursor = ScanHashMember(shards[shard], cursor, count, filter);
+        if (newCursor != 0)
+            return newCursor * nShards + shard;
 
-    std::vector<QDB::const_local_iterator> iters;
-    size_t newCursor = ScanHashMember(store_[dbno_], cursor, count, iters);
+        // the next call starts from next shard
+        return shard + 1 < nShards ? shard + 1 : 0;
+    }
+
+    return 0;
+}
+
+size_t QStore::DBSize() const
+{
+    size_t size = 0;
+    for (const auto& db : store_[dbno_])
+        size += db.size();
+
+    return size;
+}
 
-    res.reserve(iters.size());
-    for (auto it : iters)
-        res.push_back(it->first);
+void QStore::ClearCurrentDB(bool async)
+{
+    for (auto& db : store_[dbno_])
+    {
+        if (async)
+            QLazyFree::Instance().Free(db, db.size());
+
+        db.clear();
+    }
 
-    return newCursor;
+    for (auto& expires : expiresDb_[dbno_])
+        expires.Clear(async);
+}
+
+QStore::const_iterator::const_iterator(const std::vector<QDB>* shards, size_t shard) :
+    shards_(shards),
+    shard_(shard)
+{
+    if (shard_ < shards_->size())
+    {
+        it_ = (*shards_)[shard_].begin();
+        _SkipEmptyShards();
+    }
+}
+
+QStore::const_iterator& QStore::const_iterator::operator++ ()
+{
+    ++ it_;
+    _SkipEmptyShards();
+
+    return *this;
+}
+
+bool QStore::const_iterator::operator== (const const_iterator& other) const
+{
+    if (shard_ != other.shard_)
+        return false;
+
+    return shard_ == shards_->size() || it_ == other.it_;
+}
+
+void QStore::const_iterator::_SkipEmptyShards()
+{
+    while (it_ == (*shards_)[shard_].end())
+    {
+        if (++ shard_ == shards_->size())
+            break;
+
+        it_ = (*shards_)[shard_].begin();
+    }
 }
 
 QError  QStore::GetValue(const QString& key, QObject*& value, bool touch)
@@ -575,53 +940,61 @@ QError  QStore::GetValueByTypeNoTouch(const QString& key, QObject*& value, QType
 
 QError  QStore::_GetValueByType(const QString& key, QObject*& value, QType type, bool touch)
 {
-    if (_ExpireIfNeed(key, ::Now()) == ExpireResult::expired)
+    // one lookup for both the value and ttl, and no clock for persist keys
+    const int shard = ShardOf(key);
+    QObject* obj = _FindObject(key, shard);
+    if (!obj || (obj->expire != 0 && _ExpireIfNeed(key, *obj, shard, ::Now())))
         return QError_notExist;
-    
-    auto cobj = GetObject(key);
-    if (cobj)
-    {
-        if (type != QType_invalid && type != QType(cobj->type))
-        {
-            return QError_type;
-        }
-        else
-        {
-            value = const_cast<QObject*>(cobj);
 
-            // Do not update if child process exists
-            extern pid_t g_qdbPid;
-            if (touch && g_rewritePid == -1 && g_qdbPid == -1)
-                value->lru = QObject::lruclock;
+    if (type != QType_invalid && type != QType(obj->type))
+        return QError_type;
 
-            return QError_ok;
-        }
-    }
-    else
-    {
-        return QError_notExist;
-    }
+    value = obj;
 
-    return  QError_ok; // never here
+    // Do not update if child process exists
+    extern pid_t g_qdbPid;
+    if (touch && g_rewritePid == -1 && g_qdbPid == -1)
+        value->Touch();
+
+    return QError_ok;
 }
 
 
-QObject* QStore::SetValue(const QString& key, QObject&& value)
+QObject* QStore::SetValue(const QString& key, QObject&& value, bool keepTtl)
 {
-    auto db = &store_[dbno_];
-    QObject& obj = ((*db)[key] = std::move(value));
-    obj.lru = QObject::lruclock;
+    const int shard = ShardOf(key);
+    auto db = &store_[dbno_][shard];
+    QObject& obj = (*db)[key];
+    const bool created = (obj.type == QType_invalid);
+    const uint32_t lru = obj.lru;
+
+    // the lfu counter is kept when the value is replaced
+    if (!created)
+        QLazyFree::Instance().FreeObject(obj);
+
+    obj = std::move(value);
+    obj.lru = lru;
+    obj.Touch(created);
+
+    if (!keepTtl)
+        _ClearExpire(obj, shard);
 
     // put this key to sync list
     if (!waitSyncKeys_.empty())
-        waitSyncKeys_[dbno_][key] = &obj;
+        _MarkDirty(key, obj, shard);
 
     return &obj;
 }
 
-void QStore::SetExpire(const QString& key, uint64_t when) const
+bool QStore::SetExpire(const QString& key, uint64_t when) const
 {
-    expiresDb_[dbno_].SetExpire(key, when);
+    const int shard = ShardOf(key);
+    QObject* obj = _FindObject(key, shard);
+    if (!obj)
+        return false;
+
+    _SetExpire(key, *obj, shard, when);
+    return true;
 }
 
 void QStore::SetExpireAfter(const QString& key, uint64_t ttl) const
@@ -632,63 +1005,167 @@ void QStore::SetExpireAfter(const QString& key, uint64_t ttl) const
 
 int64_t QStore::TTL(const QString& key, uint64_t now)
 {
-    return expiresDb_[dbno_].TTL(key, now);
+    const int shard = ShardOf(key);
+    QObject* obj = _FindObject(key, shard);
+    if (!obj)
+        return ExpireResult::notExist;
+
+    if (_ExpireIfNeed(key, *obj, shard, now))
+        return ExpireResult::expired;
+
+    if (obj->expire == 0)
+        return ExpireResult::persist;
+
+    return static_cast<int64_t>(obj->expire - now);
 }
 
 bool QStore::ClearExpire(const QString& key)
 {
-    return expiresDb_[dbno_].ClearExpire(key);
+    const int shard = ShardOf(key);
+    QObject* obj = _FindObject(key, shard);
+    return obj && _ClearExpire(*obj, shard);
+}
+
+bool QStore::_ExpireIfNeed(const QString& key, QObject& obj, int shard, uint64_t now)
+{
+    if (obj.expire == 0 || obj.expire > now)
+        return false;
+
+    WRN << "Delete timeout key " << key;
+    DeleteKey(key, true);
+    ++ expireStats_[shard].expired;
+    return true;
 }
 
-QStore::ExpireResult QStore::_ExpireIfNeed(const QString& key, uint64_t now)
+void QStore::_SetExpire(const QString& key, QObject& obj, int shard, uint64_t when) const
 {
-    return  expiresDb_[dbno_].ExpireIfNeed(key, now);
+    const uint64_t old = obj.expire;
+    obj.expire = when;
+    expiresDb_[dbno_][shard].Add(store_[dbno_][shard], key, old, when);
+}
+
+bool QStore::_ClearExpire(QObject& obj, int shard) const
+{
+    if (obj.expire == 0)
+        return false;
+
+    obj.expire = 0;
+    expiresDb_[dbno_][shard].Remove(store_[dbno_][shard]);
+    return true;
 }
 
 void QStore::InitExpireTimer()
 {
-    for (int i = 0; i < static_cast<int>(expiresDb_.size()); ++ i)
-    {
-        auto timer = TimerManager::Instance().CreateTimer();
-        timer->Init(1);
-        timer->SetCallback([&, i] () {
-                int oldDb = QSTORE.SelectDB(i);
-                QSTORE.LoopCheckExpire(::Now());
-                QSTORE.SelectDB(oldDb);
-        });
+    auto timer = TimerManager::Instance().CreateTimer();
+    timer->Init(1);
+    timer->SetCallback([] () {
+            QSTORE.ActiveExpireCycle(::Now());
+            QSTORE.ActiveDefragCycle();
 
-        TimerManager::Instance().AddTimer(timer);
+            int oldDb = QSTORE.GetDB();
+            for (int i = 0; QSTORE.SelectDB(i) != -1; ++ i)
+                QSTORE.LoopRehash();
+            QSTORE.SelectDB(oldDb);
+    });
+
+    TimerManager::Instance().AddTimer(timer);
+}
+
+void QStore::OnInfoCommand(UnboundedBuffer& res)
+{
+    uint64_t expired = 0, perSec = 0, cycleUs = 0;
+    int stale = 0;
+    for (int i = 0; i < shards_; ++ i)
+    {
+        const ExpireStat& stat = expireStats_[i];
+        expired += stat.expired;
+        perSec += stat.expiredPerSec;
+        cycleUs += stat.cycleUs;
+        stale += stat.stalePermille;
     }
+
+    char buf[512];
+    int n = snprintf(buf, sizeof buf - 1,
+                     "# Stats\r\n"
+                     "expired_keys:%lu\r\n"
+                     "expired_keys_per_sec:%lu\r\n"
+                     "expired_stale_perc:%.2f\r\n"
+                     "expire_cycle_cpu_milliseconds:%lu\r\n"
+                     "evicted_keys:%lu\r\n"
+                     "lazyfreed_objects:%lu\r\n"
+                     "active_defrag_hits:%lu\r\n"
+                     "active_defrag_misses:%lu\r\n"
+                     , expired
+                     , perSec
+                     , stale / 10.0 / shards_
+                     , cycleUs / 1000
+                     , evictedKeys_.load()
+                     , QLazyFree::Instance().Freed()
+                     , defragHits_.load()
+                     , defragMisses_.load()
+                     );
+
+    if (!res.IsEmpty())
+        res.PushData("\r\n", 2);
+
+    res.PushData(buf, n);
 }
 
-void QStore::ResetDb()
+void QStore::ResetDb(bool async)
 {
-    std::vector<QDB>(store_.size()).swap(store_);
-    std::vector<ExpiresDB>(expiresDb_.size()).swap(expiresDb_);
-    std::vector<BlockedClients>(blockedClients_.size()).swap(blockedClients_);
+    const int dbNum = static_cast<int>(store_.size());
+
+    decltype(store_) store;
+    decltype(expiresDb_) expiresDb;
+    store.swap(store_);
+    expiresDb.swap(expiresDb_);
+
+    if (async)
+    {
+        std::size_t keys = 0, volatileKeys = 0;
+        for (const auto& shards : store)
+            for (const auto& db : shards)
+                keys += db.size();
+
+        for (const auto& shards : expiresDb)
+            for (const auto& expires : shards)
+                volatileKeys += expires.Size();
+
+        QLazyFree::Instance().Free(store, keys);
+        QLazyFree::Instance().Free(expiresDb, volatileKeys);
+    }
+
+    decltype(blockedClients_)().swap(blockedClients_);
+    Init(dbNum, shards_);
     dbno_ = 0;
 }
 
 size_t QStore::BlockedSize() const
 {
     size_t s = 0;
-    for (const auto& b : blockedClients_)
-        s += b.Size();
+    for (const auto& shards : blockedClients_)
+        for (const auto& b : shards)
+            s += b.Size();
     
     return s;
 }
 
 bool    QStore::BlockClient(const QString& key, QClient* client, uint64_t timeout, ListPosition pos, const QString* dstList)
 {
-    return blockedClients_[dbno_].BlockClient(key, client, timeout, pos, dstList);
+    return blockedClients_[dbno_][ShardOf(key)].BlockClient(key, client, timeout, pos, dstList);
 }
 size_t  QStore::UnblockClient(QClient* client)
 {
-    return blockedClients_[dbno_].UnblockClient(client);
+    // all the keys a client waiting for are in the same shard
+    const auto& keys = client->WaitingKeys();
+    if (keys.empty())
+        return 0;
+
+    return blockedClients_[dbno_][ShardOf(*keys.begin())].UnblockClient(client);
 }
-size_t  QStore::ServeClient(const QString& key, const PLIST& list)
+size_t  QStore::ServeClient(const QString& key, QObject* list)
 {
-    return blockedClients_[dbno_].ServeClient(key, list);
+    return blockedClients_[dbno_][ShardOf(key)].ServeClient(key, list);
 }
 
 void    QStore::InitBlockedTimer()
@@ -708,59 +1185,209 @@ void    QStore::InitBlockedTimer()
 }
 
 
-static void EvictItems()
+void QStore::EvictionPool::Insert(uint64_t idle, int dbno, const QString& key)
 {
-    QObject::lruclock = static_cast<uint32_t>(::time(nullptr));
-    QObject::lruclock &= kMaxLRUValue;
+    // the worst one is dropped when full
+    auto it = std::lower_bound(candidates_.begin(), candidates_.end(), idle,
+                               [](const Candidate& c, uint64_t idle) {
+                                   return c.idle < idle;
+                               });
+    if (it == candidates_.begin() && candidates_.size() == kSize)
+        return;
 
-    int currentDb = QSTORE.GetDB();
-    
-    QEDIS_DEFER {
-        QSTORE.SelectDB(currentDb);
-    };
+    for (const auto& c : candidates_)
+    {
+        if (c.dbno == dbno && c.key == key)
+            return;
+    }
+
+    if (candidates_.size() == kSize)
+    {
+        candidates_.erase(candidates_.begin());
+        -- it;
+    }
+
+    candidates_.insert(it, Candidate{idle, dbno, key});
+}
 
-    int tryCnt = 0;
-    size_t usedMem = 0;
-    while (tryCnt ++ < 32 && (usedMem = getMemoryInfo(VmRSS)) > g_config.maxmemory)
+bool QStore::EvictionPool::Pop(Candidate& best)
+{
+    if (candidates_.empty())
+        return false;
+
+    best = std::move(candidates_.back());
+    candidates_.pop_back();
+    return true;
+}
+
+void QStore::_PopulateEvictionPool(int dbno, int shard, EvictionPool& pool)
+{
+    const QDB& db = store_[dbno][shard];
+    ExpiresDB& expires = expiresDb_[dbno][shard];
+    const int policy = g_config.maxmemoryPolicy;
+
+    std::vector<const QDB::value_type*> samples;
+    if (policy == EvictVolatileTTL ||
+        (IsVolatilePolicy(policy) && expires.Size() * 4 < db.size()))
     {
-        if (g_config.noeviction)
+        // keys with ttl are few, sample the ones expire soonest instead
+        expires.Soonest(db, g_config.maxmemorySamples, samples);
+    }
+    else
+    {
+        // the volatile ones are filtered, try more times
+        const int tries = g_config.maxmemorySamples * (IsVolatilePolicy(policy) ? 4 : 1);
+        for (int i = 0; i < tries && static_cast<int>(samples.size()) < g_config.maxmemorySamples; ++ i)
         {
-            WRN << "noeviction policy, but memory usage exceeds: " << usedMem;
-            return;
+            QDB::const_local_iterator it = RandomHashMember(db);
+            if (it == QDB::const_local_iterator())
+                break;
+
+            if (!IsVolatilePolicy(policy) || it->second.expire != 0)
+                samples.push_back(&*it);
         }
+    }
+
+    for (auto kv : samples)
+    {
+        uint64_t idle = 0;
+        if (policy == EvictVolatileTTL)
+            idle = std::numeric_limits<uint64_t>::max() - kv->second.expire;
+        else if (IsLFUPolicy(policy))
+            idle = 255 - LFUDecrAndReturn(kv->second.lru);
+        else
+            idle = EstimateIdleTime(kv->second.lru);
+
+        pool.Insert(idle, dbno, kv->first);
+    }
+}
 
-        for (int dbno = 0; true; ++ dbno)
+bool QStore::_SelectEvictKey(int shard, int& dbno, QString& key)
+{
+    const int policy = g_config.maxmemoryPolicy;
+    const bool volatileOnly = IsVolatilePolicy(policy);
+    const int dbNum = static_cast<int>(store_.size());
+    EvictionPool& pool = evictionPools_[shard];
+
+    if (policy == EvictAllKeysRandom || policy == EvictVolatileRandom)
+    {
+        // the dbs in turn
+        for (int i = 0; i < dbNum; ++ i)
         {
-            if (QSTORE.SelectDB(dbno) == -1)
-                break;
+            const int db = pool.nextDb;
+            pool.nextDb = (pool.nextDb + 1) % dbNum;
 
-            if (QSTORE.DBSize() == 0)
+            const QDB& d = store_[db][shard];
+            ExpiresDB& expires = expiresDb_[db][shard];
+            if (volatileOnly ? expires.Size() == 0 : d.empty())
                 continue;
-        
-            QString evictKey;
-            uint32_t choosedIdle = 0;
-            for (int i = 0; i < g_config.maxmemorySamples; ++ i)
+
+            const QDB::value_type* victim = nullptr;
+            for (int j = 0; j < 16 && !victim; ++ j)
             {
-                QObject* val = nullptr;
+                QDB::const_local_iterator it = RandomHashMember(d);
+                if (!volatileOnly || it->second.expire != 0)
+                    victim = &*it;
+            }
 
-                auto key = QSTORE.RandomKey(&val);
-                if (!val) continue;
-                
-                auto idle = EstimateIdleTime(val->lru);
-                if (evictKey.empty() || choosedIdle < idle)
-                {
-                    evictKey = std::move(key);
-                    choosedIdle = idle;
-                }
+            if (!victim)
+            {
+                // keys with ttl are few
+                std::vector<const QDB::value_type*> soonest;
+                expires.Soonest(d, 1, soonest);
+                if (!soonest.empty())
+                    victim = soonest.front();
             }
 
-            if (!evictKey.empty())
+            if (victim)
             {
-                QSTORE.DeleteKey(evictKey);
-                WRN << "Evict '" << evictKey << "' in db " << dbno << ", idle time: " << choosedIdle << ", used mem: " << usedMem;
+                dbno = db;
+                key = victim->first;
+                return true;
             }
         }
+
+        return false;
+    }
+
+    for (int db = 0; db < dbNum; ++ db)
+    {
+        if (volatileOnly ? expiresDb_[db][shard].Size() == 0 : store_[db][shard].empty())
+            continue;
+
+        _PopulateEvictionPool(db, shard, pool);
+    }
+
+    // the best one first, skip the ones deleted or persisted meanwhile
+    EvictionPool::Candidate c;
+    while (pool.Pop(c))
+    {
+        const QDB& db = store_[c.dbno][shard];
+        auto it = db.find(c.key);
+        if (it != db.end() && (!volatileOnly || it->second.expire != 0))
+        {
+            dbno = c.dbno;
+            key = std::move(c.key);
+            return true;
+        }
     }
+
+    return false;
+}
+
+bool QStore::EvictIfNeeded(int shard)
+{
+    size_t usedMem = UsedMemory();
+    if (usedMem <= g_config.maxmemory)
+        return true;
+
+    if (g_config.maxmemoryPolicy == EvictNo)
+        return false;
+
+    const int currentDb = dbno_;
+    QEDIS_DEFER {
+        dbno_ = currentDb;
+    };
+
+    // the memory freed is counted at once
+    for (int n = 0; n < kMaxEvictKeys && usedMem > g_config.maxmemory; ++ n)
+    {
+        int dbno = 0;
+        QString key;
+        bool found = false;
+        for (int i = 0; i < (shard < 0 ? shards_ : 1) && !found; ++ i)
+        {
+            int evictShard = shard;
+            if (shard < 0)
+            {
+                evictShard = nextEvictShard_;
+                nextEvictShard_ = (nextEvictShard_ + 1) % shards_;
+            }
+
+            found = _SelectEvictKey(evictShard, dbno, key);
+        }
+
+        if (!found)
+        {
+            WRN << "Nothing to evict by " << EvictionPolicyName(g_config.maxmemoryPolicy)
+                << ", but memory usage exceeds: " << usedMem;
+            return false;
+        }
+
+        dbno_ = dbno;
+        DBG << "Evict '" << key << "' in db " << dbno << ", used mem: " << usedMem;
+
+        std::vector<QString> params{"del", key};
+        Propogate(params);
+
+        DeleteKey(key);
+        ++ evictedKeys_;
+
+        usedMem = UsedMemory();
+    }
+
+    // still too much, the next writes go on evicting
+    return true;
 }
 
 uint32_t EstimateIdleTime(uint32_t lru)
@@ -771,18 +1398,178 @@ uint32_t EstimateIdleTime(uint32_t lru)
         return (kMaxLRUValue - lru) + QObject::lruclock;
 }
 
+uint8_t LFUDecrAndReturn(uint32_t lru)
+{
+    const uint32_t ldt = lru >> 8;
+    const uint32_t counter = lru & 0xff;
+
+    // minutes of 16 bits since last access
+    const uint32_t elapsed = ldt <= QObject::lfuclock ? QObject::lfuclock - ldt :
+                                                         0xffff - ldt + QObject::lfuclock;
+    const uint32_t periods = g_config.lfuDecayTime ? elapsed / g_config.lfuDecayTime : 0;
+
+    return static_cast<uint8_t>(periods >= counter ? 0 : counter - periods);
+}
+
 
 void QStore::InitEvictionTimer()
 {
     auto timer = TimerManager::Instance().CreateTimer();
-    timer->Init(1000); // emit eviction every second.
+    timer->Init(1000);
     timer->SetCallback([] () {
-        EvictItems();
+        // keys are evicted by write commands, update lru clock and peak here
+        const time_t now = ::time(nullptr);
+        QObject::lruclock = static_cast<uint32_t>(now) & kMaxLRUValue;
+        QObject::lfuclock = static_cast<uint32_t>(now / 60) & 0xffff;
+
+        const size_t usedMem = UsedMemory();
+        if (g_config.maxmemoryPolicy == EvictNo && usedMem > g_config.maxmemory)
+            WRN << "noeviction policy, but memory usage exceeds: " << usedMem;
+
+        QSTORE.DefragCron();
     });
 
     TimerManager::Instance().AddTimer(timer);
 }
 
+void QStore::DefragCron()
+{
+    if (!g_config.activedefrag || defragRunning_)
+        return;
+
+    AllocatorStats stats;
+    if (!GetAllocatorStats(stats) || stats.active <= stats.allocated)
+        return;
+
+    const std::size_t fragBytes = stats.active - stats.allocated;
+    if (fragBytes < purgedFragBytes_)
+        purgedFragBytes_ = fragBytes;
+
+    if (fragBytes < g_config.activeDefragIgnoreBytes ||
+        fragBytes * 100 < stats.allocated * g_config.activeDefragThresholdLower)
+        return;
+
+    if (!DefragSupported())
+    {
+        // the blocks can't be moved, just give back the free pages, and
+        // again only if it's fragmented more
+        if (fragBytes < purgedFragBytes_ + g_config.activeDefragIgnoreBytes && purgedFragBytes_ != 0)
+            return;
+
+        PurgeAllocator();
+        USR << "Fragmented " << fragBytes << " bytes, purge allocator, rss "
+            << stats.resident << " -> " << getMemoryInfo(VmRSS);
+        purgedFragBytes_ = fragBytes;
+        return;
+    }
+
+    USR << "Fragmented " << fragBytes << " bytes, start active defrag";
+    StartDefrag();
+}
+
+void QStore::StartDefrag()
+{
+    // the shards may be in the cycle
+    QAllShardsGuard guard;
+
+    for (int i = 0; i < shards_; ++ i)
+    {
+        DefragState& state = defragStates_[i];
+        state.done = false;
+        state.dbno = 0;
+        state.cursor = 0;
+        state.values.clear();
+        state.valueCursor = 0;
+    }
+
+    defragShardsLeft_ = shards_;
+    defragRunning_ = true;
+}
+
+void QStore::ActiveDefragCycle(int shard)
+{
+    if (!defragRunning_)
+        return;
+
+    DefragState& state = defragStates_[shard];
+    if (state.done)
+        return;
+
+    // called every ms, like the expire cycle
+    const uint64_t end = NowUs() + g_config.activeDefragCycleMax * 10;
+    const int dbNum = static_cast<int>(store_.size());
+    QDefragger defragger;
+
+    auto moveKey = [&](QDB::value_type* node) -> QDB::value_type* {
+        QDB::value_type* res = nullptr;
+        if (defragger.NodeHint(node, node->first))
+        {
+            res = new QDB::value_type(node->first, std::move(node->second));
+            // the key entry is not moved with the value
+            res->second.expire = node->second.expire;
+            res->second.dirty = node->second.dirty;
+            delete node;
+        }
+
+        QDB::value_type* kv = res ? res : node;
+        QObject& obj = kv->second;
+        if (obj.encoding == QEncode_set || obj.encoding == QEncode_hash)
+            state.values.push_back(std::make_pair(state.dbno, kv->first));
+        else
+            defragger.Value(obj);
+
+        return res;
+    };
+
+    // check clock every 16 buckets
+    for (int n = 1; (n & 0xf) || NowUs() < end; ++ n)
+    {
+        if (!state.values.empty())
+        {
+            _DefragValueStep(state, shard, defragger);
+        }
+        else if (state.dbno == dbNum)
+        {
+            state.done = true;
+            break;
+        }
+        else
+        {
+            state.cursor = store_[state.dbno][shard].ScanDefrag(state.cursor, moveKey);
+            if (state.cursor == 0)
+                ++ state.dbno;
+        }
+    }
+
+    defragHits_ += defragger.hits;
+    defragMisses_ += defragger.misses;
+
+    // the last shard returns the free pages
+    if (state.done && -- defragShardsLeft_ == 0)
+    {
+        PurgeAllocator();
+        defragRunning_ = false;
+    }
+}
+
+void QStore::_DefragValueStep(DefragState& state, int shard, QDefragger& defragger)
+{
+    const auto& value = state.values.front();
+    QDB& db = store_[value.first][shard];
+
+    // it may be deleted or converted since
+    auto it = db.find(value.second);
+    if (it != db.end() && it->second.encoding == QEncode_set)
+        state.valueCursor = defragger.ScanDict(*it->second.CastSet(), state.valueCursor);
+    else if (it != db.end() && it->second.encoding == QEncode_hash)
+        state.valueCursor = defragger.ScanDict(*it->second.CastHash(), state.valueCursor);
+    else
+        state.valueCursor = 0;
+
+    if (state.valueCursor == 0)
+        state.values.pop_front();
+}
+
 void QStore::InitDumpBackends()
 {
     assert (waitSyncKeys_.empty());
@@ -792,7 +1579,7 @@ void QStore::InitDumpBackends()
 
     if (g_config.backend == BackEndLeveldb)
     {
-        waitSyncKeys_.resize(store_.size());
+        waitSyncKeys_.assign(store_.size(), std::vector<ToSyncDb>(shards_));
         for (size_t i = 0; i < store_.size(); ++ i)
         {
             std::unique_ptr<QLeveldb> db(new QLeveldb);
@@ -832,31 +1619,51 @@ void  QStore::DumpToBackends(int dbno)
 
     const int kMaxSync = 100;
     int processed = 0;
-    auto& dirtyKeys = waitSyncKeys_[dbno];
             
     uint64_t now = ::Now();
-    for (auto it = dirtyKeys.begin(); processed++ < kMaxSync && it != dirtyKeys.end(); )
+    for (int shard = 0; shard < shards_; ++ shard)
     {
-        // check ttl
-        int64_t when = QSTORE.TTL(it->first, now);
+        auto& db = store_[dbno][shard];
+        auto& toSync = waitSyncKeys_[dbno][shard];
 
-        if (it->second && when != QStore::ExpireResult::expired)
+        for (; processed < kMaxSync && !toSync.updated.empty(); ++ processed)
         {
-            assert (when != QStore::ExpireResult::notExpire);
+            const QString& key = toSync.updated.back();
 
-            if (when > 0)
-                when += now;
+            // not dirty if synced by a duplicated one, or deleted
+            auto it(db.find(key));
+            if (it != db.end() && it->second.dirty)
+            {
+                QObject& obj = it->second;
+                obj.dirty = 0;
 
-            backends_[dbno]->Put(it->first, *it->second, when);
-            DBG << "UPDATE leveldb key " << it->first << ", when = " << when;
+                if (obj.expire == 0 || obj.expire > now)
+                {
+                    int64_t when = obj.expire ? static_cast<int64_t>(obj.expire) : QStore::ExpireResult::persist;
+                    backends_[dbno]->Put(key, obj, when);
+                    DBG << "UPDATE leveldb key " << key << ", when = " << when;
+                }
+                else
+                {
+                    backends_[dbno]->Delete(key);
+                    DBG << "DELETE leveldb key " << key;
+                }
+            }
+
+            toSync.updated.pop_back();
         }
-        else
+
+        for (auto it = toSync.deleted.begin(); processed < kMaxSync && it != toSync.deleted.end(); ++ processed)
         {
-            backends_[dbno]->Delete(it->first);
-            DBG << "DELETE leveldb key " << it->first;
+            // may be set again
+            if (!db.count(*it))
+            {
+                backends_[dbno]->Delete(*it);
+                DBG << "DELETE leveldb key " << *it;
+            }
+
+            it = toSync.deleted.erase(it);
         }
-            
-        it = dirtyKeys.erase(it);
     }
 }
    
@@ -865,25 +1672,35 @@ void QStore::AddDirtyKey(const QString& key)
     // put this key to sync list
     if (!waitSyncKeys_.empty())
     {
-        QObject* obj = nullptr;
-        GetValue(key, obj);
-        waitSyncKeys_[dbno_][key] = obj;
+        const int shard = ShardOf(key);
+        QObject* obj = _FindObject(key, shard);
+        if (obj)
+            _MarkDirty(key, *obj, shard);
+        else
+            waitSyncKeys_[dbno_][shard].deleted.insert(key);
     }
 }
-    
-void QStore::AddDirtyKey(const QString& key, const QObject* value)
+
+void QStore::_MarkDirty(const QString& key, QObject& obj, int shard)
 {
-    // put this key to sync list
-    if (!waitSyncKeys_.empty())
-        waitSyncKeys_[dbno_][key] = value;
+    if (!obj.dirty)
+    {
+        obj.dirty = 1;
+        waitSyncKeys_[dbno_][shard].updated.push_back(key);
+    }
 }
 
-std::vector<QString>  g_dirtyKeys;
+thread_local std::vector<QString>  g_dirtyKeys;
+
+// shard workers propogate concurrently
+static std::mutex  s_propogateMutex;
 
 void Propogate(const std::vector<QString>& params)
 {
     assert (!params.empty());
 
+    std::lock_guard<std::mutex>  guard(s_propogateMutex);
+
     if (!g_dirtyKeys.empty())
     {
         for (const auto& k : g_dirtyKeys)
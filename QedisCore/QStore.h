@@ -6,17 +6,25 @@
 #include "QSortedSet.h"
 #include "QHash.h"
 #include "QList.h"
+#include "QZipList.h"
 #include "Timer.h"
 #include "QDumpInterface.h"
+#include "QDefrag.h"
 
 #include <vector>
 #include <map>
+#include <list>
+#include <deque>
+#include <unordered_set>
 #include <memory>
+#include <atomic>
 
 namespace qedis
 {
 
 using PSTRING = QString*;
+using PEMBSTRING = QEmbString*;
+using PSHAREDSTRING = SharedString*;
 using PLIST = QList*;
 using PSET = QSet*;
 using PSSET = QSortedSet*;
@@ -26,18 +34,29 @@ using PHASH = QHash*;
 static const int kLRUBits = 24;
 static const uint32_t kMaxLRUValue = (1 << kLRUBits) - 1;
 
+// For the lfu policies, lru keeps the access time in minutes of 16 bits and
+// a logarithmic counter of 8 bits, which is decreased as time passes.
+static const uint8_t kLFUInitVal = 5;
+
 uint32_t EstimateIdleTime(uint32_t lru);
+uint8_t  LFUDecrAndReturn(uint32_t lru);
 
 struct QObject
 {
 public:
     static uint32_t lruclock;
+    static uint32_t lfuclock; // minutes
 
     unsigned int type : 4;
     unsigned int encoding : 4;
     unsigned int lru : kLRUBits;
 
+    // The key entry of db: they are not moved with the value, so SetValue
+    // keeps the ttl, and commands find the deadline with the same lookup.
+    unsigned int dirty : 1; // wait to sync to backend
+
     void* value;
+    uint64_t expire; // absolute ms, 0 if persist
     
     explicit
     QObject(QType = QType_invalid);
@@ -51,6 +70,9 @@ public:
     
     void Clear();
     void Reset(void* newvalue = nullptr);
+
+    // update lru when accessed, the counter of a new key starts at kLFUInitVal
+    void Touch(bool created = false);
     
     static QObject CreateString(const QString& value);
     static QObject CreateString(long value);
@@ -60,10 +82,14 @@ public:
     static QObject CreateHash();
     
     PSTRING  CastString()       const { return reinterpret_cast<PSTRING>(value); }
+    PEMBSTRING CastEmbString()  const { return reinterpret_cast<PEMBSTRING>(value); }
+    PSHAREDSTRING CastSharedString() const { return reinterpret_cast<PSHAREDSTRING>(value); }
     PLIST    CastList()         const { return reinterpret_cast<PLIST>(value);   }
     PSET     CastSet()          const { return reinterpret_cast<PSET>(value);    }
     PSSET    CastSortedSet()    const { return reinterpret_cast<PSSET>(value); }
     PHASH    CastHash()         const { return reinterpret_cast<PHASH>(value);   }
+    PZIPLIST CastZipList()      const { return reinterpret_cast<PZIPLIST>(value); }
+    PINTSET  CastIntset()       const { return reinterpret_cast<PINTSET>(value); }
    
 private:
     void _MoveFrom(QObject&& obj);
@@ -72,13 +98,15 @@ private:
 
 class QClient;
 
-using QDB = std::unordered_map<QString, QObject,
-                               my_hash,
-                               std::equal_to<QString> >;
+using QDB = QDict<QString, QObject, my_hash>;
 
 
 const int kMaxDbNum = 65536;
 
+// Keys are mapped to slots like redis cluster, and slots to shards
+const int kSlots = 16384;
+int KeySlot(const QString& key);
+
 class QStore
 {
 public:
@@ -87,24 +115,52 @@ public:
     QStore(const QStore& ) = delete;
     void operator= (const QStore& ) = delete;
     
-    void Init(int dbNum = 16);
+    void Init(int dbNum = 16, int shards = 1);
 
     int SelectDB(int dbno);
     int GetDB() const;
+
+    // Every db is split into shards by key slot, see QShards
+    int ShardCount() const { return shards_; }
+    int ShardOf(const QString& key) const
+    {
+        return shards_ == 1 ? 0 : KeySlot(key) % shards_;
+    }
     
     // Key operation
-    bool DeleteKey(const QString& key);
+    // lazy: a big value is freed in background, see QLazyFree
+    bool DeleteKey(const QString& key, bool lazy = false);
     bool ExistsKey(const QString& key) const;
     QType  KeyType(const QString& key) const;
     QString RandomKey(QObject** val = nullptr) const;
-    size_t DBSize() const { return store_[dbno_].size(); }
-    size_t ScanKey(size_t cursor, size_t count, std::vector<QString>& res) const;
+    size_t DBSize() const;
+    // pattern and type are optional filters, see ScanHashMember
+    size_t ScanKey(size_t cursor, size_t count, const QString* pattern, QType type,
+                   std::vector<QString>& res) const;
+
+    // iterate the shards of current db one by one
+    class const_iterator
+    {
+    public:
+        const_iterator(const std::vector<QDB>* shards, size_t shard);
 
-    // iterator
-    QDB::const_iterator begin() const   { return store_[dbno_].begin(); }
-    QDB::const_iterator end()   const   { return store_[dbno_].end(); }
-    QDB::iterator       begin()         { return store_[dbno_].begin(); }
-    QDB::iterator       end()           { return store_[dbno_].end(); }
+        const QDB::value_type& operator* () const { return *it_; }
+        const QDB::value_type* operator->() const { return &*it_; }
+        const_iterator& operator++ ();
+
+        bool operator== (const const_iterator& other) const;
+        bool operator!= (const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        void _SkipEmptyShards();
+
+        const std::vector<QDB>* shards_;
+        size_t shard_;
+        QDB::const_iterator it_;
+    };
+
+    const_iterator begin() const { return const_iterator(&store_[dbno_], 0); }
+    const_iterator end()   const { return const_iterator(&store_[dbno_], store_[dbno_].size()); }
     
     const QObject* GetObject(const QString& key) const;
     QError GetValue(const QString& key, QObject*& value, bool touch = true);
@@ -112,7 +168,7 @@ public:
     // do not update lru time
     QError  GetValueByTypeNoTouch(const QString& key, QObject*& value, QType type = QType_invalid);
 
-    QObject* SetValue(const QString& key, QObject&& value);
+    QObject* SetValue(const QString& key, QObject&& value, bool keepTtl = true);
 
     // for expire key
     enum ExpireResult : std::int8_t
@@ -122,16 +178,21 @@ public:
         expired  = -2,
         notExist = -2,
     };
-    void    SetExpire(const QString& key, uint64_t when) const;
+    // false if key not exists
+    bool    SetExpire(const QString& key, uint64_t when) const;
     void    SetExpireAfter(const QString& key, uint64_t ttl) const;
     int64_t TTL(const QString& key, uint64_t now);
     bool    ClearExpire(const QString& key);
-    int     LoopCheckExpire(uint64_t now);
+    // delete the expired keys of all dbs in a cpu time budget
+    int     ActiveExpireCycle(uint64_t now, int shard = 0);
     void    InitExpireTimer();
+    void    OnInfoCommand(UnboundedBuffer& res);
+    // incremental rehash of db in cron, see QDict
+    void    LoopRehash(int shard = 0);
     
-    // danger cmd
-    void    ClearCurrentDB() { store_[dbno_].clear(); }
-    void    ResetDb();
+    // danger cmd, async frees the keys in background
+    void    ClearCurrentDB(bool async = false);
+    void    ResetDb(bool async = false);
     
     // for blocked list
     bool    BlockClient(const QString& key,
@@ -140,47 +201,115 @@ public:
                         ListPosition pos,
                         const QString* dstList = 0);
     size_t  UnblockClient(QClient* client);
-    size_t  ServeClient(const QString& key, const PLIST& list);
+    size_t  ServeClient(const QString& key, QObject* list);
     
-    int     LoopCheckBlocked(uint64_t now);
+    int     LoopCheckBlocked(uint64_t now, int shard = 0);
     void    InitBlockedTimer();
     
     size_t  BlockedSize() const;
     
     static  int dirty_;
 
-    // eviction timer for lru
+    // evict keys by maxmemory-policy until used memory is under maxmemory,
+    // before write commands. shard is the one of calling worker, or -1 with
+    // all the shards locked.
+    // false if over maxmemory but nothing can be evicted, or noeviction
+    bool    EvictIfNeeded(int shard = 0);
+    // lru clock
     void    InitEvictionTimer();
+
+    // Active defrag: if the allocator is fragmented, DefragCron of main
+    // thread starts a pass over the keyspace, then every shard moves its keys
+    // and values in a cpu budget by ActiveDefragCycle, see QDefragger
+    void    DefragCron();
+    void    StartDefrag();
+    bool    IsDefragRunning() const { return defragRunning_; }
+    void    ActiveDefragCycle(int shard = 0);
     // for backends
     void    InitDumpBackends();
     void    DumpToBackends(int dbno);
     void    AddDirtyKey(const QString& key);
-    void    AddDirtyKey(const QString& key, const QObject* value);
     
 private:
-    QStore() : dbno_(0)
+    QStore() : shards_(1)
     {
     }
     
     QError  _GetValueByType(const QString& key, QObject*& value, QType type = QType_invalid, bool touch = true);
 
-    ExpireResult    _ExpireIfNeed(const QString& key, uint64_t now);
+    QObject*  _FindObject(const QString& key, int shard) const;
+    bool    _ExpireIfNeed(const QString& key, QObject& obj, int shard, uint64_t now);
+    void    _SetExpire(const QString& key, QObject& obj, int shard, uint64_t when) const;
+    bool    _ClearExpire(QObject& obj, int shard) const;
+    void    _MarkDirty(const QString& key, QObject& obj, int shard);
     
+    // Index of the keys with ttl, the deadlines are in the key entries
     class ExpiresDB
     {
     public:
-        void SetExpire(const QString& key, uint64_t when);
-        int64_t TTL(const QString& key, uint64_t now);
-        bool ClearExpire(const QString& key);
-        ExpireResult ExpireIfNeed(const QString& key, uint64_t now);
+        // obj.expire is already updated from old to when
+        void Add(const QDB& db, const QString& key, uint64_t old, uint64_t when);
+        void Remove(const QDB& db);
 
-        int LoopCheck(uint64_t now);
+        // delete the keys of passed seconds until the budget is used up
+        int ActiveExpire(QDB& db, uint64_t now, uint64_t budgetEndUs, bool& timeout);
+        // expired keys still in memory, roughly
+        std::size_t DueKeys(uint64_t now) const;
+        // the live keys expire soonest, at most count of them
+        void Soonest(const QDB& db, int count, std::vector<const QDB::value_type*>& res);
+        std::size_t Size() const { return size_; }
+        void Clear(bool async = false);
         
     private:
-        using Q_EXPIRE_DB = std::unordered_map<QString, uint64_t,
-                                    my_hash,
-                                    std::equal_to<QString> >;
-        Q_EXPIRE_DB expireKeys_;  // all the keys to be expired, unorder.
+        void _Unindex(const QDB& db);
+
+        // keys bucketed by the second of deadline. When a key's ttl changes,
+        // its old entry is left as garbage, dropped lazily or by compaction
+        std::map<uint64_t, std::vector<QString> > index_;
+        std::size_t size_ = 0;
+        std::size_t garbage_ = 0;
+    };
+
+    // Candidates of eviction, kept between the evictions like redis, so the
+    // best keys of several sampling rounds are evicted, not of the latest one
+    class EvictionPool
+    {
+    public:
+        struct Candidate
+        {
+            uint64_t idle; // the greater, the better to evict
+            int      dbno;
+            QString  key;
+        };
+
+        // keep the best kSize ones
+        void Insert(uint64_t idle, int dbno, const QString& key);
+        // the best one, false if empty
+        bool Pop(Candidate& best);
+
+        static const std::size_t kSize = 16;
+        int nextDb = 0; // for random policies
+
+    private:
+        std::vector<Candidate> candidates_; // by idle ascending
+    };
+
+    bool    _SelectEvictKey(int shard, int& dbno, QString& key);
+    void    _PopulateEvictionPool(int dbno, int shard, EvictionPool& pool);
+
+    // one per shard, counters are read by INFO of main thread
+    struct ExpireStat
+    {
+        std::atomic<uint64_t> expired {0};
+        std::atomic<uint64_t> expiredPerSec {0};
+        std::atomic<uint64_t> cycleUs {0};
+        std::atomic<int> stalePermille {0};
+
+        // only touched by the cron
+        int nextDb = 0;
+        int budgetUs = 0;
+        uint64_t lastSample = 0;
+        uint64_t lastExpired = 0;
     };
     
     class BlockedClients
@@ -192,7 +321,7 @@ private:
                             ListPosition  pos,
                             const QString* dstList = 0);
         size_t UnblockClient(QClient* client);
-        size_t ServeClient(const QString& key, const PLIST& list);
+        size_t ServeClient(const QString& key, QObject* list);
         
         int LoopCheck(uint64_t now);
         size_t Size() const { return blockedClients_.size(); }
@@ -206,22 +335,57 @@ private:
     QError _SetValue(const QString& key, QObject& value, bool exclusive = false);
 
     // Because GetObject() must be const, so mutable them
-    mutable std::vector<QDB> store_;
-    mutable std::vector<ExpiresDB> expiresDb_;
-    std::vector<BlockedClients> blockedClients_;
+    // All indexed by [dbno][shard]
+    mutable std::vector<std::vector<QDB> > store_;
+    mutable std::vector<std::vector<ExpiresDB> > expiresDb_;
+    std::unique_ptr<ExpireStat[]> expireStats_;
+    std::unique_ptr<EvictionPool[]> evictionPools_;
+    std::vector<std::vector<BlockedClients> > blockedClients_;
     std::vector<std::unique_ptr<QDumpInterface> > backends_;
         
-    using ToSyncDb = std::unordered_map<QString, const QObject* ,
-                                        my_hash,
-                                        std::equal_to<QString> >;
-    std::vector<ToSyncDb> waitSyncKeys_;
-    int dbno_;
+    // keys wait to sync to backend, the updated ones are marked dirty
+    // in their entries, so they are queued only once
+    struct ToSyncDb
+    {
+        std::vector<QString> updated;
+        std::unordered_set<QString, my_hash> deleted;
+    };
+    std::vector<std::vector<ToSyncDb> > waitSyncKeys_;
+    int shards_;
+
+    // bound the work of a write command
+    static const int kMaxEvictKeys = 64;
+    int nextEvictShard_ = 0; // main thread evicts the shards in turn
+    std::atomic<uint64_t> evictedKeys_ {0};
+
+    // one per shard, where the pass of defrag is
+    struct DefragState
+    {
+        bool done = true;
+        int dbno = 0;
+        std::size_t cursor = 0;
+        // sets and hashes met, their elements are moved by their own cursor
+        std::deque<std::pair<int, QString> > values;
+        std::size_t valueCursor = 0;
+    };
+    // one bucket of the first value
+    void    _DefragValueStep(DefragState& state, int shard, QDefragger& defragger);
+
+    std::unique_ptr<DefragState[]> defragStates_;
+    std::atomic<bool> defragRunning_ {false};
+    std::atomic<int> defragShardsLeft_ {0};
+    std::atomic<uint64_t> defragHits_ {0};
+    std::atomic<uint64_t> defragMisses_ {0};
+    std::size_t purgedFragBytes_ = 0; // without defrag hint, only purge
+
+    // every thread executing commands has its own current db
+    static __thread int dbno_;
 };
 
 #define QSTORE  QStore::Instance()
 
 // ugly, but I don't want to write signalModifiedKey() every where
-extern std::vector<QString> g_dirtyKeys;
+extern thread_local std::vector<QString> g_dirtyKeys;
 extern void Propogate(const std::vector<QString>& params);
 extern void Propogate(int dbno, const std::vector<QString>& params);
     
@@ -1,7 +1,13 @@
 #include "QString.h"
 #include "QStore.h"
+#include "QConfig.h"
+#include "QMemory.h"
 #include "Log/Logger.h"
 #include <cassert>
+#include <cstring>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
 
 namespace qedis
 {
@@ -17,6 +23,17 @@ QObject QObject::CreateString(const QString& value)
         obj.value = (void*)val;
         DBG << "set long value " << val;
     }
+    else if (value.size() <= static_cast<std::size_t>(g_config.stringMaxEmbeddedValue))
+    {
+        obj.encoding = QEncode_embstr;
+        obj.value = QEmbString::Create(value.data(), value.size());
+    }
+    else if (g_config.stringMinSharedValue > 0 &&
+             value.size() >= static_cast<std::size_t>(g_config.stringMinSharedValue))
+    {
+        obj.encoding = QEncode_sharedstr;
+        obj.value = CreateSharedString(value.data(), value.size());
+    }
     else
     {
         obj.encoding = QEncode_raw;
@@ -36,6 +53,40 @@ QObject QObject::CreateString(long val)
     return obj;
 }
 
+QEmbString* QEmbString::Create(const char* data, std::size_t size)
+{
+    QEmbString* s = reinterpret_cast<QEmbString* >(zmalloc(offsetof(QEmbString, data) + size + 1));
+    s->size = static_cast<uint32_t>(size);
+    memcpy(s->data, data, size);
+    s->data[size] = '\0';
+
+    return s;
+}
+
+void QEmbString::Free(QEmbString* s)
+{
+    zfree(s);
+}
+
+static void FreeSharedString(SharedString* s)
+{
+    s->~SharedString();
+    zfree(s);
+}
+
+SharedString* CreateSharedString(const char* data, std::size_t size)
+{
+    void* mem = zmalloc(offsetof(SharedString, data) + size + 1);
+
+    SharedString* s = new (mem) SharedString;
+    s->refs = 1;
+    s->deleter = &FreeSharedString;
+    s->size = size;
+    memcpy(s->data, data, size);
+    s->data[size] = '\0';
+
+    return s;
+}
     
 static void DeleteString(QString* s)
 {
@@ -61,6 +112,17 @@ std::unique_ptr<QString, void (*)(QString* )>
         snprintf(vbuf, sizeof vbuf - 1, "%ld",  val);
         return std::unique_ptr<QString, void (*)(QString* )>(new QString(vbuf), DeleteString);
     }
+    else if (value->encoding == QEncode_embstr)
+    {
+        // a copy, call GetStringView if only to read
+        const QEmbString* emb = value->CastEmbString();
+        return std::unique_ptr<QString, void (*)(QString* )>(new QString(emb->data, emb->size), DeleteString);
+    }
+    else if (value->encoding == QEncode_sharedstr)
+    {
+        const SharedString* str = value->CastSharedString();
+        return std::unique_ptr<QString, void (*)(QString* )>(new QString(str->data, str->size), DeleteString);
+    }
     else
     {
         assert (!!!"error string encoding");
@@ -69,6 +131,30 @@ std::unique_ptr<QString, void (*)(QString* )>
     return std::unique_ptr<QString, void (*)(QString* )>(nullptr, NotDeleteString);
 }
 
+QStringView GetStringView(const QObject* value, char (&buf)[32])
+{
+    switch (value->encoding)
+    {
+        case QEncode_raw:
+            return QStringView(*value->CastString());
+
+        case QEncode_embstr:
+            return value->CastEmbString()->View();
+
+        case QEncode_sharedstr:
+            return QStringView(value->CastSharedString()->data, value->CastSharedString()->size);
+
+        case QEncode_int:
+            return QStringView(buf, snprintf(buf, sizeof buf, "%ld", (intptr_t)value->value));
+
+        default:
+            assert (!!!"error string encoding");
+            break;
+    }
+
+    return QStringView();
+}
+
 static bool SetValue(const QString& key, const QString& value, bool exclusive = false)
 {
     if (exclusive)
@@ -78,8 +164,8 @@ static bool SetValue(const QString& key, const QString& value, bool exclusive =
             return false;
     }
 
-    QSTORE.ClearExpire(key); // clear key's old ttl
-    QSTORE.SetValue(key, QObject::CreateString(value));
+    // clear key's old ttl
+    QSTORE.SetValue(key, QObject::CreateString(value), false);
 
     return true;
 }
@@ -205,17 +291,20 @@ QError setrange(const std::vector<QString>& params, UnboundedBuffer* reply)
         }
     }
 
-    auto str = GetDecodedString(value);
+    // modified in place from now on
+    if (value->encoding != QEncode_raw)
+    {
+        char buf[32];
+        QStringView view = GetStringView(value, buf);
+        value->Reset(new QString(view.data, view.size));
+        value->encoding = QEncode_raw;
+    }
+
+    PSTRING str = value->CastString();
     const size_t newSize = offset + params[3].size();
 
     if (newSize > str->size())  str->resize(newSize, '\0');
     str->replace(offset, params[3].size(), params[3]);
-    
-    if (value->encoding == QEncode_int)
-    {
-        value->Reset(new QString(*str));
-        value->encoding = QEncode_raw;
-    }
 
     FormatInt(static_cast<long>(str->size()), reply);
     return QError_ok;
@@ -224,8 +313,15 @@ QError setrange(const std::vector<QString>& params, UnboundedBuffer* reply)
 
 static void AddReply(QObject* value, UnboundedBuffer* reply)
 {
-    auto str = GetDecodedString(value);
-    FormatBulk(str->c_str(), str->size(), reply);
+    if (value->encoding == QEncode_sharedstr)
+    {
+        FormatBulk(value->CastSharedString(), reply);
+        return;
+    }
+
+    char buf[32];
+    QStringView str = GetStringView(value, buf);
+    FormatBulk(str.data, str.size, reply);
 }
 
 QError get(const std::vector<QString>& params, UnboundedBuffer* reply)
@@ -284,11 +380,12 @@ QError getrange(const std::vector<QString>& params, UnboundedBuffer* reply)
         return QError_nan;
     }
 
-    auto str = GetDecodedString(value);
-    AdjustIndex(start, end, str->size());
+    char buf[32];
+    QStringView str = GetStringView(value, buf);
+    AdjustIndex(start, end, str.size);
 
     if (start <= end)
-        FormatBulk(&(*str)[start], end - start + 1, reply);
+        FormatBulk(str.data + start, end - start + 1, reply);
     else
         FormatEmptyBulk(reply);
 
@@ -309,7 +406,7 @@ QError  getset(const std::vector<QString>& params, UnboundedBuffer* reply)
         if (!value)
             FormatNull(reply);
         else    
-            FormatBulk(*GetDecodedString(value), reply);
+            AddReply(value, reply);
 
         QSTORE.SetValue(params[1], QObject::CreateString(params[2]));
         break;
@@ -331,8 +428,13 @@ QError  append(const std::vector<QString>& params, UnboundedBuffer* reply)
     {
     case QError_ok:
         {
-            auto s = GetDecodedString(value);
-            value = QSTORE.SetValue(params[1], QObject::CreateString(*s + params[2]));
+            char buf[32];
+            QStringView old = GetStringView(value, buf);
+
+            QString s;
+            s.reserve(old.size + params[2].size());
+            s.append(old.data, old.size).append(params[2]);
+            value = QSTORE.SetValue(params[1], QObject::CreateString(s));
         }
         break;
 
@@ -345,8 +447,8 @@ QError  append(const std::vector<QString>& params, UnboundedBuffer* reply)
         return err;
     };
 
-    auto s = GetDecodedString(value);
-    FormatInt(static_cast<long>(s->size()), reply);
+    char buf[32];
+    FormatInt(static_cast<long>(GetStringView(value, buf).size), reply);
     return QError_ok;
 }
 
@@ -382,13 +484,14 @@ QError bitcount(const std::vector<QString>& params, UnboundedBuffer* reply)
         }
     }
 
-    auto str = GetDecodedString(value);
-    AdjustIndex(start, end, str->size());
+    char buf[32];
+    QStringView str = GetStringView(value, buf);
+    AdjustIndex(start, end, str.size);
 
     size_t cnt = 0;
     if (end >= start)
     {
-        cnt = BitCount((const uint8_t*)str->data() + start,  end - start + 1);
+        cnt = BitCount((const uint8_t*)str.data + start,  end - start + 1);
     }
 
     FormatInt(static_cast<long>(cnt), reply);
@@ -412,9 +515,10 @@ QError getbit(const std::vector<QString>& params, UnboundedBuffer* reply)
         return QError_nan;
     }
     
-    auto str = GetDecodedString(value);
-    const uint8_t* buf = (const uint8_t*)str->c_str();
-    size_t  size = 8 * str->size();
+    char tmp[32];
+    QStringView str = GetStringView(value, tmp);
+    const uint8_t* buf = (const uint8_t*)str.data;
+    size_t  size = 8 * str.size;
 
     if (offset < 0 || offset >= static_cast<long>(size))
     {
@@ -602,8 +706,8 @@ QError strlen(const std::vector<QString>& params, UnboundedBuffer* reply)
         return err;
     }
     
-    auto str = GetDecodedString(val);
-    FormatInt(static_cast<long>(str->size()), reply);
+    char buf[32];
+    FormatInt(static_cast<long>(GetStringView(val, buf).size), reply);
     return QError_ok;
 }
 
@@ -3,19 +3,56 @@
 
 #include <string>
 #include <memory>
+#include <cstdint>
+
+#include "SharedString.h"
 
 namespace qedis
 {
 
 using QString = std::string;
 
+// A slice of chars owned by others, like the std::string_view of c++17.
+struct QStringView
+{
+    const char*  data;
+    std::size_t  size;
+
+    QStringView() : data(nullptr), size(0) { }
+    QStringView(const char* d, std::size_t n) : data(d), size(n) { }
+    QStringView(const QString& s) : data(s.data()), size(s.size()) { }
+
+    bool empty() const { return size == 0; }
+    QString ToString() const { return QString(data, size); }
+};
+
 //typedef std::basic_string<char, std::char_traits<char>, Bert::Allocator<char> >  QString;
 
+// A short string value: the size and chars share one allocation, instead
+// of a QString object and the buffer it points to.
+struct QEmbString
+{
+    uint32_t size;
+    char     data[1]; // ends with '\0'
+
+    static QEmbString* Create(const char* data, std::size_t size);
+    static void Free(QEmbString* s);
+
+    QStringView View() const { return QStringView(data, size); }
+};
+
+// A big string value, replies reference it instead of copy.
+// It's never modified, setrange makes a raw string of it.
+SharedString* CreateSharedString(const char* data, std::size_t size);
+
 struct QObject;
 
 std::unique_ptr<QString, void (*)(QString* )>
 GetDecodedString(const QObject* value);
 
+// the chars of a string object without copy, int is formatted into buf
+QStringView GetStringView(const QObject* value, char (&buf)[32]);
+
 }
 
 #endif
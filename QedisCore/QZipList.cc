@@ -0,0 +1,142 @@
+#include "QZipList.h"
+#include "QCommon.h"
+#include "QMemory.h"
+#include <cstring>
+#include <cstdlib>
+#include <cassert>
+
+extern "C"
+{
+#include "redisZipList.h"
+}
+
+namespace qedis
+{
+
+static const unsigned char ZIP_END = 255;
+
+PZIPLIST ZipListNew()
+{
+    return ziplistNew();
+}
+
+void ZipListFree(PZIPLIST zl)
+{
+    zfree(zl);
+}
+
+PZIPLIST ZipListCopy(const char* blob, std::size_t len)
+{
+    PZIPLIST zl = static_cast<PZIPLIST>(zmalloc(len));
+    memcpy(zl, blob, len);
+    return zl;
+}
+
+std::size_t ZipListSize(PZIPLIST zl)
+{
+    return ziplistLen(zl);
+}
+
+std::size_t ZipListBytes(PZIPLIST zl)
+{
+    return ziplistBlobLen(zl);
+}
+
+unsigned char* ZipListFirst(PZIPLIST zl)
+{
+    return ziplistIndex(zl, 0);
+}
+
+unsigned char* ZipListLast(PZIPLIST zl)
+{
+    return ziplistIndex(zl, -1);
+}
+
+unsigned char* ZipListNext(PZIPLIST zl, unsigned char* p)
+{
+    return ziplistNext(zl, p);
+}
+
+unsigned char* ZipListPrev(PZIPLIST zl, unsigned char* p)
+{
+    return ziplistPrev(zl, p);
+}
+
+unsigned char* ZipListIndex(PZIPLIST zl, long index)
+{
+    return ziplistIndex(zl, static_cast<int>(index));
+}
+
+QString ZipListGet(unsigned char* p)
+{
+    assert (p);
+
+    unsigned char* sval = nullptr;
+    unsigned int   slen = 0;
+    long long      lval = 0;
+
+    int succ = ziplistGet(p, &sval, &slen, &lval);
+    assert (succ);
+    (void)succ;
+
+    if (sval)
+        return QString(reinterpret_cast<const char* >(sval), slen);
+
+    char buf[32];
+    auto len = Number2Str<long long>(buf, sizeof buf, lval);
+    return QString(buf, len);
+}
+
+bool ZipListEqual(unsigned char* p, const QString& str)
+{
+    return ziplistCompare(p, (unsigned char* )str.data(), static_cast<unsigned>(str.size())) != 0;
+}
+
+unsigned char* ZipListFind(PZIPLIST zl, const QString& str, unsigned skip)
+{
+    unsigned char* p = ziplistIndex(zl, 0);
+    if (!p)
+        return nullptr;
+
+    return ziplistFind(p, (unsigned char* )str.data(), static_cast<unsigned>(str.size()), skip);
+}
+
+PZIPLIST ZipListPush(PZIPLIST zl, const QString& str, bool tail)
+{
+    return ziplistPush(zl, (unsigned char* )str.data(), static_cast<unsigned>(str.size()),
+                       tail ? ZIPLIST_TAIL : ZIPLIST_HEAD);
+}
+
+PZIPLIST ZipListInsert(PZIPLIST zl, unsigned char* p, const QString& str)
+{
+    return ziplistInsert(zl, p, (unsigned char* )str.data(), static_cast<unsigned>(str.size()));
+}
+
+PZIPLIST ZipListDelete(PZIPLIST zl, unsigned char** p)
+{
+    zl = ziplistDelete(zl, p);
+    if (**p == ZIP_END)
+        *p = nullptr;
+
+    return zl;
+}
+
+PZIPLIST ZipListDeleteRange(PZIPLIST zl, std::size_t index, std::size_t num)
+{
+    return ziplistDeleteRange(zl, static_cast<unsigned>(index), static_cast<unsigned>(num));
+}
+
+PZIPLIST ZipListReplace(PZIPLIST zl, unsigned char** p, const QString& str)
+{
+    // ziplistDelete leaves *p pointing at the next entry, or the end mark
+    zl = ziplistDelete(zl, p);
+    std::size_t offset = *p - zl;
+
+    zl = ziplistInsert(zl, *p, (unsigned char* )str.data(), static_cast<unsigned>(str.size()));
+    *p = zl + offset;
+
+    return zl;
+}
+
+}
+
@@ -0,0 +1,43 @@
+#ifndef BERT_QZIPLIST_H
+#define BERT_QZIPLIST_H
+
+#include "QString.h"
+
+namespace qedis
+{
+
+// Thin wrappers over redis ziplist, which is the compact encoding
+// of small list, set, hash and sorted set.
+// Functions that may realloc return the new ziplist pointer.
+using PZIPLIST = unsigned char*;
+
+PZIPLIST        ZipListNew();
+void            ZipListFree(PZIPLIST zl);
+PZIPLIST        ZipListCopy(const char* blob, std::size_t len);
+
+std::size_t     ZipListSize(PZIPLIST zl);   // entries
+std::size_t     ZipListBytes(PZIPLIST zl);  // blob length
+
+unsigned char*  ZipListFirst(PZIPLIST zl);  // nullptr if empty
+unsigned char*  ZipListLast(PZIPLIST zl);   // nullptr if empty
+unsigned char*  ZipListNext(PZIPLIST zl, unsigned char* p);
+unsigned char*  ZipListPrev(PZIPLIST zl, unsigned char* p);
+unsigned char*  ZipListIndex(PZIPLIST zl, long index); // negative from tail
+
+QString         ZipListGet(unsigned char* p);
+bool            ZipListEqual(unsigned char* p, const QString& str);
+// search from head, skip entries between comparisons: 1 for key of pairs
+unsigned char*  ZipListFind(PZIPLIST zl, const QString& str, unsigned skip = 0);
+
+PZIPLIST        ZipListPush(PZIPLIST zl, const QString& str, bool tail = true);
+// insert before p, p may point to the end
+PZIPLIST        ZipListInsert(PZIPLIST zl, unsigned char* p, const QString& str);
+// *p is updated to the next entry, nullptr if there is no more
+PZIPLIST        ZipListDelete(PZIPLIST zl, unsigned char** p);
+PZIPLIST        ZipListDeleteRange(PZIPLIST zl, std::size_t index, std::size_t num);
+PZIPLIST        ZipListReplace(PZIPLIST zl, unsigned char** p, const QString& str);
+
+}
+
+#endif
+
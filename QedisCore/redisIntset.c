@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "redisIntset.h"
+#include "QMemory.h"
 
 #define memrev16ifbe(x)   (x)
 #define memrev32ifbe(x)   (x)
@@ -99,7 +100,7 @@ static void _intsetSet(intset *is, int pos, int64_t value) {
 
 /* Create an empty intset. */
 intset *intsetNew(void) {
-    intset *is = malloc(sizeof(intset));
+    intset *is = zmalloc(sizeof(intset));
     is->encoding = intrev32ifbe(INTSET_ENC_INT16);
     is->length = 0;
     return is;
@@ -108,7 +109,7 @@ intset *intsetNew(void) {
 /* Resize the intset */
 static intset *intsetResize(intset *is, uint32_t len) {
     uint32_t size = len*intrev32ifbe(is->encoding);
-    is = realloc(is,sizeof(intset)+size);
+    is = zrealloc(is,sizeof(intset)+size);
     return is;
 }
 
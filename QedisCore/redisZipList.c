@@ -107,7 +107,9 @@
 #include <stdint.h>
 #include <limits.h>
 #include <assert.h>
+#include <errno.h>
 #include "redisZipList.h"
+#include "QMemory.h"
 
 #define memrev32ifbe(x)   (x)
 #define intrev32ifbe(x)   (x)
@@ -313,16 +315,30 @@ static unsigned int zipRawEntryLength(unsigned char *p) {
     return prevlensize + lensize + len;
 }
 
+/* Only the canonical decimal form is accepted, like redis' string2ll, so
+ * that an integer entry is decoded to exactly the same string. */
 int Strtoll(const char* ptr, size_t nBytes, long long* outVal)
 {
-    if (nBytes == 0 || nBytes > 21)
+    if (nBytes == 0 || nBytes > 20)
         return 0;
-    
+
+    char buf[32];
+    memcpy(buf, ptr, nBytes);
+    buf[nBytes] = '\0';
+
     char* pEnd = 0;
-    long long ret = strtoll(ptr, &pEnd, 0);
-    
+    errno = 0;
+    long long ret = strtoll(buf, &pEnd, 10);
+    if (errno != 0 || pEnd != buf + nBytes)
+        return 0;
+
+    char canonical[32];
+    if (snprintf(canonical, sizeof canonical, "%lld", ret) != (int)nBytes ||
+        memcmp(canonical, buf, nBytes) != 0)
+        return 0;
+
     *outVal = ret;
-    return pEnd == ptr + nBytes;
+    return 1;
 }
 
 /* Check if string pointed to by 'entry' can be encoded as an integer.
@@ -429,7 +445,7 @@ static zlentry zipEntry(unsigned char *p) {
 /* Create a new empty ziplist. */
 unsigned char *ziplistNew(void) {
     unsigned int bytes = ZIPLIST_HEADER_SIZE+1;
-    unsigned char *zl = (unsigned char* )malloc(bytes);
+    unsigned char *zl = (unsigned char* )zmalloc(bytes);
     ZIPLIST_BYTES(zl) = intrev32ifbe(bytes);
     ZIPLIST_TAIL_OFFSET(zl) = intrev32ifbe(ZIPLIST_HEADER_SIZE);
     ZIPLIST_LENGTH(zl) = 0;
@@ -439,7 +455,7 @@ unsigned char *ziplistNew(void) {
 
 /* Resize the ziplist. */
 static unsigned char *ziplistResize(unsigned char *zl, unsigned int len) {
-    zl = (unsigned char* )realloc(zl,len);
+    zl = (unsigned char* )zrealloc(zl,len);
     ZIPLIST_BYTES(zl) = intrev32ifbe(len);
     zl[len-1] = ZIP_END;
     return zl;
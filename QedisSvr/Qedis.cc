@@ -10,6 +10,7 @@
 
 #include "Log/Logger.h"
 #include "Timer.h"
+#include "NetThreadPool.h"
 
 #include "QClient.h"
 #include "QSlaveClient.h"
@@ -21,8 +22,11 @@
 #include "QDB.h"
 #include "QAOF.h"
 #include "QConfig.h"
+#include "QMemory.h"
 #include "QSlowLog.h"
 #include "QModule.h"
+#include "QShard.h"
+#include "QLazyFree.h"
 
 #include "QedisLogo.h"
 #include "Qedis.h"
@@ -295,22 +299,31 @@ bool Qedis::_Init()
 
     QCommandTable::Init();
     QCommandTable::AliasCommand(g_config.aliases);
-    QSTORE.Init(g_config.databases);
-    QSTORE.InitExpireTimer();
-    QSTORE.InitBlockedTimer();
+    QSTORE.Init(g_config.databases, g_config.workerThreads);
+    if (g_config.workerThreads == 0)
+    {
+        // otherwise every shard worker checks its own
+        QSTORE.InitExpireTimer();
+        QSTORE.InitBlockedTimer();
+    }
     QSTORE.InitEvictionTimer();
     QSTORE.InitDumpBackends();
     QPubsub::Instance().InitPubsubTimer();
     QMigrationManager::Instance().InitMigrationTimer();
     
+    SetStartupMemory();
+
     // Only if there is no backend, load aof or rdb
     if (g_config.backend == qedis::BackEndNone)
         LoadDbFromDisk();
 
     QAOFThreadController::Instance().Start();
+    QLazyFree::Instance().Start();
 
     QSlowLog::Instance().SetThreshold(g_config.slowlogtime);
     QSlowLog::Instance().SetLogLimit(static_cast<std::size_t>(g_config.slowlogmaxlen));
+
+    QSHARDS.Start(g_config.workerThreads, g_config.busyPollUs > 0, g_config.workerCpus);
     
     {
         auto cronTimer = TimerManager::Instance().CreateTimer();
@@ -428,9 +441,19 @@ static void CheckChild()
 bool Qedis::_RunLogic()
 {
     g_now.Now();
-    TimerManager::Instance().UpdateTimers(g_now);
+
+    // timers are checked by milliseconds, don't lock shard workers needlessly
+    static uint64_t lastCheckMs = 0;
+    if (g_now.MilliSeconds() != lastCheckMs)
+    {
+        lastCheckMs = g_now.MilliSeconds();
+
+        // timers may touch the whole keyspace
+        qedis::QAllShardsGuard guard;
+        TimerManager::Instance().UpdateTimers(g_now);
     
-    CheckChild();
+        CheckChild();
+    }
     
     return Server::_RunLogic();
 }
@@ -439,7 +462,9 @@ bool Qedis::_RunLogic()
 void Qedis::_Recycle()
 {
     std::cerr << "Qedis::_Recycle: server is exiting.. BYE BYE\n";
+    qedis::QShards::Instance().Stop();
     qedis::QAOFThreadController::Instance().Stop();
+    qedis::QLazyFree::Instance().Stop();
 }
 
 
@@ -460,7 +485,14 @@ int main(int ac, char* av[])
             return -2;
         }
     }
-    
+
+    Internal::NetThreadPool::Instance().SetThreadNum(qedis::g_config.recvThreads,
+                                                     qedis::g_config.sendThreads);
+    Internal::NetThreadPool::Instance().SetIoUring(qedis::g_config.ioBackend == "io_uring");
+    Internal::NetThreadPool::Instance().SetBusyPoll(qedis::g_config.busyPollUs);
+    Internal::NetThreadPool::Instance().SetCpus(qedis::g_config.recvCpus, qedis::g_config.sendCpus);
+    svr.SetBusyPoll(qedis::g_config.busyPollUs > 0);
+    svr.SetLogicCpu(qedis::g_config.logicCpu);
     svr.MainLoop(qedis::g_config.daemonize);
     
     return 0;
@@ -0,0 +1,174 @@
+#include "UnitTest.h"
+#include "Buffer.h"
+#include "AsyncBuffer.h"
+#include <string>
+#include <thread>
+#include <cstdlib>
+#include <cstddef>
+
+TEST_CASE(bufferpool_reuse)
+{
+    BufferPool& pool = BufferPool::Instance();
+    EXPECT_TRUE(BufferPool::BlockSize(1) == BufferPool::kMinBlock);
+    EXPECT_TRUE(BufferPool::BlockSize(5000) == 8 * 1024);
+
+    const std::size_t used = pool.InUse();
+    char* block = pool.Acquire(5000);
+    EXPECT_TRUE(pool.InUse() == used + 8 * 1024);
+    pool.Release(block, 8 * 1024);
+    EXPECT_TRUE(pool.InUse() == used);
+
+    // the same class is taken from cache
+    const uint64_t reused = pool.Reused();
+    block = pool.Acquire(6000);
+    EXPECT_TRUE(pool.Reused() == reused + 1);
+    pool.Release(block, 8 * 1024);
+}
+
+TEST_CASE(pooledbuffer_resize)
+{
+    PooledBuffer buf;
+    EXPECT_TRUE(buf.Capacity() == 0);
+
+    buf.InitCapacity(4096);
+    std::string data(3000, 'a');
+    EXPECT_TRUE(buf.PushData(data.data(), data.size()));
+    buf.AdjustReadPtr(2000);
+
+    // wraps around
+    std::string more(2500, 'b');
+    EXPECT_TRUE(buf.PushData(more.data(), more.size()));
+
+    // the data are kept in the new buffer
+    EXPECT_TRUE(buf.Resize(16 * 1024));
+    EXPECT_TRUE(buf.Capacity() == 16 * 1024);
+    EXPECT_TRUE(buf.ReadableSize() == 3500);
+
+    std::string out(3500, '\0');
+    EXPECT_TRUE(buf.PeekData(&out[0], out.size()));
+    EXPECT_TRUE(out == std::string(1000, 'a') + more);
+
+    EXPECT_TRUE(!buf.Resize(1024) || buf.IsEmpty());
+
+    buf.Release();
+    EXPECT_TRUE(buf.Capacity() == 0);
+}
+
+TEST_CASE(asyncbuffer_release)
+{
+    const std::size_t used = BufferPool::Instance().InUse();
+
+    AsyncBuffer buf(16 * 1024);
+    std::string small(100, 's');
+    std::string big(200 * 1024, 'b');
+    buf.Write(small.data(), small.size());
+    buf.Write(big.data(), big.size());
+
+    // the big one spans chunks
+    std::string sent;
+    BufferSequence bf;
+    while (buf.ProcessBuffer(bf), bf.TotalBytes() > 0)
+    {
+        for (std::size_t i = 0; i < bf.count; ++ i)
+            sent.append(static_cast<const char*>(bf.buffers[i].iov_base), bf.buffers[i].iov_len);
+
+        buf.Skip(bf.TotalBytes());
+    }
+
+    EXPECT_TRUE(sent == small + big);
+
+    // nothing held when all sent
+    std::size_t bytes = 1, memory = 1;
+    buf.GetStats(bytes, memory);
+    EXPECT_TRUE(bytes == 0);
+    EXPECT_TRUE(memory == 0);
+    EXPECT_TRUE(BufferPool::Instance().InUse() == used);
+}
+
+TEST_CASE(asyncbuffer_publish)
+{
+    AsyncBuffer buf;
+    buf.Write("abc", 3, false);
+
+    BufferSequence bf;
+    buf.ProcessBuffer(bf);
+    EXPECT_TRUE(bf.TotalBytes() == 0);
+
+    buf.Write("de", 2, false);
+    buf.Publish();
+    buf.ProcessBuffer(bf);
+    EXPECT_TRUE(bf.TotalBytes() == 5);
+    buf.Skip(5);
+
+    buf.ProcessBuffer(bf);
+    EXPECT_TRUE(bf.TotalBytes() == 0);
+}
+
+TEST_CASE(asyncbuffer_spsc)
+{
+    const int kWrites = 100000;
+    AsyncBuffer buf(4 * 1024);
+
+    std::thread producer([&buf]() {
+        for (int i = 0; i < kWrites; ++ i)
+        {
+            const std::string s = std::to_string(i) + "\n";
+            buf.Write(s.data(), s.size(), i % 3 != 0);
+        }
+
+        buf.Publish();
+    });
+
+    std::string expect;
+    for (int i = 0; i < kWrites; ++ i)
+        expect += std::to_string(i) + "\n";
+
+    std::string sent;
+    BufferSequence bf;
+    while (sent.size() < expect.size())
+    {
+        buf.ProcessBuffer(bf);
+        for (std::size_t i = 0; i < bf.count; ++ i)
+            sent.append(static_cast<const char*>(bf.buffers[i].iov_base), bf.buffers[i].iov_len);
+
+        buf.Skip(bf.TotalBytes());
+    }
+
+    producer.join();
+    EXPECT_TRUE(sent == expect);
+}
+
+static bool s_freed = false;
+
+TEST_CASE(asyncbuffer_ref)
+{
+    const std::string value(100 * 1024, 'v');
+    auto str = static_cast<SharedString* >(::malloc(offsetof(SharedString, data) + value.size() + 1));
+    str->refs = 1;
+    str->deleter = [](SharedString* s) { s_freed = true; ::free(s); };
+    str->size = value.size();
+    memcpy(str->data, value.data(), value.size());
+
+    const std::string header = "$" + std::to_string(value.size()) + "\r\n";
+    AsyncBuffer buf;
+    buf.Write(header.data(), header.size(), false);
+    buf.Write(str, false);
+    buf.Write("\r\n", 2);
+
+    // the value is deleted, the buffer still holds it
+    str->Unref();
+    EXPECT_TRUE(!s_freed);
+
+    std::string sent;
+    BufferSequence bf;
+    while (buf.ProcessBuffer(bf), bf.TotalBytes() > 0)
+    {
+        for (std::size_t i = 0; i < bf.count; ++ i)
+            sent.append(static_cast<const char*>(bf.buffers[i].iov_base), bf.buffers[i].iov_len);
+
+        buf.Skip(bf.TotalBytes());
+    }
+
+    EXPECT_TRUE(sent == header + value + "\r\n");
+    EXPECT_TRUE(s_freed);
+}
@@ -0,0 +1,47 @@
+#include "UnitTest.h"
+#include "MPSCQueue.h"
+#include <thread>
+#include <vector>
+
+TEST_CASE(mpscqueue_producers)
+{
+    MPSCQueue<int> q;
+    EXPECT_TRUE(q.Empty());
+
+    const int kProducers = 4;
+    const int kItems = 100000;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++ p)
+    {
+        producers.emplace_back([&q, p]() {
+            for (int i = 0; i < kItems; ++ i)
+                q.Push(p * kItems + i);
+        });
+    }
+
+    // items of one producer are popped in order
+    std::vector<int> last(kProducers, -1);
+    int popped = 0;
+    bool ordered = true;
+    while (popped < kProducers * kItems)
+    {
+        int item;
+        if (!q.Pop(item))
+            continue;
+
+        const int p = item / kItems;
+        if (item % kItems != last[p] + 1)
+            ordered = false;
+
+        last[p] = item % kItems;
+        ++ popped;
+    }
+
+    for (auto& t : producers)
+        t.join();
+
+    EXPECT_TRUE(ordered);
+    EXPECT_TRUE(q.Empty());
+}
+
@@ -0,0 +1,36 @@
+#include "UnitTest.h"
+#include "QCommand.h"
+
+using namespace qedis;
+
+TEST_CASE(command_lookup)
+{
+    QCommandTable::Init();
+
+    const QCommandInfo* get = QCommandTable::GetCommandInfo("get");
+    EXPECT_TRUE(get && get->cmd == "get");
+    EXPECT_TRUE(QCommandTable::GetCommandInfo("GeT") == get);
+    EXPECT_TRUE(QCommandTable::GetCommandInfo("getx") == nullptr);
+    EXPECT_TRUE(QCommandTable::GetCommandInfo("ge") == nullptr);
+    EXPECT_TRUE(QCommandTable::GetCommandInfo("") == nullptr);
+
+    // slice of a request, no terminating zero
+    const char req[] = "ZRANGEBYSCOREzset";
+    const QCommandInfo* zrange = QCommandTable::GetCommandInfo(req, 13);
+    EXPECT_TRUE(zrange && zrange->cmd == "zrangebyscore");
+
+    // alias like rename-command, then back
+    EXPECT_TRUE(QCommandTable::AliasCommand("get", "myget"));
+    EXPECT_TRUE(QCommandTable::GetCommandInfo("get") == nullptr);
+    EXPECT_TRUE(QCommandTable::GetCommandInfo("MYGET") == get);
+    EXPECT_TRUE(QCommandTable::AliasCommand("myget", "get"));
+    EXPECT_TRUE(QCommandTable::GetCommandInfo("get") == get);
+
+    // like module commands
+    EXPECT_TRUE(QCommandTable::AddCommand("get2", get));
+    EXPECT_FALSE(QCommandTable::AddCommand("GET2", get));
+    EXPECT_TRUE(QCommandTable::GetCommandInfo("Get2") == get);
+    EXPECT_TRUE(QCommandTable::DelCommand("get2") == get);
+    EXPECT_TRUE(QCommandTable::GetCommandInfo("get2") == nullptr);
+}
+
@@ -0,0 +1,132 @@
+#include "UnitTest.h"
+#include "QDict.h"
+#include "QHelper.h"
+#include <map>
+#include <set>
+
+using namespace qedis;
+
+using Dict = QDict<QString, int, my_hash>;
+
+TEST_CASE(dict_incremental_rehash)
+{
+    Dict dict;
+    std::map<QString, int> expect;
+
+    // pointers are stable while growing
+    dict["key0"] = 0;
+    const int* first = &dict.find("key0")->second;
+
+    bool rehashed = false;
+    for (int i = 0; i < 10000; ++ i)
+    {
+        QString key("key" + std::to_string(i));
+        dict.emplace(key, i);
+        expect[key] = i;
+
+        if (dict.IsRehashing())
+        {
+            rehashed = true;
+            // both tables are looked up while rehashing
+            EXPECT_TRUE(dict.count("key0") == 1);
+        }
+
+        // erase some, leaving deleted slots
+        if (i % 3 == 0 && i > 0)
+        {
+            QString del("key" + std::to_string(i - 1));
+            dict.erase(del);
+            expect.erase(del);
+        }
+    }
+
+    EXPECT_TRUE(rehashed);
+    EXPECT_TRUE(dict.size() == expect.size());
+    EXPECT_TRUE(&dict.find("key0")->second == first);
+    EXPECT_TRUE(dict.find("key2") == dict.end());
+
+    std::size_t n = 0;
+    bool same = true;
+    for (const auto& kv : dict)
+    {
+        ++ n;
+        auto it = expect.find(kv.first);
+        if (it == expect.end() || it->second != kv.second)
+            same = false;
+    }
+    EXPECT_TRUE(same && n == expect.size());
+
+    // erase all by iterator, then shrink in cron
+    for (auto it = dict.begin(); it != dict.end(); )
+    {
+        if (it->second % 2 == 0)
+            it = dict.erase(it);
+        else
+            ++ it;
+    }
+    for (auto it = dict.begin(); it != dict.end(); )
+        it = dict.erase(it);
+
+    EXPECT_TRUE(dict.empty());
+    while (dict.Rehash(100))
+        ;
+    EXPECT_TRUE(dict.TryShrink());
+    while (dict.Rehash(100))
+        ;
+    EXPECT_TRUE(dict.bucket_count() == 8);
+}
+
+TEST_CASE(hashset_basic)
+{
+    QHashSet<QString, my_hash> set;
+    EXPECT_TRUE(set.insert("a").second);
+    EXPECT_FALSE(set.insert("a").second);
+    EXPECT_TRUE(set.emplace("b").second);
+
+    auto copy(set);
+    EXPECT_TRUE(set.erase("a") == 1);
+    EXPECT_TRUE(set.erase("a") == 0);
+    EXPECT_TRUE(set.size() == 1 && copy.size() == 2);
+    EXPECT_TRUE(copy.count("a") == 1);
+
+    auto it = RandomHashMember(set);
+    EXPECT_TRUE(it != decltype(set)::const_local_iterator() && *it == "b");
+}
+
+TEST_CASE(dict_scan_resize)
+{
+    Dict dict;
+    for (int i = 0; i < 1000; ++ i)
+        dict.emplace("key" + std::to_string(i), i);
+
+    // grow and shrink while scanning, the first 1000 keys are never erased
+    std::set<int> seen;
+    std::size_t cursor = 0;
+    int next = 1000;
+    do
+    {
+        cursor = ScanHashMember(dict, cursor, 10, [&seen](const Dict::value_type& kv) {
+            seen.insert(kv.second);
+        });
+
+        if (next < 20000)
+        {
+            for (int i = 0; i < 200; ++ i, ++ next)
+                dict.emplace("key" + std::to_string(next), next);
+        }
+        else
+        {
+            for (int i = 0; i < 500 && next > 1000; ++ i)
+                dict.erase("key" + std::to_string(-- next));
+
+            dict.Rehash(1000);
+            dict.TryShrink();
+        }
+    } while (cursor != 0);
+
+    bool all = true;
+    for (int i = 0; i < 1000; ++ i)
+        all = all && seen.count(i) == 1;
+
+    EXPECT_TRUE(all);
+}
@@ -0,0 +1,103 @@
+#include "UnitTest.h"
+#include "QQuickList.h"
+#include <deque>
+#include <algorithm>
+
+using namespace qedis;
+
+static bool SameAs(const QQuickList& ql, const std::deque<QString>& expect)
+{
+    if (ql.Size() != expect.size())
+        return false;
+
+    if (expect.empty())
+        return true;
+
+    std::vector<QString> elems;
+    ql.Range(0, static_cast<long>(ql.Size()) - 1, [&elems](const QString& e) {
+        elems.push_back(e);
+    });
+
+    return std::equal(elems.begin(), elems.end(), expect.begin());
+}
+
+TEST_CASE(quicklist_basic)
+{
+    // 4 entries per node, compress all but head and tail
+    QQuickList ql(4, 1);
+    std::deque<QString> expect;
+
+    for (int i = 0; i < 100; ++ i)
+    {
+        // long and repetitive, so nodes are compressible
+        QString elem(40, 'a' + i % 26);
+        elem += std::to_string(i);
+
+        ql.PushTail(elem);
+        expect.push_back(elem);
+    }
+
+    EXPECT_TRUE(ql.NodeCount() == 25);
+    EXPECT_TRUE(SameAs(ql, expect));
+    EXPECT_TRUE(ql.Index(50) == expect[50]);
+    EXPECT_TRUE(ql.Index(99) == expect[99]);
+
+    ql.Replace(37, "x");
+    expect[37] = "x";
+    ql.Erase(10);
+    expect.erase(expect.begin() + 10);
+    EXPECT_TRUE(SameAs(ql, expect));
+
+    // split a full node in the middle
+    EXPECT_TRUE(ql.Insert("x", "y", false));
+    expect.insert(std::find(expect.begin(), expect.end(), "x") + 1, "y");
+    EXPECT_TRUE(ql.Insert("x", "w", true));
+    expect.insert(std::find(expect.begin(), expect.end(), "x"), "w");
+    EXPECT_FALSE(ql.Insert("none", "z", true));
+    EXPECT_TRUE(SameAs(ql, expect));
+
+    ql.DeleteRange(5, 30);
+    expect.erase(expect.begin() + 5, expect.begin() + 35);
+    EXPECT_TRUE(SameAs(ql, expect));
+
+    QString elem;
+    EXPECT_TRUE(ql.PopHead(&elem) && elem == expect.front());
+    expect.pop_front();
+    EXPECT_TRUE(ql.PopTail(&elem) && elem == expect.back());
+    expect.pop_back();
+    EXPECT_TRUE(SameAs(ql, expect));
+}
+
+TEST_CASE(quicklist_remove)
+{
+    QQuickList ql(-1, 2);
+    std::deque<QString> expect;
+
+    for (int i = 0; i < 3000; ++ i)
+    {
+        QString elem = (i % 3 == 0) ? "dup" : "elem" + std::to_string(i % 100);
+        ql.PushHead(elem);
+        expect.push_front(elem);
+    }
+
+    EXPECT_TRUE(ql.Remove("dup", 10, true) == 10);
+    for (int i = 0, n = 0; n < 10; ++ i)
+    {
+        if (expect[i] == "dup")
+        {
+            expect.erase(expect.begin() + i --);
+            ++ n;
+        }
+    }
+    EXPECT_TRUE(SameAs(ql, expect));
+
+    EXPECT_TRUE(ql.Remove("dup", 3000, false) == 990);
+    expect.erase(std::remove(expect.begin(), expect.end(), "dup"), expect.end());
+    EXPECT_TRUE(SameAs(ql, expect));
+
+    while (ql.PopTail(nullptr))
+        ;
+
+    EXPECT_TRUE(ql.Size() == 0 && ql.NodeCount() == 0);
+}
+
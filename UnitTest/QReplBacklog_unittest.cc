@@ -0,0 +1,116 @@
+#include "UnitTest.h"
+#include "QStore.h"
+#include "QClient.h"
+#include "QConfig.h"
+#include "QReplication.h"
+#include <string>
+#include <memory>
+#include <cstring>
+
+using namespace qedis;
+
+static std::string ReadBacklog(const QReplBacklog& backlog, std::size_t offset)
+{
+    UnboundedBuffer out;
+    if (!backlog.Read(offset, out))
+        return "<none>";
+
+    return std::string(out.ReadAddr(), out.ReadableSize());
+}
+
+TEST_CASE(replbacklog_ring)
+{
+    QReplBacklog backlog;
+    backlog.Feed("xx", 2);
+    EXPECT_TRUE(backlog.Offset() == 2);
+    EXPECT_TRUE(ReadBacklog(backlog, 2) == "<none>");
+
+    // the offset goes on from the stream before it
+    backlog.Create(16);
+    backlog.Feed("0123456789", 10);
+    EXPECT_TRUE(backlog.StartOffset() == 2);
+    EXPECT_TRUE(backlog.Offset() == 12);
+    EXPECT_TRUE(ReadBacklog(backlog, 2) == "0123456789");
+    EXPECT_TRUE(ReadBacklog(backlog, 7) == "56789");
+    EXPECT_TRUE(ReadBacklog(backlog, 12) == "");
+    EXPECT_TRUE(ReadBacklog(backlog, 13) == "<none>");
+    EXPECT_TRUE(ReadBacklog(backlog, 1) == "<none>");
+
+    // wraps around, the oldest ones are lost
+    backlog.Feed("abcdefghij", 10);
+    EXPECT_TRUE(backlog.StartOffset() == 6);
+    EXPECT_TRUE(backlog.Offset() == 22);
+    EXPECT_TRUE(ReadBacklog(backlog, 6) == "456789abcdefghij");
+    EXPECT_TRUE(ReadBacklog(backlog, 17) == "fghij");
+    EXPECT_TRUE(ReadBacklog(backlog, 22) == "");
+    EXPECT_TRUE(ReadBacklog(backlog, 5) == "<none>");
+
+    // bigger than the buffer, only its tail is kept
+    const std::string big = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    backlog.Feed(big.data(), big.size());
+    EXPECT_TRUE(backlog.Offset() == 22 + big.size());
+    EXPECT_TRUE(backlog.StartOffset() == backlog.Offset() - 16);
+    EXPECT_TRUE(ReadBacklog(backlog, backlog.StartOffset()) == big.substr(big.size() - 16));
+    EXPECT_TRUE(ReadBacklog(backlog, backlog.Offset()) == "");
+    EXPECT_TRUE(ReadBacklog(backlog, backlog.StartOffset() - 1) == "<none>");
+}
+
+static std::size_t MasterOffset()
+{
+    UnboundedBuffer info;
+    QREPL.OnInfoCommand(info);
+
+    const std::string s(info.ReadAddr(), info.ReadableSize());
+    const char* field = "master_repl_offset:";
+    return std::stoul(s.substr(s.find(field) + strlen(field)));
+}
+
+static std::string SentData(QClient& cli)
+{
+    BufferSequence bf;
+    cli.PrepareSend(bf);
+
+    std::string data;
+    for (std::size_t i = 0; i < bf.count; ++ i)
+        data.append(static_cast<const char*>(bf.buffers[i].iov_base), bf.buffers[i].iov_len);
+
+    return data;
+}
+
+TEST_CASE(replbacklog_partial_resync)
+{
+    QSTORE.Init(2, 1);
+    g_config.runid = "0123456789abcdef0123456789abcdef01234567";
+
+    // a slave full synced, the backlog starts with it
+    auto full = std::make_shared<QClient>();
+    full->SetSlaveInfo();
+    QREPL.AddSlave(full.get());
+    QREPL.SendToSlaves({"set", "a", "1"});
+
+    // the offset of +FULLRESYNC, the snapshot has the writes before it
+    const std::size_t offset = MasterOffset();
+
+    const std::string missed = "*3\r\n$3\r\nset\r\n$1\r\nb\r\n$1\r\n2\r\n";
+    QREPL.SendToSlaves({"set", "b", "2"});
+    EXPECT_TRUE(MasterOffset() == offset + missed.size());
+
+    auto cli = std::make_shared<QClient>();
+    EXPECT_FALSE(QREPL.TryPartialResync(cli.get(), "?", offset));
+    EXPECT_FALSE(QREPL.TryPartialResync(cli.get(), g_config.runid, MasterOffset() + 1));
+
+    // the psync from that offset continues with the writes after it
+    EXPECT_TRUE(QREPL.TryPartialResync(cli.get(), g_config.runid, offset));
+    EXPECT_TRUE(cli->GetSlaveInfo()->state == QSlaveState_online);
+    EXPECT_TRUE(cli->GetSlaveInfo()->ackOffset == offset);
+
+    // online, no write is lost after the backlog
+    const std::string next = "*2\r\n$3\r\ndel\r\n$1\r\na\r\n";
+    QREPL.SendToSlaves({"del", "a"});
+    EXPECT_TRUE(SentData(*cli) == "+CONTINUE\r\n" + missed + next);
+
+    // exactly at the current offset nothing is missed
+    auto last = std::make_shared<QClient>();
+    EXPECT_TRUE(QREPL.TryPartialResync(last.get(), g_config.runid, MasterOffset()));
+    EXPECT_TRUE(SentData(*last) == "+CONTINUE\r\n");
+}
@@ -0,0 +1,54 @@
+#include "UnitTest.h"
+#include "QStore.h"
+#include "QConfig.h"
+
+using namespace qedis;
+
+TEST_CASE(intset_basic)
+{
+    QObject set(QObject::CreateSet());
+    EXPECT_TRUE(set.encoding == QEncode_intset);
+
+    EXPECT_TRUE(SetAdd(set, "3"));
+    EXPECT_TRUE(SetAdd(set, "-1"));
+    EXPECT_TRUE(SetAdd(set, "9223372036854775807"));
+    EXPECT_FALSE(SetAdd(set, "3"));
+    EXPECT_TRUE(set.encoding == QEncode_intset);
+    EXPECT_TRUE(SetSize(set) == 3);
+
+    EXPECT_TRUE(SetIsMember(set, "-1"));
+    EXPECT_FALSE(SetIsMember(set, "03"));
+    EXPECT_FALSE(SetIsMember(set, "x"));
+
+    std::vector<QString> members;
+    SetForEach(set, [&members](const QString& m) {
+        members.push_back(m);
+    });
+    EXPECT_TRUE(members.size() == 3 && members[0] == "-1" && members[2] == "9223372036854775807");
+
+    EXPECT_TRUE(SetRemove(set, "3"));
+    EXPECT_FALSE(SetRemove(set, "3"));
+    EXPECT_FALSE(SetRemove(set, "abc"));
+    EXPECT_TRUE(SetSize(set) == 2);
+}
+
+TEST_CASE(intset_upgrade)
+{
+    QObject set(QObject::CreateSet());
+    SetAdd(set, "1");
+    SetAdd(set, "2");
+
+    // not canonical decimal, must be kept as string
+    EXPECT_TRUE(SetAdd(set, "02"));
+    EXPECT_TRUE(set.encoding == QEncode_zipset);
+    EXPECT_TRUE(SetSize(set) == 3);
+    EXPECT_TRUE(SetIsMember(set, "1") && SetIsMember(set, "02"));
+
+    QObject big(QObject::CreateSet());
+    for (int i = 0; i <= g_config.setMaxIntsetEntries; ++ i)
+        SetAdd(big, std::to_string(i));
+
+    EXPECT_TRUE(big.encoding == QEncode_set);
+    EXPECT_TRUE(SetIsMember(big, std::to_string(g_config.setMaxIntsetEntries)));
+}
+
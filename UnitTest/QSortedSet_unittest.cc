@@ -0,0 +1,80 @@
+#include "UnitTest.h"
+#include "QSortedSet.h"
+
+using namespace qedis;
+
+TEST_CASE(skiplist_rank)
+{
+    QSkipList zsl;
+    for (int i = 0; i < 1000; ++ i)
+        zsl.Insert(i, "m" + std::to_string(i));
+
+    EXPECT_TRUE(zsl.Size() == 1000);
+    EXPECT_TRUE(zsl.GetRank(0, "m0") == 1);
+    EXPECT_TRUE(zsl.GetRank(999, "m999") == 1000);
+    EXPECT_TRUE(zsl.GetRank(500, "m500") == 501);
+    EXPECT_TRUE(zsl.GetRank(500, "m501") == 0);
+
+    EXPECT_TRUE(zsl.GetByRank(1)->member == "m0");
+    EXPECT_TRUE(zsl.GetByRank(1000)->member == "m999");
+    EXPECT_TRUE(zsl.GetByRank(1001) == nullptr);
+    EXPECT_TRUE(zsl.GetByRank(0) == nullptr);
+
+    EXPECT_TRUE(zsl.Delete(500, "m500"));
+    EXPECT_FALSE(zsl.Delete(500, "m500"));
+    EXPECT_TRUE(zsl.GetRank(501, "m501") == 501);
+    EXPECT_TRUE(zsl.GetByRank(501)->member == "m501");
+}
+
+TEST_CASE(skiplist_same_score)
+{
+    QSkipList zsl;
+    zsl.Insert(1, "c");
+    zsl.Insert(1, "a");
+    zsl.Insert(1, "b");
+    zsl.Insert(0, "z");
+
+    EXPECT_TRUE(zsl.GetByRank(1)->member == "z");
+    EXPECT_TRUE(zsl.GetByRank(2)->member == "a");
+    EXPECT_TRUE(zsl.GetByRank(4)->member == "c");
+    EXPECT_TRUE(zsl.Last()->member == "c");
+
+    zsl.UpdateScore(0, "z", 2);
+    EXPECT_TRUE(zsl.GetRank(2, "z") == 4);
+    EXPECT_TRUE(zsl.First()->member == "a");
+}
+
+TEST_CASE(sortedset_range)
+{
+    QSortedSet sset;
+    for (int i = 0; i < 100; ++ i)
+        sset.AddMember("m" + std::to_string(i), i * 2);
+
+    EXPECT_TRUE(sset.Rank("m10") == 10);
+    EXPECT_TRUE(sset.RevRank("m10") == 89);
+    EXPECT_TRUE(sset.Rank("none") == -1);
+    EXPECT_TRUE(sset.GetMemberByRank(99).first == "m99");
+
+    auto res = sset.RangeByRank(-3, -1);
+    EXPECT_TRUE(res.size() == 3);
+    EXPECT_TRUE(res[0].first == "m97" && res[2].first == "m99");
+
+    res = sset.RangeByScore(9, 14);
+    EXPECT_TRUE(res.size() == 3);
+    EXPECT_TRUE(res[0].first == "m5" && res[2].second == 14);
+
+    auto it = sset.FindMember("m0");
+    EXPECT_TRUE(sset.UpdateMember(it, 1000) == 1000);
+    EXPECT_TRUE(sset.Rank("m0") == 99);
+
+    EXPECT_TRUE(sset.DelRangeByRank(0, 9) == 10);
+    EXPECT_TRUE(sset.Size() == 90);
+    EXPECT_TRUE(sset.FindMember("m1") == sset.end());
+    EXPECT_TRUE(sset.Rank("m11") == 0);
+
+    EXPECT_TRUE(sset.DelRangeByScore(100, 2000) == 51);
+    EXPECT_TRUE(sset.Size() == 39);
+    EXPECT_TRUE(sset.FindMember("m0") == sset.end());
+    EXPECT_TRUE(sset.GetMemberByRank(38).first == "m49");
+}
+
@@ -0,0 +1,385 @@
+#include "UnitTest.h"
+#include "QStore.h"
+#include "QConfig.h"
+#include "QMemory.h"
+#include "QLazyFree.h"
+#include <set>
+#include <thread>
+
+using namespace qedis;
+
+TEST_CASE(store_shards)
+{
+    // the store is a singleton, other cases should Init again if they need it
+    QSTORE.Init(2, 4);
+    EXPECT_TRUE(QSTORE.ShardCount() == 4);
+
+    // only the part inside {} is hashed
+    EXPECT_TRUE(KeySlot("{user1000}.following") == KeySlot("{user1000}.followers"));
+    EXPECT_TRUE(KeySlot("foo{bar}{zap}") == KeySlot("{bar}"));
+    // empty tag, hash the whole key
+    EXPECT_TRUE(KeySlot("{}a") == static_cast<int>(my_hash()("{}a") % kSlots));
+
+    const int kKeys = 1000;
+    std::set<int> shards;
+    for (int i = 0; i < kKeys; ++ i)
+    {
+        QString key = "key:" + std::to_string(i);
+        QSTORE.SetValue(key, QObject::CreateString(key));
+        shards.insert(QSTORE.ShardOf(key));
+    }
+
+    EXPECT_TRUE(shards.size() == 4);
+    EXPECT_TRUE(QSTORE.DBSize() == kKeys);
+
+    std::set<QString> iterated;
+    for (const auto& kv : QSTORE)
+        iterated.insert(kv.first);
+
+    EXPECT_TRUE(iterated.size() == kKeys);
+
+    std::set<QString> scanned;
+    size_t cursor = 0;
+    do
+    {
+        std::vector<QString> res;
+        cursor = QSTORE.ScanKey(cursor, 10, nullptr, QType_invalid, res);
+        scanned.insert(res.begin(), res.end());
+    } while (cursor != 0);
+
+    EXPECT_TRUE(scanned == iterated);
+
+    QObject* value = nullptr;
+    EXPECT_TRUE(QSTORE.GetValue("key:42", value) == QError_ok);
+    EXPECT_TRUE(*GetDecodedString(value) == "key:42");
+    EXPECT_TRUE(QSTORE.DeleteKey("key:42"));
+    EXPECT_FALSE(QSTORE.ExistsKey("key:42"));
+
+    // other db is empty
+    QSTORE.SelectDB(1);
+    EXPECT_TRUE(QSTORE.DBSize() == 0);
+    EXPECT_TRUE(QSTORE.begin() == QSTORE.end());
+    QSTORE.SelectDB(0);
+
+    QSTORE.ClearCurrentDB();
+    EXPECT_TRUE(QSTORE.DBSize() == 0);
+    EXPECT_TRUE(QSTORE.RandomKey().empty());
+}
+
+
+TEST_CASE(store_expire_cycle)
+{
+    QSTORE.Init(2, 1);
+    QSTORE.ClearCurrentDB();
+
+    const uint64_t now = 100000;
+    const int kKeys = 1000;
+    for (int i = 0; i < kKeys; ++ i)
+    {
+        QString key = "ttl:" + std::to_string(i);
+        QSTORE.SetValue(key, QObject::CreateString(key));
+        QSTORE.SetExpire(key, now + i * 10);
+    }
+
+    // change ttl, the old entries of index are garbage
+    QSTORE.SetExpire("ttl:0", now + 60000);
+    EXPECT_TRUE(QSTORE.ClearExpire("ttl:1"));
+    EXPECT_TRUE(QSTORE.ExistsKey("ttl:1"));
+    EXPECT_TRUE(QSTORE.TTL("ttl:1", now) == QStore::persist);
+
+    // keys in the current second are not touched
+    EXPECT_TRUE(QSTORE.ActiveExpireCycle(now + 500) == 0);
+
+    // the keys of [now, now + 5000) are all expired at now + 5000
+    int deleted = 0;
+    for (int i = 0; i < 100 && deleted < 498; ++ i)
+        deleted += QSTORE.ActiveExpireCycle(now + 5000);
+
+    EXPECT_TRUE(deleted == 498);
+    EXPECT_TRUE(QSTORE.ExistsKey("ttl:0"));
+    EXPECT_TRUE(QSTORE.ExistsKey("ttl:1"));
+    EXPECT_FALSE(QSTORE.ExistsKey("ttl:2"));
+    EXPECT_TRUE(QSTORE.ExistsKey("ttl:500"));
+    EXPECT_TRUE(QSTORE.TTL("ttl:500", now + 4000) == 1000);
+
+    // ttl is kept in the key entry when value is replaced, unless asked
+    QSTORE.SetValue("ttl:500", QObject::CreateString("new"));
+    EXPECT_TRUE(QSTORE.TTL("ttl:500", now + 4000) == 1000);
+    QSTORE.SetValue("ttl:500", QObject::CreateString("new"), false);
+    EXPECT_TRUE(QSTORE.TTL("ttl:500", now + 4000) == QStore::persist);
+    EXPECT_FALSE(QSTORE.SetExpire("nokey", now));
+
+    // lazily expired
+    EXPECT_TRUE(QSTORE.TTL("ttl:999", now + 10000) == QStore::expired);
+    EXPECT_FALSE(QSTORE.ExistsKey("ttl:999"));
+
+    QSTORE.ClearCurrentDB();
+    EXPECT_TRUE(QSTORE.ActiveExpireCycle(now + 100000) == 0);
+}
+
+TEST_CASE(store_evict)
+{
+    QSTORE.Init(2, 1);
+    QSTORE.ClearCurrentDB();
+
+    const size_t base = UsedMemory();
+    const int kKeys = 10000;
+    for (int i = 0; i < kKeys; ++ i)
+        QSTORE.SetValue("evict:" + std::to_string(i), QObject::CreateString(QString(100, 'v')));
+
+    // every value at least
+    const size_t used = UsedMemory();
+    EXPECT_TRUE(used >= base + kKeys * 100);
+    EXPECT_TRUE(PeakMemory() >= used);
+
+    const auto oldMax = g_config.maxmemory;
+    const auto oldPolicy = g_config.maxmemoryPolicy;
+
+    g_config.maxmemoryPolicy = EvictAllKeysLRU;
+    g_config.maxmemory = used - 256 * 1024;
+    // a call evicts a few keys only, like a write command does
+    for (int i = 0; i < 1000 && UsedMemory() > g_config.maxmemory; ++ i)
+        EXPECT_TRUE(QSTORE.EvictIfNeeded(-1));
+    EXPECT_TRUE(UsedMemory() <= g_config.maxmemory);
+    EXPECT_TRUE(QSTORE.DBSize() < kKeys);
+    EXPECT_TRUE(QSTORE.DBSize() > kKeys / 2);
+
+    g_config.maxmemoryPolicy = EvictNo;
+    g_config.maxmemory = UsedMemory() - 1;
+    EXPECT_FALSE(QSTORE.EvictIfNeeded(0));
+
+    g_config.maxmemory = oldMax;
+    g_config.maxmemoryPolicy = oldPolicy;
+
+    QSTORE.ClearCurrentDB();
+    EXPECT_TRUE(UsedMemory() < used);
+}
+
+// evict until count keys are gone, or nothing can be evicted
+static int EvictKeys(int count)
+{
+    const size_t before = QSTORE.DBSize();
+    while (QSTORE.DBSize() + count > before)
+    {
+        g_config.maxmemory = UsedMemory() - 1;
+        if (!QSTORE.EvictIfNeeded(0))
+            break;
+    }
+
+    return static_cast<int>(before - QSTORE.DBSize());
+}
+
+TEST_CASE(store_evict_policy)
+{
+    QSTORE.Init(2, 1);
+    QSTORE.ClearCurrentDB();
+
+    const auto oldMax = g_config.maxmemory;
+    const auto oldPolicy = g_config.maxmemoryPolicy;
+    const auto oldClock = QObject::lruclock;
+    const auto oldLfuClock = QObject::lfuclock;
+
+    // lru: the keys accessed long ago go first
+    g_config.maxmemoryPolicy = EvictAllKeysLRU;
+    QObject::lruclock = 1000;
+    for (int i = 0; i < 500; ++ i)
+        QSTORE.SetValue("old:" + std::to_string(i), QObject::CreateString("v"));
+    QObject::lruclock = 2000;
+    for (int i = 0; i < 500; ++ i)
+        QSTORE.SetValue("new:" + std::to_string(i), QObject::CreateString("v"));
+
+    EXPECT_TRUE(EvictKeys(200) >= 200);
+    int alive = 0;
+    for (int i = 0; i < 500; ++ i)
+        alive += QSTORE.ExistsKey("new:" + std::to_string(i)) ? 1 : 0;
+    EXPECT_TRUE(alive == 500);
+    QSTORE.ClearCurrentDB();
+
+    // lfu: the counter grows slowly with hits, and decays with time
+    g_config.maxmemoryPolicy = EvictAllKeysLFU;
+    QObject* obj = QSTORE.SetValue("hot", QObject::CreateString("v"));
+    EXPECT_TRUE(LFUDecrAndReturn(obj->lru) == kLFUInitVal);
+    for (int i = 0; i < 10000; ++ i)
+        obj->Touch();
+    const uint8_t freq = LFUDecrAndReturn(obj->lru);
+    EXPECT_TRUE(freq > kLFUInitVal + 5 && freq < 255);
+    QObject::lfuclock += 3;
+    EXPECT_TRUE(LFUDecrAndReturn(obj->lru) == freq - 3);
+    QSTORE.ClearCurrentDB();
+
+    // volatile-ttl: only the keys with ttl, soonest first
+    g_config.maxmemoryPolicy = EvictVolatileTTL;
+    for (int i = 0; i < 100; ++ i)
+    {
+        QString key = "ttl:" + std::to_string(i);
+        QSTORE.SetValue(key, QObject::CreateString("v"));
+        QSTORE.SetExpire(key, ::Now() + 3600 * 1000 + i * 1000);
+        QSTORE.SetValue("persist:" + std::to_string(i), QObject::CreateString("v"));
+    }
+
+    EXPECT_TRUE(EvictKeys(10) >= 10);
+    EXPECT_FALSE(QSTORE.ExistsKey("ttl:0"));
+    EXPECT_TRUE(QSTORE.ExistsKey("ttl:99"));
+    EXPECT_TRUE(QSTORE.DBSize() >= 100);
+
+    // nothing left to evict
+    EXPECT_TRUE(EvictKeys(1000) <= 100);
+    EXPECT_TRUE(QSTORE.DBSize() == 100);
+    EXPECT_TRUE(QSTORE.ExistsKey("persist:0"));
+
+    g_config.maxmemory = oldMax;
+    g_config.maxmemoryPolicy = oldPolicy;
+    QObject::lruclock = oldClock;
+    QObject::lfuclock = oldLfuClock;
+    QSTORE.ClearCurrentDB();
+}
+
+static bool WaitLazyFreed(uint64_t freed)
+{
+    for (int i = 0; i < 1000 && QLazyFree::Instance().Freed() < freed; ++ i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    return QLazyFree::Instance().Freed() == freed && QLazyFree::Instance().Pending() == 0;
+}
+
+TEST_CASE(store_lazyfree)
+{
+    QSTORE.Init(2, 1);
+    QSTORE.ClearCurrentDB();
+    QLazyFree::Instance().Start();
+
+    auto bigSet = [](const QString& key) {
+        QObject* obj = QSTORE.SetValue(key, QObject::CreateSet());
+        for (int i = 0; i < 1000; ++ i)
+            SetAdd(*obj, "member:" + std::to_string(i));
+    };
+
+    const uint64_t freed = QLazyFree::Instance().Freed();
+
+    // small values are freed at once
+    QSTORE.SetValue("small", QObject::CreateString("v"));
+    EXPECT_TRUE(QSTORE.DeleteKey("small", true));
+    EXPECT_TRUE(QLazyFree::Instance().Freed() == freed);
+
+    bigSet("big");
+    EXPECT_TRUE(QLazyFree::FreeEffort(*QSTORE.GetObject("big")) == 1000);
+    EXPECT_TRUE(QSTORE.DeleteKey("big", true));
+    EXPECT_FALSE(QSTORE.ExistsKey("big"));
+    EXPECT_TRUE(WaitLazyFreed(freed + 1));
+
+    // overwritten
+    bigSet("big");
+    QSTORE.SetValue("big", QObject::CreateString("v"));
+    EXPECT_TRUE(WaitLazyFreed(freed + 2));
+
+    // the whole db, the keys with ttl are in the index too
+    for (int i = 0; i < 100; ++ i)
+        QSTORE.SetValue("key:" + std::to_string(i), QObject::CreateString("v"));
+    QSTORE.SetExpire("key:0", ::Now() + 3600 * 1000);
+    QSTORE.ClearCurrentDB(true);
+    EXPECT_TRUE(QSTORE.DBSize() == 0);
+    EXPECT_TRUE(WaitLazyFreed(freed + 2 + 101 + 1));
+
+    QLazyFree::Instance().Stop();
+    QSTORE.ClearCurrentDB();
+}
+
+TEST_CASE(store_defrag)
+{
+    QSTORE.Init(2, 1);
+    QSTORE.ClearCurrentDB();
+
+    // move every block
+    auto oldHint = SetDefragHint([](const void* ) { return true; });
+
+    const QString longValue(100, 'r');
+    QSTORE.SetValue("raw", QObject::CreateString(longValue));
+    QSTORE.SetValue("emb", QObject::CreateString("short"));
+    QSTORE.SetValue("int", QObject::CreateString(42));
+    QSTORE.SetExpire("emb", ::Now() + 3600 * 1000);
+
+    QObject* list = QSTORE.SetValue("list", QObject::CreateList());
+    QObject* set = QSTORE.SetValue("set", QObject::CreateSet());
+    QObject* hash = QSTORE.SetValue("hash", QObject::CreateHash());
+    for (int i = 0; i < 1000; ++ i)
+    {
+        const QString elem = "element:" + std::to_string(i) + QString(20, 'x');
+        ListPush(*list, elem, ListPosition::tail);
+        SetAdd(*set, elem);
+        HashSet(*hash, elem, std::to_string(i));
+    }
+    EXPECT_TRUE(list->encoding == QEncode_list);
+    EXPECT_TRUE(set->encoding == QEncode_set);
+    EXPECT_TRUE(hash->encoding == QEncode_hash);
+
+    const void* rawValue = QSTORE.GetObject("raw")->value;
+    const void* rawKey = &*QSTORE.begin();
+
+    QSTORE.StartDefrag();
+    for (int i = 0; i < 100000 && QSTORE.IsDefragRunning(); ++ i)
+        QSTORE.ActiveDefragCycle();
+    EXPECT_FALSE(QSTORE.IsDefragRunning());
+
+    // moved but the same
+    EXPECT_TRUE(QSTORE.GetObject("raw")->value != rawValue);
+    EXPECT_TRUE(&*QSTORE.begin() != rawKey);
+    EXPECT_TRUE(QSTORE.DBSize() == 6);
+
+    QObject* value = nullptr;
+    EXPECT_TRUE(QSTORE.GetValue("raw", value) == QError_ok);
+    EXPECT_TRUE(*GetDecodedString(value) == longValue);
+    EXPECT_TRUE(QSTORE.GetValue("emb", value) == QError_ok);
+    EXPECT_TRUE(*GetDecodedString(value) == "short");
+    EXPECT_TRUE(QSTORE.TTL("emb", ::Now()) > 0);
+    EXPECT_TRUE(QSTORE.GetValue("int", value) == QError_ok);
+    EXPECT_TRUE(*GetDecodedString(value) == "42");
+
+    QString elem;
+    EXPECT_TRUE(QSTORE.GetValue("list", value) == QError_ok);
+    EXPECT_TRUE(ListSize(*value) == 1000);
+    EXPECT_TRUE(ListIndex(*value, 999, &elem) && elem == "element:999" + QString(20, 'x'));
+    EXPECT_TRUE(QSTORE.GetValue("set", value) == QError_ok);
+    EXPECT_TRUE(SetSize(*value) == 1000);
+    EXPECT_TRUE(SetIsMember(*value, "element:500" + QString(20, 'x')));
+    EXPECT_TRUE(QSTORE.GetValue("hash", value) == QError_ok);
+    EXPECT_TRUE(HashSize(*value) == 1000);
+    EXPECT_TRUE(HashGet(*value, "element:7" + QString(20, 'x'), &elem) && elem == "7");
+
+    SetDefragHint(oldHint);
+    QSTORE.ClearCurrentDB();
+}
+
+TEST_CASE(string_encoding)
+{
+    char buf[32];
+
+    QObject num(QObject::CreateString("-42"));
+    EXPECT_TRUE(num.encoding == QEncode_int);
+    EXPECT_TRUE(GetStringView(&num, buf).ToString() == "-42");
+
+    QString session(60, 's');
+    QObject emb(QObject::CreateString(session));
+    EXPECT_TRUE(emb.encoding == QEncode_embstr);
+    EXPECT_TRUE(GetStringView(&emb, buf).ToString() == session);
+    EXPECT_TRUE(*GetDecodedString(&emb) == session);
+    EXPECT_TRUE(emb.CastEmbString()->data[60] == '\0');
+
+    QObject empty(QObject::CreateString(""));
+    EXPECT_TRUE(empty.encoding == QEncode_embstr);
+    EXPECT_TRUE(GetStringView(&empty, buf).empty());
+
+    QObject raw(QObject::CreateString(QString(65, 'r')));
+    EXPECT_TRUE(raw.encoding == QEncode_raw);
+    EXPECT_TRUE(GetStringView(&raw, buf).size == 65);
+
+    QString big(16 * 1024, 'b');
+    QObject shared(QObject::CreateString(big));
+    EXPECT_TRUE(shared.encoding == QEncode_sharedstr);
+    EXPECT_TRUE(GetStringView(&shared, buf).ToString() == big);
+    EXPECT_TRUE(*GetDecodedString(&shared) == big);
+
+    // moved with the value
+    QObject moved(std::move(emb));
+    EXPECT_TRUE(moved.encoding == QEncode_embstr);
+    EXPECT_TRUE(*GetDecodedString(&moved) == session);
+}
@@ -0,0 +1,107 @@
+#include "UnitTest.h"
+#include "QZipList.h"
+#include "QStore.h"
+#include "QConfig.h"
+
+using namespace qedis;
+
+TEST_CASE(ziplist_basic)
+{
+    PZIPLIST zl = ZipListNew();
+    zl = ZipListPush(zl, "b");
+    zl = ZipListPush(zl, "123");
+    zl = ZipListPush(zl, "a", false);
+
+    EXPECT_TRUE(ZipListSize(zl) == 3);
+    EXPECT_TRUE(ZipListGet(ZipListIndex(zl, 0)) == "a");
+    EXPECT_TRUE(ZipListGet(ZipListIndex(zl, -1)) == "123");
+    EXPECT_TRUE(ZipListEqual(ZipListIndex(zl, 1), "b"));
+    EXPECT_TRUE(ZipListFind(zl, "123") != nullptr);
+    EXPECT_TRUE(ZipListFind(zl, "0123") == nullptr);
+
+    unsigned char* p = ZipListFind(zl, "b");
+    zl = ZipListReplace(zl, &p, "bb");
+    EXPECT_TRUE(ZipListGet(p) == "bb");
+
+    zl = ZipListDelete(zl, &p);
+    EXPECT_TRUE(ZipListSize(zl) == 2);
+    EXPECT_TRUE(ZipListGet(p) == "123");
+
+    zl = ZipListDeleteRange(zl, 0, 2);
+    EXPECT_TRUE(ZipListSize(zl) == 0);
+    EXPECT_TRUE(ZipListFirst(zl) == nullptr);
+
+    ZipListFree(zl);
+}
+
+TEST_CASE(ziplist_hash_convert)
+{
+    QObject obj(QObject::CreateHash());
+    EXPECT_TRUE(obj.encoding == QEncode_ziphash);
+
+    for (int i = 0; i < g_config.hashMaxZiplistEntries; ++ i)
+        EXPECT_TRUE(HashSet(obj, "f" + std::to_string(i), std::to_string(i)));
+
+    EXPECT_FALSE(HashSet(obj, "f0", "new"));
+    EXPECT_TRUE(obj.encoding == QEncode_ziphash);
+
+    HashSet(obj, "overflow", "1");
+    EXPECT_TRUE(obj.encoding == QEncode_hash);
+    EXPECT_TRUE(HashSize(obj) == static_cast<size_t>(g_config.hashMaxZiplistEntries) + 1);
+
+    QString value;
+    EXPECT_TRUE(HashGet(obj, "f0", &value) && value == "new");
+
+    QObject big(QObject::CreateHash());
+    HashSet(big, "f", QString(g_config.hashMaxZiplistValue + 1, 'x'));
+    EXPECT_TRUE(big.encoding == QEncode_hash);
+}
+
+TEST_CASE(ziplist_list_convert)
+{
+    QObject obj(QObject::CreateList());
+    EXPECT_TRUE(obj.encoding == QEncode_ziplist);
+
+    ListPush(obj, "b", ListPosition::tail);
+    ListPush(obj, "a", ListPosition::head);
+    ListPush(obj, "c", ListPosition::tail);
+
+    QString elem;
+    EXPECT_TRUE(ListIndex(obj, -1, &elem) && elem == "c");
+    EXPECT_TRUE(ListRemove(obj, "b", 0) == 1);
+
+    ListPush(obj, QString(g_config.listMaxZiplistValue + 1, 'x'), ListPosition::tail);
+    EXPECT_TRUE(obj.encoding == QEncode_list);
+    EXPECT_TRUE(ListSize(obj) == 3);
+    EXPECT_TRUE(ListPop(obj, ListPosition::head, &elem) && elem == "a");
+}
+
+TEST_CASE(ziplist_set_sset_convert)
+{
+    QObject set(QObject::CreateSet());
+    EXPECT_TRUE(SetAdd(set, "m"));
+    EXPECT_FALSE(SetAdd(set, "m"));
+    EXPECT_TRUE(set.encoding == QEncode_zipset);
+    for (int i = 0; i < g_config.setMaxZiplistEntries; ++ i)
+        SetAdd(set, std::to_string(i));
+    EXPECT_TRUE(set.encoding == QEncode_set);
+    EXPECT_TRUE(SetIsMember(set, "m"));
+
+    QObject sset(QObject::CreateSSet());
+    SSetAdd(sset, "c", 3);
+    SSetAdd(sset, "a", 1);
+    SSetAdd(sset, "b", 1.5);
+    EXPECT_TRUE(sset.encoding == QEncode_zipsset);
+    EXPECT_TRUE(SSetRank(sset, "b") == 1);
+    EXPECT_TRUE(SSetIncrBy(sset, "a", 10) == 11);
+    EXPECT_TRUE(SSetRank(sset, "a", true) == 0);
+
+    for (int i = 0; i < g_config.zsetMaxZiplistEntries; ++ i)
+        SSetAdd(sset, "m" + std::to_string(i), i);
+    EXPECT_TRUE(sset.encoding == QEncode_sset);
+
+    double score = 0;
+    EXPECT_TRUE(SSetScore(sset, "b", &score) && score == 1.5);
+    EXPECT_TRUE(SSetRank(sset, "m0") == 0);
+}
+